@@ -19,6 +19,7 @@
 #include "../interface/bpImageConverter.h"
 
 
+#include <atomic>
 #include <mutex>
 #include <thread>
 
@@ -74,6 +75,57 @@ struct bpImageConverterC
     SelectImpl<cCopyBlockImpl>(std::forward<Args>(aArgs)...);
   }
 
+  template<typename... Args>
+  void CopyBlockOwned(Args&&... aArgs)
+  {
+    SelectImpl<cCopyBlockOwnedImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  void CopyBlockPacked(Args&&... aArgs)
+  {
+    SelectImpl<cCopyBlockPackedImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  void CopyBlockScaled(Args&&... aArgs)
+  {
+    SelectImpl<cCopyBlockScaledImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  void CopyRegion(Args&&... aArgs)
+  {
+    SelectImpl<cCopyRegionImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  void SetTiles(Args&&... aArgs)
+  {
+    SelectImpl<cSetTilesImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  void CopyTile(Args&&... aArgs)
+  {
+    SelectImpl<cCopyTileImpl>(std::forward<Args>(aArgs)...);
+  }
+
+  template<typename... Args>
+  bool TryCopyBlock(Args&&... aArgs)
+  {
+    bool vResult = false;
+    SelectImpl<cTryCopyBlockImpl, bool&>(vResult, std::forward<Args>(aArgs)...);
+    return vResult;
+  }
+
+  bpConverterTypes::cQueueStatus GetQueueStatus()
+  {
+    bpConverterTypes::cQueueStatus vResult;
+    SelectImpl<cGetQueueStatusImpl, bpConverterTypes::cQueueStatus&>(vResult);
+    return vResult;
+  }
+
   template<typename... Args>
   void Finish(Args&&... aArgs)
   {
@@ -207,6 +259,102 @@ private:
     }
   };
 
+  struct cCopyBlockOwnedImpl
+  {
+    template<typename T, typename WrongT, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& /*aImpl*/, WrongT* /*aFileDataBlock*/, Args&&... /*aArgs*/)
+    {
+      throw "Block data type does not match converter data type";
+    }
+
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, T* aFileDataBlock, Args&&... aArgs)
+    {
+      aImpl->CopyBlockOwned(aFileDataBlock, std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cCopyBlockPackedImpl
+  {
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, Args&&... aArgs)
+    {
+      aImpl->CopyBlockPacked(std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cCopyBlockScaledImpl
+  {
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, Args&&... aArgs)
+    {
+      aImpl->CopyBlockScaled(std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cCopyRegionImpl
+  {
+    template<typename T, typename WrongT, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& /*aImpl*/, const WrongT* /*aData*/, Args&&... /*aArgs*/)
+    {
+      throw "Region data type does not match converter data type";
+    }
+
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, const T* aData, Args&&... aArgs)
+    {
+      aImpl->CopyRegion(aData, std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cSetTilesImpl
+  {
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, Args&&... aArgs)
+    {
+      aImpl->SetTiles(std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cCopyTileImpl
+  {
+    template<typename T, typename WrongT, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& /*aImpl*/, const WrongT* /*aData*/, Args&&... /*aArgs*/)
+    {
+      throw "Tile data type does not match converter data type";
+    }
+
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, const T* aData, Args&&... aArgs)
+    {
+      aImpl->CopyTile(aData, std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cTryCopyBlockImpl
+  {
+    template<typename T, typename WrongT, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& /*aImpl*/, bool& /*aResult*/, const WrongT* /*aFileDataBlock*/, Args&&... /*aArgs*/)
+    {
+      throw "Block data type does not match converter data type";
+    }
+
+    template<typename T, typename... Args>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, bool& aResult, const T* aFileDataBlock, Args&&... aArgs)
+    {
+      aResult = aImpl->TryCopyBlock(aFileDataBlock, std::forward<Args>(aArgs)...);
+    }
+  };
+
+  struct cGetQueueStatusImpl
+  {
+    template<typename T>
+    static void Do(bpSharedPtr<bpImageConverterInterface<T>>& aImpl, bpConverterTypes::cQueueStatus& aResult)
+    {
+      aResult = aImpl->GetQueueStatus();
+    }
+  };
+
   struct cFinishImpl
   {
     template<typename T, typename... Args>
@@ -343,6 +491,15 @@ static bpConverterTypes::cOptions Convert(bpConverterTypesC_OptionsPtr aOptions)
   vOptions.mEnableLogProgress = aOptions->mEnableLogProgress;
   vOptions.mNumberOfThreads = aOptions->mNumberOfThreads;
   vOptions.mCompressionAlgorithmType = (bpConverterTypes::tCompressionAlgorithmType)aOptions->mCompressionAlgorithmType;
+  // callers not using bpConverterTypesC_InitOptions may not have set the newer fields
+  if (aOptions->mVersion != BP_CONVERTER_TYPES_C_OPTIONS_VERSION) {
+    return vOptions;
+  }
+  vOptions.mParallelCopyThreshold = static_cast<bpSize>(aOptions->mParallelCopyThreshold);
+  vOptions.mAppendTimePoints = aOptions->mAppendTimePoints;
+  vOptions.mMaxMemoryBytes = static_cast<bpSize>(aOptions->mMaxMemoryBytes);
+  vOptions.mScratchDirectory = Convert(aOptions->mScratchDirectory);
+  vOptions.mHistogramSampleRate = aOptions->mHistogramSampleRate;
   return vOptions;
 }
 
@@ -357,6 +514,40 @@ static bpConverterTypes::tProgressCallback Convert(bpConverterTypesC_ProgressCal
   return vProgressCallback;
 }
 
+// calls the release callback of an owned block once, from the converter or from the C wrapper if the converter did not keep it
+class bpReleaseCallbackOnce
+{
+public:
+  bpReleaseCallbackOnce(bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aFileDataBlock, void* aCallbackUserData)
+    : mReleaseCallback(aReleaseCallback),
+      mFileDataBlock(aFileDataBlock),
+      mCallbackUserData(aCallbackUserData),
+      mIsReleased(false)
+  {
+  }
+
+  void Release()
+  {
+    if (mReleaseCallback && !mIsReleased.exchange(true)) {
+      mReleaseCallback(mFileDataBlock, mCallbackUserData);
+    }
+  }
+
+private:
+  bpConverterTypesC_ReleaseCallback mReleaseCallback;
+  void* mFileDataBlock;
+  void* mCallbackUserData;
+  std::atomic<bool> mIsReleased;
+};
+
+static bpConverterTypes::tReleaseCallback Convert(const bpSharedPtr<bpReleaseCallbackOnce>& aReleaseCallback)
+{
+  bpConverterTypes::tReleaseCallback vReleaseCallback = [aReleaseCallback] {
+    aReleaseCallback->Release();
+  };
+  return vReleaseCallback;
+}
+
 static bpConverterTypes::tParameters Convert(bpConverterTypesC_ParametersPtr aParameters)
 {
   if (!aParameters) {
@@ -397,6 +588,20 @@ static bpConverterTypes::tTimeInfoVector Convert(bpConverterTypesC_TimeInfoVecto
   return vTimeInfoPerTimePoint;
 }
 
+static bpConverterTypes::tTileVector Convert(bpConverterTypesC_TileVector aTiles)
+{
+  if (!aTiles) {
+    return{};
+  }
+
+  bpConverterTypes::tTileVector vTiles;
+  vTiles.reserve(aTiles->mValuesCount);
+  for (bpSize vIndex = 0; vIndex < aTiles->mValuesCount; ++vIndex) {
+    vTiles.push_back({ Convert(&aTiles->mValues[vIndex].mOffset), Convert(&aTiles->mValues[vIndex].mSize) });
+  }
+  return vTiles;
+}
+
 static bpConverterTypes::cColor Convert(const bpConverterTypesC_Color& aColor)
 {
   bpConverterTypes::cColor vColor;
@@ -438,6 +643,30 @@ static bpConverterTypes::tColorInfoVector Convert(bpConverterTypesC_ColorInfoVec
 }
 
 
+void bpConverterTypesC_InitOptions(bpConverterTypesC_Options* aOptions)
+{
+  if (!aOptions) {
+    return;
+  }
+
+  bpConverterTypes::cOptions vOptions;
+  aOptions->mThumbnailSizeXY = static_cast<unsigned int>(vOptions.mThumbnailSizeXY);
+  aOptions->mFlipDimensionX = vOptions.mFlipDimensionXYZ[0];
+  aOptions->mFlipDimensionY = vOptions.mFlipDimensionXYZ[1];
+  aOptions->mFlipDimensionZ = vOptions.mFlipDimensionXYZ[2];
+  aOptions->mForceFileBlockSizeZ1 = vOptions.mForceFileBlockSizeZ1;
+  aOptions->mEnableLogProgress = vOptions.mEnableLogProgress;
+  aOptions->mNumberOfThreads = static_cast<unsigned int>(vOptions.mNumberOfThreads);
+  aOptions->mCompressionAlgorithmType = (tCompressionAlgorithmType)vOptions.mCompressionAlgorithmType;
+  aOptions->mVersion = BP_CONVERTER_TYPES_C_OPTIONS_VERSION;
+  aOptions->mParallelCopyThreshold = vOptions.mParallelCopyThreshold;
+  aOptions->mAppendTimePoints = vOptions.mAppendTimePoints;
+  aOptions->mMaxMemoryBytes = vOptions.mMaxMemoryBytes;
+  aOptions->mScratchDirectory = nullptr;
+  aOptions->mHistogramSampleRate = static_cast<unsigned int>(vOptions.mHistogramSampleRate);
+}
+
+
 bpImageConverterCPtr bpImageConverterC_Create(
   bpConverterTypesC_DataType aDataType, bpConverterTypesC_Size5DPtr aImageSize, bpConverterTypesC_Size5DPtr aSample,
   bpConverterTypesC_DimensionSequence5DPtr aDimensionSequence, bpConverterTypesC_Size5DPtr aFileBlockSize,
@@ -534,6 +763,284 @@ void bpImageConverterC_CopyBlockFloat(bpImageConverterCPtr aImageConverterC, bpC
 }
 
 
+template<typename T>
+static void bpImageConverterC_CopyBlockOwned(bpImageConverterCPtr aImageConverterC, T* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData)
+{
+  bpSharedPtr<bpReleaseCallbackOnce> vReleaseCallback = std::make_shared<bpReleaseCallbackOnce>(aReleaseCallback, aFileDataBlock, aCallbackUserData);
+  if (aImageConverterC) {
+    aImageConverterC->TryExecute([&] {
+      aImageConverterC->CopyBlockOwned(aFileDataBlock, Convert(aBlockIndex), Convert(vReleaseCallback));
+    });
+  }
+
+  // nobody else holds the callback (no converter, wrong data type, an exception before the block was taken): the
+  // caller gets the data back now
+  if (vReleaseCallback.use_count() == 1) {
+    vReleaseCallback->Release();
+  }
+}
+
+
+void bpImageConverterC_CopyBlockOwnedUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData)
+{
+  bpImageConverterC_CopyBlockOwned(aImageConverterC, aFileDataBlock, aBlockIndex, aReleaseCallback, aCallbackUserData);
+}
+
+
+void bpImageConverterC_CopyBlockOwnedUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData)
+{
+  bpImageConverterC_CopyBlockOwned(aImageConverterC, aFileDataBlock, aBlockIndex, aReleaseCallback, aCallbackUserData);
+}
+
+
+void bpImageConverterC_CopyBlockOwnedUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData)
+{
+  bpImageConverterC_CopyBlockOwned(aImageConverterC, aFileDataBlock, aBlockIndex, aReleaseCallback, aCallbackUserData);
+}
+
+
+void bpImageConverterC_CopyBlockOwnedFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData)
+{
+  bpImageConverterC_CopyBlockOwned(aImageConverterC, aFileDataBlock, aBlockIndex, aReleaseCallback, aCallbackUserData);
+}
+
+
+void bpImageConverterC_CopyBlockPacked(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, tPackedDataFormat aFormat, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  if (!aImageConverterC) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    aImageConverterC->CopyBlockPacked(static_cast<const bpUInt8*>(aFileDataBlock), (bpConverterTypes::tPackedDataFormat)aFormat, Convert(aBlockIndex));
+  });
+}
+
+
+template<typename T>
+static void bpImageConverterC_CopyBlockScaled(bpImageConverterCPtr aImageConverterC, T* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  if (!aImageConverterC) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    aImageConverterC->CopyBlockScaled(static_cast<const T*>(aFileDataBlock), aScale, aOffset, Convert(aBlockIndex));
+  });
+}
+
+
+void bpImageConverterC_CopyBlockScaledUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  bpImageConverterC_CopyBlockScaled(aImageConverterC, aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+void bpImageConverterC_CopyBlockScaledUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  bpImageConverterC_CopyBlockScaled(aImageConverterC, aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+void bpImageConverterC_CopyBlockScaledUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  bpImageConverterC_CopyBlockScaled(aImageConverterC, aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+void bpImageConverterC_CopyBlockScaledFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  bpImageConverterC_CopyBlockScaled(aImageConverterC, aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename T>
+static bool bpImageConverterC_TryCopyBlock(bpImageConverterCPtr aImageConverterC, T* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  if (!aImageConverterC) {
+    return false;
+  }
+
+  bool vResult = false;
+  aImageConverterC->TryExecute([&] {
+    vResult = aImageConverterC->TryCopyBlock(static_cast<const T*>(aFileDataBlock), Convert(aBlockIndex));
+  });
+  return vResult;
+}
+
+
+bool bpImageConverterC_TryCopyBlockUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  return bpImageConverterC_TryCopyBlock(aImageConverterC, aFileDataBlock, aBlockIndex);
+}
+
+
+bool bpImageConverterC_TryCopyBlockUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  return bpImageConverterC_TryCopyBlock(aImageConverterC, aFileDataBlock, aBlockIndex);
+}
+
+
+bool bpImageConverterC_TryCopyBlockUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  return bpImageConverterC_TryCopyBlock(aImageConverterC, aFileDataBlock, aBlockIndex);
+}
+
+
+bool bpImageConverterC_TryCopyBlockFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex)
+{
+  return bpImageConverterC_TryCopyBlock(aImageConverterC, aFileDataBlock, aBlockIndex);
+}
+
+
+template<typename T>
+static void bpImageConverterC_CopyRegion(bpImageConverterCPtr aImageConverterC, T* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize)
+{
+  if (!aImageConverterC) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    aImageConverterC->CopyRegion(aData, Convert(aOffset), Convert(aSize));
+  });
+}
+
+
+void bpImageConverterC_CopyRegionUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize)
+{
+  bpImageConverterC_CopyRegion(aImageConverterC, aData, aOffset, aSize);
+}
+
+
+void bpImageConverterC_CopyRegionUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize)
+{
+  bpImageConverterC_CopyRegion(aImageConverterC, aData, aOffset, aSize);
+}
+
+
+void bpImageConverterC_CopyRegionUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize)
+{
+  bpImageConverterC_CopyRegion(aImageConverterC, aData, aOffset, aSize);
+}
+
+
+void bpImageConverterC_CopyRegionFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize)
+{
+  bpImageConverterC_CopyRegion(aImageConverterC, aData, aOffset, aSize);
+}
+
+
+void bpImageConverterC_SetTiles(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_TileVector aTiles, tOverlapPolicy aPolicy)
+{
+  if (!aImageConverterC) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    aImageConverterC->SetTiles(Convert(aTiles), (bpConverterTypes::tOverlapPolicy)aPolicy);
+  });
+}
+
+
+template<typename T>
+static void bpImageConverterC_CopyTile(bpImageConverterCPtr aImageConverterC, T* aData, unsigned int aTileIndex)
+{
+  if (!aImageConverterC) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    aImageConverterC->CopyTile(aData, static_cast<bpSize>(aTileIndex));
+  });
+}
+
+
+void bpImageConverterC_CopyTileUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aData, unsigned int aTileIndex)
+{
+  bpImageConverterC_CopyTile(aImageConverterC, aData, aTileIndex);
+}
+
+
+void bpImageConverterC_CopyTileUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aData, unsigned int aTileIndex)
+{
+  bpImageConverterC_CopyTile(aImageConverterC, aData, aTileIndex);
+}
+
+
+void bpImageConverterC_CopyTileUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aData, unsigned int aTileIndex)
+{
+  bpImageConverterC_CopyTile(aImageConverterC, aData, aTileIndex);
+}
+
+
+void bpImageConverterC_CopyTileFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aData, unsigned int aTileIndex)
+{
+  bpImageConverterC_CopyTile(aImageConverterC, aData, aTileIndex);
+}
+
+
+void bpImageConverterC_GetQueueStatus(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_QueueStatus* aQueueStatus)
+{
+  if (!aImageConverterC || !aQueueStatus) {
+    return;
+  }
+
+  aImageConverterC->TryExecute([&] {
+    bpConverterTypes::cQueueStatus vQueueStatus = aImageConverterC->GetQueueStatus();
+    aQueueStatus->mCopyJobs = vQueueStatus.mCopyJobs;
+    aQueueStatus->mCopyBytes = vQueueStatus.mCopyBytes;
+    aQueueStatus->mBlockJobs = vQueueStatus.mBlockJobs;
+    aQueueStatus->mWriteBytes = vQueueStatus.mWriteBytes;
+    aQueueStatus->mIsBusy = vQueueStatus.mIsBusy;
+    aQueueStatus->mBlockMemoryBytes = vQueueStatus.mBlockMemoryBytes;
+    aQueueStatus->mCachedMemoryBytes = vQueueStatus.mCachedMemoryBytes;
+    aQueueStatus->mPeakMemoryBytes = vQueueStatus.mPeakMemoryBytes;
+  });
+}
+
+
+template<typename T>
+static void GetOwnedFileBlockSize(bpConverterTypesC_Size5DPtr aImageSize, bpConverterTypesC_OptionsPtr aOptions, bpConverterTypesC_Size5D* aFileBlockSize)
+{
+  bpConverterTypes::tSize5D vFileBlockSize = bpImageConverter<T>::GetOwnedFileBlockSize(Convert(aImageSize), Convert(aOptions));
+  aFileBlockSize->mValueX = static_cast<unsigned int>(vFileBlockSize[bpConverterTypes::X]);
+  aFileBlockSize->mValueY = static_cast<unsigned int>(vFileBlockSize[bpConverterTypes::Y]);
+  aFileBlockSize->mValueZ = static_cast<unsigned int>(vFileBlockSize[bpConverterTypes::Z]);
+  aFileBlockSize->mValueC = static_cast<unsigned int>(vFileBlockSize[bpConverterTypes::C]);
+  aFileBlockSize->mValueT = static_cast<unsigned int>(vFileBlockSize[bpConverterTypes::T]);
+}
+
+
+bool bpImageConverterC_GetOwnedFileBlockSize(bpConverterTypesC_DataType aDataType, bpConverterTypesC_Size5DPtr aImageSize, bpConverterTypesC_OptionsPtr aOptions, bpConverterTypesC_Size5D* aFileBlockSize)
+{
+  if (!aFileBlockSize) {
+    return false;
+  }
+
+  try {
+    if (aDataType == bpConverterTypesC_UInt8Type) {
+      GetOwnedFileBlockSize<bpUInt8>(aImageSize, aOptions, aFileBlockSize);
+    }
+    else if (aDataType == bpConverterTypesC_UInt16Type) {
+      GetOwnedFileBlockSize<bpUInt16>(aImageSize, aOptions, aFileBlockSize);
+    }
+    else if (aDataType == bpConverterTypesC_UInt32Type) {
+      GetOwnedFileBlockSize<bpUInt32>(aImageSize, aOptions, aFileBlockSize);
+    }
+    else if (aDataType == bpConverterTypesC_FloatType) {
+      GetOwnedFileBlockSize<bpFloat>(aImageSize, aOptions, aFileBlockSize);
+    }
+    else {
+      return false;
+    }
+  }
+  catch (...) {
+    return false;
+  }
+  return true;
+}
+
+
 void bpImageConverterC_Finish(
   bpImageConverterCPtr aImageConverterC,
   bpConverterTypesC_ImageExtentPtr aImageExtent,
@@ -26,6 +26,7 @@
 #include <set>
 #include <cmath>
 #include <functional>
+#include <future>
 
 
 typedef char bpChar;
@@ -260,6 +261,28 @@ namespace bpConverterTypes
     eCompressionAlgorithmShuffleLZ4 = 31
   };
 
+  // 12 bit values packed two in three bytes, value 0 is in bytes 0 and 1, value 1 in bytes 1 and 2
+  enum tPackedDataFormat {
+    ePackedDataMono12p = 0,       // value 0 = byte 0 | (low nibble of byte 1) << 8, value 1 = high nibble of byte 1 | byte 2 << 4
+    ePackedDataMono12Packed = 1   // value 0 = byte 0 << 4 | low nibble of byte 1, value 1 = byte 2 << 4 | high nibble of byte 1
+  };
+
+  // which value CopyTile keeps where tiles overlap
+  enum tOverlapPolicy {
+    eOverlapFirstWins = 0,    // the tile with the lowest index
+    eOverlapLastWins = 1,     // the tile with the highest index
+    eOverlapLinearBlend = 2   // weighted mean, the weight of a tile grows linearly from its border in X and Y
+  };
+
+  // box of a mosaic tile in voxels of the image
+  struct cTile
+  {
+    tIndex5D mOffset;
+    tSize5D mSize;
+  };
+
+  typedef std::vector<cTile> tTileVector;
+
   struct cOptions
   {
     bpSize mThumbnailSizeXY = 256;
@@ -268,9 +291,40 @@ namespace bpConverterTypes
     bool mEnableLogProgress = false;
     bpSize mNumberOfThreads = 8;
     tCompressionAlgorithmType mCompressionAlgorithmType = eCompressionAlgorithmGzipLevel2;
+    // file blocks of at least this size (in bytes) are scattered into the image by mNumberOfThreads threads, 0 disables
+    // off by default, a few MB (e.g. 4 * 1024 * 1024) suit large file blocks
+    bpSize mParallelCopyThreshold = 0;
+    // the image size in T is only the initial number of time points, blocks of later time points can be copied until Finish
+    // needs a file block size and sample of 1 in T, the progress is estimated from the initial number of time points
+    bool mAppendTimePoints = false;
+    // memory (in bytes) for blocks, compression buffers and histograms, CopyBlock waits while it is exceeded, 0 is unlimited
+    // a soft limit: if no queued work can return memory, copying continues to complete the blocks holding it
+    bpSize mMaxMemoryBytes = 0;
+    // directory of a temporary file that partially filled blocks are moved to while mMaxMemoryBytes is exceeded, empty keeps them in RAM
+    bpString mScratchDirectory;
+    // full resolution histograms count every Nth row of voxels (staggered from plane to plane) and scale the counts by N
+    // estimates the histograms and display ranges, rare values may be missed. lower resolutions are exact, 1 counts every voxel
+    bpSize mHistogramSampleRate = 1;
   };
 
   using tProgressCallback = std::function<void(bpFloat aProgress, bpUInt64 aTotalBytesWritten)>;
+
+  using tReleaseCallback = std::function<void()>;
+
+  // ready once the data of a CopyBlockAsync call has been copied, get() rethrows copy errors
+  using tCopyHandle = std::shared_future<void>;
+
+  struct cQueueStatus
+  {
+    bpSize mCopyJobs = 0;       // CopyBlockAsync calls not copied yet
+    bpUInt64 mCopyBytes = 0;    // data of these calls
+    bpSize mBlockJobs = 0;      // full blocks waiting to be scheduled for compression and writing
+    bpUInt64 mWriteBytes = 0;   // blocks being resampled, compressed or written
+    bool mIsBusy = false;       // TryCopyBlock would currently refuse a block and CopyBlock could wait
+    bpUInt64 mBlockMemoryBytes = 0;  // memory of the image blocks in use
+    bpUInt64 mCachedMemoryBytes = 0; // memory of released image blocks kept for reuse
+    bpUInt64 mPeakMemoryBytes = 0;   // highest mBlockMemoryBytes so far
+  };
 };
 
 
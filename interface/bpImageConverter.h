@@ -40,6 +40,32 @@ public:
 
   void CopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
 
+  void CopyBlockOwned(TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bpConverterTypes::tReleaseCallback aRelease) override;
+
+  void CopyBlockPacked(const bpUInt8* aFileDataBlock, bpConverterTypes::tPackedDataFormat aFormat, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  void CopyBlockScaled(const bpUInt8* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpUInt16* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpUInt32* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpFloat* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  bool TryCopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  void CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize) override;
+
+  void SetTiles(const bpConverterTypes::tTileVector& aTiles, bpConverterTypes::tOverlapPolicy aPolicy) override;
+
+  void CopyTile(const TDataType* aData, bpSize aTileIndex) override;
+
+  bpConverterTypes::tCopyHandle CopyBlockAsync(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  bpConverterTypes::cQueueStatus GetQueueStatus() const override;
+
+  /**
+   * File block size (C and T are 1) for which CopyBlockOwned does not copy the data.
+   */
+  static bpConverterTypes::tSize5D GetOwnedFileBlockSize(const bpConverterTypes::tSize5D& aImageSize, const bpConverterTypes::cOptions& aOptions);
+
   void Finish(
     const bpConverterTypes::cImageExtent& aImageExtent,
     const bpConverterTypes::tParameters& aParameters,
@@ -35,6 +35,69 @@ public:
    */
   virtual void CopyBlock(const TDataType* aData, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
 
+  /**
+   * CopyBlockOwned takes ownership of aData and calls aRelease (from any thread) once the data is no longer used.
+   *
+   * If the file block size equals bpImageConverter::GetOwnedFileBlockSize, the dimension sequence starts with X,Y,Z,
+   * nothing is sampled or flipped, aData is written to file without copying. The part of aData outside the image is
+   * overwritten with zeros in that case. Otherwise aData is copied as in CopyBlock and released immediately.
+   */
+  virtual void CopyBlockOwned(TDataType* aData, const bpConverterTypes::tIndex5D& aBlockIndex, bpConverterTypes::tReleaseCallback aRelease) = 0;
+
+  /**
+   * CopyBlockPacked copies like CopyBlock from 12 bit values packed two in three bytes, as delivered by many cameras.
+   * The values are unpacked while they are copied to the image. aData holds all values of the file block in the order
+   * of the dimension sequence, (number of values * 3 + 1) / 2 bytes. Not available for 8 bit images.
+   */
+  virtual void CopyBlockPacked(const bpUInt8* aData, bpConverterTypes::tPackedDataFormat aFormat, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+
+  /**
+   * CopyBlockScaled copies like CopyBlock from data of another type, e.g. float data into a 16 bit image.
+   * Each value is converted to round(value * aScale + aOffset), clamped to the range of TDataType, while it is copied.
+   * Float images are only scaled. The conversion computes in single precision.
+   */
+  virtual void CopyBlockScaled(const bpUInt8* aData, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+  virtual void CopyBlockScaled(const bpUInt16* aData, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+  virtual void CopyBlockScaled(const bpUInt32* aData, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+  virtual void CopyBlockScaled(const bpFloat* aData, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+
+  /**
+   * TryCopyBlock copies like CopyBlock, unless the writer is busy and CopyBlock could wait for it.
+   * Returns false without copying in that case.
+   */
+  virtual bool TryCopyBlock(const TDataType* aData, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+
+  /**
+   * CopyRegion copies a box of voxels that does not need to be aligned to the file blocks, e.g. a camera ROI.
+   * aData holds the aSize voxels starting at voxel aOffset of the image, in the order of the dimension sequence.
+   * Regions may overlap, voxels already copied by another region are kept. A memory block is written once all its voxels are copied.
+   * Regions must not overlap blocks copied with CopyBlock.
+   */
+  virtual void CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize) = 0;
+
+  /**
+   * SetTiles declares the tiles of a mosaic, each a box of voxels of the image. Tiles may overlap and leave gaps, gaps are written as zeros.
+   * aPolicy selects the value of a voxel covered by several tiles, the result does not depend on the order the tiles are copied in.
+   * Call once before copying any data, the image is then only filled with CopyTile.
+   */
+  virtual void SetTiles(const bpConverterTypes::tTileVector& aTiles, bpConverterTypes::tOverlapPolicy aPolicy) = 0;
+
+  /**
+   * CopyTile copies the voxels of tile aTileIndex, ordered like the data of CopyRegion. Each tile is copied once, in any order and from any thread.
+   */
+  virtual void CopyTile(const TDataType* aData, bpSize aTileIndex) = 0;
+
+  /**
+   * CopyBlockAsync queues the copy and returns immediately. aData must stay valid until the returned handle is ready.
+   * The queued copies are done in order of submission and may wait for the writer like CopyBlock.
+   */
+  virtual bpConverterTypes::tCopyHandle CopyBlockAsync(const TDataType* aData, const bpConverterTypes::tIndex5D& aBlockIndex) = 0;
+
+  /**
+   * Jobs and bytes waiting in the writer, e.g. to decide whether to buffer, drop or throttle acquisition.
+   */
+  virtual bpConverterTypes::cQueueStatus GetQueueStatus() const = 0;
+
   virtual void Finish(
     const bpConverterTypes::cImageExtent& aImageExtent,
     const bpConverterTypes::tParameters& aParameters,
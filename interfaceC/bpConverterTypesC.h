@@ -121,6 +121,25 @@ typedef enum {
 } tCompressionAlgorithmType;
 
 
+// see tPackedDataFormat in bpConverterTypes.h
+typedef enum {
+  ePackedDataMono12p = 0,
+  ePackedDataMono12Packed = 1
+} tPackedDataFormat;
+
+
+// see tOverlapPolicy in bpConverterTypes.h
+typedef enum {
+  eOverlapFirstWins = 0,
+  eOverlapLastWins = 1,
+  eOverlapLinearBlend = 2
+} tOverlapPolicy;
+
+
+// set in bpConverterTypesC_Options::mVersion by bpConverterTypesC_InitOptions, other values ignore the fields after mVersion
+#define BP_CONVERTER_TYPES_C_OPTIONS_VERSION 0x62704f31u
+
+// use bpConverterTypesC_InitOptions to set the defaults before changing any field
 typedef struct
 {
   unsigned int mThumbnailSizeXY; // 256
@@ -131,6 +150,12 @@ typedef struct
   bool mEnableLogProgress; // false
   unsigned int mNumberOfThreads; // 8
   tCompressionAlgorithmType mCompressionAlgorithmType; // eCompressionAlgorithmGzipLevel2
+  unsigned int mVersion; // BP_CONVERTER_TYPES_C_OPTIONS_VERSION, otherwise the fields below keep their defaults
+  bpConverterTypesC_UInt64 mParallelCopyThreshold; // 0 (bytes, 0 disables, e.g. 4194304)
+  bool mAppendTimePoints; // false (image size T is the initial number of time points)
+  bpConverterTypesC_UInt64 mMaxMemoryBytes; // 0 (unlimited)
+  bpConverterTypesC_String mScratchDirectory; // NULL (partially filled blocks stay in RAM)
+  unsigned int mHistogramSampleRate; // 1 (full resolution histograms count every voxel)
 } bpConverterTypesC_Options;
 
 typedef const bpConverterTypesC_Options* bpConverterTypesC_OptionsPtr;
@@ -195,4 +220,29 @@ typedef struct {
 typedef const bpConverterTypesC_ColorInfos* bpConverterTypesC_ColorInfoVector;
 
 
+typedef struct {
+  bpConverterTypesC_Index5D mOffset;
+  bpConverterTypesC_Size5D mSize;
+} bpConverterTypesC_Tile;
+
+typedef struct {
+  const bpConverterTypesC_Tile* mValues;
+  unsigned int mValuesCount;
+} bpConverterTypesC_Tiles;
+
+typedef const bpConverterTypesC_Tiles* bpConverterTypesC_TileVector;
+
+
+typedef struct {
+  bpConverterTypesC_UInt64 mCopyJobs;
+  bpConverterTypesC_UInt64 mCopyBytes;
+  bpConverterTypesC_UInt64 mBlockJobs;
+  bpConverterTypesC_UInt64 mWriteBytes;
+  bool mIsBusy;
+  bpConverterTypesC_UInt64 mBlockMemoryBytes;
+  bpConverterTypesC_UInt64 mCachedMemoryBytes;
+  bpConverterTypesC_UInt64 mPeakMemoryBytes;
+} bpConverterTypesC_QueueStatus;
+
+
 #endif // __BP_CONVERTER_TYPES__
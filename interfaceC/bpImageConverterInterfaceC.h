@@ -46,6 +46,10 @@ typedef struct bpImageConverterC* bpImageConverterCPtr;
 
 typedef void(*bpConverterTypesC_ProgressCallback)(bpConverterTypesC_Float aProgress, bpConverterTypesC_UInt64 aTotalBytesWritten, void* aUserData);
 
+typedef void(*bpConverterTypesC_ReleaseCallback)(void* aFileDataBlock, void* aUserData);
+
+BP_IMARISWRITER_DLL_API void bpConverterTypesC_InitOptions(bpConverterTypesC_Options* aOptions);
+
 BP_IMARISWRITER_DLL_API bpImageConverterCPtr bpImageConverterC_Create(
   bpConverterTypesC_DataType aDataType, bpConverterTypesC_Size5DPtr aImageSize, bpConverterTypesC_Size5DPtr aSample,
   bpConverterTypesC_DimensionSequence5DPtr aDimensionSequence, bpConverterTypesC_Size5DPtr aFileBlockSize,
@@ -64,6 +68,46 @@ BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockUInt16(bpImageConverterC
 BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
 BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
 
+// aReleaseCallback is called once (from any thread) when aFileDataBlock is no longer used, see CopyBlockOwned in bpImageConverterInterface.h.
+// It is also called before returning if the call fails, e.g. for a wrong data type (see bpImageConverterC_GetLastException).
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockOwnedUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockOwnedUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockOwnedUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockOwnedFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex, bpConverterTypesC_ReleaseCallback aReleaseCallback, void* aCallbackUserData);
+
+// 12 bit values packed two in three bytes, see CopyBlockPacked in bpImageConverterInterface.h
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockPacked(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, tPackedDataFormat aFormat, bpConverterTypesC_Index5DPtr aBlockIndex);
+
+// converts each value to round(value * aScale + aOffset) of the converter data type, see CopyBlockScaled in bpImageConverterInterface.h
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockScaledUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockScaledUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockScaledUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyBlockScaledFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, float aScale, float aOffset, bpConverterTypesC_Index5DPtr aBlockIndex);
+
+// returns false without copying if the writer is busy, see TryCopyBlock in bpImageConverterInterface.h
+BP_IMARISWRITER_DLL_API bool bpImageConverterC_TryCopyBlockUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API bool bpImageConverterC_TryCopyBlockUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API bool bpImageConverterC_TryCopyBlockUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
+BP_IMARISWRITER_DLL_API bool bpImageConverterC_TryCopyBlockFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aFileDataBlock, bpConverterTypesC_Index5DPtr aBlockIndex);
+
+// region at any voxel offset, see CopyRegion in bpImageConverterInterface.h
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyRegionUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyRegionUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyRegionUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyRegionFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aData, bpConverterTypesC_Index5DPtr aOffset, bpConverterTypesC_Size5DPtr aSize);
+
+// tiles of a mosaic, see SetTiles and CopyTile in bpImageConverterInterface.h
+BP_IMARISWRITER_DLL_API void bpImageConverterC_SetTiles(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_TileVector aTiles, tOverlapPolicy aPolicy);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyTileUInt8(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt8* aData, unsigned int aTileIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyTileUInt16(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt16* aData, unsigned int aTileIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyTileUInt32(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_UInt32* aData, unsigned int aTileIndex);
+BP_IMARISWRITER_DLL_API void bpImageConverterC_CopyTileFloat(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_Float* aData, unsigned int aTileIndex);
+
+BP_IMARISWRITER_DLL_API void bpImageConverterC_GetQueueStatus(bpImageConverterCPtr aImageConverterC, bpConverterTypesC_QueueStatus* aQueueStatus);
+
+// file block size for which bpImageConverterC_CopyBlockOwned* does not copy the data, returns false on invalid arguments
+BP_IMARISWRITER_DLL_API bool bpImageConverterC_GetOwnedFileBlockSize(bpConverterTypesC_DataType aDataType, bpConverterTypesC_Size5DPtr aImageSize, bpConverterTypesC_OptionsPtr aOptions, bpConverterTypesC_Size5D* aFileBlockSize);
+
 BP_IMARISWRITER_DLL_API void bpImageConverterC_Finish(
   bpImageConverterCPtr aImageConverterC,
   bpConverterTypesC_ImageExtentPtr aImageExtent,
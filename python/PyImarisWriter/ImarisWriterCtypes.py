@@ -138,6 +138,9 @@ eCompressionAlgorithmShuffleLZ4 = 31
 
 # bpConverterTypesC_Options
 
+# the fields after mVersion are only read if it is set to this
+BP_CONVERTER_TYPES_C_OPTIONS_VERSION = 0x62704f31
+
 class bpConverterTypesC_Options(Structure):
     _fields_ = [('mThumbnailSizeXY', c_uint),
                 ('mFlipDimensionX', c_bool),
@@ -146,7 +149,13 @@ class bpConverterTypesC_Options(Structure):
                 ('mForceFileBlockSizeZ1', c_bool),
                 ('mEnableLogProgress', c_bool),
                 ('mNumberOfThreads', c_uint),
-                ('mCompressionAlgorithmType', tCompressionAlgorithmType)]
+                ('mCompressionAlgorithmType', tCompressionAlgorithmType),
+                ('mVersion', c_uint),
+                ('mParallelCopyThreshold', c_ulonglong),
+                ('mAppendTimePoints', c_bool),
+                ('mMaxMemoryBytes', c_ulonglong),
+                ('mScratchDirectory', c_char_p),
+                ('mHistogramSampleRate', c_uint)]
 
 
 bpConverterTypesC_OptionsPtr = POINTER(bpConverterTypesC_Options)
@@ -304,6 +304,11 @@ class Options:
         self.mEnableLogProgress = False
         self.mNumberOfThreads = 8
         self.mCompressionAlgorithmType = eCompressionAlgorithmGzipLevel2
+        self.mParallelCopyThreshold = 0
+        self.mAppendTimePoints = False
+        self.mMaxMemoryBytes = 0
+        self.mScratchDirectory = ''
+        self.mHistogramSampleRate = 1
 
 
 class CallbackClass:
@@ -439,7 +444,13 @@ class ImageConverter(PyClassnameExceptionRaiser):
                                                                                    options.mFlipDimensionZ,
                                                                                    options.mEnableLogProgress,
                                                                                    options.mNumberOfThreads,
-                                                                                   options.mCompressionAlgorithmType))
+                                                                                   options.mCompressionAlgorithmType,
+                                                                                   BP_CONVERTER_TYPES_C_OPTIONS_VERSION,
+                                                                                   options.mParallelCopyThreshold,
+                                                                                   options.mAppendTimePoints,
+                                                                                   options.mMaxMemoryBytes,
+                                                                                   options.mScratchDirectory.encode() if options.mScratchDirectory else None,
+                                                                                   options.mHistogramSampleRate))
         except AttributeError as error:
              self.raise_creating_clex('Invalid options: {}'.format(error))
 
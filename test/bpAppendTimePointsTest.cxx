@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+#include "bpTestImsFile.h"
+
+#include <string>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+static bpUInt8 GetVoxel(bpSize aX, bpSize aY, bpSize aZ, bpSize aT)
+{
+  return static_cast<bpUInt8>(aX * 7 + aY * 13 + aZ * 31 + aT * 57);
+}
+
+static const bpVec3 IMAGE_SIZE = { 100, 70, 12 };
+static const bpVec3 BLOCK_SIZE = { 32, 32, 8 };
+// the converter is created for one time point, the others are appended
+static const bpSize SIZE_T = 4;
+
+
+static void CopyTimePoint(bpImageConverter<bpUInt8>& aConverter, bpSize aIndexT)
+{
+  std::vector<bpUInt8> vBlock(BLOCK_SIZE[0] * BLOCK_SIZE[1] * BLOCK_SIZE[2]);
+  for (bpSize vBlockZ = 0; vBlockZ * BLOCK_SIZE[2] < IMAGE_SIZE[2]; ++vBlockZ) {
+    for (bpSize vBlockY = 0; vBlockY * BLOCK_SIZE[1] < IMAGE_SIZE[1]; ++vBlockY) {
+      for (bpSize vBlockX = 0; vBlockX * BLOCK_SIZE[0] < IMAGE_SIZE[0]; ++vBlockX) {
+        for (bpSize vZ = 0; vZ < BLOCK_SIZE[2]; ++vZ) {
+          for (bpSize vY = 0; vY < BLOCK_SIZE[1]; ++vY) {
+            for (bpSize vX = 0; vX < BLOCK_SIZE[0]; ++vX) {
+              vBlock[(vZ * BLOCK_SIZE[1] + vY) * BLOCK_SIZE[0] + vX] = GetVoxel(vBlockX * BLOCK_SIZE[0] + vX, vBlockY * BLOCK_SIZE[1] + vY, vBlockZ * BLOCK_SIZE[2] + vZ, aIndexT);
+            }
+          }
+        }
+        aConverter.CopyBlock(vBlock.data(), tIndex5D(X, vBlockX, Y, vBlockY, Z, vBlockZ, C, 0, T, aIndexT));
+      }
+    }
+  }
+}
+
+
+static void Write(const bpString& aOutputFile)
+{
+  cOptions vOptions;
+  vOptions.mAppendTimePoints = true;
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, tSize5D(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, IMAGE_SIZE[2], C, 1, T, 1), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, BLOCK_SIZE[0], Y, BLOCK_SIZE[1], Z, BLOCK_SIZE[2], C, 1, T, 1), aOutputFile, vOptions, "bpAppendTimePointsTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  for (bpSize vT = 0; vT < SIZE_T; ++vT) {
+    CopyTimePoint(vConverter, vT);
+  }
+
+  // a block of a complete time point cannot be copied again
+  std::vector<bpUInt8> vBlock(BLOCK_SIZE[0] * BLOCK_SIZE[1] * BLOCK_SIZE[2]);
+  bool vHasThrown = false;
+  try {
+    vConverter.CopyBlock(vBlock.data(), tIndex5D(X, 0, Y, 0, Z, 0, C, 0, T, 1));
+  }
+  catch (const bpError&) {
+    vHasThrown = true;
+  }
+  BP_CHECK(vHasThrown);
+
+  cImageExtent vImageExtent = { 0, 0, 0, static_cast<bpFloat>(IMAGE_SIZE[0]), static_cast<bpFloat>(IMAGE_SIZE[1]), static_cast<bpFloat>(IMAGE_SIZE[2]) };
+  tTimeInfoVector vTimeInfos(SIZE_T);
+  tColorInfoVector vColorInfos(1);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+}
+
+
+static void Check(const bpString& aOutputFile)
+{
+  hid_t vFile = H5Fopen(aOutputFile.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vFile >= 0);
+  if (vFile < 0) {
+    return;
+  }
+  for (bpSize vT = 0; vT < SIZE_T; ++vT) {
+    auto vGetVoxel = [vT](bpSize aX, bpSize aY, bpSize aZ) { return GetVoxel(aX, aY, aZ, vT); };
+    BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, vT, 0, IMAGE_SIZE, vGetVoxel));
+    BP_CHECK(bpTestReadHistogram(vFile, 0, vT, 0) == bpTestGetHistogramUInt8(IMAGE_SIZE, vGetVoxel));
+  }
+  // no time point beyond the appended ones
+  BP_CHECK(H5Lexists(vFile, ("/DataSet/ResolutionLevel 0/TimePoint " + std::to_string(SIZE_T)).c_str(), H5P_DEFAULT) == 0);
+  H5Fclose(vFile);
+}
+
+
+int main()
+{
+  Write("bpAppendTimePointsTest.ims");
+  Check("bpAppendTimePointsTest.ims");
+  return bpTestFailures();
+}
@@ -0,0 +1,163 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+#include "bpTestImsFile.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+static bpUInt8 GetVoxel(bpSize aX, bpSize aY, bpSize aZ, bpSize aC, bpSize aT)
+{
+  return static_cast<bpUInt8>(aX * 7 + aY * 13 + aZ * 31 + aC * 101 + aT * 57);
+}
+
+// not a multiple of the file block size of 32 x 32 x 8
+static const bpVec3 IMAGE_SIZE = { 200, 150, 20 };
+static const bpSize SIZE_C = 2;
+static const bpSize SIZE_T = 2;
+static const bpVec3 BLOCK_SIZE = { 32, 32, 8 };
+
+enum tCopyMode
+{
+  eCopyBlock,
+  eCopyBlockAsync,
+  eTryCopyBlock
+};
+
+
+// all file blocks of the image, in X, Y, Z, C, T order
+static std::vector<tIndex5D> GetBlockIndices()
+{
+  std::vector<tIndex5D> vIndices;
+  for (bpSize vT = 0; vT < SIZE_T; ++vT) {
+    for (bpSize vC = 0; vC < SIZE_C; ++vC) {
+      for (bpSize vZ = 0; vZ * BLOCK_SIZE[2] < IMAGE_SIZE[2]; ++vZ) {
+        for (bpSize vY = 0; vY * BLOCK_SIZE[1] < IMAGE_SIZE[1]; ++vY) {
+          for (bpSize vX = 0; vX * BLOCK_SIZE[0] < IMAGE_SIZE[0]; ++vX) {
+            vIndices.push_back(tIndex5D(X, vX, Y, vY, Z, vZ, C, vC, T, vT));
+          }
+        }
+      }
+    }
+  }
+  return vIndices;
+}
+
+static std::vector<bpUInt8> GetBlock(const tIndex5D& aIndex)
+{
+  std::vector<bpUInt8> vBlock(BLOCK_SIZE[0] * BLOCK_SIZE[1] * BLOCK_SIZE[2]);
+  for (bpSize vZ = 0; vZ < BLOCK_SIZE[2]; ++vZ) {
+    for (bpSize vY = 0; vY < BLOCK_SIZE[1]; ++vY) {
+      for (bpSize vX = 0; vX < BLOCK_SIZE[0]; ++vX) {
+        vBlock[(vZ * BLOCK_SIZE[1] + vY) * BLOCK_SIZE[0] + vX] = GetVoxel(aIndex[X] * BLOCK_SIZE[0] + vX, aIndex[Y] * BLOCK_SIZE[1] + vY, aIndex[Z] * BLOCK_SIZE[2] + vZ, aIndex[C], aIndex[T]);
+      }
+    }
+  }
+  return vBlock;
+}
+
+
+// aNumberOfProducers threads take the blocks in turns and copy them with aMode
+static void Write(const bpString& aOutputFile, const cOptions& aOptions, tCopyMode aMode, bpSize aNumberOfProducers)
+{
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, tSize5D(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, IMAGE_SIZE[2], C, SIZE_C, T, SIZE_T), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, BLOCK_SIZE[0], Y, BLOCK_SIZE[1], Z, BLOCK_SIZE[2], C, 1, T, 1), aOutputFile, aOptions, "bpConcurrentCopyTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  std::vector<tIndex5D> vIndices = GetBlockIndices();
+  // CopyBlockAsync needs the data until its handle is ready
+  std::vector<std::vector<bpUInt8>> vBlocks(vIndices.size());
+  std::vector<tCopyHandle> vHandles(vIndices.size());
+  std::atomic<bpSize> vNextBlock(0);
+  std::vector<std::thread> vProducers;
+  for (bpSize vProducer = 0; vProducer < aNumberOfProducers; ++vProducer) {
+    vProducers.emplace_back([&] {
+      for (bpSize vBlock = vNextBlock++; vBlock < vIndices.size(); vBlock = vNextBlock++) {
+        vBlocks[vBlock] = GetBlock(vIndices[vBlock]);
+        if (aMode == eCopyBlock) {
+          vConverter.CopyBlock(vBlocks[vBlock].data(), vIndices[vBlock]);
+        }
+        else if (aMode == eCopyBlockAsync) {
+          vHandles[vBlock] = vConverter.CopyBlockAsync(vBlocks[vBlock].data(), vIndices[vBlock]);
+        }
+        else {
+          while (!vConverter.TryCopyBlock(vBlocks[vBlock].data(), vIndices[vBlock])) {
+            std::this_thread::yield();
+          }
+        }
+        if (aMode != eCopyBlockAsync) {
+          vBlocks[vBlock].clear();
+        }
+      }
+    });
+  }
+  for (std::thread& vProducer : vProducers) {
+    vProducer.join();
+  }
+  for (tCopyHandle& vHandle : vHandles) {
+    if (vHandle.valid()) {
+      vHandle.get();
+    }
+  }
+  BP_CHECK_EQUAL(bpSize(0), vConverter.GetQueueStatus().mCopyJobs);
+
+  cImageExtent vImageExtent = { 0, 0, 0, static_cast<bpFloat>(IMAGE_SIZE[0]), static_cast<bpFloat>(IMAGE_SIZE[1]), static_cast<bpFloat>(IMAGE_SIZE[2]) };
+  tTimeInfoVector vTimeInfos(SIZE_T);
+  tColorInfoVector vColorInfos(SIZE_C);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+}
+
+
+static void Check(const bpString& aOutputFile)
+{
+  hid_t vFile = H5Fopen(aOutputFile.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vFile >= 0);
+  if (vFile < 0) {
+    return;
+  }
+  for (bpSize vT = 0; vT < SIZE_T; ++vT) {
+    for (bpSize vC = 0; vC < SIZE_C; ++vC) {
+      auto vGetVoxel = [vC, vT](bpSize aX, bpSize aY, bpSize aZ) { return GetVoxel(aX, aY, aZ, vC, vT); };
+      BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, vT, vC, IMAGE_SIZE, vGetVoxel));
+      BP_CHECK(bpTestReadHistogram(vFile, 0, vT, vC) == bpTestGetHistogramUInt8(IMAGE_SIZE, vGetVoxel));
+    }
+  }
+  H5Fclose(vFile);
+}
+
+
+int main()
+{
+  cOptions vOptions;
+  Write("bpConcurrentCopyTestBlocks.ims", vOptions, eCopyBlock, 4);
+  Check("bpConcurrentCopyTestBlocks.ims");
+  Write("bpConcurrentCopyTestAsync.ims", vOptions, eCopyBlockAsync, 2);
+  Check("bpConcurrentCopyTestAsync.ims");
+  Write("bpConcurrentCopyTestTry.ims", vOptions, eTryCopyBlock, 3);
+  Check("bpConcurrentCopyTestTry.ims");
+
+  // every file block is scattered by the copy threads
+  vOptions.mParallelCopyThreshold = 1;
+  Write("bpConcurrentCopyTestParallel.ims", vOptions, eCopyBlock, 4);
+  Check("bpConcurrentCopyTestParallel.ims");
+  return bpTestFailures();
+}
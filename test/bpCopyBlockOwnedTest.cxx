@@ -0,0 +1,116 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+#include "bpTestImsFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+static bpUInt8 GetVoxel(bpSize aX, bpSize aY, bpSize aZ)
+{
+  return static_cast<bpUInt8>(aX * 7 + aY * 13 + aZ * 31);
+}
+
+static const bpVec3 IMAGE_SIZE = { 300, 260, 140 };
+
+
+// the most buffers handed over and not released yet at once
+static bpSize Write(const bpString& aOutputFile, bpSize aMaxMemoryBlocks)
+{
+  tSize5D vImageSize(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, IMAGE_SIZE[2], C, 1, T, 1);
+  cOptions vOptions;
+  tSize5D vBlockSize = bpImageConverter<bpUInt8>::GetOwnedFileBlockSize(vImageSize, vOptions);
+  bpSize vBlockBytes = vBlockSize[X] * vBlockSize[Y] * vBlockSize[Z];
+  vOptions.mMaxMemoryBytes = aMaxMemoryBlocks * vBlockBytes;
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, vImageSize, tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), vBlockSize, aOutputFile, vOptions, "bpCopyBlockOwnedTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  // filled before they are handed over, to hand them over faster than they are written
+  const bpVec3 vSize = { vBlockSize[X], vBlockSize[Y], vBlockSize[Z] };
+  std::vector<std::pair<bpUInt8*, tIndex5D>> vBlocks;
+  for (bpSize vBlockZ = 0; vBlockZ * vSize[2] < IMAGE_SIZE[2]; ++vBlockZ) {
+    for (bpSize vBlockY = 0; vBlockY * vSize[1] < IMAGE_SIZE[1]; ++vBlockY) {
+      for (bpSize vBlockX = 0; vBlockX * vSize[0] < IMAGE_SIZE[0]; ++vBlockX) {
+        bpUInt8* vBlock = new bpUInt8[vBlockBytes];
+        for (bpSize vZ = 0; vZ < vSize[2]; ++vZ) {
+          for (bpSize vY = 0; vY < vSize[1]; ++vY) {
+            for (bpSize vX = 0; vX < vSize[0]; ++vX) {
+              vBlock[(vZ * vSize[1] + vY) * vSize[0] + vX] = GetVoxel(vBlockX * vSize[0] + vX, vBlockY * vSize[1] + vY, vBlockZ * vSize[2] + vZ);
+            }
+          }
+        }
+        vBlocks.emplace_back(vBlock, tIndex5D(X, vBlockX, Y, vBlockY, Z, vBlockZ, C, 0, T, 0));
+      }
+    }
+  }
+
+  std::atomic<bpSize> vNumberOfOwnedBlocks(0);
+  std::atomic<bpSize> vNumberOfReleasedBlocks(0);
+  bpSize vMaxNumberOfOwnedBlocks = 0;
+  for (const auto& vBlock : vBlocks) {
+    bpUInt8* vData = vBlock.first;
+    vMaxNumberOfOwnedBlocks = std::max<bpSize>(vMaxNumberOfOwnedBlocks, ++vNumberOfOwnedBlocks);
+    vConverter.CopyBlockOwned(vData, vBlock.second, [vData, &vNumberOfOwnedBlocks, &vNumberOfReleasedBlocks] {
+      delete[] vData;
+      --vNumberOfOwnedBlocks;
+      ++vNumberOfReleasedBlocks;
+    });
+  }
+
+  cImageExtent vImageExtent = { 0, 0, 0, static_cast<bpFloat>(IMAGE_SIZE[0]), static_cast<bpFloat>(IMAGE_SIZE[1]), static_cast<bpFloat>(IMAGE_SIZE[2]) };
+  tTimeInfoVector vTimeInfos(1);
+  tColorInfoVector vColorInfos(1);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+  BP_CHECK_EQUAL(vBlocks.size(), vNumberOfReleasedBlocks.load());
+  BP_CHECK(vBlocks.size() > 8);
+  std::cout << aOutputFile << ": " << vBlocks.size() << " blocks, at most " << vMaxNumberOfOwnedBlocks << " owned" << std::endl;
+  return vMaxNumberOfOwnedBlocks;
+}
+
+
+static void Check(const bpString& aOutputFile)
+{
+  hid_t vFile = H5Fopen(aOutputFile.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vFile >= 0);
+  if (vFile < 0) {
+    return;
+  }
+  BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, 0, 0, IMAGE_SIZE, GetVoxel));
+  BP_CHECK(bpTestReadHistogram(vFile, 0, 0, 0) == bpTestGetHistogramUInt8(IMAGE_SIZE, GetVoxel));
+  H5Fclose(vFile);
+}
+
+
+int main()
+{
+  Write("bpCopyBlockOwnedTest.ims", 0);
+  Check("bpCopyBlockOwnedTest.ims");
+
+  // the adopted buffers count against the budget, CopyBlockOwned waits for them to be released
+  bpSize vMaxNumberOfOwnedBlocks = Write("bpCopyBlockOwnedTestBudget.ims", 4);
+  Check("bpCopyBlockOwnedTestBudget.ims");
+  BP_CHECK(vMaxNumberOfOwnedBlocks <= 8);
+  return bpTestFailures();
+}
@@ -0,0 +1,168 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../writer/bpCopyKernels.h"
+
+#include "bpTest.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+// value aIndex of the packed data, as documented for tPackedDataFormat
+static bpUInt16 GetPacked12Reference(const std::vector<bpUInt8>& aData, bpSize aIndex, bpConverterTypes::tPackedDataFormat aFormat)
+{
+  bpUInt16 vByte0 = aData[3 * (aIndex / 2)];
+  bpUInt16 vByte1 = aData[3 * (aIndex / 2) + 1];
+  bpUInt16 vByte2 = aData[3 * (aIndex / 2) + 2];
+  if (aFormat == bpConverterTypes::ePackedDataMono12p) {
+    return aIndex % 2 == 0 ? vByte0 | ((vByte1 & 0x0f) << 8) : (vByte1 >> 4) | (vByte2 << 4);
+  }
+  return aIndex % 2 == 0 ? (vByte0 << 4) | (vByte1 & 0x0f) : (vByte2 << 4) | (vByte1 >> 4);
+}
+
+
+template<typename TDataType>
+static void TestUnpack12(bpConverterTypes::tPackedDataFormat aFormat)
+{
+  std::mt19937 vRandom(12);
+  const bpSize vNumberOfValues = 200;
+  std::vector<bpUInt8> vPacked((vNumberOfValues * 3 + 1) / 2);
+  for (bpUInt8& vByte : vPacked) {
+    vByte = static_cast<bpUInt8>(vRandom());
+  }
+
+  for (bpSize vStep = 1; vStep <= 3; ++vStep) {
+    for (bpSize vFirstValue = 0; vFirstValue < 3; ++vFirstValue) {
+      for (bpSize vCount = 0; vFirstValue + (vCount - 1) * vStep < vNumberOfValues || vCount == 0; ++vCount) {
+        for (bool vReverse : { false, true }) {
+          // one guard value behind the destination
+          std::vector<TDataType> vDest(vCount + 1, 12345);
+          bpUnpack12(vPacked.data(), vFirstValue, vStep, vCount, vDest.data(), vReverse, aFormat);
+          bool vIsEqual = true;
+          for (bpSize vIndex = 0; vIndex < vCount; ++vIndex) {
+            TDataType vExpected = static_cast<TDataType>(GetPacked12Reference(vPacked, vFirstValue + vIndex * vStep, aFormat));
+            vIsEqual = vIsEqual && vDest[vReverse ? vCount - 1 - vIndex : vIndex] == vExpected;
+          }
+          BP_CHECK(vIsEqual);
+          BP_CHECK(vDest[vCount] == 12345);
+        }
+      }
+    }
+  }
+}
+
+
+// round(aValue) clamped to the range of TDataType, NaN to 0, as documented for bpConvertStrided
+template<typename TDataType>
+static TDataType ConvertReference(bpFloat aValue)
+{
+  bpFloat vMax = static_cast<bpFloat>(std::numeric_limits<TDataType>::max());
+  if (std::isnan(aValue) || aValue <= 0) {
+    return 0;
+  }
+  return aValue >= vMax ? std::numeric_limits<TDataType>::max() : static_cast<TDataType>(std::nearbyint(aValue));
+}
+
+template<>
+bpFloat ConvertReference<bpFloat>(bpFloat aValue)
+{
+  return aValue;
+}
+
+template<typename TDataType>
+static bool IsSame(TDataType aValue, TDataType aOther)
+{
+  return aValue == aOther;
+}
+
+static bool IsSame(bpFloat aValue, bpFloat aOther)
+{
+  return aValue == aOther || (std::isnan(aValue) && std::isnan(aOther));
+}
+
+
+template<typename TInput, typename TDataType>
+static void TestConvertStrided(const std::vector<TInput>& aSource, bpFloat aScale, bpFloat aOffset)
+{
+  for (bpSize vStep = 1; vStep <= 3; ++vStep) {
+    for (bpSize vCount = 0; vCount * vStep <= aSource.size(); ++vCount) {
+      for (bool vReverse : { false, true }) {
+        std::vector<TDataType> vDest(vCount + 1, 123);
+        bpConvertStrided(aSource.data(), vStep, vCount, vDest.data(), vReverse, aScale, aOffset);
+        bool vIsEqual = true;
+        for (bpSize vIndex = 0; vIndex < vCount; ++vIndex) {
+          TDataType vExpected = ConvertReference<TDataType>(static_cast<bpFloat>(aSource[vIndex * vStep]) * aScale + aOffset);
+          vIsEqual = vIsEqual && IsSame(vDest[vReverse ? vCount - 1 - vIndex : vIndex], vExpected);
+        }
+        BP_CHECK(vIsEqual);
+        BP_CHECK(vDest[vCount] == 123);
+      }
+    }
+  }
+}
+
+template<typename TInput>
+static std::vector<TInput> GetConvertSource(bpSize aCount)
+{
+  std::mt19937 vRandom(8);
+  std::vector<TInput> vSource(aCount);
+  for (TInput& vValue : vSource) {
+    vValue = static_cast<TInput>(vRandom());
+  }
+  // the extremes of the type in the first vector and in the tail
+  vSource[1] = std::numeric_limits<TInput>::max();
+  vSource[2] = 0;
+  vSource[aCount - 1] = std::numeric_limits<TInput>::max();
+  return vSource;
+}
+
+template<typename TDataType>
+static void TestConvertStrided()
+{
+  // a scale of 0.5 and offsets of 0.5 put many values half way between two integers
+  TestConvertStrided<bpUInt8, TDataType>(GetConvertSource<bpUInt8>(70), 0.5f, 0.5f);
+  TestConvertStrided<bpUInt8, TDataType>(GetConvertSource<bpUInt8>(70), 300.0f, -1000.0f);
+  TestConvertStrided<bpUInt16, TDataType>(GetConvertSource<bpUInt16>(70), 0.5f, 0);
+  TestConvertStrided<bpUInt16, TDataType>(GetConvertSource<bpUInt16>(70), 2.0f, 0.5f);
+  TestConvertStrided<bpUInt32, TDataType>(GetConvertSource<bpUInt32>(70), 1.0f, 0);
+  TestConvertStrided<bpUInt32, TDataType>(GetConvertSource<bpUInt32>(70), 1.0f / 65536, 0.5f);
+
+  std::vector<bpFloat> vFloats = { -1.5f, -0.5f, 0, 0.5f, 1.5f, 2.5f, 254.5f, 255.5f, 256, 65534.5f, 65535.5f, 1e10f, -1e10f,
+    std::numeric_limits<bpFloat>::quiet_NaN(), std::numeric_limits<bpFloat>::infinity(), -std::numeric_limits<bpFloat>::infinity() };
+  std::vector<bpFloat> vSource;
+  for (bpSize vRepeat = 0; vRepeat < 5; ++vRepeat) {
+    vSource.insert(vSource.end(), vFloats.begin() + vRepeat, vFloats.end());
+  }
+  TestConvertStrided<bpFloat, TDataType>(vSource, 1.0f, 0);
+  TestConvertStrided<bpFloat, TDataType>(vSource, -2.0f, 3.0f);
+}
+
+
+int main()
+{
+  TestUnpack12<bpUInt16>(bpConverterTypes::ePackedDataMono12p);
+  TestUnpack12<bpUInt16>(bpConverterTypes::ePackedDataMono12Packed);
+  TestUnpack12<bpUInt32>(bpConverterTypes::ePackedDataMono12p);
+  TestUnpack12<bpFloat>(bpConverterTypes::ePackedDataMono12Packed);
+
+  TestConvertStrided<bpUInt8>();
+  TestConvertStrided<bpUInt16>();
+  TestConvertStrided<bpUInt32>();
+  TestConvertStrided<bpFloat>();
+  return bpTestFailures();
+}
@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+
+#include <hdf5.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+static bpUInt16 GetVoxel(bpSize aX, bpSize aY, bpSize aZ, bpSize aC)
+{
+  return static_cast<bpUInt16>(aX * 7 + aY * 13 + aZ * 31 + aC * 101);
+}
+
+// large enough for two resolution levels, not a multiple of the file block size of 32 x 32 x 4
+static const bpSize IMAGE_SIZE_X = 300;
+static const bpSize IMAGE_SIZE_Y = 230;
+static const bpSize IMAGE_SIZE_Z = 9;
+
+
+static void Finish(bpImageConverter<bpUInt16>& aConverter)
+{
+  cImageExtent vImageExtent = { 0, 0, 0, IMAGE_SIZE_X, IMAGE_SIZE_Y, IMAGE_SIZE_Z };
+  tTimeInfoVector vTimeInfos(1);
+  tColorInfoVector vColorInfos(2);
+  aConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+}
+
+static bpUniquePtr<bpImageConverter<bpUInt16>> CreateConverter(const bpString& aOutputFile)
+{
+  return std::make_unique<bpImageConverter<bpUInt16>>(bpUInt16Type, tSize5D(X, IMAGE_SIZE_X, Y, IMAGE_SIZE_Y, Z, IMAGE_SIZE_Z, C, 2, T, 1), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, 32, Y, 32, Z, 4, C, 1, T, 1), aOutputFile, cOptions(), "bpCopyRegionTest", "1.0", [](bpFloat, bpUInt64) {});
+}
+
+
+static void WriteBlocks(const bpString& aOutputFile)
+{
+  bpUniquePtr<bpImageConverter<bpUInt16>> vConverter = CreateConverter(aOutputFile);
+  std::vector<bpUInt16> vBlock(32 * 32 * 4);
+  for (bpSize vC = 0; vC < 2; ++vC) {
+    for (bpSize vBlockZ = 0; vBlockZ * 4 < IMAGE_SIZE_Z; ++vBlockZ) {
+      for (bpSize vBlockY = 0; vBlockY * 32 < IMAGE_SIZE_Y; ++vBlockY) {
+        for (bpSize vBlockX = 0; vBlockX * 32 < IMAGE_SIZE_X; ++vBlockX) {
+          for (bpSize vZ = 0; vZ < 4; ++vZ) {
+            for (bpSize vY = 0; vY < 32; ++vY) {
+              for (bpSize vX = 0; vX < 32; ++vX) {
+                vBlock[(vZ * 32 + vY) * 32 + vX] = GetVoxel(vBlockX * 32 + vX, vBlockY * 32 + vY, vBlockZ * 4 + vZ, vC);
+              }
+            }
+          }
+          vConverter->CopyBlock(vBlock.data(), tIndex5D(X, vBlockX, Y, vBlockY, Z, vBlockZ, C, vC, T, 0));
+        }
+      }
+    }
+  }
+  Finish(*vConverter);
+}
+
+
+// overlapping regions that are not aligned to the file blocks
+static void WriteRegions(const bpString& aOutputFile)
+{
+  bpUniquePtr<bpImageConverter<bpUInt16>> vConverter = CreateConverter(aOutputFile);
+  for (bpSize vC = 0; vC < 2; ++vC) {
+    for (bpSize vBeginZ = 0; vBeginZ < IMAGE_SIZE_Z; vBeginZ += 3) {
+      for (bpSize vBeginY = 0; vBeginY < IMAGE_SIZE_Y; vBeginY += 19) {
+        for (bpSize vBeginX = 0; vBeginX < IMAGE_SIZE_X; vBeginX += 23) {
+          bpSize vSizeX = std::min<bpSize>(30, IMAGE_SIZE_X - vBeginX);
+          bpSize vSizeY = std::min<bpSize>(25, IMAGE_SIZE_Y - vBeginY);
+          bpSize vSizeZ = std::min<bpSize>(4, IMAGE_SIZE_Z - vBeginZ);
+          std::vector<bpUInt16> vRegion(vSizeX * vSizeY * vSizeZ);
+          for (bpSize vZ = 0; vZ < vSizeZ; ++vZ) {
+            for (bpSize vY = 0; vY < vSizeY; ++vY) {
+              for (bpSize vX = 0; vX < vSizeX; ++vX) {
+                vRegion[(vZ * vSizeY + vY) * vSizeX + vX] = GetVoxel(vBeginX + vX, vBeginY + vY, vBeginZ + vZ, vC);
+              }
+            }
+          }
+          vConverter->CopyRegion(vRegion.data(), tIndex5D(X, vBeginX, Y, vBeginY, Z, vBeginZ, C, vC, T, 0),
+            tSize5D(X, vSizeX, Y, vSizeY, Z, vSizeZ, C, 1, T, 1));
+        }
+      }
+    }
+  }
+  Finish(*vConverter);
+}
+
+
+// the voxels of a dataset, empty if there is none
+static std::vector<bpUInt16> ReadDataset(hid_t aFile, const bpString& aName)
+{
+  if (H5Lexists(aFile, aName.c_str(), H5P_DEFAULT) <= 0) {
+    return{};
+  }
+  hid_t vDataset = H5Dopen2(aFile, aName.c_str(), H5P_DEFAULT);
+  hid_t vSpace = H5Dget_space(vDataset);
+  std::vector<bpUInt16> vData(static_cast<bpSize>(H5Sget_simple_extent_npoints(vSpace)));
+  H5Dread(vDataset, H5T_NATIVE_USHORT, H5S_ALL, H5S_ALL, H5P_DEFAULT, vData.data());
+  H5Sclose(vSpace);
+  H5Dclose(vDataset);
+  return vData;
+}
+
+
+int main()
+{
+  WriteBlocks("bpCopyRegionTestBlocks.ims");
+  WriteRegions("bpCopyRegionTestRegions.ims");
+
+  hid_t vBlocksFile = H5Fopen("bpCopyRegionTestBlocks.ims", H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t vRegionsFile = H5Fopen("bpCopyRegionTestRegions.ims", H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vBlocksFile >= 0 && vRegionsFile >= 0);
+  bpSize vNumberOfDatasets = 0;
+  for (bpSize vIndexR = 0; ; ++vIndexR) {
+    bpString vLevel = "/DataSet/ResolutionLevel " + std::to_string(vIndexR);
+    if (H5Lexists(vBlocksFile, vLevel.c_str(), H5P_DEFAULT) <= 0) {
+      break;
+    }
+    for (bpSize vIndexC = 0; vIndexC < 2; ++vIndexC) {
+      bpString vName = vLevel + "/TimePoint 0/Channel " + std::to_string(vIndexC) + "/Data";
+      std::vector<bpUInt16> vBlocks = ReadDataset(vBlocksFile, vName);
+      BP_CHECK(!vBlocks.empty());
+      BP_CHECK(vBlocks == ReadDataset(vRegionsFile, vName));
+      ++vNumberOfDatasets;
+    }
+  }
+  BP_CHECK(vNumberOfDatasets >= 4);
+  H5Fclose(vBlocksFile);
+  H5Fclose(vRegionsFile);
+  return bpTestFailures();
+}
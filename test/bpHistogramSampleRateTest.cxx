@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+
+#include <hdf5.h>
+
+#include <string>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+// the value depends on y and z, skipping rows changes the histogram
+static bpUInt8 GetVoxel(bpSize aX, bpSize aY, bpSize aZ)
+{
+  return static_cast<bpUInt8>(aX * 7 + aY * 13 + aZ * 31);
+}
+
+// not a multiple of the file block size of 32 x 32 x 4
+static const bpSize IMAGE_SIZE_X = 100;
+static const bpSize IMAGE_SIZE_Y = 70;
+static const bpSize IMAGE_SIZE_Z = 9;
+
+
+static void Write(const bpString& aOutputFile, bpSize aHistogramSampleRate)
+{
+  cOptions vOptions;
+  vOptions.mHistogramSampleRate = aHistogramSampleRate;
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, tSize5D(X, IMAGE_SIZE_X, Y, IMAGE_SIZE_Y, Z, IMAGE_SIZE_Z, C, 1, T, 1), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, 32, Y, 32, Z, 4, C, 1, T, 1), aOutputFile, vOptions, "bpHistogramSampleRateTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  std::vector<bpUInt8> vImage(IMAGE_SIZE_X * IMAGE_SIZE_Y * IMAGE_SIZE_Z);
+  for (bpSize vZ = 0; vZ < IMAGE_SIZE_Z; ++vZ) {
+    for (bpSize vY = 0; vY < IMAGE_SIZE_Y; ++vY) {
+      for (bpSize vX = 0; vX < IMAGE_SIZE_X; ++vX) {
+        vImage[(vZ * IMAGE_SIZE_Y + vY) * IMAGE_SIZE_X + vX] = GetVoxel(vX, vY, vZ);
+      }
+    }
+  }
+  vConverter.CopyRegion(vImage.data(), tIndex5D(X, 0, Y, 0, Z, 0, C, 0, T, 0), tSize5D(X, IMAGE_SIZE_X, Y, IMAGE_SIZE_Y, Z, IMAGE_SIZE_Z, C, 1, T, 1));
+
+  cImageExtent vImageExtent = { 0, 0, 0, IMAGE_SIZE_X, IMAGE_SIZE_Y, IMAGE_SIZE_Z };
+  tTimeInfoVector vTimeInfos(1);
+  tColorInfoVector vColorInfos(1);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+}
+
+
+// the rows whose y + z is a multiple of aHistogramSampleRate, each counted aHistogramSampleRate times
+static std::vector<bpUInt64> GetHistogramReference(bpSize aHistogramSampleRate)
+{
+  std::vector<bpUInt64> vBins(256);
+  for (bpSize vZ = 0; vZ < IMAGE_SIZE_Z; ++vZ) {
+    for (bpSize vY = 0; vY < IMAGE_SIZE_Y; ++vY) {
+      if ((vY + vZ) % aHistogramSampleRate != 0) {
+        continue;
+      }
+      for (bpSize vX = 0; vX < IMAGE_SIZE_X; ++vX) {
+        vBins[GetVoxel(vX, vY, vZ)] += aHistogramSampleRate;
+      }
+    }
+  }
+  return vBins;
+}
+
+
+// the full resolution histogram, empty if there is none
+static std::vector<bpUInt64> ReadHistogram(const bpString& aFileName)
+{
+  std::vector<bpUInt64> vBins;
+  hid_t vFile = H5Fopen(aFileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (vFile < 0) {
+    return vBins;
+  }
+  const char* vName = "/DataSet/ResolutionLevel 0/TimePoint 0/Channel 0/Histogram";
+  if (H5Lexists(vFile, vName, H5P_DEFAULT) > 0) {
+    hid_t vDataset = H5Dopen2(vFile, vName, H5P_DEFAULT);
+    hid_t vSpace = H5Dget_space(vDataset);
+    vBins.resize(static_cast<bpSize>(H5Sget_simple_extent_npoints(vSpace)));
+    H5Dread(vDataset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, vBins.data());
+    H5Sclose(vSpace);
+    H5Dclose(vDataset);
+  }
+  H5Fclose(vFile);
+  return vBins;
+}
+
+
+int main()
+{
+  for (bpSize vHistogramSampleRate : { 1, 3 }) {
+    bpString vFileName = "bpHistogramSampleRateTest" + std::to_string(vHistogramSampleRate) + ".ims";
+    Write(vFileName, vHistogramSampleRate);
+    BP_CHECK(ReadHistogram(vFileName) == GetHistogramReference(vHistogramSampleRate));
+  }
+  return bpTestFailures();
+}
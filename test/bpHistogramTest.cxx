@@ -0,0 +1,146 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../writer/bpHistogram.h"
+
+#include "bpTest.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+static bool IsSame(const bpHistogram& aHistogram, const bpHistogram& aOther)
+{
+  if (aHistogram.GetMin() != aOther.GetMin() || aHistogram.GetMax() != aOther.GetMax() ||
+      aHistogram.GetNumberOfBins() != aOther.GetNumberOfBins()) {
+    return false;
+  }
+  for (bpSize vBin = 0; vBin < aHistogram.GetNumberOfBins(); ++vBin) {
+    if (aHistogram.GetCount(vBin) != aOther.GetCount(vBin)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static bpUInt64 GetCountTotal(const bpHistogram& aHistogram)
+{
+  bpUInt64 vCount = 0;
+  for (bpSize vBin = 0; vBin < aHistogram.GetNumberOfBins(); ++vBin) {
+    vCount += aHistogram.GetCount(vBin);
+  }
+  return vCount;
+}
+
+
+// values whose range grows while they are added, so that the bins move within the rows
+static std::vector<bpFloat> GetFloatValues(std::mt19937& aRandom, bpSize aCount, bool aWithSpecialValues)
+{
+  std::vector<bpFloat> vValues(aCount);
+  for (bpSize vIndex = 0; vIndex < aCount; ++vIndex) {
+    bpFloat vRange = 1.0f + 10.0f * vIndex;
+    vValues[vIndex] = std::uniform_real_distribution<bpFloat>(-vRange, 3 * vRange)(aRandom);
+    if (aWithSpecialValues && aRandom() % 97 == 0) {
+      vValues[vIndex] = aRandom() % 2 == 0 ? std::numeric_limits<bpFloat>::quiet_NaN() : 0.0f;
+    }
+  }
+  return vValues;
+}
+
+static std::vector<bpUInt32> GetUInt32Values(std::mt19937& aRandom, bpSize aCount)
+{
+  std::vector<bpUInt32> vValues(aCount);
+  for (bpSize vIndex = 0; vIndex < aCount; ++vIndex) {
+    vValues[vIndex] = static_cast<bpUInt32>(aRandom() % (100 + 1000 * vIndex));
+  }
+  return vValues;
+}
+
+
+template<typename TDataType>
+static void TestAddValues(const std::vector<TDataType>& aValues, std::mt19937& aRandom)
+{
+  bpHistogramBuilderAdaptive vSequential;
+  for (TDataType vValue : aValues) {
+    vSequential.AddValue(static_cast<bpFloat>(vValue));
+  }
+
+  // rows of different lengths, some shorter than a vector
+  bpHistogramBuilderAdaptive vRows;
+  bpSize vIndex = 0;
+  while (vIndex < aValues.size()) {
+    bpSize vCount = std::min<bpSize>(aRandom() % 50, aValues.size() - vIndex);
+    vRows.AddValues(aValues.data() + vIndex, vCount);
+    vIndex += vCount;
+  }
+
+  BP_CHECK(IsSame(vSequential.GetHistogram(), vRows.GetHistogram()));
+}
+
+
+static void TestAddValues()
+{
+  std::mt19937 vRandom(24);
+  TestAddValues(GetFloatValues(vRandom, 10000, false), vRandom);
+  TestAddValues(GetFloatValues(vRandom, 10000, true), vRandom);
+  TestAddValues(GetUInt32Values(vRandom, 10000), vRandom);
+
+  // a single value repeated, the bins have no width until a second value arrives
+  std::vector<bpFloat> vConstant(100, 7.0f);
+  vConstant.push_back(8.0f);
+  vConstant.push_back(7.0f);
+  TestAddValues(vConstant, vRandom);
+}
+
+
+static void TestMerge()
+{
+  std::mt19937 vRandom(24);
+  std::vector<bpFloat> vValues = GetFloatValues(vRandom, 10000, false);
+  bpFloat vValueMin = *std::min_element(vValues.begin(), vValues.end());
+  bpFloat vValueMax = *std::max_element(vValues.begin(), vValues.end());
+
+  bpHistogramBuilderAdaptive vFirst;
+  bpHistogramBuilderAdaptive vSecond;
+  vFirst.AddValues(vValues.data(), vValues.size() / 2);
+  vSecond.AddValues(vValues.data() + vValues.size() / 2, vValues.size() - vValues.size() / 2);
+
+  // merging an empty builder changes nothing
+  bpHistogram vBefore = vFirst.GetHistogram();
+  vFirst.Merge(bpHistogramBuilderAdaptive());
+  BP_CHECK(IsSame(vBefore, vFirst.GetHistogram()));
+
+  vFirst.Merge(vSecond);
+  bpHistogram vMerged = vFirst.GetHistogram();
+  BP_CHECK_EQUAL(bpUInt64(vValues.size()), GetCountTotal(vMerged));
+  BP_CHECK(vMerged.GetMin() <= vValueMin);
+  BP_CHECK(vMerged.GetMax() >= vValueMax);
+
+  // into an empty builder
+  bpHistogramBuilderAdaptive vEmpty;
+  vEmpty.Merge(vSecond);
+  BP_CHECK_EQUAL(GetCountTotal(vSecond.GetHistogram()), GetCountTotal(vEmpty.GetHistogram()));
+}
+
+
+int main()
+{
+  TestAddValues();
+  TestMerge();
+  return bpTestFailures();
+}
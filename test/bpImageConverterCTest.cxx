@@ -0,0 +1,167 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interfaceC/bpImageConverterInterfaceC.h"
+
+#include "bpTest.h"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+
+// counts the release callbacks of one block
+struct cReleaseCounter
+{
+  std::atomic<int> mCount{ 0 };
+  void* mFileDataBlock = nullptr;
+};
+
+static void Release(void* aFileDataBlock, void* aUserData)
+{
+  cReleaseCounter* vCounter = static_cast<cReleaseCounter*>(aUserData);
+  vCounter->mFileDataBlock = aFileDataBlock;
+  ++vCounter->mCount;
+}
+
+
+static void TestNoConverter()
+{
+  std::vector<bpConverterTypesC_UInt16> vData(16);
+  bpConverterTypesC_Index5D vBlockIndex = { 0, 0, 0, 0, 0 };
+  cReleaseCounter vCounter;
+  bpImageConverterC_CopyBlockOwnedUInt16(nullptr, vData.data(), &vBlockIndex, Release, &vCounter);
+  BP_CHECK_EQUAL(1, vCounter.mCount.load());
+  BP_CHECK(vCounter.mFileDataBlock == vData.data());
+}
+
+
+static void TestConverter()
+{
+  bpConverterTypesC_Size5D vImageSize = { 32, 32, 4, 1, 1 };
+  bpConverterTypesC_Size5D vSample = { 1, 1, 1, 1, 1 };
+  bpConverterTypesC_DimensionSequence5D vDimensionSequence = {
+    bpConverterTypesC_DimensionX, bpConverterTypesC_DimensionY, bpConverterTypesC_DimensionZ,
+    bpConverterTypesC_DimensionC, bpConverterTypesC_DimensionT };
+  bpConverterTypesC_Size5D vFileBlockSize;
+  BP_CHECK(bpImageConverterC_GetOwnedFileBlockSize(bpConverterTypesC_UInt16Type, &vImageSize, nullptr, &vFileBlockSize));
+  bpImageConverterCPtr vConverter = bpImageConverterC_Create(bpConverterTypesC_UInt16Type, &vImageSize, &vSample,
+    &vDimensionSequence, &vFileBlockSize, "bpImageConverterCTest.ims", nullptr, "bpImageConverterCTest", "1.0", nullptr, nullptr);
+  BP_CHECK(vConverter != nullptr);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+
+  bpConverterTypesC_UInt64 vBlockSize = vFileBlockSize.mValueX * vFileBlockSize.mValueY * vFileBlockSize.mValueZ;
+  bpConverterTypesC_Index5D vBlockIndex = { 0, 0, 0, 0, 0 };
+
+  // the block type does not match the converter type
+  std::vector<bpConverterTypesC_UInt8> vWrongTypeData(vBlockSize);
+  cReleaseCounter vWrongTypeCounter;
+  bpImageConverterC_CopyBlockOwnedUInt8(vConverter, vWrongTypeData.data(), &vBlockIndex, Release, &vWrongTypeCounter);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) != nullptr);
+  BP_CHECK_EQUAL(1, vWrongTypeCounter.mCount.load());
+  BP_CHECK(vWrongTypeCounter.mFileDataBlock == vWrongTypeData.data());
+
+  // the block index is outside the image
+  std::vector<bpConverterTypesC_UInt16> vOutsideData(vBlockSize);
+  bpConverterTypesC_Index5D vOutsideBlockIndex = { 100, 0, 0, 0, 0 };
+  cReleaseCounter vOutsideCounter;
+  bpImageConverterC_CopyBlockOwnedUInt16(vConverter, vOutsideData.data(), &vOutsideBlockIndex, Release, &vOutsideCounter);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) != nullptr);
+  BP_CHECK_EQUAL(1, vOutsideCounter.mCount.load());
+
+  // the converter keeps the data until it is written
+  std::vector<bpConverterTypesC_UInt16> vData(vBlockSize, 7);
+  cReleaseCounter vCounter;
+  bpImageConverterC_CopyBlockOwnedUInt16(vConverter, vData.data(), &vBlockIndex, Release, &vCounter);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+
+  // the block has already been copied
+  std::vector<bpConverterTypesC_UInt16> vCopiedData(vBlockSize);
+  cReleaseCounter vCopiedCounter;
+  bpImageConverterC_CopyBlockOwnedUInt16(vConverter, vCopiedData.data(), &vBlockIndex, Release, &vCopiedCounter);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) != nullptr);
+  BP_CHECK_EQUAL(1, vCopiedCounter.mCount.load());
+
+  bpConverterTypesC_TimeInfo vTimeInfo = { 2458885, 0 };
+  bpConverterTypesC_TimeInfos vTimeInfos = { &vTimeInfo, 1 };
+  bpConverterTypesC_ColorInfo vColorInfo = { true, { 1, 1, 1, 1 }, nullptr, 0, 1, 0, 255, 1 };
+  bpConverterTypesC_ColorInfos vColorInfos = { &vColorInfo, 1 };
+  bpImageConverterC_Finish(vConverter, nullptr, nullptr, &vTimeInfos, &vColorInfos, false);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+  bpImageConverterC_Destroy(vConverter);
+  BP_CHECK_EQUAL(1, vCounter.mCount.load());
+  BP_CHECK(vCounter.mFileDataBlock == vData.data());
+
+  // no callback at all is fine
+  bpImageConverterC_CopyBlockOwnedUInt16(nullptr, vData.data(), &vBlockIndex, nullptr, nullptr);
+}
+
+
+// options set field by field by a caller that does not know the fields after mVersion
+static void TestOptionsVersion()
+{
+  bpConverterTypesC_Options vDefaults;
+  std::memset(&vDefaults, 0xcd, sizeof(vDefaults));
+  bpConverterTypesC_InitOptions(&vDefaults);
+  BP_CHECK_EQUAL(256u, vDefaults.mThumbnailSizeXY);
+  BP_CHECK_EQUAL(8u, vDefaults.mNumberOfThreads);
+  BP_CHECK_EQUAL(BP_CONVERTER_TYPES_C_OPTIONS_VERSION, vDefaults.mVersion);
+  BP_CHECK(vDefaults.mScratchDirectory == nullptr);
+  BP_CHECK_EQUAL(1u, vDefaults.mHistogramSampleRate);
+
+  bpConverterTypesC_Options vOptions;
+  std::memset(&vOptions, 0xcd, sizeof(vOptions));
+  vOptions.mThumbnailSizeXY = 256;
+  vOptions.mFlipDimensionX = false;
+  vOptions.mFlipDimensionY = false;
+  vOptions.mFlipDimensionZ = false;
+  vOptions.mForceFileBlockSizeZ1 = false;
+  vOptions.mEnableLogProgress = false;
+  vOptions.mNumberOfThreads = 2;
+  vOptions.mCompressionAlgorithmType = eCompressionAlgorithmGzipLevel2;
+
+  // the garbage scratch directory and memory limit are not read
+  bpConverterTypesC_Size5D vImageSize = { 32, 32, 4, 1, 1 };
+  bpConverterTypesC_Size5D vSample = { 1, 1, 1, 1, 1 };
+  bpConverterTypesC_DimensionSequence5D vDimensionSequence = {
+    bpConverterTypesC_DimensionX, bpConverterTypesC_DimensionY, bpConverterTypesC_DimensionZ,
+    bpConverterTypesC_DimensionC, bpConverterTypesC_DimensionT };
+  bpImageConverterCPtr vConverter = bpImageConverterC_Create(bpConverterTypesC_UInt16Type, &vImageSize, &vSample,
+    &vDimensionSequence, &vImageSize, "bpImageConverterCTestOptions.ims", &vOptions, "bpImageConverterCTest", "1.0", nullptr, nullptr);
+  BP_CHECK(vConverter != nullptr);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+
+  std::vector<bpConverterTypesC_UInt16> vData(32 * 32 * 4, 7);
+  bpConverterTypesC_Index5D vBlockIndex = { 0, 0, 0, 0, 0 };
+  bpImageConverterC_CopyBlockUInt16(vConverter, vData.data(), &vBlockIndex);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+
+  bpConverterTypesC_TimeInfo vTimeInfo = { 2458885, 0 };
+  bpConverterTypesC_TimeInfos vTimeInfos = { &vTimeInfo, 1 };
+  bpConverterTypesC_ColorInfo vColorInfo = { true, { 1, 1, 1, 1 }, nullptr, 0, 1, 0, 255, 1 };
+  bpConverterTypesC_ColorInfos vColorInfos = { &vColorInfo, 1 };
+  bpImageConverterC_Finish(vConverter, nullptr, nullptr, &vTimeInfos, &vColorInfos, false);
+  BP_CHECK(bpImageConverterC_GetLastException(vConverter) == nullptr);
+  bpImageConverterC_Destroy(vConverter);
+}
+
+
+int main()
+{
+  TestNoConverter();
+  TestConverter();
+  TestOptionsVersion();
+  return bpTestFailures();
+}
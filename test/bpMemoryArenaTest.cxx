@@ -0,0 +1,137 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../writer/bpMemoryArena.h"
+
+#include "bpTest.h"
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+static const bpSize HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+struct cAllocation
+{
+  bpUInt8* mData;
+  bpSize mBytes;
+  bpUInt8 mValue;
+};
+
+
+static bool IsFilled(const cAllocation& aAllocation)
+{
+  for (bpSize vIndex = 0; vIndex < aAllocation.mBytes; ++vIndex) {
+    if (aAllocation.mData[vIndex] != static_cast<bpUInt8>(aAllocation.mValue + vIndex)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static cAllocation Allocate(bpMemoryArena& aArena, bpSize aBytes, bpUInt8 aValue)
+{
+  cAllocation vAllocation = { static_cast<bpUInt8*>(aArena.Allocate(aBytes)), aBytes, aValue };
+  for (bpSize vIndex = 0; vIndex < aBytes; ++vIndex) {
+    vAllocation.mData[vIndex] = static_cast<bpUInt8>(aValue + vIndex);
+  }
+  return vAllocation;
+}
+
+
+// small and large blocks of many sizes, freed in random order, keep their data and alignment
+static void TestAllocateFree()
+{
+  std::mt19937 vRandom(17);
+  bpMemoryArena vArena;
+  std::vector<cAllocation> vAllocations;
+  for (bpSize vRound = 0; vRound < 400; ++vRound) {
+    if (vAllocations.empty() || vRandom() % 3 != 0) {
+      bpSize vBytes = vRandom() % 2 == 0 ? vRandom() % 60000 : 64 * 1024 + vRandom() % (3 * HUGE_PAGE_BYTES);
+      cAllocation vAllocation = Allocate(vArena, vBytes, static_cast<bpUInt8>(vRound));
+      std::uintptr_t vAddress = reinterpret_cast<std::uintptr_t>(vAllocation.mData);
+      BP_CHECK_EQUAL(std::uintptr_t(0), vAddress % (vBytes < 64 * 1024 ? 64 : 64 * 1024));
+      vAllocations.push_back(vAllocation);
+    }
+    else {
+      std::swap(vAllocations[vRandom() % vAllocations.size()], vAllocations.back());
+      BP_CHECK(IsFilled(vAllocations.back()));
+      vArena.Free(vAllocations.back().mData, vAllocations.back().mBytes);
+      vAllocations.pop_back();
+    }
+  }
+  for (const cAllocation& vAllocation : vAllocations) {
+    BP_CHECK(IsFilled(vAllocation));
+    vArena.Free(vAllocation.mData, vAllocation.mBytes);
+  }
+}
+
+
+#ifdef __linux__
+static bool IsResident(const bpUInt8* aData, bpSize aBytes)
+{
+  bpSize vPageBytes = static_cast<bpSize>(sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> vResident((aBytes + vPageBytes - 1) / vPageBytes);
+  if (mincore(const_cast<bpUInt8*>(aData), aBytes, vResident.data()) != 0) {
+    return false;
+  }
+  for (unsigned char vPage : vResident) {
+    if ((vPage & 1) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// a freed block keeps its memory until all blocks of its huge page are freed
+static void TestReleaseHugePages()
+{
+  const bpSize vBytes = 1024 * 1024;
+  bpMemoryArena vArena;
+  // the last block keeps the region mapped
+  std::vector<cAllocation> vAllocations;
+  for (bpSize vIndex = 0; vIndex < 5; ++vIndex) {
+    vAllocations.push_back(Allocate(vArena, vBytes, static_cast<bpUInt8>(vIndex)));
+  }
+  for (bpSize vIndex = 0; vIndex + 1 < vAllocations.size(); ++vIndex) {
+    vArena.Free(vAllocations[vIndex].mData, vBytes);
+    std::uintptr_t vPage = reinterpret_cast<std::uintptr_t>(vAllocations[vIndex].mData) / HUGE_PAGE_BYTES;
+    bool vIsPageUsed = false;
+    for (bpSize vOther = vIndex + 1; vOther < vAllocations.size(); ++vOther) {
+      vIsPageUsed = vIsPageUsed || reinterpret_cast<std::uintptr_t>(vAllocations[vOther].mData) / HUGE_PAGE_BYTES == vPage;
+      BP_CHECK(IsFilled(vAllocations[vOther]));
+    }
+    BP_CHECK_EQUAL(vIsPageUsed, IsResident(vAllocations[vIndex].mData, vBytes));
+  }
+  vArena.Free(vAllocations.back().mData, vBytes);
+}
+#endif
+
+
+int main()
+{
+  TestAllocateFree();
+#ifdef __linux__
+  TestReleaseHugePages();
+#endif
+  return bpTestFailures();
+}
@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+#include "bpTestImsFile.h"
+
+#include <iostream>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+// a hash of the position, nothing to compress
+static bpUInt8 GetNoiseVoxel(bpSize aX, bpSize aY, bpSize aZ)
+{
+  bpUInt32 vHash = static_cast<bpUInt32>(aX * 73856093 ^ aY * 19349663 ^ aZ * 83492791);
+  vHash ^= vHash >> 13;
+  vHash *= 0x5bd1e995;
+  return static_cast<bpUInt8>(vHash ^ (vHash >> 15));
+}
+
+// long runs of equal voxels
+static bpUInt8 GetRunsVoxel(bpSize aX, bpSize aY, bpSize aZ)
+{
+  return static_cast<bpUInt8>(aX / 100 + aY * 3 + aZ * 7);
+}
+
+// the planes are copied one at a time, all memory blocks of a slab are partially filled at once
+static const bpVec3 IMAGE_SIZE = { 512, 384, 40 };
+
+
+// the peak of the memory held by blocks while copying
+template<typename TGetVoxel>
+static bpSize Write(const bpString& aOutputFile, const cOptions& aOptions, TGetVoxel aGetVoxel)
+{
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, tSize5D(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, IMAGE_SIZE[2], C, 1, T, 1), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, 1, C, 1, T, 1), aOutputFile, aOptions, "bpMemoryBudgetTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  std::vector<bpUInt8> vPlane(IMAGE_SIZE[0] * IMAGE_SIZE[1]);
+  for (bpSize vZ = 0; vZ < IMAGE_SIZE[2]; ++vZ) {
+    for (bpSize vY = 0; vY < IMAGE_SIZE[1]; ++vY) {
+      for (bpSize vX = 0; vX < IMAGE_SIZE[0]; ++vX) {
+        vPlane[vY * IMAGE_SIZE[0] + vX] = aGetVoxel(vX, vY, vZ);
+      }
+    }
+    vConverter.CopyBlock(vPlane.data(), tIndex5D(X, 0, Y, 0, Z, vZ, C, 0, T, 0));
+  }
+  bpSize vPeakMemoryBytes = vConverter.GetQueueStatus().mPeakMemoryBytes;
+
+  cImageExtent vImageExtent = { 0, 0, 0, static_cast<bpFloat>(IMAGE_SIZE[0]), static_cast<bpFloat>(IMAGE_SIZE[1]), static_cast<bpFloat>(IMAGE_SIZE[2]) };
+  tTimeInfoVector vTimeInfos(1);
+  tColorInfoVector vColorInfos(1);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+  std::cout << aOutputFile << ": peak " << vPeakMemoryBytes << " bytes" << std::endl;
+  return vPeakMemoryBytes;
+}
+
+
+template<typename TGetVoxel>
+static void Check(const bpString& aOutputFile, TGetVoxel aGetVoxel)
+{
+  hid_t vFile = H5Fopen(aOutputFile.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vFile >= 0);
+  if (vFile < 0) {
+    return;
+  }
+  BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, 0, 0, IMAGE_SIZE, aGetVoxel));
+  BP_CHECK(bpTestReadHistogram(vFile, 0, 0, 0) == bpTestGetHistogramUInt8(IMAGE_SIZE, aGetVoxel));
+  H5Fclose(vFile);
+}
+
+
+int main()
+{
+  cOptions vOptions;
+  bpSize vUnlimitedPeak = Write("bpMemoryBudgetTest.ims", vOptions, GetNoiseVoxel);
+  Check("bpMemoryBudgetTest.ims", GetNoiseVoxel);
+
+  // a soft limit, the partially filled blocks stay in RAM if there is nowhere to move them
+  vOptions.mMaxMemoryBytes = vUnlimitedPeak / 8;
+  bpSize vLimitedPeak = Write("bpMemoryBudgetTestLimited.ims", vOptions, GetNoiseVoxel);
+  Check("bpMemoryBudgetTestLimited.ims", GetNoiseVoxel);
+  BP_CHECK(vLimitedPeak < vUnlimitedPeak);
+
+  // the idle blocks move to the scratch file, and back to RAM once there is room for them
+  vOptions.mScratchDirectory = ".";
+  Write("bpMemoryBudgetTestScratch.ims", vOptions, GetNoiseVoxel);
+  Check("bpMemoryBudgetTestScratch.ims", GetNoiseVoxel);
+
+  // the idle blocks are compressed in RAM and decompressed for the next plane
+  vOptions.mScratchDirectory.clear();
+  Write("bpMemoryBudgetTestCompressed.ims", vOptions, GetRunsVoxel);
+  Check("bpMemoryBudgetTestCompressed.ims", GetRunsVoxel);
+  return bpTestFailures();
+}
@@ -0,0 +1,119 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../writer/bpResampleKernels.h"
+
+#include "bpTest.h"
+
+#include <limits>
+#include <random>
+#include <vector>
+
+
+// mean of the values, rounded down for integers
+template<typename TDataType>
+static TDataType AverageReference(const std::vector<TDataType>& aValues)
+{
+  bpUInt64 vSum = 0;
+  for (TDataType vValue : aValues) {
+    vSum += vValue;
+  }
+  return static_cast<TDataType>(vSum / aValues.size());
+}
+
+// summed in the order of the rows, as documented for bpDownsampleRows
+template<>
+bpFloat AverageReference(const std::vector<bpFloat>& aValues)
+{
+  bpFloat vSum = 0;
+  for (bpFloat vValue : aValues) {
+    vSum += vValue;
+  }
+  return vSum / static_cast<bpFloat>(aValues.size());
+}
+
+
+template<typename TDataType>
+static TDataType GetRandomValue(std::mt19937& aRandom)
+{
+  // the maximum often, to check that the sums do not overflow
+  if (aRandom() % 4 == 0) {
+    return std::numeric_limits<TDataType>::max();
+  }
+  return static_cast<TDataType>(aRandom());
+}
+
+template<>
+bpFloat GetRandomValue(std::mt19937& aRandom)
+{
+  return std::uniform_real_distribution<bpFloat>(-1000.0f, 1000.0f)(aRandom);
+}
+
+
+template<typename TDataType, bpSize StrideX>
+static void TestDownsampleRows(bpSize aNumberOfRows)
+{
+  std::mt19937 vRandom(21);
+  // whole vectors of every kernel and a rest for the scalar loop
+  const bpSize vMaxCount = 75;
+  std::vector<std::vector<TDataType>> vRows(aNumberOfRows, std::vector<TDataType>(vMaxCount * StrideX));
+  std::vector<const TDataType*> vRowPointers;
+  for (std::vector<TDataType>& vRow : vRows) {
+    for (TDataType& vValue : vRow) {
+      vValue = GetRandomValue<TDataType>(vRandom);
+    }
+    vRowPointers.push_back(vRow.data());
+  }
+
+  for (bpSize vCount = 0; vCount <= vMaxCount; ++vCount) {
+    // one guard value behind the destination
+    std::vector<TDataType> vDest(vCount + 1, 123);
+    bpDownsampleRows<TDataType, StrideX>(vRowPointers.data(), aNumberOfRows, vCount, vDest.data());
+    bool vIsEqual = true;
+    for (bpSize vIndex = 0; vIndex < vCount; ++vIndex) {
+      std::vector<TDataType> vValues;
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        for (bpSize vOffsetX = 0; vOffsetX < StrideX; ++vOffsetX) {
+          vValues.push_back(vRows[vRow][vIndex * StrideX + vOffsetX]);
+        }
+      }
+      vIsEqual = vIsEqual && vDest[vIndex] == AverageReference(vValues);
+    }
+    BP_CHECK(vIsEqual);
+    BP_CHECK_EQUAL(TDataType(123), vDest[vCount]);
+  }
+}
+
+
+template<typename TDataType>
+static void TestDownsampleRows()
+{
+  for (bpSize vNumberOfRows : { 1, 2, 4, 8 }) {
+    TestDownsampleRows<TDataType, 1>(vNumberOfRows);
+  }
+  for (bpSize vNumberOfRows : { 1, 2, 4 }) {
+    TestDownsampleRows<TDataType, 2>(vNumberOfRows);
+  }
+}
+
+
+int main()
+{
+  TestDownsampleRows<bpUInt8>();
+  TestDownsampleRows<bpUInt16>();
+  TestDownsampleRows<bpUInt32>();
+  TestDownsampleRows<bpFloat>();
+  return bpTestFailures();
+}
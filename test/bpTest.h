@@ -0,0 +1,46 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_TEST__
+#define __BP_TEST__
+
+#include <iostream>
+
+
+// number of failed checks, main returns it
+inline int& bpTestFailures()
+{
+  static int vFailures = 0;
+  return vFailures;
+}
+
+#define BP_CHECK(aCondition) \
+  do { \
+    if (!(aCondition)) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #aCondition << std::endl; \
+      ++bpTestFailures(); \
+    } \
+  } while (false)
+
+#define BP_CHECK_EQUAL(aExpected, aActual) \
+  do { \
+    if (!((aExpected) == (aActual))) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #aExpected << " == " << #aActual \
+                << " (" << (aExpected) << " != " << (aActual) << ")" << std::endl; \
+      ++bpTestFailures(); \
+    } \
+  } while (false)
+
+#endif // __BP_TEST__
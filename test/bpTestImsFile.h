@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_TEST_IMS_FILE__
+#define __BP_TEST_IMS_FILE__
+
+#include "../interface/bpConverterTypes.h"
+
+#include <hdf5.h>
+
+#include <string>
+#include <vector>
+
+
+template<typename TDataType>
+hid_t bpTestGetH5Type();
+
+template<>
+inline hid_t bpTestGetH5Type<bpUInt8>()
+{
+  return H5T_NATIVE_UCHAR;
+}
+
+template<>
+inline hid_t bpTestGetH5Type<bpUInt16>()
+{
+  return H5T_NATIVE_USHORT;
+}
+
+template<>
+inline hid_t bpTestGetH5Type<bpUInt32>()
+{
+  return H5T_NATIVE_UINT;
+}
+
+template<>
+inline hid_t bpTestGetH5Type<bpFloat>()
+{
+  return H5T_NATIVE_FLOAT;
+}
+
+template<>
+inline hid_t bpTestGetH5Type<bpUInt64>()
+{
+  return H5T_NATIVE_UINT64;
+}
+
+
+inline bpString bpTestGetChannelGroup(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC)
+{
+  return "/DataSet/ResolutionLevel " + std::to_string(aIndexR) + "/TimePoint " + std::to_string(aIndexT) + "/Channel " + std::to_string(aIndexC);
+}
+
+
+/**
+* The values of a dataset in file order, empty if there is none. aSize gets the size of each dimension, the
+* voxel data is Z, Y, X (padded to the chunk size).
+*/
+template<typename TDataType>
+std::vector<TDataType> bpTestReadDataset(hid_t aFile, const bpString& aName, std::vector<bpSize>* aSize = nullptr)
+{
+  if (H5Lexists(aFile, aName.c_str(), H5P_DEFAULT) <= 0) {
+    return{};
+  }
+  hid_t vDataset = H5Dopen2(aFile, aName.c_str(), H5P_DEFAULT);
+  hid_t vSpace = H5Dget_space(vDataset);
+  if (aSize) {
+    std::vector<hsize_t> vDims(static_cast<bpSize>(H5Sget_simple_extent_ndims(vSpace)));
+    H5Sget_simple_extent_dims(vSpace, vDims.data(), nullptr);
+    aSize->assign(vDims.begin(), vDims.end());
+  }
+  std::vector<TDataType> vData(static_cast<bpSize>(H5Sget_simple_extent_npoints(vSpace)));
+  H5Dread(vDataset, bpTestGetH5Type<TDataType>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, vData.data());
+  H5Sclose(vSpace);
+  H5Dclose(vDataset);
+  return vData;
+}
+
+
+/**
+* Whether the voxels of a channel match aGetVoxel(x, y, z) inside the image size (the padding is not checked).
+*/
+template<typename TDataType, typename TGetVoxel>
+bool bpTestIsDataEqual(hid_t aFile, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpVec3& aImageSize, TGetVoxel aGetVoxel)
+{
+  std::vector<bpSize> vSize;
+  std::vector<TDataType> vData = bpTestReadDataset<TDataType>(aFile, bpTestGetChannelGroup(aIndexR, aIndexT, aIndexC) + "/Data", &vSize);
+  if (vData.empty() || vSize.size() != 3 || vSize[0] < aImageSize[2] || vSize[1] < aImageSize[1] || vSize[2] < aImageSize[0]) {
+    return false;
+  }
+  for (bpSize vZ = 0; vZ < aImageSize[2]; ++vZ) {
+    for (bpSize vY = 0; vY < aImageSize[1]; ++vY) {
+      for (bpSize vX = 0; vX < aImageSize[0]; ++vX) {
+        if (!(vData[(vZ * vSize[1] + vY) * vSize[2] + vX] == aGetVoxel(vX, vY, vZ))) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+// the 256 bin histogram of a channel, empty if there is none
+inline std::vector<bpUInt64> bpTestReadHistogram(hid_t aFile, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC)
+{
+  return bpTestReadDataset<bpUInt64>(aFile, bpTestGetChannelGroup(aIndexR, aIndexT, aIndexC) + "/Histogram");
+}
+
+
+// the histogram of 8 bit voxels aGetVoxel(x, y, z)
+template<typename TGetVoxel>
+std::vector<bpUInt64> bpTestGetHistogramUInt8(const bpVec3& aImageSize, TGetVoxel aGetVoxel)
+{
+  std::vector<bpUInt64> vBins(256);
+  for (bpSize vZ = 0; vZ < aImageSize[2]; ++vZ) {
+    for (bpSize vY = 0; vY < aImageSize[1]; ++vY) {
+      for (bpSize vX = 0; vX < aImageSize[0]; ++vX) {
+        ++vBins[static_cast<bpUInt8>(aGetVoxel(vX, vY, vZ))];
+      }
+    }
+  }
+  return vBins;
+}
+
+#endif // __BP_TEST_IMS_FILE__
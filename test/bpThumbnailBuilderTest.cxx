@@ -0,0 +1,152 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../writer/bpThumbnailBuilder.h"
+
+#include "bpTest.h"
+
+#include <algorithm>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+static bpUInt8 GetVoxel(bpSize aX, bpSize aY, bpSize aZ, bpSize aC)
+{
+  return static_cast<bpUInt8>(aX * 3 + aY * 5 + aZ * 11 + aC * 40);
+}
+
+static const bpSize SIZE_C = 2;
+static const bpSize THUMBNAIL_SIZE_XY = 100;
+
+
+static std::vector<cColorInfo> GetColors()
+{
+  std::vector<cColorInfo> vColors(SIZE_C);
+  vColors[0].mBaseColor = cColor{ 1, 0, 0, 1 };
+  vColors[1].mBaseColor = cColor{ 0, 1, 0.5f, 1 };
+  vColors[1].mRangeMin = 20;
+  vColors[1].mRangeMax = 200;
+  vColors[1].mGammaCorrection = 1.5f;
+  return vColors;
+}
+
+
+// the maximum projection or the middle slice, sampled and colorized one voxel at a time
+static bpThumbnail GetReference(const bpVec3& aImageSize, const cImageExtent& aExtent, bool aIsMIP)
+{
+  bpFloatVec3 vExtents{ aExtent.mExtentMaxX - aExtent.mExtentMinX, aExtent.mExtentMaxY - aExtent.mExtentMinY, aExtent.mExtentMaxZ - aExtent.mExtentMinZ };
+  std::pair<bpSize, bpSize> vSizeXY = bpComputeThumbnailSizeXY(THUMBNAIL_SIZE_XY, aImageSize, vExtents);
+  std::vector<cColorInfo> vColors = GetColors();
+  std::vector<bpUInt8> vRGBA(vSizeXY.first * vSizeXY.second * 4);
+  for (bpSize vIndexY = 0; vIndexY < vSizeXY.second; ++vIndexY) {
+    for (bpSize vIndexX = 0; vIndexX < vSizeXY.first; ++vIndexX) {
+      bpSize vX = vIndexX * aImageSize[0] / vSizeXY.first;
+      bpSize vY = vIndexY * aImageSize[1] / vSizeXY.second;
+      for (bpSize vC = 0; vC < SIZE_C; ++vC) {
+        bpUInt8 vValue = GetVoxel(vX, vY, aImageSize[2] / 2, vC);
+        if (aIsMIP) {
+          vValue = 0;
+          for (bpSize vZ = 0; vZ < aImageSize[2]; ++vZ) {
+            vValue = std::max(vValue, GetVoxel(vX, vY, vZ, vC));
+          }
+        }
+        cColor vColor = vColors[vC].GetColor(vValue);
+        bpUInt8* vPixel = &vRGBA[(vIndexX + vIndexY * vSizeXY.first) * 4];
+        vPixel[0] = std::max(vPixel[0], static_cast<bpUInt8>(vColor.mRed * 255));
+        vPixel[1] = std::max(vPixel[1], static_cast<bpUInt8>(vColor.mGreen * 255));
+        vPixel[2] = std::max(vPixel[2], static_cast<bpUInt8>(vColor.mBlue * 255));
+        vPixel[3] = std::max(vPixel[3], static_cast<bpUInt8>(vColor.mAlpha * 255));
+      }
+    }
+  }
+  return bpThumbnail(vSizeXY.first, vSizeXY.second, vRGBA);
+}
+
+static bool IsEqual(const bpThumbnail& aThumbnail, const bpThumbnail& aOther)
+{
+  if (aThumbnail.GetSizeX() != aOther.GetSizeX() || aThumbnail.GetSizeY() != aOther.GetSizeY()) {
+    return false;
+  }
+  bpSize vBytes = aThumbnail.GetSizeX() * aThumbnail.GetSizeY() * 4;
+  return std::equal(aThumbnail.GetRGBAPointer(), aThumbnail.GetRGBAPointer() + vBytes, aOther.GetRGBAPointer());
+}
+
+
+// adds the blocks of every resolution and two time points in bands of rows, only time point 0 of the thumbnail resolution counts
+static void Test(const std::vector<bpVec3>& aResolutionSizes, const std::vector<bpVec3>& aBlockSizes, const cImageExtent& aExtent)
+{
+  bpThumbnailBuilder<bpUInt8> vBuilder(THUMBNAIL_SIZE_XY, aResolutionSizes, aBlockSizes, SIZE_C);
+  bpSize vIndexR = bpComputeThumbnailIndexR(THUMBNAIL_SIZE_XY, aResolutionSizes);
+  const bpSize vBandSizeY = 8;
+  const bpSize vBandSizeZ = 2;
+  for (bpSize vT = 0; vT < 2; ++vT) {
+    for (bpSize vR = 0; vR < aResolutionSizes.size(); ++vR) {
+      const bpVec3& vSize = aResolutionSizes[vR];
+      const bpVec3& vBlockSize = aBlockSizes[vR];
+      bool vIsThumbnail = vT == 0 && vR == vIndexR;
+      std::vector<bpUInt8> vBlock(vBlockSize[0] * vBlockSize[1] * vBlockSize[2]);
+      bpConstMemoryBlock<bpUInt8> vData(vBlock.data(), vBlock.size(), [] {});
+      // the last block first, the result does not depend on the order
+      for (bpSize vBlockZ = (vSize[2] + vBlockSize[2] - 1) / vBlockSize[2]; vBlockZ-- > 0;) {
+        for (bpSize vBlockY = (vSize[1] + vBlockSize[1] - 1) / vBlockSize[1]; vBlockY-- > 0;) {
+          for (bpSize vBlockX = (vSize[0] + vBlockSize[0] - 1) / vBlockSize[0]; vBlockX-- > 0;) {
+            for (bpSize vC = 0; vC < SIZE_C; ++vC) {
+              for (bpSize vZ = 0; vZ < vBlockSize[2]; ++vZ) {
+                for (bpSize vY = 0; vY < vBlockSize[1]; ++vY) {
+                  for (bpSize vX = 0; vX < vBlockSize[0]; ++vX) {
+                    bpSize vIndexX = vBlockX * vBlockSize[0] + vX;
+                    bpSize vIndexY = vBlockY * vBlockSize[1] + vY;
+                    bpSize vIndexZ = vBlockZ * vBlockSize[2] + vZ;
+                    bool vIsInside = vIndexX < vSize[0] && vIndexY < vSize[1] && vIndexZ < vSize[2];
+                    // the padding and the other blocks would be brighter than the image
+                    vBlock[(vZ * vBlockSize[1] + vY) * vBlockSize[0] + vX] = vIsThumbnail && vIsInside ? GetVoxel(vIndexX, vIndexY, vIndexZ, vC) : 255;
+                  }
+                }
+              }
+              for (bpSize vBeginZ = 0; vBeginZ < vBlockSize[2]; vBeginZ += vBandSizeZ) {
+                for (bpSize vBeginY = 0; vBeginY < vBlockSize[1]; vBeginY += vBandSizeY) {
+                  vBuilder.AddDataRows(vData, vBlockX, vBlockY, vBlockZ, vT, vC, vR, { vBeginY, vBeginZ }, { vBeginY + vBandSizeY, vBeginZ + vBandSizeZ });
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  const bpVec3& vImageSize = aResolutionSizes[vIndexR];
+  bpThumbnail vMIP = GetReference(vImageSize, aExtent, true);
+  bpThumbnail vMiddle = GetReference(vImageSize, aExtent, false);
+  bpThumbnail vExpected = bpComputeThumbnailQuality(vMIP) > bpComputeThumbnailQuality(vMiddle) ? vMIP : vMiddle;
+  BP_CHECK(IsEqual(vExpected, vBuilder.CreateThumbnail(GetColors(), aExtent)));
+}
+
+
+int main()
+{
+  // the second resolution is the smallest that is at least the thumbnail size
+  std::vector<bpVec3> vResolutionSizes = { { 300, 210, 9 }, { 150, 105, 9 }, { 75, 52, 9 } };
+  std::vector<bpVec3> vBlockSizes = { { 64, 64, 4 }, { 32, 32, 4 }, { 32, 32, 4 } };
+  Test(vResolutionSizes, vBlockSizes, { 0, 0, 0, 300, 210, 9 });
+  // anisotropic voxels
+  Test(vResolutionSizes, vBlockSizes, { 0, 0, 0, 300, 420, 9 });
+
+  // a single slice is its own projection
+  Test({ { 130, 110, 1 } }, { { 32, 32, 1 } }, { 0, 0, 0, 130, 110, 1 });
+  return bpTestFailures();
+}
@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "../interface/bpImageConverter.h"
+
+#include "bpTest.h"
+#include "bpTestImsFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+using namespace bpConverterTypes;
+
+
+// the value tile aTileIndex has at a voxel of the image
+static bpUInt8 GetTileVoxel(bpSize aX, bpSize aY, bpSize aZ, bpSize aTileIndex)
+{
+  return static_cast<bpUInt8>(aX * 7 + aY * 13 + aZ * 31 + aTileIndex * 50);
+}
+
+// the tiles cover the lower X and Y of time point 0 only, time point 1 is all gaps
+static const bpVec3 IMAGE_SIZE = { 200, 150, 10 };
+static const bpSize SIZE_T = 2;
+
+
+static tTileVector GetTiles()
+{
+  tTileVector vTiles;
+  vTiles.push_back({ tIndex5D(X, 0, Y, 0, Z, 0, C, 0, T, 0), tSize5D(X, 70, Y, 60, Z, 10, C, 1, T, 1) });
+  vTiles.push_back({ tIndex5D(X, 50, Y, 0, Z, 0, C, 0, T, 0), tSize5D(X, 60, Y, 60, Z, 10, C, 1, T, 1) });
+  vTiles.push_back({ tIndex5D(X, 0, Y, 40, Z, 0, C, 0, T, 0), tSize5D(X, 110, Y, 50, Z, 10, C, 1, T, 1) });
+  // inside tile 0, but not in all slices
+  vTiles.push_back({ tIndex5D(X, 20, Y, 10, Z, 2, C, 0, T, 0), tSize5D(X, 30, Y, 30, Z, 5, C, 1, T, 1) });
+  return vTiles;
+}
+
+static bool IsInside(const cTile& aTile, bpSize aX, bpSize aY, bpSize aZ)
+{
+  return aX >= aTile.mOffset[X] && aX < aTile.mOffset[X] + aTile.mSize[X] &&
+    aY >= aTile.mOffset[Y] && aY < aTile.mOffset[Y] + aTile.mSize[Y] &&
+    aZ >= aTile.mOffset[Z] && aZ < aTile.mOffset[Z] + aTile.mSize[Z];
+}
+
+// the expected voxel of time point 0, resolving the overlaps one voxel at a time
+static bpUInt8 GetVoxel(const tTileVector& aTiles, tOverlapPolicy aPolicy, bpSize aX, bpSize aY, bpSize aZ)
+{
+  std::vector<bpSize> vCovering;
+  for (bpSize vTileIndex = 0; vTileIndex < aTiles.size(); ++vTileIndex) {
+    if (IsInside(aTiles[vTileIndex], aX, aY, aZ)) {
+      vCovering.push_back(vTileIndex);
+    }
+  }
+  if (vCovering.empty()) {
+    return 0;
+  }
+  if (aPolicy == eOverlapFirstWins) {
+    return GetTileVoxel(aX, aY, aZ, vCovering.front());
+  }
+  if (aPolicy == eOverlapLastWins || vCovering.size() == 1) {
+    return GetTileVoxel(aX, aY, aZ, vCovering.back());
+  }
+  bpDouble vSum = 0;
+  bpDouble vWeights = 0;
+  for (bpSize vTileIndex : vCovering) {
+    const cTile& vTile = aTiles[vTileIndex];
+    bpSize vDistance = std::min(
+      std::min(aX - vTile.mOffset[X], vTile.mOffset[X] + vTile.mSize[X] - 1 - aX),
+      std::min(aY - vTile.mOffset[Y], vTile.mOffset[Y] + vTile.mSize[Y] - 1 - aY));
+    bpDouble vWeight = static_cast<bpDouble>(vDistance + 1);
+    vSum += vWeight * GetTileVoxel(aX, aY, aZ, vTileIndex);
+    vWeights += vWeight;
+  }
+  return static_cast<bpUInt8>(std::floor(vSum / vWeights + 0.5));
+}
+
+
+static void Write(const bpString& aOutputFile, tOverlapPolicy aPolicy)
+{
+  bpImageConverter<bpUInt8> vConverter(bpUInt8Type, tSize5D(X, IMAGE_SIZE[0], Y, IMAGE_SIZE[1], Z, IMAGE_SIZE[2], C, 1, T, SIZE_T), tSize5D(X, 1, Y, 1, Z, 1, C, 1, T, 1),
+    tDimensionSequence5D(X, Y, Z, C, T), tSize5D(X, 32, Y, 32, Z, 8, C, 1, T, 1), aOutputFile, cOptions(), "bpTileTest", "1.0", [](bpFloat, bpUInt64) {});
+
+  tTileVector vTiles = GetTiles();
+  vConverter.SetTiles(vTiles, aPolicy);
+  // the result does not depend on the order the tiles are copied in
+  for (bpSize vTileIndex = vTiles.size(); vTileIndex-- > 0;) {
+    const cTile& vTile = vTiles[vTileIndex];
+    std::vector<bpUInt8> vData(vTile.mSize[X] * vTile.mSize[Y] * vTile.mSize[Z]);
+    for (bpSize vZ = 0; vZ < vTile.mSize[Z]; ++vZ) {
+      for (bpSize vY = 0; vY < vTile.mSize[Y]; ++vY) {
+        for (bpSize vX = 0; vX < vTile.mSize[X]; ++vX) {
+          vData[(vZ * vTile.mSize[Y] + vY) * vTile.mSize[X] + vX] = GetTileVoxel(vTile.mOffset[X] + vX, vTile.mOffset[Y] + vY, vTile.mOffset[Z] + vZ, vTileIndex);
+        }
+      }
+    }
+    vConverter.CopyTile(vData.data(), vTileIndex);
+  }
+
+  cImageExtent vImageExtent = { 0, 0, 0, static_cast<bpFloat>(IMAGE_SIZE[0]), static_cast<bpFloat>(IMAGE_SIZE[1]), static_cast<bpFloat>(IMAGE_SIZE[2]) };
+  tTimeInfoVector vTimeInfos(SIZE_T);
+  tColorInfoVector vColorInfos(1);
+  vConverter.Finish(vImageExtent, tParameters(), vTimeInfos, vColorInfos, false);
+}
+
+
+static void Check(const bpString& aOutputFile, tOverlapPolicy aPolicy)
+{
+  hid_t vFile = H5Fopen(aOutputFile.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  BP_CHECK(vFile >= 0);
+  if (vFile < 0) {
+    return;
+  }
+  tTileVector vTiles = GetTiles();
+  auto vGetVoxel = [&vTiles, aPolicy](bpSize aX, bpSize aY, bpSize aZ) { return GetVoxel(vTiles, aPolicy, aX, aY, aZ); };
+  BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, 0, 0, IMAGE_SIZE, vGetVoxel));
+  BP_CHECK(bpTestReadHistogram(vFile, 0, 0, 0) == bpTestGetHistogramUInt8(IMAGE_SIZE, vGetVoxel));
+
+  auto vGetZero = [](bpSize, bpSize, bpSize) { return bpUInt8(0); };
+  BP_CHECK(bpTestIsDataEqual<bpUInt8>(vFile, 0, 1, 0, IMAGE_SIZE, vGetZero));
+  BP_CHECK(bpTestReadHistogram(vFile, 0, 1, 0) == bpTestGetHistogramUInt8(IMAGE_SIZE, vGetZero));
+  H5Fclose(vFile);
+}
+
+
+int main()
+{
+  Write("bpTileTestFirstWins.ims", eOverlapFirstWins);
+  Check("bpTileTestFirstWins.ims", eOverlapFirstWins);
+  Write("bpTileTestLastWins.ims", eOverlapLastWins);
+  Check("bpTileTestLastWins.ims", eOverlapLastWins);
+  Write("bpTileTestBlend.ims", eOverlapLinearBlend);
+  Check("bpTileTestBlend.ims", eOverlapLinearBlend);
+  return bpTestFailures();
+}
@@ -0,0 +1,816 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpCopyKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BP_COPY_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define BP_COPY_KERNELS_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define BP_COPY_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+
+template<bpSize NBytes>
+struct cBits;
+
+template<>
+struct cBits<1> { using tType = bpUInt8; };
+
+template<>
+struct cBits<2> { using tType = bpUInt16; };
+
+template<>
+struct cBits<4> { using tType = bpUInt32; };
+
+
+/**
+* Copies whole vectors of TKernel::mWidth values and returns the number of values copied, the caller copies the rest.
+* A kernel with mStep > 1 loads mStep - 1 values past the last one it uses, so the last vector must not contain the last value.
+*/
+template<typename TKernel, typename TBits>
+bpSize CopyVectors(const TBits* aSource, bpSize aCount, TBits* aDest, bool aReverse)
+{
+  const bpSize vWidth = TKernel::mWidth;
+  const bpSize vStep = TKernel::mStep;
+  const bpSize vPadding = vStep > 1 ? 1 : 0;
+  bpSize vIndex = 0;
+  if (!aReverse) {
+    for (; vIndex + vWidth + vPadding <= aCount; vIndex += vWidth) {
+      TKernel::Store(aDest + vIndex, TKernel::Load(aSource + vIndex * vStep));
+    }
+  }
+  else {
+    for (; vIndex + vWidth + vPadding <= aCount; vIndex += vWidth) {
+      TKernel::Store(aDest + aCount - vIndex - vWidth, TKernel::Reverse(TKernel::Load(aSource + vIndex * vStep)));
+    }
+  }
+  return vIndex;
+}
+
+
+#ifdef BP_COPY_KERNELS_SSE2
+
+template<typename TBits>
+struct cSse2Vector
+{
+  static const bpSize mWidth = 16 / sizeof(TBits);
+
+  static __m128i LoadU(const TBits* aSource)
+  {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSource));
+  }
+
+  static void Store(TBits* aDest, __m128i aValues)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest), aValues);
+  }
+
+  static __m128i Reverse(__m128i aValues);
+};
+
+template<>
+inline __m128i cSse2Vector<bpUInt32>::Reverse(__m128i aValues)
+{
+  return _mm_shuffle_epi32(aValues, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+template<>
+inline __m128i cSse2Vector<bpUInt16>::Reverse(__m128i aValues)
+{
+  aValues = _mm_shufflelo_epi16(aValues, _MM_SHUFFLE(0, 1, 2, 3));
+  aValues = _mm_shufflehi_epi16(aValues, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_shuffle_epi32(aValues, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+template<>
+inline __m128i cSse2Vector<bpUInt8>::Reverse(__m128i aValues)
+{
+  // reverse the 16 bit words, then swap the bytes within each word
+  aValues = cSse2Vector<bpUInt16>::Reverse(aValues);
+  return _mm_or_si128(_mm_slli_epi16(aValues, 8), _mm_srli_epi16(aValues, 8));
+}
+
+
+template<typename TBits, bpSize Step>
+struct cSse2Kernel;
+
+template<typename TBits>
+struct cSse2Kernel<TBits, 1> : cSse2Vector<TBits>
+{
+  static const bpSize mStep = 1;
+
+  static __m128i Load(const TBits* aSource)
+  {
+    return cSse2Vector<TBits>::LoadU(aSource);
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt8, 2> : cSse2Vector<bpUInt8>
+{
+  static const bpSize mStep = 2;
+
+  static __m128i Load(const bpUInt8* aSource)
+  {
+    __m128i vMask = _mm_set1_epi16(0xff);
+    __m128i vLow = _mm_and_si128(LoadU(aSource), vMask);
+    __m128i vHigh = _mm_and_si128(LoadU(aSource + 16), vMask);
+    return _mm_packus_epi16(vLow, vHigh);
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt8, 4> : cSse2Vector<bpUInt8>
+{
+  static const bpSize mStep = 4;
+
+  static __m128i Load(const bpUInt8* aSource)
+  {
+    __m128i vMask = _mm_set1_epi32(0xff);
+    __m128i vValues0 = _mm_and_si128(LoadU(aSource), vMask);
+    __m128i vValues1 = _mm_and_si128(LoadU(aSource + 16), vMask);
+    __m128i vValues2 = _mm_and_si128(LoadU(aSource + 32), vMask);
+    __m128i vValues3 = _mm_and_si128(LoadU(aSource + 48), vMask);
+    return _mm_packus_epi16(_mm_packs_epi32(vValues0, vValues1), _mm_packs_epi32(vValues2, vValues3));
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt16, 2> : cSse2Vector<bpUInt16>
+{
+  static const bpSize mStep = 2;
+
+  static __m128i Load(const bpUInt16* aSource)
+  {
+    return PackLow16(LoadU(aSource), LoadU(aSource + 8));
+  }
+
+  // packs the low words of the 32 bit values, sign extending first so that the signed saturation keeps all 16 bits
+  static __m128i PackLow16(__m128i aLow, __m128i aHigh)
+  {
+    aLow = _mm_srai_epi32(_mm_slli_epi32(aLow, 16), 16);
+    aHigh = _mm_srai_epi32(_mm_slli_epi32(aHigh, 16), 16);
+    return _mm_packs_epi32(aLow, aHigh);
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt16, 4> : cSse2Vector<bpUInt16>
+{
+  static const bpSize mStep = 4;
+
+  static __m128i Load(const bpUInt16* aSource)
+  {
+    __m128i vLow = _mm_unpacklo_epi64(LoadFirstWords(aSource), LoadFirstWords(aSource + 8));
+    __m128i vHigh = _mm_unpacklo_epi64(LoadFirstWords(aSource + 16), LoadFirstWords(aSource + 24));
+    return cSse2Kernel<bpUInt16, 2>::PackLow16(vLow, vHigh);
+  }
+
+  // values 0 and 4 in the two low 32 bit lanes
+  static __m128i LoadFirstWords(const bpUInt16* aSource)
+  {
+    __m128i vValues = _mm_srli_epi64(_mm_slli_epi64(LoadU(aSource), 48), 48);
+    return _mm_shuffle_epi32(vValues, _MM_SHUFFLE(3, 1, 2, 0));
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt32, 2> : cSse2Vector<bpUInt32>
+{
+  static const bpSize mStep = 2;
+
+  static __m128i Load(const bpUInt32* aSource)
+  {
+    __m128 vLow = _mm_castsi128_ps(LoadU(aSource));
+    __m128 vHigh = _mm_castsi128_ps(LoadU(aSource + 4));
+    return _mm_castps_si128(_mm_shuffle_ps(vLow, vHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt32, 3> : cSse2Vector<bpUInt32>
+{
+  static const bpSize mStep = 3;
+
+  static __m128i Load(const bpUInt32* aSource)
+  {
+    __m128 vValues0 = _mm_castsi128_ps(LoadU(aSource));
+    __m128 vValues1 = _mm_castsi128_ps(LoadU(aSource + 4));
+    __m128 vValues2 = _mm_castsi128_ps(LoadU(aSource + 8));
+    // values 6 and 9 in lanes 0 and 2
+    __m128 vHigh = _mm_shuffle_ps(vValues1, vValues2, _MM_SHUFFLE(1, 1, 2, 2));
+    return _mm_castps_si128(_mm_shuffle_ps(vValues0, vHigh, _MM_SHUFFLE(2, 0, 3, 0)));
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt32, 4> : cSse2Vector<bpUInt32>
+{
+  static const bpSize mStep = 4;
+
+  static __m128i Load(const bpUInt32* aSource)
+  {
+    __m128 vValues0 = _mm_castsi128_ps(LoadU(aSource));
+    __m128 vValues1 = _mm_castsi128_ps(LoadU(aSource + 4));
+    __m128 vValues2 = _mm_castsi128_ps(LoadU(aSource + 8));
+    __m128 vValues3 = _mm_castsi128_ps(LoadU(aSource + 12));
+    __m128 vLow = _mm_shuffle_ps(vValues0, vValues1, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 vHigh = _mm_shuffle_ps(vValues2, vValues3, _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm_castps_si128(_mm_shuffle_ps(vLow, vHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+  }
+};
+
+#endif // BP_COPY_KERNELS_SSE2
+
+
+#ifdef BP_COPY_KERNELS_SSSE3
+
+template<>
+struct cSse2Kernel<bpUInt8, 3> : cSse2Vector<bpUInt8>
+{
+  static const bpSize mStep = 3;
+
+  static __m128i Load(const bpUInt8* aSource)
+  {
+    const __m128i vShuffle0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i vShuffle1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+    const __m128i vShuffle2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+    __m128i vValues0 = _mm_shuffle_epi8(LoadU(aSource), vShuffle0);
+    __m128i vValues1 = _mm_shuffle_epi8(LoadU(aSource + 16), vShuffle1);
+    __m128i vValues2 = _mm_shuffle_epi8(LoadU(aSource + 32), vShuffle2);
+    return _mm_or_si128(_mm_or_si128(vValues0, vValues1), vValues2);
+  }
+};
+
+template<>
+struct cSse2Kernel<bpUInt16, 3> : cSse2Vector<bpUInt16>
+{
+  static const bpSize mStep = 3;
+
+  static __m128i Load(const bpUInt16* aSource)
+  {
+    const __m128i vShuffle0 = _mm_setr_epi8(0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i vShuffle1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1, -1, -1);
+    const __m128i vShuffle2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, 10, 11);
+    __m128i vValues0 = _mm_shuffle_epi8(LoadU(aSource), vShuffle0);
+    __m128i vValues1 = _mm_shuffle_epi8(LoadU(aSource + 8), vShuffle1);
+    __m128i vValues2 = _mm_shuffle_epi8(LoadU(aSource + 16), vShuffle2);
+    return _mm_or_si128(_mm_or_si128(vValues0, vValues1), vValues2);
+  }
+};
+
+#endif // BP_COPY_KERNELS_SSSE3
+
+
+#ifdef BP_COPY_KERNELS_AVX2
+
+template<typename TBits>
+struct cAvx2Vector
+{
+  static const bpSize mWidth = 32 / sizeof(TBits);
+
+  static __m256i LoadU(const TBits* aSource)
+  {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSource));
+  }
+
+  static void Store(TBits* aDest, __m256i aValues)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDest), aValues);
+  }
+
+  static __m256i Reverse(__m256i aValues);
+};
+
+template<>
+inline __m256i cAvx2Vector<bpUInt32>::Reverse(__m256i aValues)
+{
+  return _mm256_permutevar8x32_epi32(aValues, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+template<>
+inline __m256i cAvx2Vector<bpUInt16>::Reverse(__m256i aValues)
+{
+  const __m256i vShuffle = _mm256_setr_epi8(
+    14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+    14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(aValues, vShuffle), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+template<>
+inline __m256i cAvx2Vector<bpUInt8>::Reverse(__m256i aValues)
+{
+  const __m256i vShuffle = _mm256_setr_epi8(
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(aValues, vShuffle), _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+
+template<typename TBits, bpSize Step>
+struct cAvx2Kernel;
+
+template<typename TBits>
+struct cAvx2Kernel<TBits, 1> : cAvx2Vector<TBits>
+{
+  static const bpSize mStep = 1;
+
+  static __m256i Load(const TBits* aSource)
+  {
+    return cAvx2Vector<TBits>::LoadU(aSource);
+  }
+};
+
+// the 256 bit packs and shuffles work per 128 bit lane, the final permute restores the order of the 64 bit quarters
+template<>
+struct cAvx2Kernel<bpUInt8, 2> : cAvx2Vector<bpUInt8>
+{
+  static const bpSize mStep = 2;
+
+  static __m256i Load(const bpUInt8* aSource)
+  {
+    __m256i vMask = _mm256_set1_epi16(0xff);
+    __m256i vLow = _mm256_and_si256(LoadU(aSource), vMask);
+    __m256i vHigh = _mm256_and_si256(LoadU(aSource + 32), vMask);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(vLow, vHigh), _MM_SHUFFLE(3, 1, 2, 0));
+  }
+};
+
+template<>
+struct cAvx2Kernel<bpUInt16, 2> : cAvx2Vector<bpUInt16>
+{
+  static const bpSize mStep = 2;
+
+  static __m256i Load(const bpUInt16* aSource)
+  {
+    __m256i vMask = _mm256_set1_epi32(0xffff);
+    __m256i vLow = _mm256_and_si256(LoadU(aSource), vMask);
+    __m256i vHigh = _mm256_and_si256(LoadU(aSource + 16), vMask);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(vLow, vHigh), _MM_SHUFFLE(3, 1, 2, 0));
+  }
+};
+
+template<>
+struct cAvx2Kernel<bpUInt32, 2> : cAvx2Vector<bpUInt32>
+{
+  static const bpSize mStep = 2;
+
+  static __m256i Load(const bpUInt32* aSource)
+  {
+    __m256 vLow = _mm256_castsi256_ps(LoadU(aSource));
+    __m256 vHigh = _mm256_castsi256_ps(LoadU(aSource + 8));
+    __m256i vValues = _mm256_castps_si256(_mm256_shuffle_ps(vLow, vHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+    return _mm256_permute4x64_epi64(vValues, _MM_SHUFFLE(3, 1, 2, 0));
+  }
+};
+
+#endif // BP_COPY_KERNELS_AVX2
+
+
+template<typename TBits>
+bpSize CopyStep3Vectors(const TBits* /*aSource*/, bpSize /*aCount*/, TBits* /*aDest*/, bool /*aReverse*/)
+{
+  return 0;
+}
+
+#ifdef BP_COPY_KERNELS_SSE2
+bpSize CopyStep3Vectors(const bpUInt32* aSource, bpSize aCount, bpUInt32* aDest, bool aReverse)
+{
+  return CopyVectors<cSse2Kernel<bpUInt32, 3>>(aSource, aCount, aDest, aReverse);
+}
+#endif
+
+#ifdef BP_COPY_KERNELS_SSSE3
+bpSize CopyStep3Vectors(const bpUInt16* aSource, bpSize aCount, bpUInt16* aDest, bool aReverse)
+{
+  return CopyVectors<cSse2Kernel<bpUInt16, 3>>(aSource, aCount, aDest, aReverse);
+}
+
+bpSize CopyStep3Vectors(const bpUInt8* aSource, bpSize aCount, bpUInt8* aDest, bool aReverse)
+{
+  return CopyVectors<cSse2Kernel<bpUInt8, 3>>(aSource, aCount, aDest, aReverse);
+}
+#endif
+
+
+template<typename TBits>
+bpSize CopyStridedVectors(const TBits* aSource, bpSize aStep, bpSize aCount, TBits* aDest, bool aReverse)
+{
+  switch (aStep) {
+#if defined(BP_COPY_KERNELS_AVX2)
+  case 1:
+    return CopyVectors<cAvx2Kernel<TBits, 1>>(aSource, aCount, aDest, aReverse);
+  case 2:
+    return CopyVectors<cAvx2Kernel<TBits, 2>>(aSource, aCount, aDest, aReverse);
+#elif defined(BP_COPY_KERNELS_SSE2)
+  case 1:
+    return CopyVectors<cSse2Kernel<TBits, 1>>(aSource, aCount, aDest, aReverse);
+  case 2:
+    return CopyVectors<cSse2Kernel<TBits, 2>>(aSource, aCount, aDest, aReverse);
+#endif
+#ifdef BP_COPY_KERNELS_SSE2
+  case 4:
+    return CopyVectors<cSse2Kernel<TBits, 4>>(aSource, aCount, aDest, aReverse);
+#endif
+  case 3:
+    return CopyStep3Vectors(aSource, aCount, aDest, aReverse);
+  default:
+    return 0;
+  }
+}
+
+
+
+template<bool IsMono12Packed>
+inline bpUInt16 GetPacked12(const bpUInt8* aSource, bpSize aIndex)
+{
+  const bpUInt8* vPair = aSource + 3 * (aIndex >> 1);
+  if (IsMono12Packed) {
+    return (aIndex & 1) == 0 ? (vPair[0] << 4) | (vPair[1] & 0x0f) : (vPair[2] << 4) | (vPair[1] >> 4);
+  }
+  return (aIndex & 1) == 0 ? vPair[0] | ((vPair[1] & 0x0f) << 8) : (vPair[1] >> 4) | (vPair[2] << 4);
+}
+
+
+#ifdef BP_COPY_KERNELS_SSSE3
+
+// 16 bit lanes 2k and 2k + 1 get bytes 1 and 2 of pair k in the order the format needs, then the nibbles are masked
+// out. Mono12p takes byte 0 | byte 1 << 8 and byte 1 | byte 2 << 8, Mono12Packed byte 1 | byte 0 << 8 and byte 1 | byte 2 << 8.
+template<bool IsMono12Packed>
+struct cUnpack12Sse : cSse2Vector<bpUInt16>
+{
+  static const bpSize mLoadBytes = 16;
+
+  static __m128i Load(const bpUInt8* aSource)
+  {
+    __m128i vBytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSource));
+    if (!IsMono12Packed) {
+      __m128i vValues = _mm_shuffle_epi8(vBytes, _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11));
+      __m128i vEven = _mm_and_si128(vValues, _mm_set1_epi32(0x00000fff));
+      __m128i vOdd = _mm_and_si128(_mm_srli_epi16(vValues, 4), _mm_set1_epi32(0xffff0000));
+      return _mm_or_si128(vEven, vOdd);
+    }
+    __m128i vValues = _mm_shuffle_epi8(vBytes, _mm_setr_epi8(1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11));
+    __m128i vShifted = _mm_srli_epi16(vValues, 4);
+    __m128i vEven = _mm_or_si128(_mm_and_si128(vShifted, _mm_set1_epi32(0x00000ff0)), _mm_and_si128(vValues, _mm_set1_epi32(0x0000000f)));
+    __m128i vOdd = _mm_and_si128(vShifted, _mm_set1_epi32(0xffff0000));
+    return _mm_or_si128(vEven, vOdd);
+  }
+};
+
+#endif // BP_COPY_KERNELS_SSSE3
+
+
+#ifdef BP_COPY_KERNELS_AVX2
+
+// same as cUnpack12Sse, with the two 128 bit lanes loaded 12 bytes apart
+template<bool IsMono12Packed>
+struct cUnpack12Avx2 : cAvx2Vector<bpUInt16>
+{
+  static const bpSize mLoadBytes = 28;
+
+  static __m256i Load(const bpUInt8* aSource)
+  {
+    __m128i vLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSource));
+    __m128i vHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSource + 12));
+    __m256i vBytes = _mm256_inserti128_si256(_mm256_castsi128_si256(vLow), vHigh, 1);
+    if (!IsMono12Packed) {
+      __m256i vValues = _mm256_shuffle_epi8(vBytes, _mm256_setr_epi8(
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11));
+      __m256i vEven = _mm256_and_si256(vValues, _mm256_set1_epi32(0x00000fff));
+      __m256i vOdd = _mm256_and_si256(_mm256_srli_epi16(vValues, 4), _mm256_set1_epi32(0xffff0000));
+      return _mm256_or_si256(vEven, vOdd);
+    }
+    __m256i vValues = _mm256_shuffle_epi8(vBytes, _mm256_setr_epi8(
+      1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11,
+      1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11));
+    __m256i vShifted = _mm256_srli_epi16(vValues, 4);
+    __m256i vEven = _mm256_or_si256(_mm256_and_si256(vShifted, _mm256_set1_epi32(0x00000ff0)), _mm256_and_si256(vValues, _mm256_set1_epi32(0x0000000f)));
+    __m256i vOdd = _mm256_and_si256(vShifted, _mm256_set1_epi32(0xffff0000));
+    return _mm256_or_si256(vEven, vOdd);
+  }
+};
+
+#endif // BP_COPY_KERNELS_AVX2
+
+
+// unpacks whole vectors of consecutive values and returns the number of values unpacked, the caller unpacks the rest
+template<bool IsMono12Packed, typename TKernel>
+bpSize Unpack12KernelVectors(const bpUInt8* aSource, bpSize aFirstValue, bpSize aCount, bpUInt16* aDest, bool aReverse)
+{
+  if (aCount == 0) {
+    return 0;
+  }
+
+  // vectors start at even values, which begin at a byte boundary
+  bpSize vIndex = 0;
+  if ((aFirstValue & 1) != 0) {
+    aDest[aReverse ? aCount - 1 : 0] = GetPacked12<IsMono12Packed>(aSource, aFirstValue);
+    vIndex = 1;
+  }
+
+  const bpSize vWidth = TKernel::mWidth;
+  bpSize vLastValue = aFirstValue + aCount - 1;
+  bpSize vEndByte = 3 * (vLastValue >> 1) + ((vLastValue & 1) != 0 ? 3 : 2);
+  for (; vIndex + vWidth <= aCount; vIndex += vWidth) {
+    bpSize vByte = 3 * ((aFirstValue + vIndex) >> 1);
+    if (vByte + TKernel::mLoadBytes > vEndByte) {
+      break;
+    }
+    if (!aReverse) {
+      TKernel::Store(aDest + vIndex, TKernel::Load(aSource + vByte));
+    }
+    else {
+      TKernel::Store(aDest + aCount - vIndex - vWidth, TKernel::Reverse(TKernel::Load(aSource + vByte)));
+    }
+  }
+  return vIndex;
+}
+
+
+// without a kernel for the destination type (or the target) Unpack12 unpacks all values in its scalar loop
+template<bool IsMono12Packed, typename TDataType>
+bpSize Unpack12Vectors(const bpUInt8* /*aSource*/, bpSize /*aFirstValue*/, bpSize /*aCount*/, TDataType* /*aDest*/, bool /*aReverse*/)
+{
+  return 0;
+}
+
+#if defined(BP_COPY_KERNELS_AVX2) || defined(BP_COPY_KERNELS_SSSE3)
+template<bool IsMono12Packed>
+bpSize Unpack12Vectors(const bpUInt8* aSource, bpSize aFirstValue, bpSize aCount, bpUInt16* aDest, bool aReverse)
+{
+#if defined(BP_COPY_KERNELS_AVX2)
+  return Unpack12KernelVectors<IsMono12Packed, cUnpack12Avx2<IsMono12Packed>>(aSource, aFirstValue, aCount, aDest, aReverse);
+#else
+  return Unpack12KernelVectors<IsMono12Packed, cUnpack12Sse<IsMono12Packed>>(aSource, aFirstValue, aCount, aDest, aReverse);
+#endif
+}
+#endif
+
+
+template<bool IsMono12Packed, typename TDataType>
+void Unpack12(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse)
+{
+  bpSize vIndex = aStep == 1 ? Unpack12Vectors<IsMono12Packed>(aSource, aFirstValue, aCount, aDest, aReverse) : 0;
+  bpSize vValue = aFirstValue + vIndex * aStep;
+  for (; vIndex < aCount; ++vIndex) {
+    aDest[aReverse ? aCount - vIndex - 1 : vIndex] = static_cast<TDataType>(GetPacked12<IsMono12Packed>(aSource, vValue));
+    vValue += aStep;
+  }
+}
+
+
+
+template<typename TDataType>
+inline TDataType ConvertValue(bpFloat aValue)
+{
+  const bpFloat vMax = static_cast<bpFloat>(std::numeric_limits<TDataType>::max());
+  // negated to map NaN to 0
+  if (!(aValue > 0)) {
+    return 0;
+  }
+  if (aValue >= vMax) {
+    return std::numeric_limits<TDataType>::max();
+  }
+  return static_cast<TDataType>(std::nearbyint(aValue));
+}
+
+template<>
+inline bpFloat ConvertValue<bpFloat>(bpFloat aValue)
+{
+  return aValue;
+}
+
+
+#ifdef BP_COPY_KERNELS_SSE2
+
+inline __m128 LoadFloats(const bpUInt8* aSource)
+{
+  bpInt32 vBytes;
+  std::memcpy(&vBytes, aSource, sizeof(vBytes));
+  __m128i vZero = _mm_setzero_si128();
+  __m128i vValues = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(vBytes), vZero), vZero);
+  return _mm_cvtepi32_ps(vValues);
+}
+
+inline __m128 LoadFloats(const bpUInt16* aSource)
+{
+  __m128i vValues = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(aSource));
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(vValues, _mm_setzero_si128()));
+}
+
+inline __m128 LoadFloats(const bpUInt32* aSource)
+{
+  // _mm_cvtepi32_ps is signed, convert the two halves separately, the sum is rounded once as in a scalar conversion
+  __m128i vValues = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSource));
+  __m128 vHigh = _mm_cvtepi32_ps(_mm_srli_epi32(vValues, 16));
+  __m128 vLow = _mm_cvtepi32_ps(_mm_and_si128(vValues, _mm_set1_epi32(0xffff)));
+  return _mm_add_ps(_mm_mul_ps(vHigh, _mm_set1_ps(65536.0f)), vLow);
+}
+
+inline __m128 LoadFloats(const bpFloat* aSource)
+{
+  return _mm_loadu_ps(aSource);
+}
+
+
+// rounds to nearest even like std::nearbyint, _mm_max_ps returns its second argument for NaN
+inline __m128i ConvertFloats(__m128 aValues, __m128 aMax)
+{
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(aValues, _mm_setzero_ps()), aMax));
+}
+
+template<typename TInput>
+inline void ConvertValues16(const TInput* aSource, bpUInt8* aDest, __m128 aScale, __m128 aOffset)
+{
+  __m128 vMax = _mm_set1_ps(255.0f);
+  __m128i vValues0 = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource), aScale), aOffset), vMax);
+  __m128i vValues1 = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource + 4), aScale), aOffset), vMax);
+  __m128i vValues2 = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource + 8), aScale), aOffset), vMax);
+  __m128i vValues3 = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource + 12), aScale), aOffset), vMax);
+  __m128i vPacked = _mm_packus_epi16(_mm_packs_epi32(vValues0, vValues1), _mm_packs_epi32(vValues2, vValues3));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest), vPacked);
+}
+
+template<typename TInput>
+inline void ConvertValues16(const TInput* aSource, bpUInt16* aDest, __m128 aScale, __m128 aOffset)
+{
+  __m128 vMax = _mm_set1_ps(65535.0f);
+  for (bpSize vIndex = 0; vIndex < 16; vIndex += 8) {
+    __m128i vLow = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource + vIndex), aScale), aOffset), vMax);
+    __m128i vHigh = ConvertFloats(_mm_add_ps(_mm_mul_ps(LoadFloats(aSource + vIndex + 4), aScale), aOffset), vMax);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest + vIndex), cSse2Kernel<bpUInt16, 2>::PackLow16(vLow, vHigh));
+  }
+}
+
+template<typename TInput>
+inline void ConvertValues16(const TInput* aSource, bpFloat* aDest, __m128 aScale, __m128 aOffset)
+{
+  for (bpSize vIndex = 0; vIndex < 16; vIndex += 4) {
+    _mm_storeu_ps(aDest + vIndex, _mm_add_ps(_mm_mul_ps(LoadFloats(aSource + vIndex), aScale), aOffset));
+  }
+}
+
+#endif // BP_COPY_KERNELS_SSE2
+
+
+// converts 16 values at a time, returns the number of values converted
+template<typename TInput, typename TDataType>
+bpSize ConvertVectors(const TInput* aSource, bpSize aCount, TDataType* aDest, bpFloat aScale, bpFloat aOffset)
+{
+#ifdef BP_COPY_KERNELS_SSE2
+  __m128 vScale = _mm_set1_ps(aScale);
+  __m128 vOffset = _mm_set1_ps(aOffset);
+  bpSize vIndex = 0;
+  for (; vIndex + 16 <= aCount; vIndex += 16) {
+    ConvertValues16(aSource + vIndex, aDest + vIndex, vScale, vOffset);
+  }
+  return vIndex;
+#else
+  return 0;
+#endif
+}
+
+// 32 bit integers exceed the range _mm_cvtps_epi32 converts
+template<typename TInput>
+bpSize ConvertVectors(const TInput* /*aSource*/, bpSize /*aCount*/, bpUInt32* /*aDest*/, bpFloat /*aScale*/, bpFloat /*aOffset*/)
+{
+  return 0;
+}
+
+
+template<typename TInput, typename TDataType>
+void ConvertValues(const TInput* aSource, bpSize aCount, TDataType* aDest, bpFloat aScale, bpFloat aOffset)
+{
+  for (bpSize vIndex = ConvertVectors(aSource, aCount, aDest, aScale, aOffset); vIndex < aCount; ++vIndex) {
+    aDest[vIndex] = ConvertValue<TDataType>(static_cast<bpFloat>(aSource[vIndex]) * aScale + aOffset);
+  }
+}
+
+}
+
+
+template<typename TDataType>
+void bpCopyStrided(const TDataType* aSource, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse)
+{
+  if (aStep == 1 && !aReverse) {
+    std::copy(aSource, aSource + aCount, aDest);
+    return;
+  }
+
+  // the kernels only move bits, floats go through the 32 bit integer kernels
+  using tBits = typename cBits<sizeof(TDataType)>::tType;
+  bpSize vCopied = CopyStridedVectors(reinterpret_cast<const tBits*>(aSource), aStep, aCount, reinterpret_cast<tBits*>(aDest), aReverse);
+
+  const TDataType* vSource = aSource + vCopied * aStep;
+  if (!aReverse) {
+    for (bpSize vIndex = vCopied; vIndex < aCount; ++vIndex) {
+      aDest[vIndex] = *vSource;
+      vSource += aStep;
+    }
+  }
+  else {
+    for (bpSize vIndex = vCopied; vIndex < aCount; ++vIndex) {
+      aDest[aCount - vIndex - 1] = *vSource;
+      vSource += aStep;
+    }
+  }
+}
+
+
+template void bpCopyStrided<bpUInt8>(const bpUInt8* aSource, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse);
+template void bpCopyStrided<bpUInt16>(const bpUInt16* aSource, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse);
+template void bpCopyStrided<bpUInt32>(const bpUInt32* aSource, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse);
+template void bpCopyStrided<bpFloat>(const bpFloat* aSource, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse);
+
+
+template<typename TDataType>
+void bpUnpack12(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat)
+{
+  if (aFormat == bpConverterTypes::ePackedDataMono12Packed) {
+    Unpack12<true>(aSource, aFirstValue, aStep, aCount, aDest, aReverse);
+  }
+  else {
+    Unpack12<false>(aSource, aFirstValue, aStep, aCount, aDest, aReverse);
+  }
+}
+
+
+template void bpUnpack12<bpUInt8>(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat);
+template void bpUnpack12<bpUInt16>(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat);
+template void bpUnpack12<bpUInt32>(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat);
+template void bpUnpack12<bpFloat>(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat);
+
+
+template<typename TInput, typename TDataType>
+void bpConvertStrided(const TInput* aSource, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset)
+{
+  if (aStep == 1 && !aReverse) {
+    ConvertValues(aSource, aCount, aDest, aScale, aOffset);
+    return;
+  }
+
+  // gather and convert in small chunks, reversed chunks are filled from the end of aDest
+  const bpSize vChunkSize = 256;
+  TInput vInput[vChunkSize];
+  TDataType vOutput[vChunkSize];
+  for (bpSize vIndex = 0; vIndex < aCount; vIndex += vChunkSize) {
+    bpSize vCount = std::min(vChunkSize, aCount - vIndex);
+    bpCopyStrided(aSource + vIndex * aStep, aStep, vCount, vInput, false);
+    if (!aReverse) {
+      ConvertValues(vInput, vCount, aDest + vIndex, aScale, aOffset);
+    }
+    else {
+      ConvertValues(vInput, vCount, vOutput, aScale, aOffset);
+      bpCopyStrided(vOutput, 1, vCount, aDest + aCount - vIndex - vCount, true);
+    }
+  }
+}
+
+
+template void bpConvertStrided<bpUInt8, bpUInt8>(const bpUInt8* aSource, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt8, bpUInt16>(const bpUInt8* aSource, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt8, bpUInt32>(const bpUInt8* aSource, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt8, bpFloat>(const bpUInt8* aSource, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt16, bpUInt8>(const bpUInt16* aSource, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt16, bpUInt16>(const bpUInt16* aSource, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt16, bpUInt32>(const bpUInt16* aSource, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt16, bpFloat>(const bpUInt16* aSource, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt32, bpUInt8>(const bpUInt32* aSource, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt32, bpUInt16>(const bpUInt32* aSource, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt32, bpUInt32>(const bpUInt32* aSource, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpUInt32, bpFloat>(const bpUInt32* aSource, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpFloat, bpUInt8>(const bpFloat* aSource, bpSize aStep, bpSize aCount, bpUInt8* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpFloat, bpUInt16>(const bpFloat* aSource, bpSize aStep, bpSize aCount, bpUInt16* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpFloat, bpUInt32>(const bpFloat* aSource, bpSize aStep, bpSize aCount, bpUInt32* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+template void bpConvertStrided<bpFloat, bpFloat>(const bpFloat* aSource, bpSize aStep, bpSize aCount, bpFloat* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
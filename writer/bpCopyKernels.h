@@ -0,0 +1,48 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_COPY_KERNELS__
+#define __BP_COPY_KERNELS__
+
+
+#include "../interface/bpConverterTypes.h"
+
+
+/**
+* Copies aCount values, taken every aStep values from aSource, densely to aDest. Writes aDest back to front if aReverse is set.
+* Steps 1, 2, 3 and 4 (interleaved channels) use SSE2, SSSE3 or AVX2 when the compiler targets them, other steps a scalar loop.
+* Never reads beyond the last value copied.
+*/
+template<typename TDataType>
+void bpCopyStrided(const TDataType* aSource, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse);
+
+
+/**
+* Like bpCopyStrided for aCount 12 bit values packed in aFormat, starting with value aFirstValue of aSource.
+* Step 1 into 16 bit destinations uses SSSE3 or AVX2 when the compiler targets them.
+*/
+template<typename TDataType>
+void bpUnpack12(const bpUInt8* aSource, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse, bpConverterTypes::tPackedDataFormat aFormat);
+
+
+/**
+* Like bpCopyStrided, converting each value to round(value * aScale + aOffset) clamped to the range of TDataType.
+* Float destinations are not rounded or clamped. Computes in single precision, with SSE2 for 8 bit, 16 bit and float destinations.
+*/
+template<typename TInput, typename TDataType>
+void bpConvertStrided(const TInput* aSource, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse, bpFloat aScale, bpFloat aOffset);
+
+
+#endif
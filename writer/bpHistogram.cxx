@@ -15,6 +15,66 @@
  ***************************************************************************/
 #include "bpHistogram.h"
 
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BP_HISTOGRAM_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define BP_HISTOGRAM_AVX2
+#include <immintrin.h>
+#endif
+
+
+void bpMergeBins(std::vector<bpUInt64>& aBins, const std::vector<bpUInt64>& aOtherBins)
+{
+  bpSize vSize = aBins.size();
+  bpUInt64* vBins = aBins.data();
+  const bpUInt64* vOtherBins = aOtherBins.data();
+  bpSize vIndex = 0;
+#if defined(BP_HISTOGRAM_AVX2)
+  for (; vIndex + 4 <= vSize; vIndex += 4) {
+    __m256i vSum = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vBins + vIndex)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vOtherBins + vIndex)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(vBins + vIndex), vSum);
+  }
+#elif defined(BP_HISTOGRAM_SSE2)
+  for (; vIndex + 2 <= vSize; vIndex += 2) {
+    __m128i vSum = _mm_add_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(vBins + vIndex)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(vOtherBins + vIndex)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(vBins + vIndex), vSum);
+  }
+#endif
+  for (; vIndex < vSize; ++vIndex) {
+    vBins[vIndex] += vOtherBins[vIndex];
+  }
+}
+
+
+void bpMergeBins(std::vector<bpUInt32>& aBins, const std::vector<bpUInt32>& aOtherBins)
+{
+  bpSize vSize = aBins.size();
+  bpUInt32* vBins = aBins.data();
+  const bpUInt32* vOtherBins = aOtherBins.data();
+  bpSize vIndex = 0;
+#if defined(BP_HISTOGRAM_AVX2)
+  for (; vIndex + 8 <= vSize; vIndex += 8) {
+    __m256i vSum = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vBins + vIndex)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vOtherBins + vIndex)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(vBins + vIndex), vSum);
+  }
+#elif defined(BP_HISTOGRAM_SSE2)
+  for (; vIndex + 4 <= vSize; vIndex += 4) {
+    __m128i vSum = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(vBins + vIndex)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(vOtherBins + vIndex)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(vBins + vIndex), vSum);
+  }
+#endif
+  for (; vIndex < vSize; ++vIndex) {
+    vBins[vIndex] += vOtherBins[vIndex];
+  }
+}
+
+
 
 bpHistogram bpResampleHistogram(const bpHistogram& aHistogram, bpSize aNewNumberOfBins)
 {
@@ -131,11 +191,40 @@ public:
     }
   }
 
+  // the same as AddValue of each value, the values AddValue would count without moving the bins are counted in runs
+  template<typename TDataType>
+  void AddValues(const TDataType* aValues, bpSize aCount)
+  {
+    bpSize vIndex = 0;
+    while (vIndex < aCount) {
+      if (!Empty()) {
+        bpFloat vValueMin;
+        bpFloat vValueMax;
+        bpSize vEnd = FindInsideBins(aValues, vIndex, aCount, vValueMin, vValueMax);
+        if (vEnd > vIndex) {
+          AddBinCounts(aValues + vIndex, vEnd - vIndex);
+          mCountTotal += vEnd - vIndex;
+          mValueMin = std::min(mValueMin, vValueMin);
+          mValueMax = std::max(mValueMax, vValueMax);
+          vIndex = vEnd;
+        }
+      }
+      if (vIndex < aCount) {
+        AddValue(static_cast<bpFloat>(aValues[vIndex]));
+        ++vIndex;
+      }
+    }
+  }
+
   void Merge(const cImpl& aOther)
   {
-    // remember actual min and max
-    bpFloat vValueMin = mValueMin;
-    bpFloat vValueMax = mValueMax;
+    if (aOther.Empty()) {
+      return;
+    }
+    // remember actual min and max, an empty histogram has none
+    bool vIsEmpty = Empty();
+    bpFloat vValueMin = vIsEmpty ? aOther.mValueMin : mValueMin;
+    bpFloat vValueMax = vIsEmpty ? aOther.mValueMax : mValueMax;
     // extend data range as much as needed by adding the last non-zero value to avoid subsequent expansions to the right
     bpSize vLastBinId = aOther.GetNumberOfBins() - 1;
     while (vLastBinId > 0 && aOther.GetCount(vLastBinId) == 0) {
@@ -359,6 +448,117 @@ private:
     mBinCounts[GetBinId((mValueMin + mValueMax) * 0.5f)] = mCountTotal;
   }
 
+  // the end of the values from aBegin on that are inside the bins and their range. AddValue does not move the bins
+  // for them, the upper bin border is left to AddValue as whether it moves the bins depends on the range of the values
+  bpSize FindInsideBins(const bpFloat* aValues, bpSize aBegin, bpSize aCount, bpFloat& aValueMin, bpFloat& aValueMax) const
+  {
+    bpFloat vValueMin = std::numeric_limits<bpFloat>::infinity();
+    bpFloat vValueMax = -std::numeric_limits<bpFloat>::infinity();
+    bpSize vIndex = aBegin;
+#ifdef BP_HISTOGRAM_SSE2
+    // NaN fails both comparisons, the values inside are never NaN
+    __m128 vBinValueMin4 = _mm_set1_ps(mBinValueMin);
+    __m128 vBinValueMax4 = _mm_set1_ps(mBinValueMax);
+    __m128 vValueMin4 = _mm_set1_ps(vValueMin);
+    __m128 vValueMax4 = _mm_set1_ps(vValueMax);
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128 vValues = _mm_loadu_ps(aValues + vIndex);
+      if (_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(vValues, vBinValueMin4), _mm_cmplt_ps(vValues, vBinValueMax4))) != 0xf) {
+        break;
+      }
+      vValueMin4 = _mm_min_ps(vValues, vValueMin4);
+      vValueMax4 = _mm_max_ps(vValues, vValueMax4);
+    }
+    bpFloat vMin4[4];
+    bpFloat vMax4[4];
+    _mm_storeu_ps(vMin4, vValueMin4);
+    _mm_storeu_ps(vMax4, vValueMax4);
+    for (bpSize vLane = 0; vLane < 4; ++vLane) {
+      vValueMin = std::min(vValueMin, vMin4[vLane]);
+      vValueMax = std::max(vValueMax, vMax4[vLane]);
+    }
+#endif
+    for (; vIndex < aCount && aValues[vIndex] >= mBinValueMin && aValues[vIndex] < mBinValueMax; ++vIndex) {
+      vValueMin = std::min(vValueMin, aValues[vIndex]);
+      vValueMax = std::max(vValueMax, aValues[vIndex]);
+    }
+    aValueMin = vValueMin;
+    aValueMax = vValueMax;
+    return vIndex;
+  }
+
+  bpSize FindInsideBins(const bpUInt32* aValues, bpSize aBegin, bpSize aCount, bpFloat& aValueMin, bpFloat& aValueMax) const
+  {
+    bpFloat vValueMin = std::numeric_limits<bpFloat>::infinity();
+    bpFloat vValueMax = -std::numeric_limits<bpFloat>::infinity();
+    bpSize vIndex = aBegin;
+    for (; vIndex < aCount; ++vIndex) {
+      bpFloat vValue = static_cast<bpFloat>(aValues[vIndex]);
+      if (!(vValue >= mBinValueMin && vValue < mBinValueMax)) {
+        break;
+      }
+      vValueMin = std::min(vValueMin, vValue);
+      vValueMax = std::max(vValueMax, vValue);
+    }
+    aValueMin = vValueMin;
+    aValueMax = vValueMax;
+    return vIndex;
+  }
+
+  // all values are inside the bins, the same bins as GetBinId
+  void AddBinCounts(const bpFloat* aValues, bpSize aCount)
+  {
+    bpFloat vValueDelta = GetValueDelta();
+    if (vValueDelta == 0) {
+      mBinCounts[GetNumberOfBins() / 2] += aCount;
+      return;
+    }
+    bpSize vIndex = 0;
+#ifdef BP_HISTOGRAM_SSE2
+    // the bin ids are small and not negative, truncation is floor. NaN converts to a negative id, it goes to the first bin
+    __m128 vBinValueMin4 = _mm_set1_ps(mBinValueMin);
+    __m128 vValueDelta4 = _mm_set1_ps(vValueDelta);
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128i vBinIds = _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(aValues + vIndex), vBinValueMin4), vValueDelta4));
+      bpInt32 vBinIds4[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(vBinIds4), vBinIds);
+      for (bpSize vLane = 0; vLane < 4; ++vLane) {
+        ++mBinCounts[ClampBinId(vBinIds4[vLane])];
+      }
+    }
+#endif
+    for (; vIndex < aCount; ++vIndex) {
+      ++mBinCounts[GetBinIdInside(aValues[vIndex], vValueDelta)];
+    }
+  }
+
+  void AddBinCounts(const bpUInt32* aValues, bpSize aCount)
+  {
+    bpFloat vValueDelta = GetValueDelta();
+    if (vValueDelta == 0) {
+      mBinCounts[GetNumberOfBins() / 2] += aCount;
+      return;
+    }
+    for (bpSize vIndex = 0; vIndex < aCount; ++vIndex) {
+      ++mBinCounts[GetBinIdInside(static_cast<bpFloat>(aValues[vIndex]), vValueDelta)];
+    }
+  }
+
+  bpSize GetBinIdInside(bpFloat aValue, bpFloat aValueDelta) const
+  {
+    bpFloat vBinId = (aValue - mBinValueMin) / aValueDelta;
+    // NaN goes to the first bin
+    if (!(vBinId >= 0)) {
+      return 0;
+    }
+    return vBinId < GetNumberOfBins() ? static_cast<bpSize>(vBinId) : GetNumberOfBins() - 1;
+  }
+
+  bpSize ClampBinId(bpSizeSigned aBinId) const
+  {
+    return aBinId < 0 ? 0 : aBinId >= static_cast<bpSizeSigned>(GetNumberOfBins()) ? GetNumberOfBins() - 1 : static_cast<bpSize>(aBinId);
+  }
+
   bpSizeSigned GetBinIdSigned(const bpFloat& aValue) const
   {
     bpFloat vValueDelta = GetValueDelta();
@@ -410,7 +610,22 @@ void bpHistogramBuilderAdaptive::AddValue(bpFloat aValue)
   mImpl->AddValue(aValue);
 }
 
+void bpHistogramBuilderAdaptive::AddValues(const bpFloat* aValues, bpSize aCount)
+{
+  mImpl->AddValues(aValues, aCount);
+}
+
+void bpHistogramBuilderAdaptive::AddValues(const bpUInt32* aValues, bpSize aCount)
+{
+  mImpl->AddValues(aValues, aCount);
+}
+
 void bpHistogramBuilderAdaptive::Merge(const bpHistogramBuilderAdaptive& aOther)
 {
   mImpl->Merge(*aOther.mImpl);
 }
+
+bpSize bpHistogramBuilderAdaptive::GetMemorySize() const
+{
+  return mImpl->GetNumberOfBins() * sizeof(bpUInt64);
+}
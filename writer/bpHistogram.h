@@ -19,6 +19,8 @@
 
 #include "../interface/bpConverterTypes.h"
 
+#include <algorithm>
+
 
 class bpHistogram
 {
@@ -68,13 +70,9 @@ private:
 bpHistogram bpResampleHistogram(const bpHistogram& aHistogram, bpSize aNewNumberOfBins);
 
 
-static inline void bpMergeBins(std::vector<bpUInt64>& aBins, const std::vector<bpUInt64>& aOtherBins)
-{
-  bpSize vSize = aBins.size();
-  for (bpSize vIndex = 0; vIndex < vSize; ++vIndex) {
-    aBins[vIndex] += aOtherBins[vIndex];
-  }
-}
+// adds aOtherBins to aBins, both the same size
+void bpMergeBins(std::vector<bpUInt64>& aBins, const std::vector<bpUInt64>& aOtherBins);
+void bpMergeBins(std::vector<bpUInt32>& aBins, const std::vector<bpUInt32>& aOtherBins);
 
 
 class bpHistogramBuilderAdaptive
@@ -85,8 +83,23 @@ public:
 
   bpHistogram GetHistogram() const;
   void AddValue(bpFloat aValue);
+
+  /**
+  * The same as AddValue of each value. Runs of values inside the current bins are counted without further checks,
+  * the values that move the bins (and values that are not finite) are added one by one.
+  */
+  void AddValues(const bpFloat* aValues, bpSize aCount);
+  void AddValues(const bpUInt32* aValues, bpSize aCount);
+
+  /**
+  * Adds the values of aOther. The total count and the value range are those of adding all values to one builder,
+  * the bin layout may depend on the order of the merges.
+  */
   void Merge(const bpHistogramBuilderAdaptive& aOther);
 
+  // bytes of the bins
+  bpSize GetMemorySize() const;
+
 private:
   class cImpl;
   bpUniquePtr<cImpl> mImpl;
@@ -113,11 +126,23 @@ public:
     ++mBins[aValue];
   }
 
+  void AddValues(const bpUInt8* aValues, bpSize aCount)
+  {
+    for (bpSize vIndex = 0; vIndex < aCount; ++vIndex) {
+      ++mBins[aValues[vIndex]];
+    }
+  }
+
   void Merge(const bpHistogramBuilder& aOther)
   {
     bpMergeBins(mBins, aOther.mBins);
   }
 
+  bpSize GetMemorySize() const
+  {
+    return mBins.size() * sizeof(bpUInt64);
+  }
+
 private:
   std::vector<bpUInt64> mBins = std::vector<bpUInt64>(256);
 };
@@ -129,26 +154,91 @@ class bpHistogramBuilder<bpUInt16>
 public:
   bpHistogram GetHistogram() const
   {
+    std::vector<bpUInt64> vBins(mNumberOfValues);
+    for (bpSize vValue = 0; vValue < mNumberOfValues; ++vValue) {
+      vBins[vValue] = static_cast<bpUInt64>(mCounts[2 * vValue]) + mCounts[2 * vValue + 1];
+    }
+    if (!mFlushedBins.empty()) {
+      bpMergeBins(vBins, mFlushedBins);
+    }
     bpUInt16 vMin = 0;
-    bpUInt16 vMax = mBins.size() - 1;
-    for (; vMin + 256 < vMax && mBins[vMax] == 0; --vMax);
-    //for (; vMin + 256 < vMax && mBins[vMin] == 0; ++vMin); // let it start from zero
-    std::vector<bpUInt64> vBins(mBins.begin() + vMin, mBins.begin() + (vMax + 1));
+    bpUInt16 vMax = mNumberOfValues - 1;
+    for (; vMin + 256 < vMax && vBins[vMax] == 0; --vMax);
+    //for (; vMin + 256 < vMax && vBins[vMin] == 0; ++vMin); // let it start from zero
+    vBins.resize(vMax + 1);
     return bpHistogram(vMin, vMax, std::move(vBins));
   }
 
   void AddValue(bpUInt16 aValue)
   {
-    ++mBins[aValue];
+    AddValues(&aValue, 1);
+  }
+
+  /**
+  * Consecutive values go to alternating counters of their bin, an increment does not wait for the one before
+  * if the values are equal (as in dark backgrounds).
+  */
+  void AddValues(const bpUInt16* aValues, bpSize aCount)
+  {
+    while (aCount > 0) {
+      // no counter can exceed the number of values added since the last flush
+      if (mCountSinceFlush == mMaxCountSinceFlush) {
+        Flush();
+      }
+      bpSize vCount = static_cast<bpSize>(std::min<bpUInt64>(aCount, mMaxCountSinceFlush - mCountSinceFlush));
+      bpUInt32* vCounts = mCounts.data();
+      bpSize vIndex = 0;
+      for (; vIndex + 2 <= vCount; vIndex += 2) {
+        ++vCounts[2 * aValues[vIndex]];
+        ++vCounts[2 * aValues[vIndex + 1] + 1];
+      }
+      if (vIndex < vCount) {
+        ++vCounts[2 * aValues[vIndex]];
+      }
+      mCountSinceFlush += vCount;
+      aValues += vCount;
+      aCount -= vCount;
+    }
   }
 
   void Merge(const bpHistogramBuilder& aOther)
   {
-    bpMergeBins(mBins, aOther.mBins);
+    if (mCountSinceFlush > mMaxCountSinceFlush - aOther.mCountSinceFlush) {
+      Flush();
+    }
+    bpMergeBins(mCounts, aOther.mCounts);
+    mCountSinceFlush += aOther.mCountSinceFlush;
+    if (!aOther.mFlushedBins.empty()) {
+      mFlushedBins.resize(mNumberOfValues);
+      bpMergeBins(mFlushedBins, aOther.mFlushedBins);
+    }
+  }
+
+  // the flushed bins only exist after 4G values and are not counted
+  bpSize GetMemorySize() const
+  {
+    return mCounts.size() * sizeof(bpUInt32);
   }
 
 private:
-  std::vector<bpUInt64> mBins = std::vector<bpUInt64>(256 * 256);
+  void Flush()
+  {
+    mFlushedBins.resize(mNumberOfValues);
+    for (bpSize vValue = 0; vValue < mNumberOfValues; ++vValue) {
+      mFlushedBins[vValue] += static_cast<bpUInt64>(mCounts[2 * vValue]) + mCounts[2 * vValue + 1];
+    }
+    std::fill(mCounts.begin(), mCounts.end(), 0);
+    mCountSinceFlush = 0;
+  }
+
+  static const bpSize mNumberOfValues = 256 * 256;
+  static const bpUInt64 mMaxCountSinceFlush = 0xffffffff;
+
+  // two counters per value, next to each other
+  std::vector<bpUInt32> mCounts = std::vector<bpUInt32>(2 * mNumberOfValues);
+  bpUInt64 mCountSinceFlush = 0;
+  // the counts of all flushes
+  std::vector<bpUInt64> mFlushedBins;
 };
 
 
@@ -17,7 +17,7 @@
 #include "bpImageConverterImpl.h"
 
 
-#include <mutex>
+#include <shared_mutex>
 
 
 template <typename TDataType>
@@ -31,16 +31,90 @@ public:
 
   bool NeedCopyBlock(const bpConverterTypes::tIndex5D& aBlockIndex) const
   {
-    tLock vLock(mMutex);
+    tSharedLock vLock(mMutex);
     return mImpl->NeedCopyBlock(aBlockIndex);
   }
 
+  // several producers may copy blocks concurrently, only Finish needs exclusive access
   void CopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex)
   {
-    tLock vLock(mMutex);
+    tSharedLock vLock(mMutex);
     mImpl->CopyBlock(aFileDataBlock, aBlockIndex);
   }
 
+  void CopyBlockOwned(TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bpConverterTypes::tReleaseCallback aRelease)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockOwned(aFileDataBlock, aBlockIndex, std::move(aRelease));
+  }
+
+  void CopyBlockPacked(const bpUInt8* aFileDataBlock, bpConverterTypes::tPackedDataFormat aFormat, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockPacked(aFileDataBlock, aFormat, aBlockIndex);
+  }
+
+  void CopyBlockScaled(const bpUInt8* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+  }
+
+  void CopyBlockScaled(const bpUInt16* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+  }
+
+  void CopyBlockScaled(const bpUInt32* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+  }
+
+  void CopyBlockScaled(const bpFloat* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+  }
+
+  void CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyRegion(aData, aOffset, aSize);
+  }
+
+  // the tiles must be known before any tile is copied
+  void SetTiles(const bpConverterTypes::tTileVector& aTiles, bpConverterTypes::tOverlapPolicy aPolicy)
+  {
+    tLock vLock(mMutex);
+    mImpl->SetTiles(aTiles, aPolicy);
+  }
+
+  void CopyTile(const TDataType* aData, bpSize aTileIndex)
+  {
+    tSharedLock vLock(mMutex);
+    mImpl->CopyTile(aData, aTileIndex);
+  }
+
+  bool TryCopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    return mImpl->TryCopyBlock(aFileDataBlock, aBlockIndex);
+  }
+
+  bpConverterTypes::tCopyHandle CopyBlockAsync(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex)
+  {
+    tSharedLock vLock(mMutex);
+    return mImpl->CopyBlockAsync(aFileDataBlock, aBlockIndex);
+  }
+
+  bpConverterTypes::cQueueStatus GetQueueStatus() const
+  {
+    tSharedLock vLock(mMutex);
+    return mImpl->GetQueueStatus();
+  }
+
   void Finish(
     const bpConverterTypes::cImageExtent& aImageExtent,
     const bpConverterTypes::tParameters& aParameters,
@@ -53,8 +127,9 @@ public:
   }
 
 private:
-  using tMutex = std::mutex;
-  using tLock = std::lock_guard<tMutex>;
+  using tMutex = std::shared_timed_mutex;
+  using tLock = std::unique_lock<tMutex>;
+  using tSharedLock = std::shared_lock<tMutex>;
 
   mutable tMutex mMutex;
 
@@ -94,6 +169,97 @@ void bpImageConverter<TDataType>::CopyBlock(const TDataType* aFileDataBlock, con
 }
 
 
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockOwned(TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bpConverterTypes::tReleaseCallback aRelease)
+{
+  mImpl->CopyBlockOwned(aFileDataBlock, aBlockIndex, std::move(aRelease));
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockPacked(const bpUInt8* aFileDataBlock, bpConverterTypes::tPackedDataFormat aFormat, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  mImpl->CopyBlockPacked(aFileDataBlock, aFormat, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockScaled(const bpUInt8* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockScaled(const bpUInt16* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockScaled(const bpUInt32* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyBlockScaled(const bpFloat* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  mImpl->CopyBlockScaled(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize)
+{
+  mImpl->CopyRegion(aData, aOffset, aSize);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::SetTiles(const bpConverterTypes::tTileVector& aTiles, bpConverterTypes::tOverlapPolicy aPolicy)
+{
+  mImpl->SetTiles(aTiles, aPolicy);
+}
+
+
+template<typename TDataType>
+void bpImageConverter<TDataType>::CopyTile(const TDataType* aData, bpSize aTileIndex)
+{
+  mImpl->CopyTile(aData, aTileIndex);
+}
+
+
+template<typename TDataType>
+bool bpImageConverter<TDataType>::TryCopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  return mImpl->TryCopyBlock(aFileDataBlock, aBlockIndex);
+}
+
+
+template<typename TDataType>
+bpConverterTypes::tCopyHandle bpImageConverter<TDataType>::CopyBlockAsync(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex)
+{
+  return mImpl->CopyBlockAsync(aFileDataBlock, aBlockIndex);
+}
+
+
+template<typename TDataType>
+bpConverterTypes::cQueueStatus bpImageConverter<TDataType>::GetQueueStatus() const
+{
+  return mImpl->GetQueueStatus();
+}
+
+
+template<typename TDataType>
+bpConverterTypes::tSize5D bpImageConverter<TDataType>::GetOwnedFileBlockSize(const bpConverterTypes::tSize5D& aImageSize, const bpConverterTypes::cOptions& aOptions)
+{
+  return bpImageConverterImpl<TDataType>::GetOwnedFileBlockSize(aImageSize, aOptions);
+}
+
+
 template<typename TDataType>
 void bpImageConverter<TDataType>::Finish(
   const bpConverterTypes::cImageExtent& aImageExtent,
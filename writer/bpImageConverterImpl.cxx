@@ -17,6 +17,10 @@
 #include "bpDeriche.h"
 #include "bpWriterFactoryHDF5.h"
 #include "bpWriterFactoryCompressor.h"
+#include "bpThreadPool.h"
+#include "bpCopyKernels.h"
+
+#include <future>
 
 
 using namespace bpConverterTypes;
@@ -31,30 +35,60 @@ bpImageConverterImpl<TDataType>::bpImageConverterImpl(
     mSample(aSample), mMinLimit(InitMapWithConstant(0)), mMaxLimit(aImageSize), mNumberOfBlocks(InitMapWithConstant(1)),
     mApplicationName(aApplicationName),
     mApplicationVersion(aApplicationVersion),
+    mAppendTimePoints(aOptions.mAppendTimePoints),
+    mMemoryBudget(std::make_shared<bpMemoryBudget>(aOptions.mMaxMemoryBytes)),
     mMultiresolutionImage(
     Div(aImageSize[X], aSample[X]), Div(aImageSize[Y], aSample[Y]), Div(aImageSize[Z], aSample[Z]),
     Div(aImageSize[C], aSample[C]), Div(aImageSize[T], aSample[T]), aDataType,
     { aFileBlockSize[X], aFileBlockSize[Y] }, { aSample[X], aSample[Y] },
-    std::make_shared<bpWriterFactoryCompressor>(std::make_shared<bpWriterFactoryHDF5>(), aOptions.mNumberOfThreads, aOptions.mEnableLogProgress ? std::move(aProgressCallback) : tProgressCallback()),
-    aOutputFile, aOptions.mCompressionAlgorithmType, aOptions.mThumbnailSizeXY, aOptions.mForceFileBlockSizeZ1, aOptions.mNumberOfThreads)
+    std::make_shared<bpWriterFactoryCompressor>(std::make_shared<bpWriterFactoryHDF5>(), aOptions.mNumberOfThreads, aOptions.mEnableLogProgress ? std::move(aProgressCallback) : tProgressCallback(), mMemoryBudget),
+    aOutputFile, aOptions.mCompressionAlgorithmType, aOptions.mThumbnailSizeXY, aOptions.mForceFileBlockSizeZ1, aOptions.mNumberOfThreads, mMemoryBudget, aOptions.mScratchDirectory, aOptions.mHistogramSampleRate),
+    mParallelCopyThreshold(aOptions.mParallelCopyThreshold), mNumberOfCopyThreads(aOptions.mNumberOfThreads), mNumberOfAsyncCopies(0)
 {
+  mAsyncCopyThread = std::make_shared<bpThreadPool>(1);
+  if (aOptions.mParallelCopyThreshold > 0 && aOptions.mNumberOfThreads > 1) {
+    mCopyThreads = std::make_shared<bpThreadPool>(aOptions.mNumberOfThreads - 1);
+  }
+
   mIsFlipped[0] = aOptions.mFlipDimensionXYZ[0];
   mIsFlipped[1] = aOptions.mFlipDimensionXYZ[1];
   mIsFlipped[2] = aOptions.mFlipDimensionXYZ[2];
 
+  if (mAppendTimePoints && (mFileBlockSize[T] != 1 || mSample[T] != 1)) {
+    throw bpError("Appending time points needs a file block size and sample of 1 in T");
+  }
+
   bpSize vNumberOfBlocks = 1;
   for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
     Dimension vDim = mBlockDataDimensionSequence[vDimIndex];
     mNumberOfBlocks[vDim] = Div(mImageSize[vDim], mFileBlockSize[vDim]);
-    vNumberOfBlocks *= mNumberOfBlocks[vDim];
+    if (vDim != T) {
+      vNumberOfBlocks *= mNumberOfBlocks[vDim];
+    }
   }
-  mBlockCopied.resize(vNumberOfBlocks, false);
+  mBlockCopied = std::make_unique<bpTimePointVector<cBlocksCopied>>([vNumberOfBlocks](bpSize /*aBlockIndexT*/) {
+    auto vBlocksCopied = std::make_unique<cBlocksCopied>();
+    vBlocksCopied->mIsCopied = std::vector<std::atomic<bool>>(vNumberOfBlocks);
+    return vBlocksCopied;
+  });
+
+  InitCopyPlan();
+
+  bpVec3 vMemoryBlockSize = mMultiresolutionImage.GetMemoryBlockSize();
+  mCanAdoptFileBlocks =
+    mBlockDataDimensionSequence[0] == X && mBlockDataDimensionSequence[1] == Y && mBlockDataDimensionSequence[2] == Z &&
+    mFileBlockSize[X] == vMemoryBlockSize[0] && mFileBlockSize[Y] == vMemoryBlockSize[1] && mFileBlockSize[Z] == vMemoryBlockSize[2] &&
+    mFileBlockSize[C] == 1 && mFileBlockSize[T] == 1 &&
+    mSample[X] == 1 && mSample[Y] == 1 && mSample[Z] == 1 && mSample[C] == 1 && mSample[T] == 1 &&
+    !mIsFlipped[0] && !mIsFlipped[1] && !mIsFlipped[2];
 }
 
 
 template<typename TDataType>
 bpImageConverterImpl<TDataType>::~bpImageConverterImpl()
 {
+  // pending asynchronous copies still refer to this
+  mAsyncCopyThread->WaitAll();
 }
 
 
@@ -91,29 +125,233 @@ bool bpImageConverterImpl<TDataType>::NeedCopyBlock(const tIndex5D& aBlockIndex)
 template<typename TDataType>
 void bpImageConverterImpl<TDataType>::CopyBlock(const TDataType* aFileDataBlock, const tIndex5D& aBlockIndex)
 {
-  if (!aFileDataBlock) {
+  CopyBlock(aFileDataBlock, aBlockIndex, true);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockPacked(const bpUInt8* aFileDataBlock, tPackedDataFormat aFormat, const tIndex5D& aBlockIndex)
+{
+  if (sizeof(TDataType) < 2) {
+    throw bpError("Packed 12 bit data needs a 16 bit, 32 bit or float image");
+  }
+  if (aFormat != ePackedDataMono12p && aFormat != ePackedDataMono12Packed) {
+    throw bpError("Unknown packed data format");
+  }
+
+  CopyBlock(cBlockData{ nullptr, aFileDataBlock, &ReadPackedRow, aFormat, 1, 0 }, aBlockIndex, true);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::ReadPackedRow(const cBlockData& aBlockData, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse)
+{
+  bpUnpack12(static_cast<const bpUInt8*>(aBlockData.mData), aFirstValue, aStep, aCount, aDest, aReverse, aBlockData.mPackedFormat);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockScaled(const bpUInt8* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const tIndex5D& aBlockIndex)
+{
+  CopyBlockScaledT(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockScaled(const bpUInt16* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const tIndex5D& aBlockIndex)
+{
+  CopyBlockScaledT(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockScaled(const bpUInt32* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const tIndex5D& aBlockIndex)
+{
+  CopyBlockScaledT(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockScaled(const bpFloat* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const tIndex5D& aBlockIndex)
+{
+  CopyBlockScaledT(aFileDataBlock, aScale, aOffset, aBlockIndex);
+}
+
+
+template<typename TDataType>
+template<typename TInput>
+void bpImageConverterImpl<TDataType>::CopyBlockScaledT(const TInput* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const tIndex5D& aBlockIndex)
+{
+  CopyBlock(cBlockData{ nullptr, aFileDataBlock, &ReadScaledRow<TInput>, ePackedDataMono12p, aScale, aOffset }, aBlockIndex, true);
+}
+
+
+template<typename TDataType>
+template<typename TInput>
+void bpImageConverterImpl<TDataType>::ReadScaledRow(const cBlockData& aBlockData, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse)
+{
+  const TInput* vSource = static_cast<const TInput*>(aBlockData.mData) + aFirstValue;
+  bpConvertStrided(vSource, aStep, aCount, aDest, aReverse, aBlockData.mScale, aBlockData.mOffset);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlock(const TDataType* aFileDataBlock, const tIndex5D& aBlockIndex, bool aWaitIfBusy)
+{
+  CopyBlock(cBlockData{ aFileDataBlock, nullptr, nullptr, ePackedDataMono12p, 1, 0 }, aBlockIndex, aWaitIfBusy);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlock(const cBlockData& aFileDataBlock, const tIndex5D& aBlockIndex, bool aWaitIfBusy)
+{
+  if (!aFileDataBlock.mValues && !aFileDataBlock.mData) {
     return;
   }
 
-  bpSize vBlockIndex = GetFileBlockIndex1D(aBlockIndex);
-  if (mBlockCopied[vBlockIndex]) {
+  tBlockIndices vBlockIndices = GetBlockIndices(aBlockIndex);
+  SetBlockCopied(aBlockIndex, GetFileBlockIndex1D(vBlockIndices));
+
+  if (aWaitIfBusy) {
+    mMultiresolutionImage.WaitForMemory();
+  }
+  CopyFileBlockToImage(vBlockIndices, aFileDataBlock, aWaitIfBusy);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::SetBlockCopied(const tIndex5D& aBlockIndex, bpSize aFileBlockIndex1D)
+{
+  // a time point block whose blocks are all copied is released, copying to it again throws in Get
+  cBlocksCopied& vBlocksCopied = mBlockCopied->Get(aBlockIndex[T]);
+  if (vBlocksCopied.mIsCopied[aFileBlockIndex1D].exchange(true)) {
     throw bpError("Block data has already been copied");
   }
-  mBlockCopied[vBlockIndex] = true;
+  if (++vBlocksCopied.mNumberOfCopied == vBlocksCopied.mIsCopied.size()) {
+    mBlockCopied->Release(aBlockIndex[T]);
+  }
+}
 
-  CopyFileBlockToImage(aBlockIndex, aFileDataBlock);
+
+template<typename TDataType>
+bool bpImageConverterImpl<TDataType>::TryCopyBlock(const TDataType* aFileDataBlock, const tIndex5D& aBlockIndex)
+{
+  if (mMultiresolutionImage.IsBusy()) {
+    return false;
+  }
+
+  // the blocks completed by this copy may exceed the queue limit, but the caller must not wait
+  CopyBlock(aFileDataBlock, aBlockIndex, false);
+  return true;
 }
 
 
 template<typename TDataType>
-bpSize bpImageConverterImpl<TDataType>::GetFileBlockIndex1D(const bpConverterTypes::tIndex5D& aBlockIndex) const
+tCopyHandle bpImageConverterImpl<TDataType>::CopyBlockAsync(const TDataType* aFileDataBlock, const tIndex5D& aBlockIndex)
 {
-  bpSize vBlockIndex = 0;
-  bpSize vNumberOfBlocks = 1;
+  auto vCopied = std::make_shared<std::promise<void>>();
+  tCopyHandle vHandle = vCopied->get_future().share();
+  ++mNumberOfAsyncCopies;
+  mAsyncCopyThread->Run([this, aFileDataBlock, aBlockIndex, vCopied] {
+    std::exception_ptr vError;
+    try {
+      CopyBlock(aFileDataBlock, aBlockIndex, true);
+    }
+    catch (...) {
+      vError = std::current_exception();
+    }
+    --mNumberOfAsyncCopies;
+    if (vError) {
+      vCopied->set_exception(vError);
+    }
+    else {
+      vCopied->set_value();
+    }
+  });
+  return vHandle;
+}
+
+
+template<typename TDataType>
+cQueueStatus bpImageConverterImpl<TDataType>::GetQueueStatus() const
+{
+  cQueueStatus vStatus;
+  vStatus.mCopyJobs = mNumberOfAsyncCopies;
+  vStatus.mCopyBytes = vStatus.mCopyJobs * mFileBlockSize[X] * mFileBlockSize[Y] * mFileBlockSize[Z] * mFileBlockSize[C] * mFileBlockSize[T] * sizeof(TDataType);
+  vStatus.mBlockJobs = mMultiresolutionImage.GetNumberOfQueuedBlocks();
+  vStatus.mWriteBytes = mMultiresolutionImage.GetQueuedWriteBytes();
+  vStatus.mIsBusy = mMultiresolutionImage.IsBusy();
+  typename bpMemoryManager<TDataType>::cStatistics vMemory = mMultiresolutionImage.GetMemoryStatistics();
+  vStatus.mBlockMemoryBytes = vMemory.mUsedBytes;
+  vStatus.mCachedMemoryBytes = vMemory.mCachedBytes;
+  vStatus.mPeakMemoryBytes = vMemory.mPeakUsedBytes;
+  return vStatus;
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyBlockOwned(TDataType* aFileDataBlock, const tIndex5D& aBlockIndex, tReleaseCallback aRelease)
+{
+  bpSize vFileBlockSize = mFileBlockSize[X] * mFileBlockSize[Y] * mFileBlockSize[Z] * mFileBlockSize[C] * mFileBlockSize[T];
+  // calls aRelease when the last user (histogram, resampling, compression, thumbnail) lets go of the data
+  bpMemoryBlock<TDataType> vFileDataBlock(aFileDataBlock, vFileBlockSize, [vRelease = std::move(aRelease)] {
+    if (vRelease) {
+      vRelease();
+    }
+  });
+
+  if (!mCanAdoptFileBlocks) {
+    CopyBlock(aFileDataBlock, aBlockIndex);
+    return;
+  }
+
+  if (!aFileDataBlock) {
+    return;
+  }
+
+  SetBlockCopied(aBlockIndex, GetFileBlockIndex1D(GetBlockIndices(aBlockIndex)));
+
+  // the adopted data counts against the budget like a block allocated for a copy, until it is released
+  mMultiresolutionImage.WaitForMemory();
+  bpSize vBytes = vFileBlockSize * sizeof(TDataType);
+  mMemoryBudget->Add(vBytes);
+  bpMemoryBlock<TDataType> vChargedBlock(aFileDataBlock, vFileBlockSize, [vFileDataBlock, vBudget = mMemoryBudget, vBytes] {
+    vBudget->Remove(vBytes);
+  });
+  mMultiresolutionImage.AdoptMemoryBlock(aBlockIndex[T], aBlockIndex[C], { aBlockIndex[X], aBlockIndex[Y], aBlockIndex[Z] }, std::move(vChargedBlock));
+}
+
+
+template<typename TDataType>
+tSize5D bpImageConverterImpl<TDataType>::GetOwnedFileBlockSize(const tSize5D& aImageSize, const cOptions& aOptions)
+{
+  bpVec3 vBlockSize = bpMultiresolutionImsImage<TDataType>::GetFullResolutionMemoryBlockSize(
+    { aImageSize[X], aImageSize[Y], aImageSize[Z] }, aImageSize[T], aOptions.mForceFileBlockSizeZ1);
+  return tSize5D(X, vBlockSize[0], Y, vBlockSize[1], Z, vBlockSize[2], C, 1, T, 1);
+}
+
+
+template<typename TDataType>
+typename bpImageConverterImpl<TDataType>::tBlockIndices bpImageConverterImpl<TDataType>::GetBlockIndices(const tIndex5D& aBlockIndex) const
+{
+  tBlockIndices vBlockIndices;
   for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
     Dimension vDim = mBlockDataDimensionSequence[vDimIndex];
-    vBlockIndex += aBlockIndex[vDim] * vNumberOfBlocks;
-    vNumberOfBlocks *= mNumberOfBlocks[vDim];
+    vBlockIndices[vDimIndex] = aBlockIndex[vDim];
+    if (vBlockIndices[vDimIndex] >= mCopyPlan.mNumberOfBlocks[vDimIndex] && (vDim != T || !mAppendTimePoints)) {
+      throw bpError("Block index is outside of the image");
+    }
+  }
+  return vBlockIndices;
+}
+
+
+template<typename TDataType>
+bpSize bpImageConverterImpl<TDataType>::GetFileBlockIndex1D(const tBlockIndices& aBlockIndices) const
+{
+  bpSize vBlockIndex = 0;
+  for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
+    vBlockIndex += aBlockIndices[vDimIndex] * mCopyPlan.mBlockIndexWeight[vDimIndex];
   }
   return vBlockIndex;
 }
@@ -127,6 +365,7 @@ void bpImageConverterImpl<TDataType>::Finish(
   const tColorInfoVector& aColorInfoPerChannel,
   bool aAutoAdjustColorRange)
 {
+  mAsyncCopyThread->WaitAll();
   mMultiresolutionImage.FinishWriteDataBlocks();
   tColorInfoVector vColorInfoPerChannel(aColorInfoPerChannel);
   if (aAutoAdjustColorRange) {
@@ -182,205 +421,491 @@ void bpImageConverterImpl<TDataType>::GetFullRangeOfFileBlock(bpSize aFileBlockI
 
 
 template<typename TDataType>
-void bpImageConverterImpl<TDataType>::CopyFileBlockToImage(const tSize5D& aFileBlockIndices, const TDataType* aDataBlock)
+void bpImageConverterImpl<TDataType>::InitCopyPlan()
 {
-  bpSize vDimNrX;
-  bpSize vDimNrY;
-  bpSize vDimNrZ;
-
-  // find position of DimX and DimY in BlockDataDimensionSequence
+  cCopyPlan& vPlan = mCopyPlan;
+  bpSize vNonXYDimIndex = 0;
+  bpSize vBlockIndexWeight = 1;
   for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
-    if (mBlockDataDimensionSequence[vDimIndex] == X) {
-      vDimNrX = vDimIndex;
+    Dimension vDimension = mBlockDataDimensionSequence[vDimIndex];
+    if (vDimension == X) {
+      vPlan.mDimX = vDimIndex;
     }
-    else if (mBlockDataDimensionSequence[vDimIndex] == Y) {
-      vDimNrY = vDimIndex;
+    else if (vDimension == Y) {
+      vPlan.mDimY = vDimIndex;
     }
-    else if (mBlockDataDimensionSequence[vDimIndex] == Z) {
-      vDimNrZ = vDimIndex;
+    else {
+      vPlan.mNonXYDims[vNonXYDimIndex++] = vDimIndex;
     }
-  }
 
-  bpSize vFileBlockSize[5];
-  for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
-    Dimension vDimension = mBlockDataDimensionSequence[vDimIndex];
-    bpSize vBlockSize = mFileBlockSize[vDimension];
-    vFileBlockSize[vDimIndex] = vBlockSize;
+    vPlan.mImageDims[vDimIndex] = static_cast<bpSize>(vDimension);
+    vPlan.mFileBlockSize[vDimIndex] = mFileBlockSize[vDimension];
+    vPlan.mNumberOfBlocks[vDimIndex] = mNumberOfBlocks[vDimension];
+    // time point blocks have their own copied flags
+    vPlan.mBlockIndexWeight[vDimIndex] = vDimension != T ? vBlockIndexWeight : 0;
+    if (vDimension != T) {
+      vBlockIndexWeight *= mNumberOfBlocks[vDimension];
+    }
+    vPlan.mDimWeight[vDimIndex] = vDimIndex > 0 ? vPlan.mFileBlockSize[vDimIndex - 1] * vPlan.mDimWeight[vDimIndex - 1] : 1;
+    vPlan.mSample[vDimIndex] = mSample[vDimension];
+    vPlan.mMinLimit[vDimIndex] = mMinLimit[vDimension];
+
+    std::vector<cBlockRange>& vRanges = vPlan.mRanges[vDimIndex];
+    vRanges.resize(mNumberOfBlocks[vDimension]);
+    for (bpSize vBlockIndex = 0; vBlockIndex < vRanges.size(); ++vBlockIndex) {
+      cBlockRange& vRange = vRanges[vBlockIndex];
+      GetRangeOfFileBlock(vBlockIndex, vDimension, vRange.mBeginInBlock, vRange.mEndInBlock);
+      GetFullRangeOfFileBlock(vBlockIndex, vDimension, vRange.mBegin, vRange.mEnd);
+    }
   }
 
-  bpSize vFileBlockIndices[5];
-  for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
-    Dimension vDimension = mBlockDataDimensionSequence[vDimIndex];
-    bpSize vBlockIndex = aFileBlockIndices[vDimension];
-    vFileBlockIndices[vDimIndex] = vBlockIndex;
+  vPlan.mStepXY = { mSample[X] * vPlan.mDimWeight[vPlan.mDimX], mSample[Y] * vPlan.mDimWeight[vPlan.mDimY] };
+  vPlan.mIsFlippedXY = { mIsFlipped[0], mIsFlipped[1] };
+  vPlan.mIsFlippedZ = mIsFlipped[2];
+  vPlan.mImageSizeZ = mImageSize[Z];
+  vPlan.mCanRawCopy =
+    vPlan.mDimX == 0 && vPlan.mDimY == 1 &&
+    mSample[X] == 1 && mSample[Y] == 1 &&
+    !mIsFlipped[0] && !mIsFlipped[1];
+  vPlan.mCopyParallel = mCopyThreads && mParallelCopyThreshold > 0 &&
+    mFileBlockSize[X] * mFileBlockSize[Y] * mFileBlockSize[Z] * mFileBlockSize[C] * mFileBlockSize[T] * sizeof(TDataType) >= mParallelCopyThreshold;
+
+  bool vIsSampled = mSample[X] != 1 || mSample[Y] != 1 || mSample[Z] != 1 || mSample[C] != 1 || mSample[T] != 1;
+  if (vIsSampled) {
+    mCopyFileBlockToImage = &bpImageConverterImpl::CopyFileBlockToImageT<5, 5, true>;
+  }
+  else if (vPlan.mDimX == 0 && vPlan.mDimY == 1) {
+    // XYZCT, XYCZT, ...
+    mCopyFileBlockToImage = &bpImageConverterImpl::CopyFileBlockToImageT<0, 1, false>;
+  }
+  else if (vPlan.mDimX == 1 && vPlan.mDimY == 2) {
+    // CXYZT, ...
+    mCopyFileBlockToImage = &bpImageConverterImpl::CopyFileBlockToImageT<1, 2, false>;
+  }
+  else {
+    mCopyFileBlockToImage = &bpImageConverterImpl::CopyFileBlockToImageT<5, 5, false>;
   }
+}
 
-  bpSize vDimensionMap[5];
-  for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
-    Dimension vDimension = mBlockDataDimensionSequence[vDimIndex];
-    switch (vDimension) {
-    case X:
-      vDimensionMap[vDimIndex] = 0;
-      continue;
-    case Y:
-      vDimensionMap[vDimIndex] = 1;
-      continue;
-    case Z:
-      vDimensionMap[vDimIndex] = 2;
-      continue;
-    case C:
-      vDimensionMap[vDimIndex] = 3;
-      continue;
-    case T:
-      vDimensionMap[vDimIndex] = 4;
-      continue;
+
+template<typename TDataType>
+constexpr bpSize bpImageConverterImpl<TDataType>::GetNonXYDim(bpSize aDimX, bpSize aDimY, bpSize aIndex)
+{
+  bpSize vCount = 0;
+  for (bpSize vDim = 0; vDim < 5; ++vDim) {
+    if (vDim != aDimX && vDim != aDimY) {
+      if (vCount == aIndex) {
+        return vDim;
+      }
+      ++vCount;
     }
   }
+  return 5;
+}
 
-  // needs to be in order of memoryBlockDataDimensionSequence
-  bpSize vMemSample[5];
-  vMemSample[0] = mSample[X];
-  vMemSample[1] = mSample[Y];
-  vMemSample[2] = mSample[Z];
-  vMemSample[3] = mSample[C];
-  vMemSample[4] = mSample[T];
-
-  bpSize vMemMinLimits[5];
-  vMemMinLimits[0] = mMinLimit[X];
-  vMemMinLimits[1] = mMinLimit[Y];
-  vMemMinLimits[2] = mMinLimit[Z];
-  vMemMinLimits[3] = mMinLimit[C];
-  vMemMinLimits[4] = mMinLimit[T];
-
-  bpSize vMemMaxLimits[5];
-  vMemMaxLimits[0] = mMaxLimit[X];
-  vMemMaxLimits[1] = mMaxLimit[Y];
-  vMemMaxLimits[2] = mMaxLimit[Z];
-  vMemMaxLimits[3] = mMaxLimit[C];
-  vMemMaxLimits[4] = mMaxLimit[T];
 
-  bpSize vDimWeight[5];
-  bpSize vBeginInBlock[5]; // Offset in the block to the beginning of the data for the nth dimension (min is 0 and max is blocksize - 1)
-  bpSize vEndInBlock[5]; // Offset in the block to the end of the data (of the block) for the nth dimension (min is 1 and max is blocksize)
-  bpSize vNonXYDim[3];
-  bpSize vNonXYDimIndex = 0;
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyFileBlockToImage(const tBlockIndices& aFileBlockIndices, const cBlockData& aDataBlock, bool aWaitIfBusy)
+{
+  (this->*mCopyFileBlockToImage)(aFileBlockIndices, aDataBlock, aWaitIfBusy);
+}
 
-  bpSize vDimX = vDimNrX;
-  bpSize vDimY = vDimNrY;
+
+template<typename TDataType>
+template<bpSize DimX, bpSize DimY, bool IsSampled>
+void bpImageConverterImpl<TDataType>::CopyFileBlockToImageT(const tBlockIndices& aFileBlockIndices, const cBlockData& aDataBlock, bool aWaitIfBusy)
+{
+  const cCopyPlan& vPlan = mCopyPlan;
+  const bool vIsDimXYFromPlan = DimX >= 5;
+  const bpSize vDimX = vIsDimXYFromPlan ? vPlan.mDimX : DimX;
+  const bpSize vDimY = vIsDimXYFromPlan ? vPlan.mDimY : DimY;
+  const bpSize vDim0 = vIsDimXYFromPlan ? vPlan.mNonXYDims[0] : GetNonXYDim(DimX, DimY, 0);
+  const bpSize vDim1 = vIsDimXYFromPlan ? vPlan.mNonXYDims[1] : GetNonXYDim(DimX, DimY, 1);
+  const bpSize vDim2 = vIsDimXYFromPlan ? vPlan.mNonXYDims[2] : GetNonXYDim(DimX, DimY, 2);
+
+  const cBlockRange* vRanges[5];
   for (bpSize vDim = 0; vDim < 5; ++vDim) {
-    GetRangeOfFileBlock(vFileBlockIndices[vDim], mBlockDataDimensionSequence[vDim], vBeginInBlock[vDim], vEndInBlock[vDim]);
-    if (vBeginInBlock[vDim] >= vEndInBlock[vDim]) {
+    // appended time points have the range of the initial ones
+    vRanges[vDim] = &vPlan.mRanges[vDim][std::min(aFileBlockIndices[vDim], vPlan.mRanges[vDim].size() - 1)];
+    if (vRanges[vDim]->mBeginInBlock >= vRanges[vDim]->mEndInBlock) {
       throw bpError("Block data has no overlap with result image");
     }
+  }
+  const cBlockRange& vRangeX = *vRanges[vDimX];
+  const cBlockRange& vRangeY = *vRanges[vDimY];
+  const cBlockRange& vRange0 = *vRanges[vDim0];
+  const cBlockRange& vRange1 = *vRanges[vDim1];
+  const cBlockRange& vRange2 = *vRanges[vDim2];
+
+  bpSize vSizeY = vRangeY.mEnd - vRangeY.mBegin;
+
+  cSliceLayout vLayout;
+  vLayout.mCopyBlockIndexXY = { aFileBlockIndices[vDimX], aFileBlockIndices[vDimY] };
+  vLayout.mSizeXY = { vRangeX.mEnd - vRangeX.mBegin, vSizeY };
+  vLayout.mStepXY = vPlan.mStepXY;
+  vLayout.mIsFlippedXY = vPlan.mIsFlippedXY;
+  vLayout.mCanRawCopy = vPlan.mCanRawCopy && vRangeX.mBeginInBlock == 0 && vRangeX.mEndInBlock == vPlan.mFileBlockSize[vDimX];
+
+  const bpSize vStep0 = IsSampled ? vPlan.mSample[vDim0] : 1;
+  const bpSize vStep1 = IsSampled ? vPlan.mSample[vDim1] : 1;
+  const bpSize vStep2 = IsSampled ? vPlan.mSample[vDim2] : 1;
+
+  // image index of the file block origin, unsigned wrap around cancels when the index in the block is added
+  const bpSize vOrigin0 = aFileBlockIndices[vDim0] * vPlan.mFileBlockSize[vDim0] - vPlan.mMinLimit[vDim0];
+  const bpSize vOrigin1 = aFileBlockIndices[vDim1] * vPlan.mFileBlockSize[vDim1] - vPlan.mMinLimit[vDim1];
+  const bpSize vOrigin2 = aFileBlockIndices[vDim2] * vPlan.mFileBlockSize[vDim2] - vPlan.mMinLimit[vDim2];
+
+  const bpSize vOffsetXY = vPlan.mDimWeight[vDimY] * vRangeY.mBeginInBlock + vPlan.mDimWeight[vDimX] * vRangeX.mBeginInBlock;
+
+  std::vector<cSlice> vSlices;
+  std::vector<TDataType> vTempBuffer;
+
+  bpSize vImageIndex[5]; // Image global index for dimension X, Y, Z, C, T (the order is 0, 1, 2, 3, 4)
+
+  for (bpSize vIndex2 = vRange2.mBeginInBlock; vIndex2 < vRange2.mEndInBlock; vIndex2 += vStep2) {
+    vImageIndex[vPlan.mImageDims[vDim2]] = IsSampled ? (vOrigin2 + vIndex2) / vStep2 : vOrigin2 + vIndex2;
+    bpSize vOffset2 = vOffsetXY + vPlan.mDimWeight[vDim2] * vIndex2;
+
+    for (bpSize vIndex1 = vRange1.mBeginInBlock; vIndex1 < vRange1.mEndInBlock; vIndex1 += vStep1) {
+      vImageIndex[vPlan.mImageDims[vDim1]] = IsSampled ? (vOrigin1 + vIndex1) / vStep1 : vOrigin1 + vIndex1;
+      bpSize vOffset1 = vOffset2 + vPlan.mDimWeight[vDim1] * vIndex1;
+
+      for (bpSize vIndex0 = vRange0.mBeginInBlock; vIndex0 < vRange0.mEndInBlock; vIndex0 += vStep0) {
+        vImageIndex[vPlan.mImageDims[vDim0]] = IsSampled ? (vOrigin0 + vIndex0) / vStep0 : vOrigin0 + vIndex0;
+
+        // The indices here are memoryIndices for each dim, not block indices!
+        // T,C,Z are only one memoryIndex (for each dim), X,Y can contain span (vBegin, vEnd) over a range of memoryIndices (for each dim)
+        cSlice vSlice;
+        vSlice.mIndexT = vImageIndex[4];
+        vSlice.mIndexC = vImageIndex[3];
+        vSlice.mIndexZ = vPlan.mIsFlippedZ ? vPlan.mImageSizeZ - vImageIndex[2] - 1 : vImageIndex[2];
+        vSlice.mOffset = vOffset1 + vPlan.mDimWeight[vDim0] * vIndex0;
+
+        if (vPlan.mCopyParallel) {
+          vSlices.push_back(vSlice);
+        }
+        else {
+          CopySliceRows(vLayout, aDataBlock, vSlice, 0, vSizeY, vTempBuffer);
+          mMultiresolutionImage.SetDataCopied(vSlice.mIndexT, vSlice.mIndexC, vSlice.mIndexZ, vLayout.mCopyBlockIndexXY, aWaitIfBusy);
+        }
+      }
+    }
+  }
 
-    vDimWeight[vDim] = vDim > 0 ? vFileBlockSize[vDim - 1] * vDimWeight[vDim - 1] : 1;
+  if (vPlan.mCopyParallel) {
+    CopySlicesParallel(vLayout, aDataBlock, vSlices, aWaitIfBusy);
+  }
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopySliceRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const cSlice& aSlice, bpSize aBeginY, bpSize aEndY, std::vector<TDataType>& aBuffer)
+{
+  bpVec2 vBeginXY;
+  bpVec2 vEndXY;
+  if (!mMultiresolutionImage.GetCopyBlockRegion(aLayout.mCopyBlockIndexXY, aSlice.mIndexZ, vBeginXY, vEndXY)) {
+    return;
+  }
+
+  bpSize vSizeX = aLayout.mSizeXY[0];
+  bpSize vStepY = aLayout.mStepXY[1];
+
+  if (aLayout.mCanRawCopy && aDataBlock.mValues) {
+    bpVec2 vRowsBeginXY = { vBeginXY[0], vBeginXY[1] + aBeginY };
+    bpVec2 vRowsEndXY = { vBeginXY[0] + vSizeX, vBeginXY[1] + aEndY };
+    const TDataType* vRows = aDataBlock.mValues + aSlice.mOffset + aBeginY * vStepY;
+    mMultiresolutionImage.CopyData(aSlice.mIndexT, aSlice.mIndexC, aSlice.mIndexZ, vRowsBeginXY, vRowsEndXY, vRows);
+    return;
+  }
+
+  // gather (and convert) the rows in chunks small enough to stay in cache until they are copied to the image
+  bpSize vRowsPerChunk = GetRowsPerChunk(vSizeX);
+  aBuffer.resize(std::min(vRowsPerChunk, aEndY - aBeginY) * vSizeX);
+  TDataType* vBuffer = aBuffer.data();
+  for (bpSize vChunkBeginY = aBeginY; vChunkBeginY < aEndY; vChunkBeginY += vRowsPerChunk) {
+    bpSize vChunkEndY = std::min(vChunkBeginY + vRowsPerChunk, aEndY);
+    ReadSliceRows(aLayout, aDataBlock, aSlice.mOffset, vChunkBeginY, vChunkEndY, vBuffer);
+
+    bpVec2 vRowsBeginXY = { vBeginXY[0], vBeginXY[1] + vChunkBeginY };
+    bpVec2 vRowsEndXY = { vBeginXY[0] + vSizeX, vBeginXY[1] + vChunkEndY };
+    mMultiresolutionImage.CopyData(aSlice.mIndexT, aSlice.mIndexC, aSlice.mIndexZ, vRowsBeginXY, vRowsEndXY, vBuffer);
+  }
+}
+
+
+template<typename TDataType>
+bpSize bpImageConverterImpl<TDataType>::GetRowsPerChunk(bpSize aSizeX)
+{
+  const bpSize vChunkBytes = 256 * 1024;
+  return std::max<bpSize>(vChunkBytes / (aSizeX * sizeof(TDataType)), 1);
+}
 
-    if (vDim != vDimX && vDim != vDimY) {
-      vNonXYDim[vNonXYDimIndex++] = vDim;
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::ReadSliceRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, bpSize aOffset, bpSize aBeginY, bpSize aEndY, TDataType* aBuffer)
+{
+  bpSize vSizeX = aLayout.mSizeXY[0];
+  bpSize vSizeY = aLayout.mSizeXY[1];
+  bpSize vStepX = aLayout.mStepXY[0];
+  bpSize vStepY = aLayout.mStepXY[1];
+  bool vIsFlippedX = aLayout.mIsFlippedXY[0];
+  bool vIsFlippedY = aLayout.mIsFlippedXY[1];
+  for (bpSize vIndexY = aBeginY; vIndexY < aEndY; ++vIndexY) {
+    bpSize vSource = aOffset + ((!vIsFlippedY ? vIndexY : vSizeY - vIndexY - 1) * vStepY);
+    TDataType* vPtr = aBuffer + ((vIndexY - aBeginY) * vSizeX);
+    if (aDataBlock.mValues) {
+      bpCopyStrided(aDataBlock.mValues + vSource, vStepX, vSizeX, vPtr, vIsFlippedX);
+    }
+    else {
+      aDataBlock.mReadRow(aDataBlock, vSource, vStepX, vSizeX, vPtr, vIsFlippedX);
     }
   }
+}
 
-  bpSize vDim2 = vNonXYDim[2];
-  bpSize vD2 = vDimensionMap[vDim2];
-  bpSize vDim1 = vNonXYDim[1];
-  bpSize vD1 = vDimensionMap[vDim1];
-  bpSize vDim0 = vNonXYDim[0];
-  bpSize vD0 = vDimensionMap[vDim0];
 
-  bpSize vBeginX;
-  bpSize vEndX;
-  GetFullRangeOfFileBlock(vFileBlockIndices[vDimX], mBlockDataDimensionSequence[vDimX], vBeginX, vEndX);
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyRegion(const TDataType* aData, const tIndex5D& aOffset, const tSize5D& aSize)
+{
+  if (!aData) {
+    return;
+  }
+  if (!mTiles.empty()) {
+    throw bpError("Regions cannot be copied to a tiled image");
+  }
+  CopyRegion(aData, aOffset, aSize, nullptr);
+}
 
-  bpSize vBeginY;
-  bpSize vEndY;
-  GetFullRangeOfFileBlock(vFileBlockIndices[vDimY], mBlockDataDimensionSequence[vDimY], vBeginY, vEndY);
 
-  bpVec2 vBegin{
-    mIsFlipped[0] ? mImageSize[X] - vEndX : vBeginX,
-    mIsFlipped[1] ? mImageSize[Y] - vEndY : vBeginY
-  };
-  bpVec2 vEnd{
-    mIsFlipped[0] ? mImageSize[X] - vBeginX : vEndX,
-    mIsFlipped[1] ? mImageSize[Y] - vBeginY : vEndY
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::SetTiles(const tTileVector& aTiles, tOverlapPolicy aPolicy)
+{
+  if (!mTiles.empty()) {
+    throw bpError("Tiles have already been set");
+  }
+  if (mAppendTimePoints) {
+    throw bpError("Tiles cannot be set when appending time points");
+  }
+  if (aTiles.empty()) {
+    throw bpError("The mosaic has no tiles");
+  }
+
+  // boxes in the sampled image, flipped in Z like the copied slices
+  std::vector<bpTileLayout::cBox> vBoxes;
+  vBoxes.reserve(aTiles.size());
+  for (const cTile& vTile : aTiles) {
+    bpTileLayout::cBox vBox;
+    for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
+      Dimension vDim = static_cast<Dimension>(vDimIndex);
+      if (vTile.mOffset[vDim] + vTile.mSize[vDim] > mImageSize[vDim]) {
+        throw bpError("Tile is outside of the image");
+      }
+      vBox.mBegin[vDimIndex] = Div(vTile.mOffset[vDim], mSample[vDim]);
+      vBox.mEnd[vDimIndex] = Div(vTile.mOffset[vDim] + vTile.mSize[vDim], mSample[vDim]);
+    }
+    if (mCopyPlan.mIsFlippedZ) {
+      bpSize vBeginZ = vBox.mBegin[2];
+      vBox.mBegin[2] = mCopyPlan.mImageSizeZ - vBox.mEnd[2];
+      vBox.mEnd[2] = mCopyPlan.mImageSizeZ - vBeginZ;
+    }
+    vBoxes.push_back(vBox);
+  }
+
+  mTiles = aTiles;
+  mTileCopied = std::vector<std::atomic<bool>>(aTiles.size());
+  mMultiresolutionImage.SetTiles(std::make_unique<bpTileLayout>(std::move(vBoxes), aPolicy));
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyTile(const TDataType* aData, bpSize aTileIndex)
+{
+  if (aTileIndex >= mTiles.size()) {
+    throw bpError("Tile index is out of range");
+  }
+  if (!aData) {
+    return;
+  }
+  if (mTileCopied[aTileIndex].exchange(true)) {
+    throw bpError("Tile data has already been copied");
+  }
+  CopyRegion(aData, mTiles[aTileIndex].mOffset, mTiles[aTileIndex].mSize, &aTileIndex);
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyRegion(const TDataType* aData, const tIndex5D& aOffset, const tSize5D& aSize, const bpSize* aTileIndex)
+{
+
+  // image range of the region and the data offset of its first sampled value, in the order of the block dimension sequence
+  bpSize vBegin[5];
+  bpSize vEnd[5];
+  bpSize vDimWeight[5];
+  bpSize vOffset = 0;
+  bpSize vWeight = 1;
+  for (bpSize vDimIndex = 0; vDimIndex < 5; ++vDimIndex) {
+    Dimension vDim = mBlockDataDimensionSequence[vDimIndex];
+    if (aOffset[vDim] + aSize[vDim] > mImageSize[vDim] && (vDim != T || !mAppendTimePoints)) {
+      throw bpError("Region is outside of the image");
+    }
+    vBegin[vDimIndex] = Div(aOffset[vDim], mSample[vDim]);
+    vEnd[vDimIndex] = Div(aOffset[vDim] + aSize[vDim], mSample[vDim]);
+    if (vBegin[vDimIndex] >= vEnd[vDimIndex]) {
+      return;
+    }
+    vDimWeight[vDimIndex] = vWeight;
+    vOffset += (vBegin[vDimIndex] * mSample[vDim] - aOffset[vDim]) * vWeight;
+    vWeight *= aSize[vDim];
+  }
+
+  const cCopyPlan& vPlan = mCopyPlan;
+  const bpSize vDimX = vPlan.mDimX;
+  const bpSize vDimY = vPlan.mDimY;
+  const bpSize vDim0 = vPlan.mNonXYDims[0];
+  const bpSize vDim1 = vPlan.mNonXYDims[1];
+  const bpSize vDim2 = vPlan.mNonXYDims[2];
+
+  cSliceLayout vLayout;
+  vLayout.mCopyBlockIndexXY = { 0, 0 };
+  vLayout.mSizeXY = { vEnd[vDimX] - vBegin[vDimX], vEnd[vDimY] - vBegin[vDimY] };
+  vLayout.mStepXY = { vPlan.mSample[vDimX] * vDimWeight[vDimX], vPlan.mSample[vDimY] * vDimWeight[vDimY] };
+  vLayout.mIsFlippedXY = vPlan.mIsFlippedXY;
+  vLayout.mCanRawCopy = vPlan.mCanRawCopy;
+
+  mMultiresolutionImage.WaitForMemory();
+  cBlockData vDataBlock{ aData, nullptr, nullptr, ePackedDataMono12p, 1, 0 };
+  bpVec2 vBeginXY = { vBegin[vDimX], vBegin[vDimY] };
+  std::vector<TDataType> vBuffer;
+  bpSize vImageIndex[5];
+  for (bpSize vIndex2 = vBegin[vDim2]; vIndex2 < vEnd[vDim2]; ++vIndex2) {
+    vImageIndex[vPlan.mImageDims[vDim2]] = vIndex2;
+    bpSize vOffset2 = vOffset + (vIndex2 - vBegin[vDim2]) * vPlan.mSample[vDim2] * vDimWeight[vDim2];
+    for (bpSize vIndex1 = vBegin[vDim1]; vIndex1 < vEnd[vDim1]; ++vIndex1) {
+      vImageIndex[vPlan.mImageDims[vDim1]] = vIndex1;
+      bpSize vOffset1 = vOffset2 + (vIndex1 - vBegin[vDim1]) * vPlan.mSample[vDim1] * vDimWeight[vDim1];
+      for (bpSize vIndex0 = vBegin[vDim0]; vIndex0 < vEnd[vDim0]; ++vIndex0) {
+        vImageIndex[vPlan.mImageDims[vDim0]] = vIndex0;
+
+        cSlice vSlice;
+        vSlice.mIndexT = vImageIndex[4];
+        vSlice.mIndexC = vImageIndex[3];
+        vSlice.mIndexZ = vPlan.mIsFlippedZ ? vPlan.mImageSizeZ - vImageIndex[2] - 1 : vImageIndex[2];
+        vSlice.mOffset = vOffset1 + (vIndex0 - vBegin[vDim0]) * vPlan.mSample[vDim0] * vDimWeight[vDim0];
+        CopyRegionRows(vLayout, vDataBlock, vSlice, vBeginXY, aTileIndex, vBuffer);
+      }
+    }
+  }
+}
+
+
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopyRegionRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const cSlice& aSlice, const bpVec2& aBeginXY, const bpSize* aTileIndex, std::vector<TDataType>& aBuffer)
+{
+  auto vCopy = [this, &aSlice, aTileIndex](const bpVec2& aRowsBeginXY, const bpVec2& aRowsEndXY, const TDataType* aData) {
+    if (aTileIndex) {
+      mMultiresolutionImage.CopyTile(*aTileIndex, aSlice.mIndexT, aSlice.mIndexC, aSlice.mIndexZ, aRowsBeginXY, aRowsEndXY, aData, true);
+    }
+    else {
+      mMultiresolutionImage.CopyRegion(aSlice.mIndexT, aSlice.mIndexC, aSlice.mIndexZ, aRowsBeginXY, aRowsEndXY, aData, true);
+    }
   };
 
-  bpSize vDimWeightX = vDimWeight[vDimX];
-  bpSize vDimWeightY = vDimWeight[vDimY];
-  bpSize vStepX = vMemSample[0] * vDimWeightX;
-  bpSize vStepY = vMemSample[1] * vDimWeightY;
+  bpSize vSizeX = aLayout.mSizeXY[0];
+  bpSize vSizeY = aLayout.mSizeXY[1];
+  if (aLayout.mCanRawCopy && aDataBlock.mValues) {
+    bpVec2 vEndXY = { aBeginXY[0] + vSizeX, aBeginXY[1] + vSizeY };
+    vCopy(aBeginXY, vEndXY, aDataBlock.mValues + aSlice.mOffset);
+    return;
+  }
 
-  bpSize vSizeX = vEndX - vBeginX;
-  bpSize vSizeY = vEndY - vBeginY;
-  bpSize vSizeXY = vSizeX * vSizeY;
+  bpSize vRowsPerChunk = GetRowsPerChunk(vSizeX);
+  aBuffer.resize(std::min(vRowsPerChunk, vSizeY) * vSizeX);
+  TDataType* vBuffer = aBuffer.data();
+  for (bpSize vChunkBeginY = 0; vChunkBeginY < vSizeY; vChunkBeginY += vRowsPerChunk) {
+    bpSize vChunkEndY = std::min(vChunkBeginY + vRowsPerChunk, vSizeY);
+    ReadSliceRows(aLayout, aDataBlock, aSlice.mOffset, vChunkBeginY, vChunkEndY, vBuffer);
 
-  bool vIsFlippedX = mIsFlipped[0];
-  bool vIsFlippedY = mIsFlipped[1];
+    bpVec2 vRowsBeginXY = { aBeginXY[0], aBeginXY[1] + vChunkBeginY };
+    bpVec2 vRowsEndXY = { aBeginXY[0] + vSizeX, aBeginXY[1] + vChunkEndY };
+    vCopy(vRowsBeginXY, vRowsEndXY, vBuffer);
+  }
+}
 
-  bool vCanRawCopy =
-    vDimX == 0 && vDimY == 1 &&
-    vMemSample[0] == 1 && vMemSample[1] == 1 &&
-    vBeginInBlock[vDimX] == 0 && vEndInBlock[vDimX] == vFileBlockSize[vDimX] &&
-    !vIsFlippedX && !vIsFlippedY;
 
-  bpSize vDimOffset[3];
-  bpSize vImageIndex[5]; // Image global index for dimension X, Y, Z, C, T (the order is 0, 1, 2, 3, 4)
+template<typename TDataType>
+void bpImageConverterImpl<TDataType>::CopySlicesParallel(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const std::vector<cSlice>& aSlices, bool aWaitIfBusy)
+{
+  // Partition by destination memory block: rows of memory blocks in Y and slices sharing the same memory block in Z.
+  // Two tasks never write to the same memory block.
+  bpVec3 vMemoryBlockSize = mMultiresolutionImage.GetMemoryBlockSize();
+  bpVec2 vBeginXY;
+  bpVec2 vEndXY;
+  mMultiresolutionImage.GetCopyBlockRegion(aLayout.mCopyBlockIndexXY, 0, vBeginXY, vEndXY);
+
+  std::vector<bpVec2> vRows;
+  bpSize vSizeY = aLayout.mSizeXY[1];
+  bpSize vBeginY = 0;
+  while (vBeginY < vSizeY) {
+    bpSize vEndY = std::min(((vBeginXY[1] + vBeginY) / vMemoryBlockSize[1] + 1) * vMemoryBlockSize[1] - vBeginXY[1], vSizeY);
+    vRows.push_back({ vBeginY, vEndY });
+    vBeginY = vEndY;
+  }
 
-  for (bpSize vIndex2 = vBeginInBlock[vDim2]; vIndex2 < vEndInBlock[vDim2]; vIndex2 += vMemSample[vD2]) {
-    bpSize vImageIndex2 = vFileBlockIndices[vDim2] * vFileBlockSize[vDim2] + vIndex2;
-    vImageIndex[vD2] = (vImageIndex2 - vMemMinLimits[vD2]) / vMemSample[vD2];
-    vDimOffset[2] = vDimWeight[vDim2] * vIndex2;
-
-    for (bpSize vIndex1 = vBeginInBlock[vDim1]; vIndex1 < vEndInBlock[vDim1]; vIndex1 += vMemSample[vD1]) {
-      bpSize vImageIndex1 = vFileBlockIndices[vDim1] * vFileBlockSize[vDim1] + vIndex1;
-      vImageIndex[vD1] = (vImageIndex1 - vMemMinLimits[vD1]) / vMemSample[vD1];
-      vDimOffset[1] = vDimWeight[vDim1] * vIndex1;
-
-      for (bpSize vIndex0 = vBeginInBlock[vDim0]; vIndex0 < vEndInBlock[vDim0]; vIndex0 += vMemSample[vD0]) {
-        bpSize vImageIndex0 = vFileBlockIndices[vDim0] * vFileBlockSize[vDim0] + vIndex0;
-        vImageIndex[vD0] = (vImageIndex0 - vMemMinLimits[vD0]) / vMemSample[vD0];
-        vDimOffset[0] = vDimWeight[vDim0] * vIndex0;
-
-        bpSize vDataOffset = vDimOffset[2] + vDimOffset[1] + vDimOffset[0] + vDimWeightY * vBeginInBlock[vDimY] + vDimWeightX * vBeginInBlock[vDimX];
-        const TDataType* vDataBlock = aDataBlock + vDataOffset;
-
-        if (!vCanRawCopy) {
-          // start read there but with different step size
-          mTempBuffer.resize(vSizeXY);
-          TDataType* vBuffer = mTempBuffer.data();
-          for (bpSize vIndexY = 0; vIndexY < vSizeY; ++vIndexY) {
-            const TDataType* vSource = vDataBlock + (vIndexY * vStepY);
-            TDataType* vPtr = vBuffer + ((!vIsFlippedY ? vIndexY : vSizeY - vIndexY - 1) * vSizeX);
-            if (!vIsFlippedX) {
-              if (vStepX == 1) {
-                std::copy(vSource, vSource + vSizeX, vPtr);
-              }
-              else {
-                for (bpSize vIndexX = 0; vIndexX < vSizeX; ++vIndexX) {
-                  *vPtr = *vSource;
-                  ++vPtr;
-                  vSource += vStepX;
-                }
-              }
-            }
-            else {
-              vPtr += vSizeX - 1;
-              for (bpSize vIndexX = 0; vIndexX < vSizeX; ++vIndexX) {
-                *vPtr = *vSource;
-                --vPtr;
-                vSource += vStepX;
-              }
-            }
-          }
-          vDataBlock = vBuffer;
-        }
+  std::map<bpVec3, std::vector<bpSize>> vSlicesPerMemoryBlockZ;
+  for (bpSize vIndex = 0; vIndex < aSlices.size(); vIndex++) {
+    const cSlice& vSlice = aSlices[vIndex];
+    vSlicesPerMemoryBlockZ[{ vSlice.mIndexT, vSlice.mIndexC, vSlice.mIndexZ / vMemoryBlockSize[2] }].push_back(vIndex);
+  }
 
-        auto vImageIndexZ = mIsFlipped[2] ? mImageSize[Z] - vImageIndex[2] - 1 : vImageIndex[2];
+  std::vector<std::pair<const bpVec2*, const std::vector<bpSize>*>> vTasks;
+  for (const auto& vSlices : vSlicesPerMemoryBlockZ) {
+    for (const bpVec2& vRow : vRows) {
+      vTasks.emplace_back(&vRow, &vSlices.second);
+    }
+  }
 
-        // The indices here are memoryIndices for each dim, not block indices!
-        // T,C,Z are only one memoryIndex (for each dim), X,Y can contain span (vBegin, vEnd) over a range of memoryIndices (for each dim)
-        mMultiresolutionImage.CopyData(vImageIndex[4], vImageIndex[3], vImageIndexZ, { vFileBlockIndices[vDimX], vFileBlockIndices[vDimY] }, vDataBlock, 0);
+  if (vTasks.empty()) {
+    return;
+  }
+
+  std::atomic<bpSize> vNextTask(0);
+  auto vCopyTasks = [this, &aLayout, &aDataBlock, &aSlices, &vTasks, &vNextTask] {
+    std::vector<TDataType> vBuffer;
+    for (bpSize vTask = vNextTask++; vTask < vTasks.size(); vTask = vNextTask++) {
+      const bpVec2& vRow = *vTasks[vTask].first;
+      for (bpSize vIndex : *vTasks[vTask].second) {
+        CopySliceRows(aLayout, aDataBlock, aSlices[vIndex], vRow[0], vRow[1], vBuffer);
       }
     }
+  };
+
+  // the calling thread works on the tasks too, the helpers only pick up what is left
+  bpSize vNumberOfHelpers = std::min(mNumberOfCopyThreads, vTasks.size()) - 1;
+  std::vector<std::future<void>> vHelpers;
+  for (bpSize vIndex = 0; vIndex < vNumberOfHelpers; vIndex++) {
+    auto vHelper = std::make_shared<std::packaged_task<void()>>(vCopyTasks);
+    vHelpers.push_back(vHelper->get_future());
+    mCopyThreads->Run([vHelper] { (*vHelper)(); });
+  }
+
+  std::exception_ptr vError;
+  try {
+    vCopyTasks();
+  }
+  catch (...) {
+    vError = std::current_exception();
+  }
+  for (auto& vHelper : vHelpers) {
+    vHelper.wait();
+  }
+  if (vError) {
+    std::rethrow_exception(vError);
+  }
+  for (auto& vHelper : vHelpers) {
+    vHelper.get();
+  }
+
+  for (const cSlice& vSlice : aSlices) {
+    mMultiresolutionImage.SetDataCopied(vSlice.mIndexT, vSlice.mIndexC, vSlice.mIndexZ, aLayout.mCopyBlockIndexXY, aWaitIfBusy);
   }
 }
 
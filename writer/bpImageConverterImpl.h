@@ -20,6 +20,11 @@
 #include "bpMultiresolutionImsImage.h"
 #include "bpWriterFactory.h"
 
+#include <atomic>
+
+
+class bpThreadPool;
+
 
 template<typename TDataType>
 class bpImageConverterImpl : public bpImageConverterInterface<TDataType>
@@ -37,6 +42,29 @@ public:
 
   void CopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
 
+  void CopyBlockOwned(TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bpConverterTypes::tReleaseCallback aRelease) override;
+
+  void CopyBlockPacked(const bpUInt8* aFileDataBlock, bpConverterTypes::tPackedDataFormat aFormat, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  void CopyBlockScaled(const bpUInt8* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpUInt16* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpUInt32* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+  void CopyBlockScaled(const bpFloat* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  void CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize) override;
+
+  void SetTiles(const bpConverterTypes::tTileVector& aTiles, bpConverterTypes::tOverlapPolicy aPolicy) override;
+
+  void CopyTile(const TDataType* aData, bpSize aTileIndex) override;
+
+  bool TryCopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  bpConverterTypes::tCopyHandle CopyBlockAsync(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex) override;
+
+  bpConverterTypes::cQueueStatus GetQueueStatus() const override;
+
+  static bpConverterTypes::tSize5D GetOwnedFileBlockSize(const bpConverterTypes::tSize5D& aImageSize, const bpConverterTypes::cOptions& aOptions);
+
   void Finish(
     const bpConverterTypes::cImageExtent& aImageExtent,
     const bpConverterTypes::tParameters& aParameters,
@@ -50,11 +78,109 @@ private:
   static tSize5D InitMapWithConstant(bpSize aValue);
   static bpSize Div(bpSize aNum, bpSize aDiv);
 
-  bpSize GetFileBlockIndex1D(const bpConverterTypes::tIndex5D& aBlockIndex) const;
+  // indices in the order of the block dimension sequence
+  using tBlockIndices = std::array<bpSize, 5>;
+
+  tBlockIndices GetBlockIndices(const bpConverterTypes::tIndex5D& aBlockIndex) const;
+  // index of the file block within its time point block
+  bpSize GetFileBlockIndex1D(const tBlockIndices& aBlockIndices) const;
+
+  // file block data as passed by the caller, either values of the image type or data that mReadRow converts
+  struct cBlockData
+  {
+    const TDataType* mValues;
+    const void* mData;
+    void (*mReadRow)(const cBlockData& aBlockData, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse);
+    bpConverterTypes::tPackedDataFormat mPackedFormat;
+    bpFloat mScale;
+    bpFloat mOffset;
+  };
+
+  static void ReadPackedRow(const cBlockData& aBlockData, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse);
+
+  template<typename TInput>
+  static void ReadScaledRow(const cBlockData& aBlockData, bpSize aFirstValue, bpSize aStep, bpSize aCount, TDataType* aDest, bool aReverse);
+
+  template<typename TInput>
+  void CopyBlockScaledT(const TInput* aFileDataBlock, bpFloat aScale, bpFloat aOffset, const bpConverterTypes::tIndex5D& aBlockIndex);
+
+  void CopyBlock(const TDataType* aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bool aWaitIfBusy);
+  void CopyBlock(const cBlockData& aFileDataBlock, const bpConverterTypes::tIndex5D& aBlockIndex, bool aWaitIfBusy);
+  // throws if the block has already been copied
+  void SetBlockCopied(const bpConverterTypes::tIndex5D& aBlockIndex, bpSize aFileBlockIndex1D);
 
   void GetRangeOfFileBlock(bpSize aFileBlockIndex, bpConverterTypes::Dimension aDimension, bpSize& aBeginInBlock, bpSize& aEndInBlock) const;
   void GetFullRangeOfFileBlock(bpSize aFileBlockIndex, bpConverterTypes::Dimension aDimension, bpSize& aBegin, bpSize& aEnd) const;
-  void CopyFileBlockToImage(const tSize5D& aFileBlockIndices, const TDataType* aDataBlock);
+  void CopyFileBlockToImage(const tBlockIndices& aFileBlockIndices, const cBlockData& aDataBlock, bool aWaitIfBusy);
+
+  // DimX and DimY are the positions of X and Y in the block dimension sequence, 5 reads them from the copy plan
+  template<bpSize DimX, bpSize DimY, bool IsSampled>
+  void CopyFileBlockToImageT(const tBlockIndices& aFileBlockIndices, const cBlockData& aDataBlock, bool aWaitIfBusy);
+
+  static constexpr bpSize GetNonXYDim(bpSize aDimX, bpSize aDimY, bpSize aIndex);
+
+  // range of a file block along one dimension
+  struct cBlockRange
+  {
+    bpSize mBeginInBlock;
+    bpSize mEndInBlock;
+    bpSize mBegin;
+    bpSize mEnd;
+  };
+
+  // the part of CopyFileBlockToImage that does not depend on the data, arrays are in the order of the block dimension sequence
+  struct cCopyPlan
+  {
+    bpSize mDimX;
+    bpSize mDimY;
+    bpSize mNonXYDims[3];
+    bpSize mImageDims[5]; // 0, 1, 2, 3, 4 for X, Y, Z, C, T
+    bpSize mFileBlockSize[5];
+    bpSize mNumberOfBlocks[5];
+    bpSize mBlockIndexWeight[5]; // 0 for T
+    bpSize mDimWeight[5];
+    bpSize mSample[5];
+    bpSize mMinLimit[5];
+    std::vector<cBlockRange> mRanges[5]; // one for each file block index
+
+    bpVec2 mStepXY;
+    std::array<bool, 2> mIsFlippedXY;
+    bool mIsFlippedZ;
+    bpSize mImageSizeZ;
+    bool mCanRawCopy; // if the block covers the whole file block in X
+    bool mCopyParallel;
+  };
+
+  void InitCopyPlan();
+
+  // one XY slice of a file block
+  struct cSlice
+  {
+    bpSize mIndexT;
+    bpSize mIndexC;
+    bpSize mIndexZ;
+    bpSize mOffset; // of the first value in the file block
+  };
+
+  // how the XY slices of a file block are read and where they go
+  struct cSliceLayout
+  {
+    bpVec2 mCopyBlockIndexXY;
+    bpVec2 mSizeXY;
+    bpVec2 mStepXY;
+    std::array<bool, 2> mIsFlippedXY;
+    bool mCanRawCopy;
+  };
+
+  void CopySliceRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const cSlice& aSlice, bpSize aBeginY, bpSize aEndY, std::vector<TDataType>& aBuffer);
+  // copies the region to the image, as the tile aTileIndex points to if it is not null
+  void CopyRegion(const TDataType* aData, const bpConverterTypes::tIndex5D& aOffset, const bpConverterTypes::tSize5D& aSize, const bpSize* aTileIndex);
+  void CopyRegionRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const cSlice& aSlice, const bpVec2& aBeginXY, const bpSize* aTileIndex, std::vector<TDataType>& aBuffer);
+
+  // gathers the rows [aBeginY, aEndY) of a slice densely to aBuffer
+  static void ReadSliceRows(const cSliceLayout& aLayout, const cBlockData& aDataBlock, bpSize aOffset, bpSize aBeginY, bpSize aEndY, TDataType* aBuffer);
+  static bpSize GetRowsPerChunk(bpSize aSizeX);
+  void CopySlicesParallel(const cSliceLayout& aLayout, const cBlockData& aDataBlock, const std::vector<cSlice>& aSlices, bool aWaitIfBusy);
   bpHistogram GetConversionImageHistogram(bpSize aIndexC) const;
   void AdjustColorRange(std::vector<bpConverterTypes::cColorInfo>& aColorInfo) const;
   static std::vector<bpFloat> GetFilteredBins(const bpHistogram& aHistogram, bpFloat aFilterWidth);
@@ -67,17 +193,41 @@ private:
   tSize5D mFileBlockSize;
   tSize5D mNumberOfBlocks;
 
-  std::vector<bool> mBlockCopied;
+  // the image size in T is only the initial number of time points
+  bool mAppendTimePoints;
+  // the blocks of a time point block that have been copied, released once all of them are
+  struct cBlocksCopied
+  {
+    std::vector<std::atomic<bool>> mIsCopied; // indexed by GetFileBlockIndex1D
+    std::atomic<bpSize> mNumberOfCopied{ 0 };
+  };
+  bpUniquePtr<bpTimePointVector<cBlocksCopied>> mBlockCopied;
+
+  bpConverterTypes::tTileVector mTiles;
+  std::vector<std::atomic<bool>> mTileCopied;
 
   tSize5D mSample;
   tSize5D mMinLimit;
   tSize5D mMaxLimit;
   bool mIsFlipped[3];  // for X,Y,Z dim
 
+  bpSharedPtr<bpMemoryBudget> mMemoryBudget;
   bpMultiresolutionImsImage<TDataType> mMultiresolutionImage;
 
-  std::vector<TDataType> mTempBuffer;
-  std::map<bpConverterTypes::Dimension, bpSize> mDimensionIndicesFromSequence;
+  // file blocks are full resolution memory blocks, CopyBlockOwned can use them without copying
+  bool mCanAdoptFileBlocks;
+
+  bpSize mParallelCopyThreshold;
+  bpSize mNumberOfCopyThreads;
+  bpSharedPtr<bpThreadPool> mCopyThreads;
+
+  // runs CopyBlockAsync in order of submission
+  bpSharedPtr<bpThreadPool> mAsyncCopyThread;
+  std::atomic<bpSize> mNumberOfAsyncCopies;
+
+  cCopyPlan mCopyPlan;
+  using tCopyFileBlockToImage = void (bpImageConverterImpl::*)(const tBlockIndices&, const cBlockData&, bool);
+  tCopyFileBlockToImage mCopyFileBlockToImage;
 };
 
 #endif // __BP_IMAGE_CONVERTER__
@@ -17,12 +17,16 @@
 #include "bpImsImage3D.h"
 
 #include <algorithm>
+#include <tuple>
 
 
 template<typename TDataType>
 bpImsImage3D<TDataType>::bpImsImage3D(bpSize aSizeX, bpSize aSizeY, bpSize aSizeZ,
-  bpSize aMemoryBlockSizeX, bpSize aMemoryBlockSizeY, bpSize aMemoryBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager)
-  : mSizeX(aSizeX),
+  bpSize aMemoryBlockSizeX, bpSize aMemoryBlockSizeY, bpSize aMemoryBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager,
+  bpSharedPtr<bpScratchFile<TDataType> > aScratchFile)
+  : mBlocks(std::make_shared<cBlocks>(aMemoryBlockSizeX * aMemoryBlockSizeY * aMemoryBlockSizeZ, aManager, std::move(aScratchFile))),
+    mManager(aManager),
+    mSizeX(aSizeX),
     mSizeY(aSizeY),
     mSizeZ(aSizeZ),
     mMemoryBlockSizeX(aMemoryBlockSizeX),
@@ -35,18 +39,16 @@ bpImsImage3D<TDataType>::bpImsImage3D(bpSize aSizeX, bpSize aSizeY, bpSize aSize
     mNBlocksY((aSizeY + mMemoryBlockSizeY - 1) / mMemoryBlockSizeY),
     mNBlocksZ((aSizeZ + mMemoryBlockSizeZ - 1) / mMemoryBlockSizeZ)
 {
-  // initialize memory blocks
+  // memory blocks are created when they are first accessed
   bpSize vNumberOfBlocks = mNBlocksX * mNBlocksY * mNBlocksZ;
-  mBlocks.reserve(vNumberOfBlocks);
-  for (bpSize vIndex = 0; vIndex < vNumberOfBlocks; vIndex++) {
-    mBlocks.emplace_back(aMemoryBlockSizeX * aMemoryBlockSizeY * aMemoryBlockSizeZ, aManager);
-  }
   mHistograms.resize(std::min<bpSize>(16, (vNumberOfBlocks + 63) / 64));
+  mHistogramMutexes = std::vector<std::mutex>(mHistograms.size());
 }
 
 template<typename TDataType>
 bpImsImage3D<TDataType>::~bpImsImage3D()
 {
+  ReleaseHistograms();
 }
 
 
@@ -76,8 +78,123 @@ bpVec3 bpImsImage3D<TDataType>::GetImageSize() const
 }
 
 template<typename TDataType>
-bpImsImageBlock<TDataType>& bpImsImage3D<TDataType>::GetBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ) {
-  return mBlocks[ConvertBlockIndex(aBlockIndexX, aBlockIndexY, aBlockIndexZ)];
+bpImsImage3D<TDataType>::cBlocks::cBlocks(bpSize aBlockSize, bpSharedPtr<bpMemoryManager<TDataType> > aManager, bpSharedPtr<bpScratchFile<TDataType> > aScratchFile)
+  : mBlockSize(aBlockSize),
+    mManager(std::move(aManager)),
+    mScratchFile(std::move(aScratchFile))
+{
+}
+
+template<typename TDataType>
+bpImsImage3D<TDataType>::cBlocks::~cBlocks()
+{
+  // the memory manager cannot be releasing a block anymore, it holds a reference while doing so
+  for (auto& vEntry : mBlocks) {
+    if (vEntry.second.mIsIdle) {
+      mManager->RemoveIdleBlock(vEntry.second.mIdlePosition);
+    }
+  }
+}
+
+template<typename TDataType>
+void bpImsImage3D<TDataType>::cBlocks::ReleaseIdleBlock(bpSize aBlockIndex)
+{
+  std::lock_guard<std::mutex> vLock(mMutex);
+  auto vIt = mBlocks.find(aBlockIndex);
+  if (vIt == mBlocks.end() || !vIt->second.mIsIdle) {
+    return;
+  }
+  cBlock& vBlock = vIt->second;
+  mManager->RemoveIdleBlock(vBlock.mIdlePosition);
+  vBlock.mIsIdle = false;
+
+  // the memory manager frees the returned memory while the budget is exceeded
+  bpSize vBytes = mBlockSize * sizeof(TDataType);
+  if (mManager->IsCompressionWorthwhile()) {
+    bpSize vCompressedBytes = vBlock.mBlock.Compress(vBytes / 2, mCompressionBuffer);
+    mManager->AddCompressionResult(vBytes, vCompressedBytes > 0 ? vCompressedBytes : vBytes);
+    if (vCompressedBytes > 0) {
+      return;
+    }
+  }
+  // without a scratch file the block stays in RAM until it is idle again
+  if (mScratchFile) {
+    vBlock.mBlock.MoveMemory(mScratchFile->GetMemory());
+    vBlock.mIsInScratchFile = true;
+  }
+}
+
+template<typename TDataType>
+typename bpImsImage3D<TDataType>::cBlock& bpImsImage3D<TDataType>::FindOrCreateBlock(bpSize aBlockIndex)
+{
+  auto vIt = mBlocks->mBlocks.find(aBlockIndex);
+  if (vIt == mBlocks->mBlocks.end()) {
+    vIt = mBlocks->mBlocks.emplace(std::piecewise_construct, std::forward_as_tuple(aBlockIndex),
+      std::forward_as_tuple(mBlocks->mBlockSize, mManager)).first;
+  }
+  return vIt->second;
+}
+
+template<typename TDataType>
+void bpImsImage3D<TDataType>::SetIdle(bpSize aBlockIndex, cBlock& aBlock, bool aIsIdle)
+{
+  if (aBlock.mIsIdle == aIsIdle) {
+    return;
+  }
+  if (!aIsIdle) {
+    mManager->RemoveIdleBlock(aBlock.mIdlePosition);
+    aBlock.mIsIdle = false;
+    return;
+  }
+  const bpSharedPtr<bpMemoryBudget>& vBudget = mManager->GetBudget();
+  if (vBudget && vBudget->GetMaxBytes() > 0 && !aBlock.mIsShared && !aBlock.mIsInScratchFile && aBlock.mBlock.IsAllocated()) {
+    aBlock.mIdlePosition = mManager->AddIdleBlock(mBlocks, aBlockIndex);
+    aBlock.mIsIdle = true;
+  }
+}
+
+template<typename TDataType>
+bpImsImageBlock<TDataType>& bpImsImage3D<TDataType>::GetBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ)
+{
+  bpSize vIndex = ConvertBlockIndex(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
+  std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+  cBlock& vBlock = FindOrCreateBlock(vIndex);
+  SetIdle(vIndex, vBlock, false);
+  vBlock.mIsShared = true;
+  return vBlock.mBlock;
+}
+
+template<typename TDataType>
+bpMemoryBlock<TDataType> bpImsImage3D<TDataType>::ReleaseBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ)
+{
+  bpSize vIndex = ConvertBlockIndex(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
+  std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+  auto vIt = mBlocks->mBlocks.find(vIndex);
+  if (vIt == mBlocks->mBlocks.end()) {
+    return{};
+  }
+  SetIdle(vIndex, vIt->second, false);
+  bpMemoryBlock<TDataType> vData = vIt->second.mBlock.ReleaseMemory();
+  mBlocks->mBlocks.erase(vIt);
+  return vData;
+}
+
+template<typename TDataType>
+TDataType* bpImsImage3D<TDataType>::GetBlockData(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ)
+{
+  bpSize vIndex = ConvertBlockIndex(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
+  std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+  cBlock& vBlock = FindOrCreateBlock(vIndex);
+  SetIdle(vIndex, vBlock, false);
+  vBlock.mIsShared = true;
+  return vBlock.mBlock.GetData();
+}
+
+template<typename TDataType>
+void bpImsImage3D<TDataType>::SetBlockData(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ, bpMemoryBlock<TDataType> aData)
+{
+  std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+  FindOrCreateBlock(ConvertBlockIndex(aBlockIndexX, aBlockIndexY, aBlockIndexZ)).mBlock.AdoptMemory(std::move(aData));
 }
 
 template<typename TDataType>
@@ -87,6 +204,21 @@ bpHistogram bpImsImage3D<TDataType>::GetHistogram(bpSize aMaxNumberOfBins) const
   return vHistogram.GetNumberOfBins() <= aMaxNumberOfBins ? vHistogram : bpResampleHistogram(vHistogram, aMaxNumberOfBins);
 }
 
+template<typename TDataType>
+void bpImsImage3D<TDataType>::ReleaseHistograms()
+{
+  bpSize vBytes = 0;
+  for (auto& vHistogram : mHistograms) {
+    if (vHistogram) {
+      vBytes += vHistogram->GetMemorySize();
+      vHistogram.reset();
+    }
+  }
+  if (vBytes > 0 && mManager->GetBudget()) {
+    mManager->GetBudget()->Remove(vBytes);
+  }
+}
+
 template<typename TDataType>
 bpHistogram bpImsImage3D<TDataType>::GetMergedHistogram() const
 {
@@ -111,10 +243,19 @@ bpHistogramBuilder<TDataType>& bpImsImage3D<TDataType>::GetHistogramBuilderForBl
   auto& vHistogram = mHistograms[GetHistogramBuilderIndexForBlock(aBlockIndexX, aBlockIndexY, aBlockIndexZ)];
   if (!vHistogram) {
     vHistogram = std::make_unique<bpHistogramBuilder<TDataType>>();
+    if (mManager->GetBudget()) {
+      mManager->GetBudget()->Add(vHistogram->GetMemorySize());
+    }
   }
   return *vHistogram;
 }
 
+template<typename TDataType>
+std::unique_lock<std::mutex> bpImsImage3D<TDataType>::LockHistogramBuilderForBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ)
+{
+  return std::unique_lock<std::mutex>(mHistogramMutexes[GetHistogramBuilderIndexForBlock(aBlockIndexX, aBlockIndexY, aBlockIndexZ)]);
+}
+
 template<typename TDataType>
 bpSize bpImsImage3D<TDataType>::GetMemoryBlockIndexX(bpSize aMemoryIndexX) const {
   return aMemoryIndexX >> mLog2BlockSizeX;
@@ -190,7 +331,32 @@ void bpImsImage3D<TDataType>::RegionToMemOperation(bpSize aIndexZ, const bpVec2&
       bpSize vBlockBeginOffsetX = vRegionBeginX > vXFirst ? vRegionBeginX - vXFirst : 0;
       bpSize vBlockEndOffsetX = vXLast > vRegionEndX ? vBlockSizeX - (vXLast - vRegionEndX) : vBlockSizeX;
 
-      bpImsImageBlock<TDataType>& vMemoryBlock = GetBlock(vBlockIndexX, vBlockIndexY, vBlockIndexZ);
+      // allocates the block under lock, the copy below only touches this producer's part of the block
+      bpSize vIndex = ConvertBlockIndex(vBlockIndexX, vBlockIndexY, vBlockIndexZ);
+      cBlock* vBlock;
+      bool vIsNewMemory;
+      {
+        std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+        vBlock = &FindOrCreateBlock(vIndex);
+        SetIdle(vIndex, *vBlock, false);
+        vIsNewMemory = !vBlock->mBlock.IsAllocated();
+        // mapped back into RAM once the budget has room for it, no other producer may be copying to it meanwhile
+        if (vBlock->mIsInScratchFile && vBlock->mRunningCopies == 0 && !vBlock->mIsShared) {
+          const bpSharedPtr<bpMemoryBudget>& vBudget = mManager->GetBudget();
+          if (vBudget->GetUsedBytes() + mBlocks->mBlockSize * sizeof(TDataType) <= vBudget->GetMaxBytes()) {
+            vBlock->mBlock.MoveMemory(mManager->GetMemory(mBlocks->mBlockSize));
+            vBlock->mIsInScratchFile = false;
+            vIsNewMemory = true;
+          }
+        }
+        vBlock->mBlock.GetData();
+        ++vBlock->mRunningCopies;
+      }
+      // the blocks of other images are locked one at a time
+      if (vIsNewMemory) {
+        mManager->ReleaseIdleBlocks();
+      }
+      bpImsImageBlock<TDataType>& vMemoryBlock = vBlock->mBlock;
 
       bpSize vBlockRegionOffsetX = vXFirst + vBlockBeginOffsetX - vRegionBeginX;
       bpSize vBlockRegionSizeX = vBlockEndOffsetX - vBlockBeginOffsetX;
@@ -213,27 +379,31 @@ void bpImsImage3D<TDataType>::RegionToMemOperation(bpSize aIndexZ, const bpVec2&
         else {
           vMemoryBlock.CopyLinePartToBlock(vBlockBeginOffset, vBlockRegionSizeXY, nullptr);
         }
-
-        continue;
       }
+      else {
+        for (bpSize vOffsetY = vBlockBeginOffsetY; vOffsetY < vBlockEndOffsetY; ++vOffsetY) {
 
-      for (bpSize vOffsetY = vBlockBeginOffsetY; vOffsetY < vBlockEndOffsetY; ++vOffsetY) {
+          bpSize vBlockBeginOffset = vOffsetZ * vBlockSizeXY + vOffsetY * vBlockSizeX + vBlockBeginOffsetX;
 
-        bpSize vBlockBeginOffset = vOffsetZ * vBlockSizeXY + vOffsetY * vBlockSizeX + vBlockBeginOffsetX;
+          if (aDataBlockXY) {
+            bpSize vBlockRegionOffset =
+              (vZFirst + vOffsetZ - vRegionBeginZ) * vRegionSizeXY +
+              (vYFirst + vOffsetY - vRegionBeginY) * vRegionSizeX +
+              vBlockRegionOffsetX;
 
-        if (aDataBlockXY) {
-          bpSize vBlockRegionOffset =
-            (vZFirst + vOffsetZ - vRegionBeginZ) * vRegionSizeXY +
-            (vYFirst + vOffsetY - vRegionBeginY) * vRegionSizeX +
-            vBlockRegionOffsetX;
+            const TDataType* vData = aDataBlockXY + vBlockRegionOffset;
+            vMemoryBlock.CopyLinePartToBlock(vBlockBeginOffset, vBlockRegionSizeX, vData);
+          }
+          else {
+            vMemoryBlock.CopyLinePartToBlock(vBlockBeginOffset, vBlockRegionSizeX, nullptr);
+          }
 
-          const TDataType* vData = aDataBlockXY + vBlockRegionOffset;
-          vMemoryBlock.CopyLinePartToBlock(vBlockBeginOffset, vBlockRegionSizeX, vData);
-        }
-        else {
-          vMemoryBlock.CopyLinePartToBlock(vBlockBeginOffset, vBlockRegionSizeX, nullptr);
         }
+      }
 
+      std::lock_guard<std::mutex> vLock(mBlocks->mMutex);
+      if (--vBlock->mRunningCopies == 0) {
+        SetIdle(vIndex, *vBlock, true);
       }
     }
   }
@@ -18,8 +18,12 @@
 
 #include "bpImsImageBlock.h"
 #include "bpMemoryManager.h"
+#include "bpScratchFile.h"
 #include "bpHistogram.h"
 
+#include <mutex>
+#include <unordered_map>
+
 /**
 * Ims image representing the dimensions X,Y,Z for one timepoint and one channel.
 */
@@ -27,8 +31,15 @@ template<typename TDataType>
 class bpImsImage3D
 {
 public:
+  /**
+  * While the budget of aManager is exceeded, blocks filled by CopyData are compressed in RAM or, if they
+  * do not compress to half their size, moved to aScratchFile (if there is one). The least recently copied
+  * blocks of all images sharing aManager go first, blocks whose data has been handed out stay as they are.
+  * A block in the scratch file moves back to RAM when it is copied to while the budget has room for it.
+  */
   bpImsImage3D(bpSize aSizeX, bpSize aSizeY, bpSize aSizeZ,
-    bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager);
+    bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager,
+    bpSharedPtr<bpScratchFile<TDataType> > aScratchFile = nullptr);
 
   bpImsImage3D(const bpImsImage3D&) = delete;
   //bpImsImage3D& operator=(const bpImsImage3D&) = delete;
@@ -42,13 +53,41 @@ public:
   bpVec3 GetNBlocks() const;
   bpVec3 GetImageSize() const;
 
+  /**
+  * Creates the block on first access. The reference stays valid until the block is released. Thread safe.
+  */
   bpImsImageBlock<TDataType>& GetBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
 
+  /**
+  * Removes a block and returns its memory (empty if it has never been allocated). Thread safe.
+  */
+  bpMemoryBlock<TDataType> ReleaseBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
+
+  /**
+  * Returns the (lazily allocated) data of a block. Thread safe, several producers may fill different parts of the image concurrently.
+  */
+  TDataType* GetBlockData(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
+
+  /**
+  * Uses aData as the memory of a block that has not been allocated yet. Thread safe.
+  */
+  void SetBlockData(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ, bpMemoryBlock<TDataType> aData);
+
   bpHistogram GetHistogram(bpSize aMaxNumberOfBins) const;
 
+  /**
+  * Frees the histogram builders once all blocks have been added, GetHistogram is empty afterwards.
+  */
+  void ReleaseHistograms();
+
   bpSize GetHistogramBuilderIndexForBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ) const;
   bpHistogramBuilder<TDataType>& GetHistogramBuilderForBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
 
+  /**
+  * Blocks share histogram builders, the builder of a block may only be used while this lock is held.
+  */
+  std::unique_lock<std::mutex> LockHistogramBuilderForBlock(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
+
   bool PadBorderBlockWithZeros(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
 private:
   void RegionToMemOperation(bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY);
@@ -63,9 +102,54 @@ private:
 
   bpSize ConvertBlockIndex(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ) const;
 
+  struct cBlock
+  {
+    cBlock(bpSize aSize, bpSharedPtr<bpMemoryManager<TDataType> > aManager)
+      : mBlock(aSize, std::move(aManager))
+    {
+    }
+
+    bpImsImageBlock<TDataType> mBlock;
+    // producers copying to the block without holding the lock of the blocks
+    bpSize mRunningCopies = 0;
+    // GetBlock or GetBlockData may have handed out the data, it must not move anymore
+    bool mIsShared = false;
+    bool mIsInScratchFile = false;
+    // in the idle blocks of the memory manager at mIdlePosition
+    bool mIsIdle = false;
+    typename bpMemoryManager<TDataType>::tIdleBlockPosition mIdlePosition;
+  };
+
+  // shared with the memory manager, which releases idle blocks of any image while the budget is exceeded
+  class cBlocks : public bpMemoryManager<TDataType>::cIdleBlockOwner
+  {
+  public:
+    cBlocks(bpSize aBlockSize, bpSharedPtr<bpMemoryManager<TDataType> > aManager, bpSharedPtr<bpScratchFile<TDataType> > aScratchFile);
+    ~cBlocks();
+
+    void ReleaseIdleBlock(bpSize aBlockIndex) override;
+
+    std::mutex mMutex;
+    // only the blocks being filled, indexed by ConvertBlockIndex
+    std::unordered_map<bpSize, cBlock> mBlocks;
+    const bpSize mBlockSize;
+    bpSharedPtr<bpMemoryManager<TDataType> > mManager;
+    bpSharedPtr<bpScratchFile<TDataType> > mScratchFile;
+    // reused for every block compressed, mMutex must be locked
+    std::vector<char> mCompressionBuffer;
+  };
+
+  // the lock of mBlocks must be held
+  cBlock& FindOrCreateBlock(bpSize aBlockIndex);
+
+  // the lock of mBlocks must be held, only blocks in RAM become idle while there is a budget
+  void SetIdle(bpSize aBlockIndex, cBlock& aBlock, bool aIsIdle);
+
   std::vector<bpUniquePtr<bpHistogramBuilder<TDataType>>> mHistograms;
+  std::vector<std::mutex> mHistogramMutexes;
 
-  std::vector<bpImsImageBlock<TDataType>> mBlocks;
+  bpSharedPtr<cBlocks> mBlocks;
+  bpSharedPtr<bpMemoryManager<TDataType> > mManager;
 
   const bpSize mMemoryBlockSizeX;
   const bpSize mMemoryBlockSizeY;
@@ -16,20 +16,29 @@
 
 #include "bpImsImage5D.h"
 
+#include <algorithm>
+
 
 template<typename TDataType>
 bpImsImage5D<TDataType>::bpImsImage5D(bpSize aSizeX, bpSize aSizeY, bpSize aSizeZ, bpSize aSizeC, bpSize aSizeT,
-  bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager)
+  bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager,
+  bpSharedPtr<bpScratchFile<TDataType> > aScratchFile)
+  : mImageSize{ aSizeX, aSizeY, aSizeZ },
+    mBlockSize{ aBlockSizeX, aBlockSizeY, aBlockSizeZ },
+    mSizeC(aSizeC),
+    mSizeT(aSizeT)
 {
-  // initialize vector mImages with 3D images
-  mImages.resize(aSizeT);
-  for (bpSize vIndexT = 0; vIndexT < aSizeT; vIndexT++) {
-    std::vector<bpImsImage3D<TDataType> >& vChannels = mImages[vIndexT];
-    vChannels.reserve(aSizeC);
+  // 3D images of a time point are initialized when it is first accessed, the image may have been moved by then
+  bpVec3 vSize = mImageSize;
+  bpVec3 vBlockSize = mBlockSize;
+  mImages = std::make_unique<bpTimePointVector<tChannels> >([vSize, vBlockSize, aSizeC, aManager, aScratchFile](bpSize /*aIndexT*/) {
+    auto vChannels = std::make_unique<tChannels>();
+    vChannels->reserve(aSizeC);
     for (bpSize vIndexC = 0; vIndexC < aSizeC; vIndexC++) {
-      vChannels.emplace_back(aSizeX, aSizeY, aSizeZ, aBlockSizeX, aBlockSizeY, aBlockSizeZ, aManager);
+      vChannels->emplace_back(vSize[0], vSize[1], vSize[2], vBlockSize[0], vBlockSize[1], vBlockSize[2], aManager, aScratchFile);
     }
-  }
+    return vChannels;
+  });
 }
 
 
@@ -42,49 +51,80 @@ bpImsImage5D<TDataType>::~bpImsImage5D()
 template<typename TDataType>
 bpSize bpImsImage5D<TDataType>::GetSizeT() const
 {
-  return mImages.size();
+  return std::max(mSizeT, mImages->GetSize());
 }
 
 
 template<typename TDataType>
 bpSize bpImsImage5D<TDataType>::GetSizeC() const
 {
-  return mImages[0].size();
+  return mSizeC;
+}
+
+
+template<typename TDataType>
+bpVec3 bpImsImage5D<TDataType>::GetImageSize() const
+{
+  return mImageSize;
+}
+
+
+template<typename TDataType>
+bpVec3 bpImsImage5D<TDataType>::GetMemoryBlockSize() const
+{
+  return mBlockSize;
+}
+
+
+template<typename TDataType>
+bpVec3 bpImsImage5D<TDataType>::GetNBlocks() const
+{
+  return{
+    (mImageSize[0] + mBlockSize[0] - 1) / mBlockSize[0],
+    (mImageSize[1] + mBlockSize[1] - 1) / mBlockSize[1],
+    (mImageSize[2] + mBlockSize[2] - 1) / mBlockSize[2] };
 }
 
 
 template<typename TDataType>
 void bpImsImage5D<TDataType>::CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY)
 {
-  bpImsImage3D<TDataType>& vImage3D = mImages[aIndexT][aIndexC];
+  bpImsImage3D<TDataType>& vImage3D = mImages->Get(aIndexT)[aIndexC];
   vImage3D.CopyData(aIndexZ, aBeginXY, aEndXY, aDataBlockXY);
 }
 
 template<typename TDataType>
 bool bpImsImage5D<TDataType>::PadBorderBlockWithZeros(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ, bpSize aIndexC, bpSize aIndexT)
 {
-  bpImsImage3D<TDataType>& vImage3D = mImages[aIndexT][aIndexC];
+  bpImsImage3D<TDataType>& vImage3D = mImages->Get(aIndexT)[aIndexC];
   return vImage3D.PadBorderBlockWithZeros(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
 }
 
 template<typename TDataType>
 bpImsImage3D<TDataType>& bpImsImage5D<TDataType>::GetImage3D(bpSize aIndexT, bpSize aIndexC)
 {
-  return mImages[aIndexT][aIndexC];
+  return mImages->Get(aIndexT)[aIndexC];
 }
 
 
 template<typename TDataType>
 const bpImsImage3D<TDataType>& bpImsImage5D<TDataType>::GetImage3D(bpSize aIndexT, bpSize aIndexC) const
 {
-  return mImages[aIndexT][aIndexC];
+  return mImages->Get(aIndexT)[aIndexC];
 }
 
 
 template<typename TDataType>
 bpImsImageBlock<TDataType>& bpImsImage5D<TDataType>::GetBlock(bpSize aIndexT, bpSize aIndexC, bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ)
 {
-  return mImages[aIndexT][aIndexC].GetBlock(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
+  return mImages->Get(aIndexT)[aIndexC].GetBlock(aBlockIndexX, aBlockIndexY, aBlockIndexZ);
+}
+
+
+template<typename TDataType>
+void bpImsImage5D<TDataType>::ReleaseTimePoint(bpSize aIndexT)
+{
+  mImages->Release(aIndexT);
 }
 
 
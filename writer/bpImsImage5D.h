@@ -18,10 +18,12 @@
 
 #include "bpImsImage3D.h"
 #include "bpMemoryManager.h"
+#include "bpTimePointVector.h"
 
 
 /**
 * Ims image representing the dimensions X,Y,Z,C,T on one resolution level.
+* The 3D images of a time point are created on first access and can be released once the time point is complete.
 */
 template<typename TDataType>
 class bpImsImage5D
@@ -29,7 +31,8 @@ class bpImsImage5D
 public:
 
   bpImsImage5D(bpSize aSizeX, bpSize aSizeY, bpSize aSizeZ, bpSize aSizeC, bpSize aSizeT,
-    bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager);
+    bpSize aBlockSizeX, bpSize aBlockSizeY, bpSize aBlockSizeZ, bpSharedPtr<bpMemoryManager<TDataType> > aManager,
+    bpSharedPtr<bpScratchFile<TDataType> > aScratchFile = nullptr);
 
   bpImsImage5D(const bpImsImage5D&) = delete;
   //bpImsImage5D& operator=(const bpImsImage5D&) = delete;
@@ -37,9 +40,15 @@ public:
 
   ~bpImsImage5D();
 
+  // at least aSizeT of the constructor, more if later time points have been accessed
   bpSize GetSizeT() const;
   bpSize GetSizeC() const;
 
+  // same for all time points and channels
+  bpVec3 GetImageSize() const;
+  bpVec3 GetMemoryBlockSize() const;
+  bpVec3 GetNBlocks() const;
+
   void CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY);
 
   bpImsImage3D<TDataType>& GetImage3D(bpSize aIndexT, bpSize aIndexC);
@@ -49,10 +58,22 @@ public:
   bpImsImageBlock<TDataType>& GetBlock(bpSize aIndexT, bpSize aIndexC, bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ);
 
   bool PadBorderBlockWithZeros(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ, bpSize aIndexC, bpSize aIndexT);
+
+  /**
+  * Frees the 3D images of time point aIndexT. They must not be accessed anymore.
+  */
+  void ReleaseTimePoint(bpSize aIndexT);
+
 private:
+  using tChannels = std::vector<bpImsImage3D<TDataType> >;
+
+  bpVec3 mImageSize;
+  bpVec3 mBlockSize;
+  bpSize mSizeC;
+  bpSize mSizeT;
 
-  // 3D images (for dimensions X,Y,Z) for each timepoint and channel, e.g. mImages[timeIndex][channelIndex]
-  std::vector<std::vector<bpImsImage3D<TDataType> > > mImages;
+  // 3D images (for dimensions X,Y,Z) for each timepoint and channel, e.g. mImages->Get(timeIndex)[channelIndex]
+  bpUniquePtr<bpTimePointVector<tChannels> > mImages;
 };
 
 #endif // __BP_IMS_IMAGE_5D__
@@ -16,6 +16,8 @@
 
 #include "bpImsImageBlock.h"
 
+#include <lz4.h>
+
 
 template<typename TDataType>
 bpImsImageBlock<TDataType>::bpImsImageBlock(bpSize aSize, bpSharedPtr<bpMemoryManager<TDataType> > aManager)
@@ -27,6 +29,7 @@ bpImsImageBlock<TDataType>::bpImsImageBlock(bpSize aSize, bpSharedPtr<bpMemoryMa
 template<typename TDataType>
 bpImsImageBlock<TDataType>::~bpImsImageBlock()
 {
+  ReleaseCompressedData();
   ReleaseMemory();
 }
 
@@ -49,6 +52,9 @@ void bpImsImageBlock<TDataType>::CopyLinePartToBlock(bpSize aBeginOffsetInBlock,
 template<typename TDataType>
 typename bpImsImageBlock<TDataType>::tData bpImsImageBlock<TDataType>::ReleaseMemory()
 {
+  if (IsCompressed()) {
+    GetData();
+  }
   tData vData = mData;
   mData = {};
   mSize = 0;
@@ -56,12 +62,100 @@ typename bpImsImageBlock<TDataType>::tData bpImsImageBlock<TDataType>::ReleaseMe
 }
 
 
+template<typename TDataType>
+void bpImsImageBlock<TDataType>::AdoptMemory(tData aData)
+{
+  if (mSize == 0 || mData.GetSize() == mSize) {
+    throw bpError("Block memory has already been allocated");
+  }
+  if (aData.GetSize() != mSize) {
+    throw bpError("Block memory size does not match");
+  }
+  mData = std::move(aData);
+}
+
+
+template<typename TDataType>
+void bpImsImageBlock<TDataType>::MoveMemory(tData aData)
+{
+  if (aData.GetSize() != mSize) {
+    throw bpError("Block memory size does not match");
+  }
+  if (IsAllocated() || IsCompressed()) {
+    const TDataType* vData = GetData();
+    std::copy(vData, vData + mSize, aData.GetData());
+  }
+  mData = std::move(aData);
+}
+
+
+template<typename TDataType>
+bool bpImsImageBlock<TDataType>::IsAllocated() const
+{
+  return mSize > 0 && mData.GetSize() == mSize;
+}
+
+
+template<typename TDataType>
+bpSize bpImsImageBlock<TDataType>::Compress(bpSize aMaxCompressedBytes, std::vector<char>& aBuffer)
+{
+  if (!IsAllocated()) {
+    return 0;
+  }
+  bpSize vBytes = mSize * sizeof(TDataType);
+  if (aBuffer.size() < aMaxCompressedBytes) {
+    aBuffer.resize(aMaxCompressedBytes);
+  }
+  int vCompressedBytes = LZ4_compress_default(reinterpret_cast<const char*>(mData.GetData()), aBuffer.data(),
+    static_cast<int>(vBytes), static_cast<int>(aMaxCompressedBytes));
+  if (vCompressedBytes <= 0) {
+    return 0;
+  }
+
+  mCompressedData.assign(aBuffer.begin(), aBuffer.begin() + vCompressedBytes);
+  if (mManager->GetBudget()) {
+    mManager->GetBudget()->Add(mCompressedData.size());
+  }
+  mData = {};
+  return mCompressedData.size();
+}
+
+
+template<typename TDataType>
+bool bpImsImageBlock<TDataType>::IsCompressed() const
+{
+  return !mCompressedData.empty();
+}
+
+
+template<typename TDataType>
+void bpImsImageBlock<TDataType>::ReleaseCompressedData()
+{
+  if (!IsCompressed()) {
+    return;
+  }
+  if (mManager->GetBudget()) {
+    mManager->GetBudget()->Remove(mCompressedData.size());
+  }
+  mCompressedData = {};
+}
+
+
 template<typename TDataType>
 TDataType* bpImsImageBlock<TDataType>::GetData()
 {
   if (mSize == 0) throw 0;
   if (mData.GetSize() != mSize) {
     mData = mManager->GetMemory(mSize);
+    if (IsCompressed()) {
+      int vBytes = static_cast<int>(mSize * sizeof(TDataType));
+      int vDecompressedBytes = LZ4_decompress_safe(mCompressedData.data(), reinterpret_cast<char*>(mData.GetData()),
+        static_cast<int>(mCompressedData.size()), vBytes);
+      if (vDecompressedBytes != vBytes) {
+        throw bpError("Could not decompress block data");
+      }
+      ReleaseCompressedData();
+    }
   }
 
   return mData.GetData();
@@ -19,6 +19,8 @@
 #include "../interface/bpConverterTypes.h"
 #include "bpMemoryManager.h"
 
+#include <vector>
+
 /**
 * Memory block in RAM.
 */
@@ -35,13 +37,39 @@ public:
 
   tData ReleaseMemory();
 
+  /**
+  * Uses aData (of the full block size) as the block's memory instead of allocating it.
+  */
+  void AdoptMemory(tData aData);
+
+  /**
+  * Copies the block's data to aData (of the full block size) and uses it from now on, the previous memory is returned.
+  */
+  void MoveMemory(tData aData);
+
+  // false for a compressed block
+  bool IsAllocated() const;
+
+  /**
+  * Replaces the data in RAM by an LZ4 compressed copy, if it fits in aMaxCompressedBytes, and returns its size (0 if it does not fit).
+  * The block is compressed into aBuffer first, which can be reused for the next block.
+  * GetData decompresses it again. The compressed bytes are accounted in the budget of the memory manager.
+  */
+  bpSize Compress(bpSize aMaxCompressedBytes, std::vector<char>& aBuffer);
+
+  bool IsCompressed() const;
+
   TDataType* GetData();
 
   const TDataType* GetData() const;
 
 private:
+  void ReleaseCompressedData();
+
   tData mData;
 
+  std::vector<char> mCompressedData;
+
   bpSize mSize;
 
   bpSharedPtr<bpMemoryManager<TDataType> > mManager;
@@ -40,6 +40,12 @@ bpSize bpImsLayout::GetNumberOfTimePoints() const
 }
 
 
+void bpImsLayout::SetNumberOfTimePoints(bpSize aSizeT)
+{
+  mSizeT = aSizeT;
+}
+
+
 bpSize bpImsLayout::GetNumberOfChannels() const
 {
   return mSizeC;
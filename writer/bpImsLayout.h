@@ -32,6 +32,7 @@ public:
   ~bpImsLayout();
 
   bpSize GetNumberOfTimePoints() const;
+  void SetNumberOfTimePoints(bpSize aSizeT);
   bpSize GetNumberOfChannels() const;
   bpSize GetNumberOfResolutionLevels() const;
 
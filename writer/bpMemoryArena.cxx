@@ -0,0 +1,258 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpMemoryArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+class bpMemoryArena::cImpl
+{
+public:
+  ~cImpl()
+  {
+    for (const auto& vRegion : mRegions) {
+      Unmap(vRegion.first, vRegion.second.mBytes);
+    }
+  }
+
+  void* Allocate(bpSize aBytes)
+  {
+    if (aBytes < mMinSlotBytes) {
+      return AllocateAligned(aBytes);
+    }
+
+    bpSize vSlotBytes = GetSlotBytes(aBytes);
+    char* vSlot = nullptr;
+    {
+      std::lock_guard<std::mutex> vLock(mMutex);
+      // the lowest region with a free slot, the higher ones are more likely to empty and be returned
+      for (auto& vRegion : mRegions) {
+        cRegion& vSlots = vRegion.second;
+        if (vSlots.mSlotBytes == vSlotBytes && !vSlots.mFreeSlots.empty()) {
+          vSlot = vSlots.mFreeSlots.back();
+          vSlots.mFreeSlots.pop_back();
+          vSlots.mIsFree[(vSlot - vRegion.first) / vSlotBytes] = false;
+          ++vSlots.mUsedSlots;
+          break;
+        }
+      }
+      if (!vSlot) {
+        vSlot = AddRegion(vSlotBytes);
+      }
+    }
+#ifdef _WIN32
+    if (!VirtualAlloc(vSlot, vSlotBytes, MEM_COMMIT, PAGE_READWRITE)) {
+      Free(vSlot, aBytes);
+      throw std::bad_alloc();
+    }
+#endif
+    return vSlot;
+  }
+
+  void Free(void* aData, bpSize aBytes)
+  {
+    if (aBytes < mMinSlotBytes) {
+      FreeAligned(aData);
+      return;
+    }
+
+    char* vSlot = static_cast<char*>(aData);
+    // the region may keep the address range, but not the memory
+#ifdef _WIN32
+    VirtualFree(vSlot, GetSlotBytes(aBytes), MEM_DECOMMIT);
+#endif
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    auto vRegion = mRegions.upper_bound(vSlot);
+    --vRegion;
+    cRegion& vSlots = vRegion->second;
+    if (--vSlots.mUsedSlots == 0) {
+      Unmap(vRegion->first, vSlots.mBytes);
+      mRegions.erase(vRegion);
+    }
+    else {
+      vSlots.mFreeSlots.push_back(vSlot);
+      vSlots.mIsFree[(vSlot - vRegion->first) / vSlots.mSlotBytes] = true;
+#ifndef _WIN32
+      ReleaseHugePages(vRegion->first, vSlots, vSlot);
+#endif
+    }
+  }
+
+private:
+  struct cRegion
+  {
+    bpSize mBytes;
+    bpSize mSlotBytes;
+    bpSize mUsedSlots;
+    std::vector<char*> mFreeSlots;
+    std::vector<bool> mIsFree;
+  };
+
+#ifndef _WIN32
+  // returns the huge pages of aSlot whose slots are all free, a part of a huge page would split it into small pages
+  void ReleaseHugePages(char* aRegionData, const cRegion& aRegion, char* aSlot) const
+  {
+    bpSize vSlotBegin = aSlot - aRegionData;
+    bpSize vSlotEnd = vSlotBegin + aRegion.mSlotBytes;
+    for (bpSize vPage = vSlotBegin / mHugePageBytes * mHugePageBytes; vPage < vSlotEnd; vPage += mHugePageBytes) {
+      bpSize vFirstSlot = vPage / aRegion.mSlotBytes;
+      bpSize vEndSlot = std::min<bpSize>((vPage + mHugePageBytes + aRegion.mSlotBytes - 1) / aRegion.mSlotBytes, aRegion.mIsFree.size());
+      bool vIsFree = true;
+      for (bpSize vIndex = vFirstSlot; vIndex < vEndSlot && vIsFree; ++vIndex) {
+        vIsFree = aRegion.mIsFree[vIndex];
+      }
+      // under the lock, a slot of the page must not be handed out meanwhile
+      if (vIsFree) {
+        madvise(aRegionData + vPage, mHugePageBytes, MADV_DONTNEED);
+      }
+    }
+  }
+#endif
+
+  // a multiple of the page size (the allocation granularity on Windows)
+  bpSize GetSlotBytes(bpSize aBytes) const
+  {
+    return (aBytes + mMinSlotBytes - 1) / mMinSlotBytes * mMinSlotBytes;
+  }
+
+  // returns the first slot of the new region, already in use
+  char* AddRegion(bpSize aSlotBytes)
+  {
+    bpSize vSlots = aSlotBytes < mRegionBytes ? mRegionBytes / aSlotBytes : 1;
+    bpSize vBytes = (vSlots * aSlotBytes + mHugePageBytes - 1) / mHugePageBytes * mHugePageBytes;
+    vSlots = vBytes / aSlotBytes;
+
+    char* vData = Map(vBytes);
+    cRegion& vRegion = mRegions[vData];
+    vRegion.mBytes = vBytes;
+    vRegion.mSlotBytes = aSlotBytes;
+    vRegion.mUsedSlots = 1;
+    vRegion.mIsFree.assign(vSlots, true);
+    vRegion.mIsFree[0] = false;
+    // the lowest slots are used first
+    for (bpSize vSlot = vSlots; vSlot > 1; --vSlot) {
+      vRegion.mFreeSlots.push_back(vData + (vSlot - 1) * aSlotBytes);
+    }
+    return vData;
+  }
+
+  char* Map(bpSize aBytes)
+  {
+#ifdef _WIN32
+    // large pages need a privilege, the address range is reserved and the slots committed when used
+    void* vData = VirtualAlloc(nullptr, aBytes, MEM_RESERVE, PAGE_READWRITE);
+    if (!vData) {
+      throw std::bad_alloc();
+    }
+    return static_cast<char*>(vData);
+#else
+    // maps a huge page more and unmaps what is before and after the aligned range
+    void* vMapped = mmap(nullptr, aBytes + mHugePageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (vMapped == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    char* vBegin = static_cast<char*>(vMapped);
+    char* vData = vBegin + (mHugePageBytes - reinterpret_cast<std::uintptr_t>(vBegin) % mHugePageBytes) % mHugePageBytes;
+    if (vData > vBegin) {
+      munmap(vBegin, vData - vBegin);
+    }
+    bpSize vTailBytes = vBegin + aBytes + mHugePageBytes - (vData + aBytes);
+    if (vTailBytes > 0) {
+      munmap(vData + aBytes, vTailBytes);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(vData, aBytes, MADV_HUGEPAGE);
+#endif
+    return vData;
+#endif
+  }
+
+  static void Unmap(char* aData, bpSize aBytes)
+  {
+#ifdef _WIN32
+    VirtualFree(aData, 0, MEM_RELEASE);
+#else
+    munmap(aData, aBytes);
+#endif
+  }
+
+  void* AllocateAligned(bpSize aBytes) const
+  {
+#ifdef _WIN32
+    void* vData = _aligned_malloc(aBytes > 0 ? aBytes : 1, mAlignment);
+#else
+    void* vData = nullptr;
+    if (posix_memalign(&vData, mAlignment, aBytes > 0 ? aBytes : 1) != 0) {
+      vData = nullptr;
+    }
+#endif
+    if (!vData) {
+      throw std::bad_alloc();
+    }
+    return vData;
+  }
+
+  static void FreeAligned(void* aData)
+  {
+#ifdef _WIN32
+    _aligned_free(aData);
+#else
+    free(aData);
+#endif
+  }
+
+  // cache line, and the widest vector loads
+  const bpSize mAlignment = 64;
+  const bpSize mMinSlotBytes = 64 * 1024;
+  const bpSize mHugePageBytes = 2 * 1024 * 1024;
+  const bpSize mRegionBytes = 16 * 1024 * 1024;
+
+  std::mutex mMutex;
+  // by address, a slot belongs to the region with the next lower address
+  std::map<char*, cRegion> mRegions;
+};
+
+
+bpMemoryArena::bpMemoryArena()
+  : mImpl(std::make_shared<cImpl>())
+{
+}
+
+
+void* bpMemoryArena::Allocate(bpSize aBytes)
+{
+  return mImpl->Allocate(aBytes);
+}
+
+
+void bpMemoryArena::Free(void* aData, bpSize aBytes)
+{
+  mImpl->Free(aData, aBytes);
+}
@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_MEMORY_ARENA__
+#define __BP_MEMORY_ARENA__
+
+
+#include "../interface/bpConverterTypes.h"
+
+
+/**
+* Allocates memory blocks aligned to at least 64 bytes. Blocks of 64 KB and more are page aligned and carved
+* from large regions that are aligned to huge pages, and marked for transparent huge pages where supported.
+* A region is returned to the system once all its blocks are freed.
+*/
+class bpMemoryArena
+{
+public:
+  bpMemoryArena();
+
+  // thread safe
+  void* Allocate(bpSize aBytes);
+
+  /**
+  * aBytes as passed to Allocate. The memory of freed blocks is returned to the system even if their region is kept,
+  * as whole huge pages once all blocks in them are freed (slot by slot on Windows).
+  */
+  void Free(void* aData, bpSize aBytes);
+
+private:
+  class cImpl;
+  bpSharedPtr<cImpl> mImpl;
+};
+
+#endif // __BP_MEMORY_ARENA__
@@ -0,0 +1,118 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpMemoryBudget.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+
+class bpMemoryBudget::cImpl
+{
+public:
+  explicit cImpl(bpSize aMaxBytes)
+    : mMaxBytes(aMaxBytes),
+      mUsedBytes(0)
+  {
+  }
+
+  void Add(bpSize aBytes)
+  {
+    mUsedBytes += aBytes;
+  }
+
+  void Remove(bpSize aBytes)
+  {
+    bpSize vUsedBytes = mUsedBytes -= aBytes;
+    if (mMaxBytes > 0 && vUsedBytes < mMaxBytes) {
+      std::lock_guard<std::mutex> vLock(mMutex);
+      mReturnedCondition.notify_all();
+    }
+  }
+
+  bpSize GetUsedBytes() const
+  {
+    return mUsedBytes;
+  }
+
+  bpSize GetMaxBytes() const
+  {
+    return mMaxBytes;
+  }
+
+  bool IsExceeded() const
+  {
+    return mMaxBytes > 0 && mUsedBytes >= mMaxBytes;
+  }
+
+  void WaitBelowLimit(const std::function<bool()>& aIsWorkQueued)
+  {
+    std::unique_lock<std::mutex> vLock(mMutex);
+    // the queued work may also finish without returning memory, check it again from time to time
+    while (IsExceeded() && aIsWorkQueued()) {
+      mReturnedCondition.wait_for(vLock, std::chrono::milliseconds(10));
+    }
+  }
+
+private:
+  const bpSize mMaxBytes;
+  std::atomic<bpSize> mUsedBytes;
+  std::mutex mMutex;
+  std::condition_variable mReturnedCondition;
+};
+
+
+bpMemoryBudget::bpMemoryBudget(bpSize aMaxBytes)
+  : mImpl(std::make_shared<cImpl>(aMaxBytes))
+{
+}
+
+
+void bpMemoryBudget::Add(bpSize aBytes)
+{
+  mImpl->Add(aBytes);
+}
+
+
+void bpMemoryBudget::Remove(bpSize aBytes)
+{
+  mImpl->Remove(aBytes);
+}
+
+
+bpSize bpMemoryBudget::GetUsedBytes() const
+{
+  return mImpl->GetUsedBytes();
+}
+
+
+bpSize bpMemoryBudget::GetMaxBytes() const
+{
+  return mImpl->GetMaxBytes();
+}
+
+
+bool bpMemoryBudget::IsExceeded() const
+{
+  return mImpl->IsExceeded();
+}
+
+
+void bpMemoryBudget::WaitBelowLimit(const std::function<bool()>& aIsWorkQueued)
+{
+  mImpl->WaitBelowLimit(aIsWorkQueued);
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_MEMORY_BUDGET__
+#define __BP_MEMORY_BUDGET__
+
+
+#include "../interface/bpConverterTypes.h"
+
+#include <functional>
+
+
+/**
+* Accounts the memory of one converter (blocks, compression buffers, histograms) against an optional limit.
+* Allocations are never refused, instead the producers wait while memory held by queued work is going to be returned.
+*/
+class bpMemoryBudget
+{
+public:
+  // aMaxBytes 0 does not limit the memory
+  explicit bpMemoryBudget(bpSize aMaxBytes);
+
+  void Add(bpSize aBytes);
+  void Remove(bpSize aBytes);
+
+  bpSize GetUsedBytes() const;
+  bpSize GetMaxBytes() const;
+  bool IsExceeded() const;
+
+  /**
+  * Waits until the used memory is below the limit. Returns early once aIsWorkQueued is false,
+  * nothing would be returned while waiting and the caller has to proceed to complete the blocks holding the memory.
+  */
+  void WaitBelowLimit(const std::function<bool()>& aIsWorkQueued);
+
+private:
+  class cImpl;
+  bpSharedPtr<cImpl> mImpl;
+};
+
+#endif // __BP_MEMORY_BUDGET__
@@ -14,97 +14,256 @@
  *   limitations under the License.                                        *
  ***************************************************************************/
 #include "bpMemoryManager.h"
+#include "bpMemoryArena.h"
 
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
-#include <algorithm>
-#include <iostream>
-#include <sstream>
-#include <stack>
-
-#ifdef BP_DEBUG
-#ifdef _WIN32
-#include <Windows.h>
-#endif
-#endif
 
 template<typename TDataType>
 class bpMemoryManager<TDataType>::cImpl
 {
 public:
-  using tData = std::pair<TDataType*, bpSize>;
+  explicit cImpl(bpSharedPtr<bpMemoryBudget> aBudget)
+    : mBudget(std::move(aBudget))
+  {
+  }
+
+  ~cImpl()
+  {
+    Trim(0);
+  }
 
   bpMemoryBlock<TDataType> GetMemory(bpSize aSize)
   {
-    tData vData{ nullptr, 0 };
+    bpSize vClass = GetSizeClass(aSize);
+    bpSize vBytes = GetClassSize(vClass) * sizeof(TDataType);
+    ++mRequests;
+    AddUsedBytes(vBytes);
 
+    TDataType* vData = nullptr;
     {
-      std::unique_lock<std::mutex> vLock(mMutex);
-      if (!mDataCache.empty()) {
-        vData = std::move(mDataCache.top());
-        mDataCache.pop();
-
-        if (aSize > vData.second) {
-          mMemoryReallocated += vData.second;
-          mMemoryCapacity += aSize - vData.second;
+      cSizeClass& vSizeClass = mSizeClasses[vClass];
+      std::lock_guard<std::mutex> vLock(vSizeClass.mMutex);
+      if (!vSizeClass.mData.empty()) {
+        vData = vSizeClass.mData.back();
+        vSizeClass.mData.pop_back();
+        mCachedBytes -= vBytes;
+      }
+    }
+
+    if (vData) {
+      ++mCacheHits;
+    }
+    else {
+      // memory cached for other sizes is not needed as much as this
+      if (mBudget && mBudget->IsExceeded()) {
+        Trim(0);
+      }
+      vData = static_cast<TDataType*>(mArena.Allocate(vBytes));
+      mAllocatedBytes += vBytes;
+      if (mBudget) {
+        mBudget->Add(vBytes);
+      }
+    }
+
+    return bpMemoryBlock<TDataType>(vData, aSize, [this, vData, vClass]() { ReturnMemory(vData, vClass); });
+  }
+
+  const bpSharedPtr<bpMemoryBudget>& GetBudget() const
+  {
+    return mBudget;
+  }
+
+  cStatistics GetStatistics() const
+  {
+    cStatistics vStatistics;
+    vStatistics.mRequests = mRequests;
+    vStatistics.mCacheHits = mCacheHits;
+    vStatistics.mAllocatedBytes = mAllocatedBytes;
+    vStatistics.mFreedBytes = mFreedBytes;
+    vStatistics.mUsedBytes = mUsedBytes;
+    vStatistics.mCachedBytes = mCachedBytes;
+    vStatistics.mPeakUsedBytes = mPeakUsedBytes;
+    return vStatistics;
+  }
+
+  bool IsCompressionWorthwhile()
+  {
+    std::unique_lock<std::mutex> vLock(mMutex);
+    if (mCompressionRatio <= mMaxCompressionRatio) {
+      return true;
+    }
+    // keeps measuring, the data may get more compressible
+    return ++mCompressionsSkipped % 16 == 0;
+  }
+
+  void AddCompressionResult(bpSize aSize, bpSize aCompressedSize)
+  {
+    std::unique_lock<std::mutex> vLock(mMutex);
+    // moving average, dominated by the last few blocks
+    mCompressionRatio += (static_cast<bpFloat>(aCompressedSize) / aSize - mCompressionRatio) / 8;
+  }
+
+  tIdleBlockPosition AddIdleBlock(std::weak_ptr<cIdleBlockOwner> aOwner, bpSize aBlockIndex)
+  {
+    std::lock_guard<std::mutex> vLock(mIdleBlocksMutex);
+    return mIdleBlocks.insert(mIdleBlocks.end(), { std::move(aOwner), aBlockIndex });
+  }
+
+  void RemoveIdleBlock(tIdleBlockPosition aPosition)
+  {
+    std::lock_guard<std::mutex> vLock(mIdleBlocksMutex);
+    mIdleBlocks.erase(aPosition);
+  }
+
+  void ReleaseIdleBlocks()
+  {
+    while (mBudget && mBudget->IsExceeded()) {
+      bpSharedPtr<cIdleBlockOwner> vOwner;
+      bpSize vBlockIndex;
+      {
+        std::lock_guard<std::mutex> vLock(mIdleBlocksMutex);
+        if (mIdleBlocks.empty()) {
+          return;
         }
+        vOwner = mIdleBlocks.front().mOwner.lock();
+        vBlockIndex = mIdleBlocks.front().mBlockIndex;
       }
-      else {
-        mMemoryCapacity += aSize;
+      // an owner being destroyed removes its blocks
+      if (!vOwner) {
+        return;
       }
+      // removes the block from the list, unless someone else has already done so
+      vOwner->ReleaseIdleBlock(vBlockIndex);
+    }
+  }
 
-      mMemoryRequested += aSize;
+private:
+  // four classes per power of two, class 0 holds up to 4 values
+  static bpSize GetSizeClass(bpSize aSize)
+  {
+    if (aSize <= 4) {
+      return 0;
     }
+    bpSize vBits = 2;
+    while (((aSize - 1) >> (vBits + 1)) > 0) {
+      ++vBits;
+    }
+    bpSize vStep = bpSize(1) << (vBits - 2);
+    bpSize vSteps = (aSize + vStep - 1) / vStep;
+    return (vBits - 2) * 4 + vSteps - 4;
+  }
 
-    if (aSize > vData.second) {
-      delete[] vData.first;
-      vData.first = new TDataType[aSize];
-      vData.second = aSize;
+  static bpSize GetClassSize(bpSize aClass)
+  {
+    if (aClass == 0) {
+      return 4;
     }
+    bpSize vBits = (aClass - 1) / 4 + 2;
+    bpSize vSteps = (aClass - 1) % 4 + 5;
+    return vSteps << (vBits - 2);
+  }
 
-    return bpMemoryBlock<TDataType>(vData.first, aSize, [vData, this]() { ReturnMemory(vData); });
+  void AddUsedBytes(bpUInt64 aBytes)
+  {
+    bpUInt64 vUsedBytes = mUsedBytes += aBytes;
+    bpUInt64 vPeak = mPeakUsedBytes;
+    while (vUsedBytes > vPeak && !mPeakUsedBytes.compare_exchange_weak(vPeak, vUsedBytes)) {
+    }
+    bpUInt64 vHighWater = mHighWaterBytes;
+    while (vUsedBytes > vHighWater && !mHighWaterBytes.compare_exchange_weak(vHighWater, vUsedBytes)) {
+    }
   }
 
-  ~cImpl()
+  void ReturnMemory(TDataType* aData, bpSize aClass)
+  {
+    bpUInt64 vBytes = GetClassSize(aClass) * sizeof(TDataType);
+    bpUInt64 vUsedBytes = mUsedBytes -= vBytes;
+
+    // the cache only keeps what it takes to get back to the recent peak
+    if ((mBudget && mBudget->IsExceeded()) || vUsedBytes + mCachedBytes + vBytes > mHighWaterBytes) {
+      Free(aData, vBytes);
+    }
+    else {
+      mCachedBytes += vBytes;
+      cSizeClass& vSizeClass = mSizeClasses[aClass];
+      std::lock_guard<std::mutex> vLock(vSizeClass.mMutex);
+      vSizeClass.mData.push_back(aData);
+    }
+
+    if (++mReturns % 64 == 0) {
+      // the peak decays towards the memory in use, the cache shrinks with it
+      bpUInt64 vHighWater = mHighWaterBytes;
+      if (vHighWater > vUsedBytes) {
+        vHighWater -= (vHighWater - vUsedBytes) / 16;
+        mHighWaterBytes = vHighWater;
+        Trim(vHighWater - vUsedBytes);
+      }
+    }
+  }
+
+  // frees cached memory, largest sizes first, until at most aMaxCachedBytes are left
+  void Trim(bpUInt64 aMaxCachedBytes)
   {
-////#ifdef BP_DEBUG
-//#ifdef _WIN32
-//    std::ostringstream vOut;
-//    vOut << "Amount of memory requested: " << mMemoryRequested * sizeof(TDataType) / 1024 / 1024 << " MB\n";
-//    vOut << "Amount of memory allocated: " << mMemoryCapacity * sizeof(TDataType) / 1024 / 1024 << " MB\n";
-//    vOut << "Amount of memory reallocated: " << mMemoryReallocated * sizeof(TDataType) / 1024 / 1024 << " MB\n";
-//    bpString vText = vOut.str();
-//
-//    std::cout << vText;
-//    //OutputDebugString(vText.c_str());
-//#endif
-////#endif
-
-    while (!mDataCache.empty()) {
-      delete[] mDataCache.top().first;
-      mDataCache.pop();
+    for (bpSize vClass = mSizeClasses.size(); vClass > 0 && mCachedBytes > aMaxCachedBytes; --vClass) {
+      cSizeClass& vSizeClass = mSizeClasses[vClass - 1];
+      bpUInt64 vBytes = GetClassSize(vClass - 1) * sizeof(TDataType);
+      std::lock_guard<std::mutex> vLock(vSizeClass.mMutex);
+      while (!vSizeClass.mData.empty() && mCachedBytes > aMaxCachedBytes) {
+        Free(vSizeClass.mData.back(), vBytes);
+        vSizeClass.mData.pop_back();
+        mCachedBytes -= vBytes;
+      }
     }
   }
 
-private:
-  void ReturnMemory(tData aData)
+  void Free(TDataType* aData, bpUInt64 aBytes)
   {
-    std::unique_lock<std::mutex> vLock(mMutex);
-    mDataCache.emplace();
-    mDataCache.top().swap(aData);
+    mArena.Free(aData, aBytes);
+    mFreedBytes += aBytes;
+    if (mBudget) {
+      mBudget->Remove(aBytes);
+    }
   }
 
+  struct cSizeClass
+  {
+    std::mutex mMutex;
+    std::vector<TDataType*> mData;
+  };
+
+  bpSharedPtr<bpMemoryBudget> mBudget;
+  bpMemoryArena mArena;
+  // a lock for each size class, requests of different sizes do not wait for each other
+  std::array<cSizeClass, 4 * 64> mSizeClasses;
+
+  std::atomic<bpUInt64> mRequests{ 0 };
+  std::atomic<bpUInt64> mCacheHits{ 0 };
+  std::atomic<bpUInt64> mReturns{ 0 };
+  std::atomic<bpUInt64> mAllocatedBytes{ 0 };
+  std::atomic<bpUInt64> mFreedBytes{ 0 };
+  std::atomic<bpUInt64> mUsedBytes{ 0 };
+  std::atomic<bpUInt64> mCachedBytes{ 0 };
+  std::atomic<bpUInt64> mPeakUsedBytes{ 0 };
+  std::atomic<bpUInt64> mHighWaterBytes{ 0 };
+
+  // the owners lock their blocks first, this is never held while waiting for an owner
+  std::mutex mIdleBlocksMutex;
+  std::list<cIdleBlock> mIdleBlocks;
+
   std::mutex mMutex;
-  std::stack<tData> mDataCache;
-  bpSize mMemoryCapacity = 0;
-  bpSize mMemoryRequested = 0;
-  bpSize mMemoryReallocated = 0;
+  const bpFloat mMaxCompressionRatio = 0.5f;
+  bpFloat mCompressionRatio = 0;
+  bpSize mCompressionsSkipped = 0;
 };
 
 
 template<typename TDataType>
-bpMemoryManager<TDataType>::bpMemoryManager()
-  : mImpl(std::make_shared<cImpl>())
+bpMemoryManager<TDataType>::bpMemoryManager(bpSharedPtr<bpMemoryBudget> aBudget)
+  : mImpl(std::make_shared<cImpl>(std::move(aBudget)))
 {
 }
 
@@ -116,6 +275,55 @@ bpMemoryBlock<TDataType> bpMemoryManager<TDataType>::GetMemory(bpSize aSize)
 }
 
 
+template<typename TDataType>
+const bpSharedPtr<bpMemoryBudget>& bpMemoryManager<TDataType>::GetBudget() const
+{
+  return mImpl->GetBudget();
+}
+
+
+template<typename TDataType>
+typename bpMemoryManager<TDataType>::cStatistics bpMemoryManager<TDataType>::GetStatistics() const
+{
+  return mImpl->GetStatistics();
+}
+
+
+template<typename TDataType>
+bool bpMemoryManager<TDataType>::IsCompressionWorthwhile()
+{
+  return mImpl->IsCompressionWorthwhile();
+}
+
+
+template<typename TDataType>
+void bpMemoryManager<TDataType>::AddCompressionResult(bpSize aSize, bpSize aCompressedSize)
+{
+  mImpl->AddCompressionResult(aSize, aCompressedSize);
+}
+
+
+template<typename TDataType>
+typename bpMemoryManager<TDataType>::tIdleBlockPosition bpMemoryManager<TDataType>::AddIdleBlock(std::weak_ptr<cIdleBlockOwner> aOwner, bpSize aBlockIndex)
+{
+  return mImpl->AddIdleBlock(std::move(aOwner), aBlockIndex);
+}
+
+
+template<typename TDataType>
+void bpMemoryManager<TDataType>::RemoveIdleBlock(tIdleBlockPosition aPosition)
+{
+  mImpl->RemoveIdleBlock(aPosition);
+}
+
+
+template<typename TDataType>
+void bpMemoryManager<TDataType>::ReleaseIdleBlocks()
+{
+  mImpl->ReleaseIdleBlocks();
+}
+
+
 template class bpMemoryManager<bpUInt8>;
 template class bpMemoryManager<bpUInt16>;
 template class bpMemoryManager<bpUInt32>;
@@ -18,16 +18,83 @@
 
 
 #include "bpMemoryBlock.h"
+#include "bpMemoryBudget.h"
+
+#include <list>
+#include <memory>
 
 
 template<typename TDataType>
 class bpMemoryManager
 {
 public:
-  bpMemoryManager();
+  struct cStatistics
+  {
+    bpUInt64 mRequests = 0;       // GetMemory calls
+    bpUInt64 mCacheHits = 0;      // requests served from cached memory
+    bpUInt64 mAllocatedBytes = 0; // allocated in total
+    bpUInt64 mFreedBytes = 0;     // returned to the system in total
+    bpUInt64 mUsedBytes = 0;      // held by memory blocks
+    bpUInt64 mCachedBytes = 0;    // kept for reuse
+    bpUInt64 mPeakUsedBytes = 0;
+  };
+
+  /**
+  * Holds blocks that may give their memory back while the budget is exceeded, see AddIdleBlock.
+  */
+  class cIdleBlockOwner
+  {
+  public:
+    virtual ~cIdleBlockOwner() = default;
+
+    // compresses or moves the block if it is still idle, called without any lock held
+    virtual void ReleaseIdleBlock(bpSize aBlockIndex) = 0;
+  };
+
+  struct cIdleBlock
+  {
+    std::weak_ptr<cIdleBlockOwner> mOwner;
+    bpSize mBlockIndex;
+  };
+
+  using tIdleBlockPosition = typename std::list<cIdleBlock>::iterator;
+
+  /**
+  * Memory is allocated aligned by a bpMemoryArena and cached in size classes, four per power of two, so a request is served by a buffer at most 25% larger.
+  * The cache is trimmed to what the recent peak of used memory needs, the peak decays while less is used.
+  * Allocations and cached memory are accounted in aBudget if there is one. Returned memory is freed
+  * instead of cached while the budget is exceeded.
+  */
+  explicit bpMemoryManager(bpSharedPtr<bpMemoryBudget> aBudget = nullptr);
 
   bpMemoryBlock<TDataType> GetMemory(bpSize aSize);
 
+  const bpSharedPtr<bpMemoryBudget>& GetBudget() const;
+
+  // thread safe, the counters are read one by one and may not add up while memory is requested
+  cStatistics GetStatistics() const;
+
+  /**
+  * True if the blocks compressed so far have shrunk to at most half their size, otherwise only now and then,
+  * to notice when the data gets more compressible. Thread safe.
+  */
+  bool IsCompressionWorthwhile();
+
+  // aCompressedSize is aSize for a block that did not compress to half its size
+  void AddCompressionResult(bpSize aSize, bpSize aCompressedSize);
+
+  /**
+  * Idle blocks of all images sharing this manager, the least recently used is released first. The owner removes
+  * a block before it is used again or destroyed and must not wait for another owner meanwhile. Thread safe.
+  */
+  tIdleBlockPosition AddIdleBlock(std::weak_ptr<cIdleBlockOwner> aOwner, bpSize aBlockIndex);
+  void RemoveIdleBlock(tIdleBlockPosition aPosition);
+
+  /**
+  * Releases idle blocks, least recently used first, while the budget is exceeded. The caller must not hold the lock of an owner.
+  */
+  void ReleaseIdleBlocks();
+
 private:
   class cImpl;
   bpSharedPtr<cImpl> mImpl;
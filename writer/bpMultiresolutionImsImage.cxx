@@ -17,8 +17,13 @@
 #include "bpMultiresolutionImsImage.h"
 #include "bpWriterFactoryHDF5.h"
 #include "bpOptimalBlockLayout.h"
+#include "bpResampleKernels.h"
 #include "bpThreadPool.h"
 
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
 
 static inline bpSize DivEx(bpSize aNum, bpSize aDiv)
 {
@@ -33,47 +38,86 @@ bpMultiresolutionImsImage<TDataType>::bpMultiresolutionImsImage(
   const bpVec2& aCopyBlockSizeXY, const bpVec2& aSampleXY,
   const bpSharedPtr<bpWriterFactory>& aWriterFactory,
   const bpString& aOutputFile, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType,
-  bpSize aThumbnailSizeXY, bool aForceFileBlockSizeZ1, bpSize aNumberOfThreads)
-: mMaxRunningJobsPerThread(32),
+  bpSize aThumbnailSizeXY, bool aForceFileBlockSizeZ1, bpSize aNumberOfThreads,
+  bpSharedPtr<bpMemoryBudget> aBudget, const bpString& aScratchDirectory, bpSize aHistogramSampleRate)
+: mChannelHistogramsMutex(std::make_unique<std::mutex>()),
+  mPartialBlocksMutex(std::make_unique<std::mutex>()),
   mCopyBlockSizeXY(aCopyBlockSizeXY),
   mSampleXY(aSampleXY),
-  mResampleCount(0)
+  mResampleCount(0),
+  mResampleMutex(std::make_unique<std::mutex>()),
+  mResampleDoneCondition(std::make_unique<std::condition_variable>()),
+  mMaxRunningJobsPerThread(32),
+  mHistogramSampleRate(std::max<bpSize>(aHistogramSampleRate, 1)),
+  mBudget(std::move(aBudget))
 {
   bool vReduceZ = !aForceFileBlockSizeZ1;
   std::vector<bpVec3> vResolutionSizes = GetOptimalImagePyramid(bpVec3{ aSizeX, aSizeY, aSizeZ }, vReduceZ);
-  std::vector<bpVec3> vResolutionBlockSizes = ComputeMemoryBlockSizes(vResolutionSizes, aSizeT);
-
-  if (aForceFileBlockSizeZ1) {
-    for (bpVec3& vBlockSize : vResolutionBlockSizes) {
-      vBlockSize[2] = 1;
-    }
-  }
+  std::vector<bpVec3> vResolutionBlockSizes = ComputeMemoryBlockSizes(vResolutionSizes, aSizeT, aForceFileBlockSizeZ1);
 
   bpImsLayout vLayout(vResolutionSizes, aSizeT, aSizeC, vResolutionBlockSizes, aDataType);
 
   mWriter = aWriterFactory->CreateWriter(aOutputFile, vLayout, aCompressionAlgorithmType);
 
-  bpSharedPtr<bpMemoryManager<TDataType> > vMemoryManager = std::make_shared<bpMemoryManager<TDataType> >();
+  mMemoryManager = std::make_shared<bpMemoryManager<TDataType> >(mBudget);
+
+  // only full resolution blocks are filled plane by plane, the lower resolutions are complete soon after
+  bpSharedPtr<bpScratchFile<TDataType> > vScratchFile;
+  if (!aScratchDirectory.empty() && mBudget && mBudget->GetMaxBytes() > 0) {
+    const bpVec3& vBlockSize = vResolutionBlockSizes[0];
+    vScratchFile = std::make_shared<bpScratchFile<TDataType> >(aScratchDirectory, vBlockSize[0] * vBlockSize[1] * vBlockSize[2]);
+  }
 
   bpSize vResolutionLevels = vResolutionSizes.size();
   mImages.reserve(vResolutionLevels);
   for (bpSize vIndex = 0; vIndex < vResolutionLevels; vIndex++) {
     const bpVec3& vSize = vResolutionSizes[vIndex];
     const bpVec3& vBlockSize = vResolutionBlockSizes[vIndex];
-    mImages.emplace_back(vSize[0], vSize[1], vSize[2], aSizeC, aSizeT, vBlockSize[0], vBlockSize[1], vBlockSize[2], vMemoryManager);
+    mImages.emplace_back(vSize[0], vSize[1], vSize[2], aSizeC, aSizeT, vBlockSize[0], vBlockSize[1], vBlockSize[2], mMemoryManager,
+      vIndex == 0 ? vScratchFile : nullptr);
   }
 
   mThumbnailBuilder = std::make_shared<bpThumbnailBuilder<TDataType>>(aThumbnailSizeXY, vResolutionSizes, vResolutionBlockSizes, aSizeC);
-  mComputeThread = std::make_shared<bpThreadPool>(1);
+  mComputeThreads = std::make_shared<bpThreadPool>(aNumberOfThreads > 0 ? aNumberOfThreads : 1);
 
-  for (bpSize vIndex = 0; vIndex < aNumberOfThreads; vIndex++) {
-    mHistogramThreads.push_back(std::make_shared<bpThreadPool>(1));
+  // every memory block has a histogram job, all but the lowest resolution a resample job
+  mCopyBlocksOfChannel.resize(vResolutionLevels);
+  bpSize vJobsOfTimePoint = 0;
+  for (bpSize vResolution = 0; vResolution < vResolutionLevels; vResolution++) {
+    mCopyBlocksOfChannel[vResolution] = GetCopyBlocksOfChannel(vResolution);
+    bpSize vJobsOfBlock = vResolution + 1 < vResolutionLevels ? 2 : 1;
+    vJobsOfTimePoint += mCopyBlocksOfChannel[vResolution].size() * aSizeC * vJobsOfBlock;
   }
 
-  mCopyBlocksLeft.resize(vResolutionLevels);
+  // the counters of a memory block only exist while it is being filled
+  bpSize vBlocksOfTimePoint = mCopyBlocksOfChannel[0].size() * aSizeC;
+  std::vector<bpSize> vBlocksOfChannel(vResolutionLevels);
   for (bpSize vResolution = 0; vResolution < vResolutionLevels; vResolution++) {
-    InitCopyBlocksLeft(vResolution);
+    vBlocksOfChannel[vResolution] = mCopyBlocksOfChannel[vResolution].size();
   }
+  mTimePoints = std::make_unique<bpTimePointVector<cTimePoint>>([this, vBlocksOfChannel, vBlocksOfTimePoint, vJobsOfTimePoint, aSizeC](bpSize aIndexT) {
+    bpSize vResolutionLevels = vBlocksOfChannel.size();
+    auto vTimePoint = std::make_unique<cTimePoint>();
+    vTimePoint->mJobsLeft = vJobsOfTimePoint;
+    vTimePoint->mShards = std::vector<typename cTimePoint::cShard>(16);
+    for (auto& vShard : vTimePoint->mShards) {
+      vShard.mCopyBlocksLeft.resize(vResolutionLevels);
+    }
+    vTimePoint->mIsComplete = std::vector<std::atomic<bpUInt64>>(DivEx(vBlocksOfTimePoint, 64));
+    for (auto& vBits : vTimePoint->mIsComplete) {
+      vBits = 0;
+    }
+    vTimePoint->mHistogramJobsLeft = std::vector<std::atomic<bpSize>>(vResolutionLevels * aSizeC);
+    for (bpSize vIndex = 0; vIndex < vTimePoint->mHistogramJobsLeft.size(); ++vIndex) {
+      vTimePoint->mHistogramJobsLeft[vIndex] = vBlocksOfChannel[vIndex % vResolutionLevels];
+    }
+    if (mTiles) {
+      InitTiledTimePoint(*vTimePoint, aIndexT);
+    }
+    return vTimePoint;
+  });
+
+  mChannelHistograms.resize(aSizeC, bpHistogram(0, 0, {}));
 }
 
 
@@ -98,43 +142,155 @@ static bool IsEmpty(const bpHistogram& aHistogram)
 template<typename TDataType>
 void bpMultiresolutionImsImage<TDataType>::FinishWriteDataBlocks()
 {
-  mComputeThread->WaitAll();
-  while (mResampleCount > 0) {
-    mComputeThread->WaitAll();
+  // time points no tile has been copied to are all gaps
+  bpSize vSizeT = GetSizeT();
+  if (mTiles) {
+    for (bpSize vIndexT = 0; vIndexT < vSizeT; ++vIndexT) {
+      // a time point with gaps left is not finished yet
+      cTimePoint* vTimePoint = mTimePoints->Find(vIndexT);
+      if (vTimePoint ? !vTimePoint->mAreGapsFilled : !mTimePoints->IsReleased(vIndexT)) {
+        FillGaps(vIndexT, true);
+      }
+    }
+  }
+
+  mComputeThreads->WaitAll();
+  // the writer threads process blocks before compressing them and schedule more jobs meanwhile
+  {
+    std::unique_lock<std::mutex> vLock(*mResampleMutex);
+    mResampleDoneCondition->wait(vLock, [this] { return mResampleCount == 0; });
   }
-  for (const auto& vThread : mHistogramThreads) {
-    vThread->WaitAll();
+  mComputeThreads->WaitAll();
+
+  // time points not all data has been copied to
+  for (bpSize vIndexT = 0; vIndexT < vSizeT; ++vIndexT) {
+    if (!mTimePoints->IsReleased(vIndexT)) {
+      FinishTimePoint(vIndexT);
+    }
   }
 
+  mWriter->FinishWriteDataBlocks();
+}
+
+static bpHistogram LimitNumberOfBins(const bpHistogram& aHistogram, bpSize aMaxNumberOfBins)
+{
+  return aHistogram.GetNumberOfBins() <= aMaxNumberOfBins ? aHistogram : bpResampleHistogram(aHistogram, aMaxNumberOfBins);
+}
+
+static bpHistogram ScaleCounts(const bpHistogram& aHistogram, bpUInt64 aFactor)
+{
+  std::vector<bpUInt64> vBins(aHistogram.GetNumberOfBins());
+  for (bpSize vBin = 0; vBin < vBins.size(); ++vBin) {
+    vBins[vBin] = aHistogram.GetCount(vBin) * aFactor;
+  }
+  return bpHistogram(aHistogram.GetMin(), aHistogram.GetMax(), std::move(vBins));
+}
+
+// adds the counts of aHistogram to aMerged, rebinned to at most 256 * 256 bins if their layouts differ
+static bpHistogram MergeHistograms(const bpHistogram& aMerged, const bpHistogram& aHistogram)
+{
+  bpHistogram vHistogram = LimitNumberOfBins(aHistogram, 256 * 256);
+  if (aMerged.GetNumberOfBins() == 0) {
+    return vHistogram;
+  }
+
+  bool vIsSameLayout = aMerged.GetMin() == vHistogram.GetMin() && aMerged.GetMax() == vHistogram.GetMax() &&
+    aMerged.GetNumberOfBins() == vHistogram.GetNumberOfBins();
+  bpFloat vMin = std::min(aMerged.GetMin(), vHistogram.GetMin());
+  bpFloat vMax = std::max(aMerged.GetMax(), vHistogram.GetMax());
+  std::vector<bpUInt64> vBins(vIsSameLayout ? aMerged.GetNumberOfBins() : 256 * 256);
+  bpHistogram vLayout(vMin, vMax, vBins);
+  const bpHistogram* vHistograms[] = { &aMerged, &vHistogram };
+  for (const bpHistogram* vHist : vHistograms) {
+    for (bpSize vBinId = 0; vBinId < vHist->GetNumberOfBins(); vBinId++) {
+      bpSize vDestBinId = vIsSameLayout ? vBinId : vLayout.GetBin(vHist->GetBinValue(vBinId));
+      vBins[vDestBinId] += vHist->GetCount(vBinId);
+    }
+  }
+  return bpHistogram(vMin, vMax, std::move(vBins));
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::FinishHistogram(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC)
+{
+  auto& vImage3D = mImages[aIndexR].GetImage3D(aIndexT, aIndexC);
+  bpHistogram vHistogram = vImage3D.GetHistogram(std::numeric_limits<bpSize>::max());
+  vImage3D.ReleaseHistograms();
+  if (aIndexR == 0 && mHistogramSampleRate > 1) {
+    // estimate the counts of all voxels from the sampled rows
+    vHistogram = ScaleCounts(vHistogram, mHistogramSampleRate);
+  }
+  if (aIndexR == 0) {
+    std::lock_guard<std::mutex> vLock(*mChannelHistogramsMutex);
+    mChannelHistograms[aIndexC] = MergeHistograms(mChannelHistograms[aIndexC], vHistogram);
+  }
+  vHistogram = LimitNumberOfBins(vHistogram, 1024);
+  if (!IsEmpty(vHistogram)) {
+    mWriter->WriteHistogram(vHistogram, aIndexT, aIndexC, aIndexR);
+  }
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnHistogramJobDone(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC)
+{
+  std::atomic<bpSize>& vHistogramJobsLeft = mTimePoints->Get(aIndexT).mHistogramJobsLeft[aIndexR + mImages.size() * aIndexC];
+  if (vHistogramJobsLeft.fetch_sub(1) != 1) {
+    OnTimePointJobDone(aIndexT);
+    return;
+  }
+  // the time point is not finished before its histograms
+  ++mResampleCount;
+  mComputeThreads->Run([this, aIndexR, aIndexT, aIndexC] {
+    FinishHistogram(aIndexR, aIndexT, aIndexC);
+    OnTimePointJobDone(aIndexT);
+    OnResampleDone();
+  }, {}, true);
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnResampleDone()
+{
+  if (--mResampleCount == 0) {
+    // under the lock, FinishWriteDataBlocks may have checked the count and not be waiting yet
+    std::lock_guard<std::mutex> vLock(*mResampleMutex);
+    mResampleDoneCondition->notify_all();
+  }
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::FinishTimePoint(bpSize aIndexT)
+{
   bpSize vSizeR = mImages.size();
-  bpSize vSizeT = mImages[0].GetSizeT();
   bpSize vSizeC = mImages[0].GetSizeC();
+  cTimePoint& vTimePoint = mTimePoints->Get(aIndexT);
   for (bpSize vIndexR = 0; vIndexR < vSizeR; ++vIndexR) {
-    for (bpSize vIndexT = 0; vIndexT < vSizeT; ++vIndexT) {
-      for (bpSize vIndexC = 0; vIndexC < vSizeC; ++vIndexC) {
-        if (!mHistogramThreads.empty()) {
-          mHistogramThreads[(vIndexT + vSizeT * vIndexC) % mHistogramThreads.size()]->Run([this, vIndexT, vIndexC, vIndexR] {
-            bpHistogram vHistogram = mImages[vIndexR].GetImage3D(vIndexT, vIndexC).GetHistogram(1024);
-            if (!IsEmpty(vHistogram)) {
-              mWriter->WriteHistogram(vHistogram, vIndexT, vIndexC, vIndexR);
-            }
-          });
-        }
-        else {
-          bpHistogram vHistogram = mImages[vIndexR].GetImage3D(vIndexT, vIndexC).GetHistogram(1024);
-          if (!IsEmpty(vHistogram)) {
-            mWriter->WriteHistogram(vHistogram, vIndexT, vIndexC, vIndexR);
-          }
-        }
+    for (bpSize vIndexC = 0; vIndexC < vSizeC; ++vIndexC) {
+      if (vTimePoint.mHistogramJobsLeft[vIndexR + vSizeR * vIndexC] > 0) {
+        FinishHistogram(vIndexR, aIndexT, vIndexC);
       }
     }
   }
 
-  for (const auto& vThread : mHistogramThreads) {
-    vThread->WaitAll();
+  for (auto& vImage5D : mImages) {
+    vImage5D.ReleaseTimePoint(aIndexT);
   }
+  // GetPartialBlock checks the time point under this lock
+  std::lock_guard<std::mutex> vLock(*mPartialBlocksMutex);
+  mTimePoints->Release(aIndexT);
+}
 
-  mWriter->FinishWriteDataBlocks();
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnTimePointJobDone(bpSize aIndexT)
+{
+  if (mTimePoints->Get(aIndexT).mJobsLeft.fetch_sub(1) != 1) {
+    return;
+  }
+  // counted until done, the job calling this only decrements after it
+  ++mResampleCount;
+  mComputeThreads->Run([this, aIndexT] {
+    FinishTimePoint(aIndexT);
+    OnResampleDone();
+  }, {}, true);
 }
 
 template<typename TDataType>
@@ -146,6 +302,7 @@ void bpMultiresolutionImsImage<TDataType>::WriteMetadata(
   const bpConverterTypes::tTimeInfoVector& aTimeInfoPerTimePoint,
   const bpConverterTypes::tColorInfoVector& aColorInfoPerChannel)
 {
+  mWriter->SetNumberOfTimePoints(GetSizeT());
   mWriter->WriteMetadata(aApplicationName, aApplicationVersion, aImageExtent, aParameters, aTimeInfoPerTimePoint, aColorInfoPerChannel);
   mWriter->WriteThumbnail(mThumbnailBuilder->CreateThumbnail(aColorInfoPerChannel, aImageExtent));
 }
@@ -153,191 +310,543 @@ void bpMultiresolutionImsImage<TDataType>::WriteMetadata(
 template<typename TDataType>
 bpHistogram bpMultiresolutionImsImage<TDataType>::GetChannelHistogram(bpSize aIndexC) const
 {
-  const bpImsImage5D<TDataType>& vImage = mImages[0];
-  bpSize vSizeT = vImage.GetSizeT();
-  if (vSizeT == 1) {
-    return vImage.GetImage3D(0, aIndexC).GetHistogram(1024);
-  }
-
-  std::vector<bpHistogram> vHistograms;
-  vHistograms.reserve(vSizeT);
-  bpFloat vMin = 0;
-  bpFloat vMax = 0;
-  for (bpSize vIndexT = 0; vIndexT < vSizeT; vIndexT++) {
-    vHistograms.push_back(vImage.GetImage3D(vIndexT, aIndexC).GetHistogram(256 * 256));
-    const auto& vHist = vHistograms.back();
-    if (vIndexT == 0 || vHist.GetMin() < vMin) {
-      vMin = vHist.GetMin();
+  std::lock_guard<std::mutex> vLock(*mChannelHistogramsMutex);
+  return LimitNumberOfBins(mChannelHistograms[aIndexC], 1024);
+}
+
+template<typename TDataType>
+bpSize bpMultiresolutionImsImage<TDataType>::GetSizeT() const
+{
+  return mImages[0].GetSizeT();
+}
+
+template<typename TDataType>
+bool bpMultiresolutionImsImage<TDataType>::GetCopyBlockRegion(const bpVec2& aCopyBlockIndexXY, bpSize aIndexZ, bpVec2& aBeginXY, bpVec2& aEndXY) const
+{
+  bpVec3 vImageSize = mImages[0].GetImageSize();
+  aBeginXY = { DivEx(aCopyBlockIndexXY[0] * mCopyBlockSizeXY[0], mSampleXY[0]), DivEx(aCopyBlockIndexXY[1] * mCopyBlockSizeXY[1], mSampleXY[1]) };
+  aEndXY = { DivEx((aCopyBlockIndexXY[0] + 1) * mCopyBlockSizeXY[0], mSampleXY[0]), DivEx((aCopyBlockIndexXY[1] + 1) * mCopyBlockSizeXY[1], mSampleXY[1]) };
+  return aBeginXY[0] < vImageSize[0] && aBeginXY[1] < vImageSize[1] && aIndexZ < vImageSize[2];
+}
+
+template<typename TDataType>
+bpVec3 bpMultiresolutionImsImage<TDataType>::GetMemoryBlockSize() const
+{
+  return mImages[0].GetMemoryBlockSize();
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY)
+{
+  mImages[0].CopyData(aIndexT, aIndexC, aIndexZ, aBeginXY, aEndXY, aDataBlockXY);
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::SetDataCopied(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aCopyBlockIndexXY, bool aWaitIfBusy)
+{
+  bpVec2 vBeginXY;
+  bpVec2 vEndXY;
+  if (GetCopyBlockRegion(aCopyBlockIndexXY, aIndexZ, vBeginXY, vEndXY)) {
+    OnCopiedRegion(aIndexT, aIndexC, aIndexZ, vBeginXY, vEndXY, aWaitIfBusy);
+  }
+}
+
+// first index in [aBegin, aEnd) whose bit is aValue, aEnd if there is none
+static bpSize FindBit(const std::vector<bpUInt64>& aBits, bpSize aBegin, bpSize aEnd, bool aValue)
+{
+  bpUInt64 vInvert = aValue ? 0 : ~bpUInt64(0);
+  bpSize vIndex = aBegin;
+  while (vIndex < aEnd) {
+    bpUInt64 vWord = (aBits[vIndex / 64] ^ vInvert) >> (vIndex % 64);
+    if (vWord != 0) {
+      while ((vWord & 1) == 0) {
+        vWord >>= 1;
+        ++vIndex;
+      }
+      return std::min(vIndex, aEnd);
     }
-    if (vIndexT == 0 || vHist.GetMax() > vMax) {
-      vMax= vHist.GetMax();
+    vIndex += 64 - vIndex % 64;
+  }
+  return aEnd;
+}
+
+static void SetBits(std::vector<bpUInt64>& aBits, bpSize aBegin, bpSize aEnd)
+{
+  bpSize vIndex = aBegin;
+  while (vIndex < aEnd) {
+    bpSize vShift = vIndex % 64;
+    bpSize vCount = std::min<bpSize>(64 - vShift, aEnd - vIndex);
+    bpUInt64 vMask = vCount == 64 ? ~bpUInt64(0) : ((bpUInt64(1) << vCount) - 1);
+    aBits[vIndex / 64] |= vMask << vShift;
+    vIndex += vCount;
+  }
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::CopyRegion(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataXY, bool aWaitIfBusy)
+{
+  // the images of a finished time point are released, only access them if there is something left to copy
+  bpVec3 vImageSize = mImages[0].GetImageSize();
+  bpVec3 vMemoryBlockSize = mImages[0].GetMemoryBlockSize();
+  bpSize vEndX = std::min(aEndXY[0], vImageSize[0]);
+  bpSize vEndY = std::min(aEndXY[1], vImageSize[1]);
+  if (aBeginXY[0] >= vEndX || aBeginXY[1] >= vEndY || aIndexZ >= vImageSize[2]) {
+    return;
+  }
+
+  bpSize vRegionSizeX = aEndXY[0] - aBeginXY[0];
+  bpSize vMemoryBlockIndexZ = aIndexZ / vMemoryBlockSize[2];
+  bpSize vOffsetZ = (aIndexZ - vMemoryBlockIndexZ * vMemoryBlockSize[2]) * vMemoryBlockSize[1] * vMemoryBlockSize[0];
+  for (bpSize vMemoryBlockIndexY = aBeginXY[1] / vMemoryBlockSize[1]; vMemoryBlockIndexY * vMemoryBlockSize[1] < vEndY; ++vMemoryBlockIndexY) {
+    bpSize vFirstY = vMemoryBlockIndexY * vMemoryBlockSize[1];
+    bpSize vBeginY = std::max(aBeginXY[1], vFirstY);
+    bpSize vBlockEndY = std::min(vEndY, vFirstY + vMemoryBlockSize[1]);
+    for (bpSize vMemoryBlockIndexX = aBeginXY[0] / vMemoryBlockSize[0]; vMemoryBlockIndexX * vMemoryBlockSize[0] < vEndX; ++vMemoryBlockIndexX) {
+      bpSize vFirstX = vMemoryBlockIndexX * vMemoryBlockSize[0];
+      bpSize vBeginX = std::max(aBeginXY[0], vFirstX) - vFirstX;
+      bpSize vBlockEndX = std::min(vEndX, vFirstX + vMemoryBlockSize[0]) - vFirstX;
+
+      bpSize vMemoryBlockIndex = GetMemoryBlockIndex(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexC, aIndexT, 0);
+      bpSharedPtr<cPartialBlock> vPartialBlock = GetPartialBlock(vMemoryBlockIndex);
+      if (!vPartialBlock) {
+        continue;
+      }
+
+      // copies the runs of each row no earlier region has copied
+      bpSize vCopied = 0;
+      {
+        std::lock_guard<std::mutex> vLock(vPartialBlock->mMutex);
+        std::vector<bpUInt64>& vBits = vPartialBlock->mBits;
+        if (vBits.empty()) {
+          vBits.resize(DivEx(vMemoryBlockSize[0] * vMemoryBlockSize[1] * vMemoryBlockSize[2], 64), 0);
+        }
+        // only touch the block data if there is something left to copy, a complete block may already be released
+        TDataType* vBlockData = nullptr;
+        for (bpSize vIndexY = vBeginY; vIndexY < vBlockEndY; ++vIndexY) {
+          bpSize vRow = vOffsetZ + (vIndexY - vFirstY) * vMemoryBlockSize[0];
+          // the source starts at the clamped begin, the block may start left of the region
+          const TDataType* vSource = aDataXY + (vIndexY - aBeginXY[1]) * vRegionSizeX + (vFirstX + vBeginX - aBeginXY[0]);
+          bpSize vSourceBegin = vRow + vBeginX;
+          bpSize vRunBegin = FindBit(vBits, vSourceBegin, vRow + vBlockEndX, false);
+          while (vRunBegin < vRow + vBlockEndX) {
+            bpSize vRunEnd = FindBit(vBits, vRunBegin, vRow + vBlockEndX, true);
+            if (!vBlockData) {
+              vBlockData = mImages[0].GetImage3D(aIndexT, aIndexC).GetBlockData(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ);
+            }
+            std::copy(vSource + (vRunBegin - vSourceBegin), vSource + (vRunEnd - vSourceBegin), vBlockData + vRunBegin);
+            SetBits(vBits, vRunBegin, vRunEnd);
+            vCopied += vRunEnd - vRunBegin;
+            vRunBegin = FindBit(vBits, vRunEnd, vRow + vBlockEndX, false);
+          }
+        }
+      }
+
+      if (vCopied > 0 && SubtractCopyBlocksLeft(vMemoryBlockIndex, 0, vCopied)) {
+        OnPartialBlockFull(aIndexT, aIndexC, { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ }, aWaitIfBusy);
+      }
     }
   }
-  std::vector<bpUInt64> vBins(256 * 256);
-  bpHistogram vLayout(vMin, vMax, vBins);
-  for (const auto& vHist : vHistograms) {
-    for (bpSize vBinId = 0; vBinId < vHist.GetNumberOfBins(); vBinId++) {
-      bpSize vDestBinId = vLayout.GetBin(vHist.GetBinValue(vBinId));
-      vBins[vDestBinId] += vHist.GetCount(vBinId);
+}
+
+template<typename TDataType>
+bpSharedPtr<typename bpMultiresolutionImsImage<TDataType>::cPartialBlock> bpMultiresolutionImsImage<TDataType>::GetPartialBlock(bpSize aMemoryBlockIndex)
+{
+  std::lock_guard<std::mutex> vLock(*mPartialBlocksMutex);
+  auto vIt = mPartialBlocks.find(aMemoryBlockIndex);
+  if (vIt != mPartialBlocks.end()) {
+    return vIt->second;
+  }
+  // a complete block has been dropped, a late overlapping region has nothing left to copy
+  if (IsMemoryBlockComplete(aMemoryBlockIndex)) {
+    return{};
+  }
+  auto vPartialBlock = std::make_shared<cPartialBlock>();
+  mPartialBlocks[aMemoryBlockIndex] = vPartialBlock;
+  return vPartialBlock;
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnPartialBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bool aWaitIfBusy)
+{
+  bpSize vMemoryBlockIndex = GetMemoryBlockIndex(aMemoryBlockIndexXYZ[0], aMemoryBlockIndexXYZ[1], aMemoryBlockIndexXYZ[2], aIndexC, aIndexT, 0);
+  bpSharedPtr<cPartialBlock> vPartialBlock;
+  {
+    std::lock_guard<std::mutex> vLock(*mPartialBlocksMutex);
+    auto vIt = mPartialBlocks.find(vMemoryBlockIndex);
+    if (vIt != mPartialBlocks.end()) {
+      vPartialBlock = vIt->second;
+      mPartialBlocks.erase(vIt);
     }
   }
-  bpHistogram vHistogram(vMin, vMax, vBins);
-  if (vHistogram.GetNumberOfBins() > 1024) {
-    vHistogram = bpResampleHistogram(vHistogram, 1024);
+
+  // all tiles covering the block are copied, the blended voxels are final
+  if (vPartialBlock && !vPartialBlock->mBlendWeights.empty()) {
+    TDataType* vBlockData = mImages[0].GetImage3D(aIndexT, aIndexC).GetBlockData(aMemoryBlockIndexXYZ[0], aMemoryBlockIndexXYZ[1], aMemoryBlockIndexXYZ[2]);
+    const std::vector<bpDouble>& vSums = vPartialBlock->mBlendSums;
+    const std::vector<bpFloat>& vWeights = vPartialBlock->mBlendWeights;
+    for (bpSize vIndex = 0; vIndex < vWeights.size(); ++vIndex) {
+      if (vWeights[vIndex] > 0) {
+        bpDouble vValue = vSums[vIndex] / vWeights[vIndex];
+        vBlockData[vIndex] = static_cast<TDataType>(std::is_floating_point<TDataType>::value ? vValue : std::floor(vValue + 0.5));
+      }
+    }
   }
-  return vHistogram;
+
+  ScheduleMemoryBlockFull(aIndexT, aIndexC, aMemoryBlockIndexXYZ, 0, aWaitIfBusy);
 }
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aCopyBlockIndexXY, const TDataType* aDataBlockXY, bpSize aIndexR)
+void bpMultiresolutionImsImage<TDataType>::SetTiles(bpUniquePtr<bpTileLayout> aTiles)
 {
-  auto& vImage5D = mImages[aIndexR];
-  auto& vImage3D = vImage5D.GetImage3D(aIndexT, aIndexC);
-  bpVec3 vImageSize = vImage3D.GetImageSize();
+  // the counters of a time point are set up from the tiles when it is created
+  if (mTimePoints->GetSize() > 0) {
+    throw bpError("Tiles have to be set before any data is copied");
+  }
+  mTiles = std::move(aTiles);
+}
 
-  bpVec2 vBeginXY = { DivEx(aCopyBlockIndexXY[0] * mCopyBlockSizeXY[0], mSampleXY[0]), DivEx(aCopyBlockIndexXY[1] * mCopyBlockSizeXY[1], mSampleXY[1]) };
-  bpVec2 vEndXY = { DivEx((aCopyBlockIndexXY[0] + 1) * mCopyBlockSizeXY[0], mSampleXY[0]), DivEx((aCopyBlockIndexXY[1] + 1) * mCopyBlockSizeXY[1], mSampleXY[1]) };
-  if (vBeginXY[0] >= vImageSize[0] || vBeginXY[1] >= vImageSize[1] || aIndexZ >= vImageSize[2]) {
-    return;
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::InitTiledTimePoint(cTimePoint& aTimePoint, bpSize aIndexT) const
+{
+  const auto& vImage5D = mImages[0];
+  bpSize vSizeC = vImage5D.GetSizeC();
+  bpVec3 vNMemoryBlocks = vImage5D.GetNBlocks();
+  bpVec3 vMemoryBlockSize = vImage5D.GetMemoryBlockSize();
+
+  // a memory block is complete once the voxels of all tiles covering it are copied
+  for (bpSize vTileIndex = 0; vTileIndex < mTiles->GetNumberOfTiles(); ++vTileIndex) {
+    const bpTileLayout::cBox& vTile = mTiles->GetTile(vTileIndex);
+    if (aIndexT < vTile.mBegin[4] || aIndexT >= vTile.mEnd[4]) {
+      continue;
+    }
+    for (bpSize vMemoryBlockIndexZ = vTile.mBegin[2] / vMemoryBlockSize[2]; vMemoryBlockIndexZ * vMemoryBlockSize[2] < vTile.mEnd[2]; ++vMemoryBlockIndexZ) {
+      bpSize vFirstZ = vMemoryBlockIndexZ * vMemoryBlockSize[2];
+      bpSize vSizeZ = std::min(vTile.mEnd[2], vFirstZ + vMemoryBlockSize[2]) - std::max(vTile.mBegin[2], vFirstZ);
+      for (bpSize vMemoryBlockIndexY = vTile.mBegin[1] / vMemoryBlockSize[1]; vMemoryBlockIndexY * vMemoryBlockSize[1] < vTile.mEnd[1]; ++vMemoryBlockIndexY) {
+        bpSize vFirstY = vMemoryBlockIndexY * vMemoryBlockSize[1];
+        bpSize vSizeY = std::min(vTile.mEnd[1], vFirstY + vMemoryBlockSize[1]) - std::max(vTile.mBegin[1], vFirstY);
+        for (bpSize vMemoryBlockIndexX = vTile.mBegin[0] / vMemoryBlockSize[0]; vMemoryBlockIndexX * vMemoryBlockSize[0] < vTile.mEnd[0]; ++vMemoryBlockIndexX) {
+          bpSize vFirstX = vMemoryBlockIndexX * vMemoryBlockSize[0];
+          bpSize vSizeX = std::min(vTile.mEnd[0], vFirstX + vMemoryBlockSize[0]) - std::max(vTile.mBegin[0], vFirstX);
+          for (bpSize vIndexC = vTile.mBegin[3]; vIndexC < vTile.mEnd[3]; ++vIndexC) {
+            bpSize vIndex = GetMemoryBlockIndex(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, vIndexC, 0, 0);
+            aTimePoint.GetShard(vIndex).mCopyBlocksLeft[0][vIndex] += vSizeX * vSizeY * vSizeZ;
+          }
+        }
+      }
+    }
+  }
+
+  // the gaps of the mosaic are zero, FillGaps writes them once the time point is used
+  bpSize vBlocksOfTimePoint = vNMemoryBlocks[0] * vNMemoryBlocks[1] * vNMemoryBlocks[2] * vSizeC;
+  for (bpSize vIndex = 0; vIndex < vBlocksOfTimePoint; ++vIndex) {
+    if (aTimePoint.GetShard(vIndex).mCopyBlocksLeft[0].count(vIndex) == 0) {
+      aTimePoint.SetComplete(vIndex);
+      aTimePoint.mGapBlocks.push_back(vIndex);
+    }
   }
+  aTimePoint.mAreGapsFilled = aTimePoint.mGapBlocks.empty();
+}
 
-  vImage5D.CopyData(aIndexT, aIndexC, aIndexZ, vBeginXY, vEndXY, aDataBlockXY);
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::FillGaps(bpSize aIndexT, bool aWaitIfBusy)
+{
+  cTimePoint& vTimePoint = mTimePoints->Get(aIndexT);
+  if (vTimePoint.mAreGapsFilled || vTimePoint.mAreGapsFilled.exchange(true)) {
+    return;
+  }
 
-  OnCopiedData(aIndexT, aIndexC, { aCopyBlockIndexXY[0], aCopyBlockIndexXY[1], aIndexZ }, aIndexR);
+  // the time point is not finished before the jobs of its gap blocks are done
+  std::vector<bpSize> vGapBlocks;
+  std::swap(vGapBlocks, vTimePoint.mGapBlocks);
+  bpVec3 vNMemoryBlocks = mImages[0].GetNBlocks();
+  bpVec3 vMemoryBlockSize = mImages[0].GetMemoryBlockSize();
+  bpSize vMemoryBlockVoxels = vMemoryBlockSize[0] * vMemoryBlockSize[1] * vMemoryBlockSize[2];
+  for (bpSize vIndex : vGapBlocks) {
+    bpVec3 vMemoryBlockIndexXYZ = { vIndex % vNMemoryBlocks[0], vIndex / vNMemoryBlocks[0] % vNMemoryBlocks[1], vIndex / (vNMemoryBlocks[0] * vNMemoryBlocks[1]) % vNMemoryBlocks[2] };
+    bpSize vIndexC = vIndex / (vNMemoryBlocks[0] * vNMemoryBlocks[1] * vNMemoryBlocks[2]);
+    TDataType* vBlockData = mImages[0].GetImage3D(aIndexT, vIndexC).GetBlockData(vMemoryBlockIndexXYZ[0], vMemoryBlockIndexXYZ[1], vMemoryBlockIndexXYZ[2]);
+    std::fill(vBlockData, vBlockData + vMemoryBlockVoxels, TDataType(0));
+    ScheduleMemoryBlockFull(aIndexT, vIndexC, vMemoryBlockIndexXYZ, 0, aWaitIfBusy);
+  }
 }
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::OnCopiedData(bpSize aIndexT, bpSize aIndexC, const bpVec3& aBlockIndexXYZ, bpSize aIndexR)
+void bpMultiresolutionImsImage<TDataType>::CopyTile(bpSize aTileIndex, bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataXY, bool aWaitIfBusy)
 {
-  bpThreadPool::tFunction vFunction = [this, aIndexT, aIndexC, aBlockIndexXYZ, aIndexR] {
-    OnCopiedDataImpl(aIndexT, aIndexC, aBlockIndexXYZ, aIndexR);
-  };
-  if (aIndexR == 0) {
-    mComputeThread->WaitSome(mMaxRunningJobsPerThread);
+  FillGaps(aIndexT, aWaitIfBusy);
+
+  auto& vImage3D = mImages[0].GetImage3D(aIndexT, aIndexC);
+  bpVec3 vMemoryBlockSize = vImage3D.GetMemoryBlockSize();
+  bpSize vMemoryBlockVoxels = vMemoryBlockSize[0] * vMemoryBlockSize[1] * vMemoryBlockSize[2];
+  bpSize vRegionSizeX = aEndXY[0] - aBeginXY[0];
+  bpSize vMemoryBlockIndexZ = aIndexZ / vMemoryBlockSize[2];
+  bpSize vOffsetZ = (aIndexZ - vMemoryBlockIndexZ * vMemoryBlockSize[2]) * vMemoryBlockSize[1] * vMemoryBlockSize[0];
+  std::vector<bpVec2> vOwnRuns;
+  std::vector<bpVec2> vBlendRuns;
+  for (bpSize vMemoryBlockIndexY = aBeginXY[1] / vMemoryBlockSize[1]; vMemoryBlockIndexY * vMemoryBlockSize[1] < aEndXY[1]; ++vMemoryBlockIndexY) {
+    bpSize vFirstY = vMemoryBlockIndexY * vMemoryBlockSize[1];
+    bpSize vBeginY = std::max(aBeginXY[1], vFirstY);
+    bpSize vBlockEndY = std::min(aEndXY[1], vFirstY + vMemoryBlockSize[1]);
+    for (bpSize vMemoryBlockIndexX = aBeginXY[0] / vMemoryBlockSize[0]; vMemoryBlockIndexX * vMemoryBlockSize[0] < aEndXY[0]; ++vMemoryBlockIndexX) {
+      bpSize vFirstX = vMemoryBlockIndexX * vMemoryBlockSize[0];
+      bpSize vBeginX = std::max(aBeginXY[0], vFirstX);
+      bpSize vBlockEndX = std::min(aEndXY[0], vFirstX + vMemoryBlockSize[0]);
+
+      bpSize vMemoryBlockIndex = GetMemoryBlockIndex(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexC, aIndexT, 0);
+      bpSharedPtr<cPartialBlock> vPartialBlock = GetPartialBlock(vMemoryBlockIndex);
+      if (!vPartialBlock) {
+        continue;
+      }
+
+      // the block is not released before this tile has been counted, the voxels it owns can be copied without the lock
+      std::unique_lock<std::mutex> vLock(vPartialBlock->mMutex);
+      TDataType* vBlockData = vImage3D.GetBlockData(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ);
+      if (!vPartialBlock->mIsCleared) {
+        std::fill(vBlockData, vBlockData + vMemoryBlockVoxels, TDataType(0));
+        vPartialBlock->mIsCleared = true;
+      }
+      vLock.unlock();
+
+      for (bpSize vIndexY = vBeginY; vIndexY < vBlockEndY; ++vIndexY) {
+        bpSize vRow = vOffsetZ + (vIndexY - vFirstY) * vMemoryBlockSize[0];
+        const TDataType* vSource = aDataXY + (vIndexY - aBeginXY[1]) * vRegionSizeX;
+        mTiles->SplitRow(aTileIndex, vIndexY, aIndexZ, aIndexC, aIndexT, vBeginX, vBlockEndX, vOwnRuns, vBlendRuns);
+        for (const bpVec2& vRun : vOwnRuns) {
+          std::copy(vSource + (vRun[0] - aBeginXY[0]), vSource + (vRun[1] - aBeginXY[0]), vBlockData + vRow + (vRun[0] - vFirstX));
+        }
+        if (vBlendRuns.empty()) {
+          continue;
+        }
+
+        if (!vLock.owns_lock()) {
+          vLock.lock();
+        }
+        if (vPartialBlock->mBlendWeights.empty()) {
+          vPartialBlock->mBlendSums.resize(vMemoryBlockVoxels, 0);
+          vPartialBlock->mBlendWeights.resize(vMemoryBlockVoxels, 0);
+        }
+        for (const bpVec2& vRun : vBlendRuns) {
+          for (bpSize vIndexX = vRun[0]; vIndexX < vRun[1]; ++vIndexX) {
+            bpFloat vWeight = mTiles->GetWeight(aTileIndex, vIndexX, vIndexY);
+            bpSize vIndex = vRow + (vIndexX - vFirstX);
+            vPartialBlock->mBlendSums[vIndex] += vWeight * static_cast<bpDouble>(vSource[vIndexX - aBeginXY[0]]);
+            vPartialBlock->mBlendWeights[vIndex] += vWeight;
+          }
+        }
+      }
+      if (vLock.owns_lock()) {
+        vLock.unlock();
+      }
+
+      bpSize vVoxels = (vBlockEndX - vBeginX) * (vBlockEndY - vBeginY);
+      if (SubtractCopyBlocksLeft(vMemoryBlockIndex, 0, vVoxels)) {
+        OnPartialBlockFull(aIndexT, aIndexC, { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ }, aWaitIfBusy);
+      }
+    }
   }
-  mComputeThread->Run(vFunction, {}, aIndexR > 0);
 }
 
 template<typename TDataType>
-bpSharedPtr<bpThreadPool> bpMultiresolutionImsImage<TDataType>::GetHistogramThread(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpVec3& aBlockIndex) const
+bool bpMultiresolutionImsImage<TDataType>::IsBusy() const
 {
-  if (mHistogramThreads.empty()) {
-    return{};
+  return GetNumberOfQueuedBlocks() > mMaxRunningJobsPerThread || (mBudget && mBudget->IsExceeded() && IsWorkQueued());
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::WaitForMemory()
+{
+  if (mBudget) {
+    mBudget->WaitBelowLimit([this] { return IsWorkQueued(); });
   }
+}
+
+template<typename TDataType>
+bool bpMultiresolutionImsImage<TDataType>::IsWorkQueued() const
+{
+  return GetNumberOfQueuedBlocks() > 0 || mResampleCount > 0 || GetQueuedWriteBytes() > 0;
+}
+
+template<typename TDataType>
+bpSize bpMultiresolutionImsImage<TDataType>::GetNumberOfQueuedBlocks() const
+{
+  return mComputeThreads->GetNumberOfWaitingFunctions();
+}
+
+template<typename TDataType>
+bpSize bpMultiresolutionImsImage<TDataType>::GetQueuedWriteBytes() const
+{
+  return mWriter->GetQueuedBytes();
+}
 
-  bpSize vHistogramIndex = mImages[aIndexR].GetImage3D(aIndexT, aIndexC).GetHistogramBuilderIndexForBlock(aBlockIndex[0], aBlockIndex[1], aBlockIndex[2]);
-  bpSharedPtr<bpThreadPool> vThread = mHistogramThreads[(vHistogramIndex + aIndexR * 5 + aIndexT + mImages[0].GetSizeT() * aIndexC) % mHistogramThreads.size()];
-  vThread->WaitSome(mMaxRunningJobsPerThread);
-  return vThread;
+template<typename TDataType>
+typename bpMemoryManager<TDataType>::cStatistics bpMultiresolutionImsImage<TDataType>::GetMemoryStatistics() const
+{
+  return mMemoryManager->GetStatistics();
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::AdoptMemoryBlock(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpMemoryBlock<TDataType> aData)
+{
+  auto& vImage3D = mImages[0].GetImage3D(aIndexT, aIndexC);
+  vImage3D.SetBlockData(aMemoryBlockIndexXYZ[0], aMemoryBlockIndexXYZ[1], aMemoryBlockIndexXYZ[2], std::move(aData));
+
+  bpVec3 vImageSize = vImage3D.GetImageSize();
+  bpVec3 vMemoryBlockSize = vImage3D.GetMemoryBlockSize();
+  bpSize vEndZ = std::min((aMemoryBlockIndexXYZ[2] + 1) * vMemoryBlockSize[2], vImageSize[2]);
+  for (bpSize vIndexZ = aMemoryBlockIndexXYZ[2] * vMemoryBlockSize[2]; vIndexZ < vEndZ; ++vIndexZ) {
+    SetDataCopied(aIndexT, aIndexC, vIndexZ, { aMemoryBlockIndexXYZ[0], aMemoryBlockIndexXYZ[1] }, true);
+  }
 }
 
 template<typename TDataType>
 bpSize bpMultiresolutionImsImage<TDataType>::GetMemoryBlockIndex(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ, bpSize aIndexC, bpSize aIndexT, bpSize aIndexR) const
 {
   bpSize vSizeC = mImages[aIndexR].GetSizeC();
-  bpVec3 vNBlocks = mImages[aIndexR].GetImage3D(0, 0).GetNBlocks();
+  bpVec3 vNBlocks = mImages[aIndexR].GetNBlocks();
   bpSize vBlockIndex = aBlockIndexX + vNBlocks[0] * (aBlockIndexY + vNBlocks[1] * (aBlockIndexZ + vNBlocks[2] * (aIndexC + vSizeC * aIndexT)));
   return vBlockIndex;
 }
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::InitCopyBlocksLeft(bpSize aIndexR)
+std::vector<bpSize> bpMultiresolutionImsImage<TDataType>::GetCopyBlocksOfChannel(bpSize aIndexR) const
 {
   const auto& vImage5D = mImages[aIndexR];
-  const auto& vImage3D = vImage5D.GetImage3D(0, 0);
-  bpVec3 vImageSize = vImage3D.GetImageSize();
-  // determine CopyBlockSize
-  bpVec3 vCopyBlockSize;
-  bpVec3 vNCopyBlocks;
-  bpVec2 vSampleXY{ 1, 1 };
+  bpVec3 vImageSize = vImage5D.GetImageSize();
+  bpVec3 vNMemoryBlocks = vImage5D.GetNBlocks();
+  bpVec3 vMemoryBlockSize = vImage5D.GetMemoryBlockSize();
+
+  std::vector<bpSize> vCopyBlocks(vNMemoryBlocks[0] * vNMemoryBlocks[1] * vNMemoryBlocks[2]);
+
   if (aIndexR == 0) {
-    vSampleXY = mSampleXY;
-    vCopyBlockSize[0] = mCopyBlockSizeXY[0];
-    vCopyBlockSize[1] = mCopyBlockSizeXY[1];
-    vCopyBlockSize[2] = 1;
-    vNCopyBlocks[0] = DivEx(vImageSize[0] * vSampleXY[0], vCopyBlockSize[0]);
-    vNCopyBlocks[1] = DivEx(vImageSize[1] * vSampleXY[1], vCopyBlockSize[1]);
-    vNCopyBlocks[2] = DivEx(vImageSize[2], vCopyBlockSize[2]);
-  }
-  else {
-    const auto& vImage5DHigherRes = mImages[aIndexR - 1];
-    const auto& vImage3DHigherRes = vImage5DHigherRes.GetImage3D(0, 0);
-    bpVec3 vMemoryBlockSizeHigherRes = vImage3DHigherRes.GetMemoryBlockSize();
-    bpVec3 vStride = GetStrideToNextResolution(aIndexR - 1);
-    vCopyBlockSize = {
-      vMemoryBlockSizeHigherRes[0] / vStride[0] ,
-      vMemoryBlockSizeHigherRes[1] / vStride[1],
-      vMemoryBlockSizeHigherRes[2] / vStride[2]
-    };
-    vNCopyBlocks = vImage3DHigherRes.GetNBlocks();
+    // count voxels, the copied regions do not need to be aligned to the copy blocks
+    for (bpSize vMemoryBlockIndexZ = 0; vMemoryBlockIndexZ < vNMemoryBlocks[2]; ++vMemoryBlockIndexZ) {
+      bpSize vSizeZ = std::min((vMemoryBlockIndexZ + 1) * vMemoryBlockSize[2], vImageSize[2]) - vMemoryBlockIndexZ * vMemoryBlockSize[2];
+      for (bpSize vMemoryBlockIndexY = 0; vMemoryBlockIndexY < vNMemoryBlocks[1]; ++vMemoryBlockIndexY) {
+        bpSize vSizeY = std::min((vMemoryBlockIndexY + 1) * vMemoryBlockSize[1], vImageSize[1]) - vMemoryBlockIndexY * vMemoryBlockSize[1];
+        for (bpSize vMemoryBlockIndexX = 0; vMemoryBlockIndexX < vNMemoryBlocks[0]; ++vMemoryBlockIndexX) {
+          bpSize vSizeX = std::min((vMemoryBlockIndexX + 1) * vMemoryBlockSize[0], vImageSize[0]) - vMemoryBlockIndexX * vMemoryBlockSize[0];
+          vCopyBlocks[vMemoryBlockIndexX + vNMemoryBlocks[0] * (vMemoryBlockIndexY + vNMemoryBlocks[1] * vMemoryBlockIndexZ)] = vSizeX * vSizeY * vSizeZ;
+        }
+      }
+    }
+    return vCopyBlocks;
   }
 
-  bpSize vSizeC = vImage5D.GetSizeC();
-  bpSize vSizeT = vImage5D.GetSizeT();
-
-  // If a block, that was just modified, is full, write it to file and copy the block's data to the corresponding block of the lower resolution image.
-  bpVec3 vNMemoryBlocks = vImage3D.GetNBlocks();
-  bpVec3 vMemoryBlockSize = vImage3D.GetMemoryBlockSize();
+  // the memory blocks of the higher resolution are the copy blocks
+  const auto& vImage3DHigherRes = mImages[aIndexR - 1];
+  bpVec3 vMemoryBlockSizeHigherRes = vImage3DHigherRes.GetMemoryBlockSize();
+  bpVec3 vStride = GetStrideToNextResolution(aIndexR - 1);
+  bpVec3 vCopyBlockSize = {
+    vMemoryBlockSizeHigherRes[0] / vStride[0],
+    vMemoryBlockSizeHigherRes[1] / vStride[1],
+    vMemoryBlockSizeHigherRes[2] / vStride[2]
+  };
+  bpVec3 vNCopyBlocks = vImage3DHigherRes.GetNBlocks();
 
-  mCopyBlocksLeft[aIndexR].resize(vNMemoryBlocks[0] * vNMemoryBlocks[1] * vNMemoryBlocks[2] * vSizeC * vSizeT);
   for (bpSize vMemoryBlockIndexZ = 0; vMemoryBlockIndexZ < vNMemoryBlocks[2]; ++vMemoryBlockIndexZ) {
     bpSize vCopyBlockIndexBeginZ = vMemoryBlockIndexZ * vMemoryBlockSize[2] / vCopyBlockSize[2];
     bpSize vEndZ = std::min((vMemoryBlockIndexZ + 1) * vMemoryBlockSize[2], vImageSize[2]);
     bpSize vCopyBlockIndexEndZ = std::min(DivEx(vEndZ, vCopyBlockSize[2]), vNCopyBlocks[2]);
     for (bpSize vMemoryBlockIndexY = 0; vMemoryBlockIndexY < vNMemoryBlocks[1]; ++vMemoryBlockIndexY) {
-      bpSize vCopyBlockIndexBeginY = vMemoryBlockIndexY * vMemoryBlockSize[1] * vSampleXY[1] / vCopyBlockSize[1];
+      bpSize vCopyBlockIndexBeginY = vMemoryBlockIndexY * vMemoryBlockSize[1] / vCopyBlockSize[1];
       bpSize vEndY = std::min((vMemoryBlockIndexY + 1) * vMemoryBlockSize[1], vImageSize[1]);
-      bpSize vCopyBlockIndexEndY = std::min(DivEx(vEndY * vSampleXY[1], vCopyBlockSize[1]), vNCopyBlocks[1]);
+      bpSize vCopyBlockIndexEndY = std::min(DivEx(vEndY, vCopyBlockSize[1]), vNCopyBlocks[1]);
       for (bpSize vMemoryBlockIndexX = 0; vMemoryBlockIndexX < vNMemoryBlocks[0]; ++vMemoryBlockIndexX) {
-        bpSize vCopyBlockIndexBeginX = vMemoryBlockIndexX * vMemoryBlockSize[0] * vSampleXY[0] / vCopyBlockSize[0];
+        bpSize vCopyBlockIndexBeginX = vMemoryBlockIndexX * vMemoryBlockSize[0] / vCopyBlockSize[0];
         bpSize vEndX = std::min((vMemoryBlockIndexX + 1) * vMemoryBlockSize[0], vImageSize[0]);
-        bpSize vCopyBlockIndexEndX = std::min(DivEx(vEndX * vSampleXY[0], vCopyBlockSize[0]), vNCopyBlocks[0]);
+        bpSize vCopyBlockIndexEndX = std::min(DivEx(vEndX, vCopyBlockSize[0]), vNCopyBlocks[0]);
 
         bpSize vCopyBlockCount = (vCopyBlockIndexEndX - vCopyBlockIndexBeginX) * (vCopyBlockIndexEndY - vCopyBlockIndexBeginY) * (vCopyBlockIndexEndZ - vCopyBlockIndexBeginZ);
-        for (bpSize vIndexT = 0; vIndexT < vSizeT; ++vIndexT) {
-          for (bpSize vIndexC = 0; vIndexC < vSizeC; ++vIndexC) {
-            bpSize vMemoryBlockIndex = GetMemoryBlockIndex(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, vIndexC, vIndexT, aIndexR);
-            mCopyBlocksLeft[aIndexR][vMemoryBlockIndex] = vCopyBlockCount;
-          }
-        }
+        vCopyBlocks[vMemoryBlockIndexX + vNMemoryBlocks[0] * (vMemoryBlockIndexY + vNMemoryBlocks[1] * vMemoryBlockIndexZ)] = vCopyBlockCount;
+      }
+    }
+  }
+  return vCopyBlocks;
+}
+
+template<typename TDataType>
+bool bpMultiresolutionImsImage<TDataType>::SubtractCopyBlocksLeft(bpSize aMemoryBlockIndex, bpSize aIndexR, bpSize aCount)
+{
+  const std::vector<bpSize>& vCopyBlocksOfChannel = mCopyBlocksOfChannel[aIndexR];
+  bpSize vBlocksOfTimePoint = vCopyBlocksOfChannel.size() * mImages[aIndexR].GetSizeC();
+  bpSize vIndex = aMemoryBlockIndex % vBlocksOfTimePoint;
+  cTimePoint& vTimePoint = mTimePoints->Get(aMemoryBlockIndex / vBlocksOfTimePoint);
+
+  typename cTimePoint::cShard& vShard = vTimePoint.GetShard(vIndex);
+  std::lock_guard<std::mutex> vLock(vShard.mMutex);
+  if (aIndexR == 0 && vTimePoint.IsComplete(vIndex)) {
+    return false;
+  }
+  std::unordered_map<bpSize, bpSize>& vCopyBlocksLeft = vShard.mCopyBlocksLeft[aIndexR];
+  auto vIt = vCopyBlocksLeft.find(vIndex);
+  if (vIt == vCopyBlocksLeft.end()) {
+    vIt = vCopyBlocksLeft.emplace(vIndex, vCopyBlocksOfChannel[vIndex % vCopyBlocksOfChannel.size()]).first;
+  }
+  vIt->second -= aCount;
+  if (vIt->second > 0) {
+    return false;
+  }
+  vCopyBlocksLeft.erase(vIt);
+  if (aIndexR == 0) {
+    vTimePoint.SetComplete(vIndex);
+  }
+  return true;
+}
+
+template<typename TDataType>
+bool bpMultiresolutionImsImage<TDataType>::IsMemoryBlockComplete(bpSize aMemoryBlockIndex)
+{
+  bpSize vBlocksOfTimePoint = mCopyBlocksOfChannel[0].size() * mImages[0].GetSizeC();
+  bpSize vIndexT = aMemoryBlockIndex / vBlocksOfTimePoint;
+  cTimePoint* vTimePoint = mTimePoints->Find(vIndexT);
+  if (!vTimePoint) {
+    return mTimePoints->IsReleased(vIndexT);
+  }
+  bpSize vIndex = aMemoryBlockIndex % vBlocksOfTimePoint;
+  return vTimePoint->IsComplete(vIndex);
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnCopiedRegion(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, bool aWaitIfBusy)
+{
+  bpVec3 vImageSize = mImages[0].GetImageSize();
+  bpVec3 vMemoryBlockSize = mImages[0].GetMemoryBlockSize();
+  bpSize vEndX = std::min(aEndXY[0], vImageSize[0]);
+  bpSize vEndY = std::min(aEndXY[1], vImageSize[1]);
+  bpSize vMemoryBlockIndexZ = aIndexZ / vMemoryBlockSize[2];
+  for (bpSize vMemoryBlockIndexY = aBeginXY[1] / vMemoryBlockSize[1]; vMemoryBlockIndexY * vMemoryBlockSize[1] < vEndY; ++vMemoryBlockIndexY) {
+    bpSize vFirstY = vMemoryBlockIndexY * vMemoryBlockSize[1];
+    bpSize vSizeY = std::min(vEndY, vFirstY + vMemoryBlockSize[1]) - std::max(aBeginXY[1], vFirstY);
+    for (bpSize vMemoryBlockIndexX = aBeginXY[0] / vMemoryBlockSize[0]; vMemoryBlockIndexX * vMemoryBlockSize[0] < vEndX; ++vMemoryBlockIndexX) {
+      bpSize vFirstX = vMemoryBlockIndexX * vMemoryBlockSize[0];
+      bpSize vSizeX = std::min(vEndX, vFirstX + vMemoryBlockSize[0]) - std::max(aBeginXY[0], vFirstX);
+      bpSize vVoxels = vSizeX * vSizeY;
+      bpSize vMemoryBlockIndex = GetMemoryBlockIndex(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexC, aIndexT, 0);
+      if (SubtractCopyBlocksLeft(vMemoryBlockIndex, 0, vVoxels)) {
+        ScheduleMemoryBlockFull(aIndexT, aIndexC, { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ }, 0, aWaitIfBusy);
       }
     }
   }
 }
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::OnCopiedDataImpl(bpSize aIndexT, bpSize aIndexC, const bpVec3& aCopyBlockIndexXYZ, bpSize aIndexR)
+void bpMultiresolutionImsImage<TDataType>::OnCopiedData(bpSize aIndexT, bpSize aIndexC, const bpVec3& aCopyBlockIndexXYZ, bpSize aIndexR, bool aWaitIfBusy)
 {
   auto& vImage5D = mImages[aIndexR];
   auto& vImage3D = vImage5D.GetImage3D(aIndexT, aIndexC);
   bpVec3 vImageSize = vImage3D.GetImageSize();
-  // determine CopyBlockSize
-  bpVec3 vCopyBlockSize;
-  bpVec3 vNCopyBlocks;
-  bpVec2 vSampleXY{ 1, 1 };
-  if (aIndexR == 0) {
-    vSampleXY = mSampleXY;
-    vCopyBlockSize[0] = mCopyBlockSizeXY[0];
-    vCopyBlockSize[1] = mCopyBlockSizeXY[1];
-    vCopyBlockSize[2] = 1;
-    vNCopyBlocks[0] = DivEx(vImageSize[0] * vSampleXY[0], vCopyBlockSize[0]);
-    vNCopyBlocks[1] = DivEx(vImageSize[1] * vSampleXY[1], vCopyBlockSize[1]);
-    vNCopyBlocks[2] = DivEx(vImageSize[2], vCopyBlockSize[2]);
-  }
-  else {
-    auto& vImage5DHigherRes = mImages[aIndexR-1];
-    auto& vImage3DHigherRes = vImage5DHigherRes.GetImage3D(aIndexT, aIndexC);
-    bpVec3 vMemoryBlockSizeHigherRes = vImage3DHigherRes.GetMemoryBlockSize();
-    bpVec3 vStride = GetStrideToNextResolution(aIndexR - 1);
-    vCopyBlockSize = {
-      vMemoryBlockSizeHigherRes[0] / vStride[0],
-      vMemoryBlockSizeHigherRes[1] / vStride[1],
-      vMemoryBlockSizeHigherRes[2] / vStride[2]
-    };
-    vNCopyBlocks = vImage3DHigherRes.GetNBlocks();
-  }
-  bpVec2 vBeginXY = { DivEx(aCopyBlockIndexXYZ[0] * vCopyBlockSize[0], vSampleXY[0]), DivEx(aCopyBlockIndexXYZ[1] * vCopyBlockSize[1], vSampleXY[1]) };
-  bpVec2 vEndXY = { DivEx((aCopyBlockIndexXYZ[0] + 1) * vCopyBlockSize[0], vSampleXY[0]), DivEx((aCopyBlockIndexXYZ[1] + 1) * vCopyBlockSize[1], vSampleXY[1]) };
+  // the memory blocks of the higher resolution are the copy blocks
+  auto& vImage3DHigherRes = mImages[aIndexR - 1].GetImage3D(aIndexT, aIndexC);
+  bpVec3 vMemoryBlockSizeHigherRes = vImage3DHigherRes.GetMemoryBlockSize();
+  bpVec3 vStride = GetStrideToNextResolution(aIndexR - 1);
+  bpVec3 vCopyBlockSize = {
+    vMemoryBlockSizeHigherRes[0] / vStride[0],
+    vMemoryBlockSizeHigherRes[1] / vStride[1],
+    vMemoryBlockSizeHigherRes[2] / vStride[2]
+  };
+  bpVec2 vBeginXY = { aCopyBlockIndexXYZ[0] * vCopyBlockSize[0], aCopyBlockIndexXYZ[1] * vCopyBlockSize[1] };
+  bpVec2 vEndXY = { (aCopyBlockIndexXYZ[0] + 1) * vCopyBlockSize[0], (aCopyBlockIndexXYZ[1] + 1) * vCopyBlockSize[1] };
   bpSize vBeginZ = aCopyBlockIndexXYZ[2] * vCopyBlockSize[2];
   if (vBeginXY[0] >= vImageSize[0] || vBeginXY[1] >= vImageSize[1] || vBeginZ >= vImageSize[2]) {
     return;
@@ -357,48 +866,72 @@ void bpMultiresolutionImsImage<TDataType>::OnCopiedDataImpl(bpSize aIndexT, bpSi
   for (bpSize vMemoryBlockIndexY = vMemoryBlockIndexBeginY; vMemoryBlockIndexY < vMemoryBlockIndexEndY; ++vMemoryBlockIndexY) {
     for (bpSize vMemoryBlockIndexX = vMemoryBlockIndexBeginX; vMemoryBlockIndexX < vMemoryBlockIndexEndX; ++vMemoryBlockIndexX) {
       bpSize vMemoryBlockIndex = vMemoryBlockIndexBegin + vMemoryBlockIndexX + vMemoryBlockIndexY * vNMemoryBlocks[0];
-      bpSize& vCopyBlocksLeft = mCopyBlocksLeft[aIndexR][vMemoryBlockIndex];
-      --vCopyBlocksLeft;
-      bool vAllCopied = vCopyBlocksLeft == 0;
-      if (vAllCopied) {
-        bpImsImageBlock<TDataType>& vMemoryBlock = vImage5D.GetBlock(aIndexT, aIndexC, vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ);
-        vImage5D.PadBorderBlockWithZeros(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexC, aIndexT);
-        bpConstMemoryBlock<TDataType> vData = vMemoryBlock.ReleaseMemory();
-        bpSize vResolutionLevels = mImages.size();
-        bpVec3 vHigherResBlockIndex = { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ };
-
-        bpWriter::tPreFunction vResample;
-        if (aIndexR + 1 < vResolutionLevels) {
-          InitLowResBlock(vHigherResBlockIndex, aIndexR, aIndexT, aIndexC);
-          ++mResampleCount;
-          vResample = [this, vHigherResBlockIndex, aIndexR, aIndexT, aIndexC, vData] {
-            ResampleBlock(vHigherResBlockIndex, aIndexR, aIndexT, aIndexC, vData);
-            --mResampleCount;
-          };
-        }
-
-        const auto& vHistogramThread = GetHistogramThread(aIndexR, aIndexT, aIndexC, vHigherResBlockIndex);
-        if (vHistogramThread) {
-          vHistogramThread->Run([this, &vImage3D, vHigherResBlockIndex, vData] {
-            AddHistogramValues(vImage3D, vHigherResBlockIndex, vData);
-          });
-        }
-        else {
-          AddHistogramValues(vImage3D, vHigherResBlockIndex, vData);
-        }
-
-        mWriter->StartWriteDataBlock(vData, vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexT, aIndexC, aIndexR, std::move(vResample));
-        mThumbnailBuilder->StartCopyDataBlock(vData, vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexT, aIndexC, aIndexR);
+      if (SubtractCopyBlocksLeft(vMemoryBlockIndex, aIndexR, 1)) {
+        ScheduleMemoryBlockFull(aIndexT, aIndexC, { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ }, aIndexR, aWaitIfBusy);
       }
     }
   }
 }
 
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::ScheduleMemoryBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpSize aIndexR, bool aWaitIfBusy)
+{
+  bpThreadPool::tFunction vFunction = [this, aIndexT, aIndexC, aMemoryBlockIndexXYZ, aIndexR] {
+    OnMemoryBlockFull(aIndexT, aIndexC, aMemoryBlockIndexXYZ, aIndexR);
+    if (aIndexR > 0) {
+      OnResampleDone();
+    }
+  };
+  if (aIndexR == 0) {
+    if (aWaitIfBusy) {
+      mComputeThreads->WaitSome(mMaxRunningJobsPerThread);
+    }
+  }
+  else {
+    // counted until done, the resample scheduling it only decrements after this
+    ++mResampleCount;
+  }
+  mComputeThreads->Run(vFunction, {}, aIndexR > 0);
+}
+
+template<typename TDataType>
+void bpMultiresolutionImsImage<TDataType>::OnMemoryBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpSize aIndexR)
+{
+  bpSize vMemoryBlockIndexX = aMemoryBlockIndexXYZ[0];
+  bpSize vMemoryBlockIndexY = aMemoryBlockIndexXYZ[1];
+  bpSize vMemoryBlockIndexZ = aMemoryBlockIndexXYZ[2];
+  auto& vImage5D = mImages[aIndexR];
+  auto& vImage3D = vImage5D.GetImage3D(aIndexT, aIndexC);
+
+  vImage5D.PadBorderBlockWithZeros(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexC, aIndexT);
+  bpConstMemoryBlock<TDataType> vData = vImage3D.ReleaseBlock(vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ);
+  bpSize vResolutionLevels = mImages.size();
+  bpVec3 vHigherResBlockIndex = { vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ };
+
+  bool vHasLowerResolution = aIndexR + 1 < vResolutionLevels;
+  if (vHasLowerResolution) {
+    InitLowResBlock(vHigherResBlockIndex, aIndexR, aIndexT, aIndexC);
+  }
+
+  // the writer thread compressing the block runs this right before, while the data is in its cache
+  ++mResampleCount;
+  bpWriter::tPreFunction vProcess = [this, vHigherResBlockIndex, aIndexR, aIndexT, aIndexC, vData, vHasLowerResolution] {
+    ProcessBlock(vHigherResBlockIndex, aIndexR, aIndexT, aIndexC, vData);
+    if (vHasLowerResolution) {
+      OnTimePointJobDone(aIndexT);
+    }
+    OnHistogramJobDone(aIndexR, aIndexT, aIndexC);
+    OnResampleDone();
+  };
+
+  mWriter->StartWriteDataBlock(vData, vMemoryBlockIndexX, vMemoryBlockIndexY, vMemoryBlockIndexZ, aIndexT, aIndexC, aIndexR, std::move(vProcess));
+}
+
 template<typename TDataType>
 bpVec3 bpMultiresolutionImsImage<TDataType>::GetStrideToNextResolution(bpSize aIndexR) const
 {
-  const bpImsImage3D<TDataType>& vHigherResImage = mImages[aIndexR].GetImage3D(0, 0);
-  const bpImsImage3D<TDataType>& vLowerResImage = mImages[aIndexR + 1].GetImage3D(0, 0);
+  const bpImsImage5D<TDataType>& vHigherResImage = mImages[aIndexR];
+  const bpImsImage5D<TDataType>& vLowerResImage = mImages[aIndexR + 1];
   bpVec3 vStride{ 1, 1, 1 };
   for (bpSize vDim = 0; vDim < 3; vDim++) {
     if (vLowerResImage.GetImageSize()[vDim] < vHigherResImage.GetImageSize()[vDim]) {
@@ -451,263 +984,221 @@ void bpMultiresolutionImsImage<TDataType>::InitLowResBlock(const bpVec3& aHigher
     throw "image layout";
   }
 
-  bpImsImageBlock<TDataType>& vSmallMemoryBlock = vLowerResImage.GetBlock(vBlockIndexSmallMinX, vBlockIndexSmallMinY, vBlockIndexSmallMinZ);
-
-  //tLock vLock(mMutexInitBlocks);
-  vSmallMemoryBlock.GetData();
+  vLowerResImage.GetBlockData(vBlockIndexSmallMinX, vBlockIndexSmallMinY, vBlockIndexSmallMinZ);
 }
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::ResampleBlock(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData)
+void bpMultiresolutionImsImage<TDataType>::ProcessBlock(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData)
 {
-  bpVec3 vStride = GetStrideToNextResolution(aIndexR);
-  ResampleBlockD(aHigherResBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, vStride);
+  if (aIndexR + 1 < mImages.size()) {
+    ProcessBlockD(aBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, GetStrideToNextResolution(aIndexR));
+  }
+  else {
+    ProcessBlockT<1, 1, 1, false>(aBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData);
+  }
 }
 
 
 template<typename TDataType>
 template<bpSize Dim, bpSize... Stride>
-std::enable_if_t<(Dim < 3)> bpMultiresolutionImsImage<TDataType>::ResampleBlockD(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride)
+std::enable_if_t<(Dim < 3)> bpMultiresolutionImsImage<TDataType>::ProcessBlockD(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride)
 {
   if (aStride[Dim] == 2) {
-    ResampleBlockD<Dim + 1, Stride..., 2>(aHigherResBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, aStride);
+    ProcessBlockD<Dim + 1, Stride..., 2>(aBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, aStride);
   }
   else {
-    ResampleBlockD<Dim + 1, Stride..., 1>(aHigherResBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, aStride);
+    ProcessBlockD<Dim + 1, Stride..., 1>(aBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData, aStride);
   }
 }
 
 
 template<typename TDataType>
 template<bpSize Dim, bpSize... Stride>
-std::enable_if_t<(Dim == 3)> bpMultiresolutionImsImage<TDataType>::ResampleBlockD(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride)
+std::enable_if_t<(Dim == 3)> bpMultiresolutionImsImage<TDataType>::ProcessBlockD(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride)
 {
-  bool vAddHistogramValues = false;
-  if (vAddHistogramValues) {
-    ResampleBlockT<Stride..., true>(aHigherResBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData);
-  }
-  else {
-    ResampleBlockT<Stride..., false>(aHigherResBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData);
-  }
+  ProcessBlockT<Stride..., true>(aBlockIndex, aIndexR, aIndexT, aIndexC, aBlockData);
 }
 
 
 template<typename TDataType>
-template<bpSize StrideX, bpSize StrideY, bpSize StrideZ, bool ShouldAddHistogramValues>
-void bpMultiresolutionImsImage<TDataType>::ResampleBlockT(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData)
+template<bpSize StrideX, bpSize StrideY, bpSize StrideZ, bool ShouldResample>
+void bpMultiresolutionImsImage<TDataType>::ProcessBlockT(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData)
 {
-  bpSize vSmallIndexR = aIndexR + 1;
-  bpImsImage3D<TDataType>& vHigherResImage = mImages[aIndexR].GetImage3D(aIndexT, aIndexC);
-  bpImsImage3D<TDataType>& vLowerResImage = mImages[vSmallIndexR].GetImage3D(aIndexT, aIndexC);
-  bpVec3 vMemoryBlockSize = vHigherResImage.GetMemoryBlockSize();
-  bpVec3 vLowerResBlockSize = vLowerResImage.GetMemoryBlockSize();
+  bpImsImage3D<TDataType>& vImage = mImages[aIndexR].GetImage3D(aIndexT, aIndexC);
+  bpVec3 vMemoryBlockSize = vImage.GetMemoryBlockSize();
+  bpVec3 vImageSize = vImage.GetImageSize();
   const TDataType* vData = aBlockData.GetData();
 
-  //minIndex is first voxel in block, maxIndex is last (+1) in block or last voxel (+1) of image
-  bpVec3 aLargeIndexMin;
-  bpVec3 aLargeIndexMax;
-  bpVec3 vStride{ StrideX, StrideY, StrideZ };
+  // the voxels of the block inside the image, the histogram gets these
+  bpVec3 vRegion;
   for (bpSize vDim = 0; vDim < 3; vDim++) {
-    aLargeIndexMin[vDim] = aHigherResBlockIndex[vDim] * vMemoryBlockSize[vDim];
-    aLargeIndexMax[vDim] = std::min((aHigherResBlockIndex[vDim] + 1) * vMemoryBlockSize[vDim], vLowerResImage.GetImageSize()[vDim] * vStride[vDim]);
+    vRegion[vDim] = std::min((aBlockIndex[vDim] + 1) * vMemoryBlockSize[vDim], vImageSize[vDim]) - aBlockIndex[vDim] * vMemoryBlockSize[vDim];
   }
-
-  if (aLargeIndexMin[0] >= aLargeIndexMax[0] || aLargeIndexMin[1] >= aLargeIndexMax[1] || aLargeIndexMin[2] >= aLargeIndexMax[2]) {
-    return;
+  bool vHasHistogramValues = vRegion[0] > 0 && vRegion[1] > 0 && vRegion[2] > 0;
+  // with a sample rate N the full resolution counts the rows whose y + z in the image is a multiple of N
+  bpSize vSampleRate = aIndexR == 0 ? mHistogramSampleRate : 1;
+  bpSize vSampleOffset = aBlockIndex[1] * vMemoryBlockSize[1] + aBlockIndex[2] * vMemoryBlockSize[2];
+  // the adaptive histograms (float, uint32) move their bins as the range grows, the block gets its own and merges it once
+  bpUniquePtr<bpHistogramBuilder<TDataType>> vBlockHistogram;
+  if (vHasHistogramValues && std::is_base_of<bpHistogramBuilderAdaptive, bpHistogramBuilder<TDataType>>::value) {
+    vBlockHistogram = std::make_unique<bpHistogramBuilder<TDataType>>();
   }
 
-  // special case: if higher resolution block only has one row and there is no corresponding lower resolution block anymore
-  bpVec3 vLowerResNBlocks = vLowerResImage.GetNBlocks();
-
-  bpSize vBlockIndexSmallMinX = (aLargeIndexMin[0] / StrideX) / vLowerResBlockSize[0];
-  bpSize vBlockIndexSmallMaxX = std::min(((aLargeIndexMax[0] - 1) / StrideX) / vLowerResBlockSize[0] + 1, vLowerResNBlocks[0]);
-  bpSize vBlockIndexSmallMinY = (aLargeIndexMin[1] / StrideY) / vLowerResBlockSize[1];
-  bpSize vBlockIndexSmallMaxY = std::min(((aLargeIndexMax[1] - 1) / StrideY) / vLowerResBlockSize[1] + 1, vLowerResNBlocks[1]);
-  bpSize vBlockIndexSmallMinZ = (aLargeIndexMin[2] / StrideZ) / vLowerResBlockSize[2];
-  bpSize vBlockIndexSmallMaxZ = std::min(((aLargeIndexMax[2] - 1) / StrideZ) / vLowerResBlockSize[2] + 1, vLowerResNBlocks[2]);
-
-  bpSize vNBlocksX = vBlockIndexSmallMaxX - vBlockIndexSmallMinX;
-  bpSize vNBlocksY = vBlockIndexSmallMaxY - vBlockIndexSmallMinY;
-  bpSize vNBlocksZ = vBlockIndexSmallMaxZ - vBlockIndexSmallMinZ;
-
-  if (vNBlocksX == 0 || vNBlocksY == 0 || vNBlocksZ == 0) {
-    if (ShouldAddHistogramValues) {
-      AddHistogramValues(vHigherResImage, aHigherResBlockIndex, aBlockData);
-    }
-    return;
-  }
-  if (vNBlocksX > 1 || vNBlocksY > 1 || vNBlocksZ > 1) {
-    throw "image layout";
+  cResampleRegion vResample;
+  if (ShouldResample) {
+    vResample = GetResampleRegion(aBlockIndex, aIndexR, aIndexT, aIndexC, { StrideX, StrideY, StrideZ });
   }
+  bool vIsResampled = vResample.mResult != nullptr;
 
-  // get memoryBlockSize of lowerResBlock
-  bpSize vSmallBlockSizeX = vLowerResBlockSize[0];
-  bpSize vSmallBlockSizeY = vLowerResBlockSize[1];
-  bpSize vSmallBlockSizeZ = vLowerResBlockSize[2];
-
-  // get memoryBlockSize of higherResBlock
   bpSize vLargeBlockSizeX = vMemoryBlockSize[0];
   bpSize vLargeBlockSizeXY = vLargeBlockSizeX * vMemoryBlockSize[1];
+  bpSize vSmallRegionX = (vResample.mSize[0] + StrideX - 1) / StrideX;
+
+  // one band of rows after the other, each is read from memory once and then used from the cache. the histogram
+  // must see the values in the order of the block (the adaptive ones depend on it), with StrideZ 2 a band is two planes
+  bpSize vSizeY = std::max(vRegion[1], vResample.mSize[1]);
+  bpSize vSizeZ = std::max(vRegion[2], vResample.mSize[2]);
+  bpSize vBandSizeY = StrideZ == 1 ? StrideY : vSizeY;
+  for (bpSize vBeginZ = 0; vBeginZ < vSizeZ; vBeginZ += StrideZ) {
+    bpSize vEndZ = vBeginZ + StrideZ;
+    for (bpSize vBeginY = 0; vBeginY < vSizeY; vBeginY += vBandSizeY) {
+      bpSize vEndY = vBeginY + vBandSizeY;
+
+      bpSize vHistogramEndY = std::min(vEndY, vRegion[1]);
+      bpSize vHistogramEndZ = std::min(vEndZ, vRegion[2]);
+      if (vHasHistogramValues && vBeginY < vHistogramEndY && vBeginZ < vHistogramEndZ) {
+        std::unique_lock<std::mutex> vLock;
+        if (!vBlockHistogram) {
+          vLock = vImage.LockHistogramBuilderForBlock(aBlockIndex[0], aBlockIndex[1], aBlockIndex[2]);
+        }
+        bpHistogramBuilder<TDataType>& vHistogram = vBlockHistogram ? *vBlockHistogram : vImage.GetHistogramBuilderForBlock(aBlockIndex[0], aBlockIndex[1], aBlockIndex[2]);
+        for (bpSize vIndexZ = vBeginZ; vIndexZ < vHistogramEndZ; ++vIndexZ) {
+          bpSize vFirstY = vBeginY + (vSampleRate - (vSampleOffset + vBeginY + vIndexZ) % vSampleRate) % vSampleRate;
+          for (bpSize vIndexY = vFirstY; vIndexY < vHistogramEndY; vIndexY += vSampleRate) {
+            vHistogram.AddValues(vData + vIndexZ * vLargeBlockSizeXY + vIndexY * vLargeBlockSizeX, vRegion[0]);
+          }
+        }
+      }
 
-  // vNBlocks is 1 for our case, what is the middle case here?
-  bpVec3 vLowerResImageSize = vLowerResImage.GetImageSize();
-  bpSize vLargeMaxX = std::min(aLargeIndexMax[0], std::min(aLargeIndexMin[0] + vNBlocksX * vSmallBlockSizeX * StrideX, vLowerResImageSize[0] * StrideX));
-  bpSize vLargeMaxY = std::min(aLargeIndexMax[1], std::min(aLargeIndexMin[1] + vNBlocksY * vSmallBlockSizeY * StrideY, vLowerResImageSize[1] * StrideY));
-  bpSize vLargeMaxZ = std::min(aLargeIndexMax[2], std::min(aLargeIndexMin[2] + vNBlocksZ * vSmallBlockSizeZ * StrideZ, vLowerResImageSize[2] * StrideZ));
-
-  // as we don't need absolute index, we can compute HigherResRegionSizes
-  bpSize vLargeRegionX = vLargeMaxX - aLargeIndexMin[0];
-  bpSize vLargeRegionY = vLargeMaxY - aLargeIndexMin[1];
-  bpSize vLargeRegionZ = vLargeMaxZ - aLargeIndexMin[2];
-
-  // special case: if higher resolution block has only one row, but there is a corresponding lower resolution block
-  if (vLargeRegionX == 0 || vLargeRegionY == 0 || vLargeRegionZ == 0) {
-    if (ShouldAddHistogramValues) {
-      AddHistogramValues(vHigherResImage, aHigherResBlockIndex, aBlockData);
-    }
-    return;
-  }
-
-  bpSize vSmallBeginX = aLargeIndexMin[0] / StrideX;
-  bpSize vSmallBeginY = aLargeIndexMin[1] / StrideY;
-  bpSize vSmallBeginZ = aLargeIndexMin[2] / StrideZ;
-
-  bpSize vSmallOffsetX = vSmallBeginX - vBlockIndexSmallMinX * vLowerResBlockSize[0];
-  bpSize vSmallOffsetY = vSmallBeginY - vBlockIndexSmallMinY * vLowerResBlockSize[1];
-  bpSize vSmallOffsetZ = vSmallBeginZ - vBlockIndexSmallMinZ * vLowerResBlockSize[2];
-
-  bpImsImageBlock<TDataType>& vSmallMemoryBlock = vLowerResImage.GetBlock(vBlockIndexSmallMinX, vBlockIndexSmallMinY, vBlockIndexSmallMinZ);
-  TDataType* vResult = vSmallMemoryBlock.GetData() + vSmallOffsetX + vSmallBlockSizeX * (vSmallOffsetY + vSmallBlockSizeY * vSmallOffsetZ);
-
-  bpHistogramBuilder<TDataType>* vHighResHistogram = nullptr;
-  if (ShouldAddHistogramValues) {
-    vHighResHistogram = &vHigherResImage.GetHistogramBuilderForBlock(aHigherResBlockIndex[0], aHigherResBlockIndex[1], aHigherResBlockIndex[2]);
-  }
-
-  bpSize vSmallIndexZ = 0;
-  for (bpSize vLargeIndexZ = 0; vLargeIndexZ < vLargeRegionZ; vLargeIndexZ += StrideZ, ++vSmallIndexZ) {
-    bpSize vLargeOffsetZ = vLargeIndexZ * vLargeBlockSizeXY;
-    bpSize vSmallOffsetZT = vSmallIndexZ * vSmallBlockSizeX * vSmallBlockSizeY;
-
-    bpSize vSmallIndexY = 0;
-    for (bpSize vLargeIndexY = 0; vLargeIndexY < vLargeRegionY; vLargeIndexY += StrideY, ++vSmallIndexY) {
-      bpSize vLargeOffsetYZT = vLargeIndexY * vLargeBlockSizeX + vLargeOffsetZ;
-      bpSize vSmallOffsetYZT = vSmallIndexY * vSmallBlockSizeX + vSmallOffsetZT;
-      bpSize vSmallIndexX = 0;
-      for (bpSize vLargeIndexX = 0; vLargeIndexX < vLargeRegionX; vLargeIndexX += StrideX, ++vSmallIndexX) {
-        bpSize vLargeOffset = vLargeIndexX + vLargeOffsetYZT;
-        bpSize vSmallOffset = vSmallIndexX + vSmallOffsetYZT;
+      mThumbnailBuilder->AddDataRows(aBlockData, aBlockIndex[0], aBlockIndex[1], aBlockIndex[2], aIndexT, aIndexC, aIndexR, { vBeginY, vBeginZ }, { vEndY, vEndZ });
 
-        bpFloat vSumOfLarge = 0;  // or TDataType?
+      if (!vIsResampled || vBeginZ >= vResample.mSize[2]) {
+        continue;
+      }
+      bpSize vResampleEndY = std::min(vEndY, vResample.mSize[1]);
+      for (bpSize vIndexY = vBeginY; vIndexY < vResampleEndY; vIndexY += StrideY) {
+        // the rows averaged into one row of the lower resolution, z before y
+        const TDataType* vRows[StrideZ * StrideY];
         for (bpSize vOffsetZ = 0; vOffsetZ < StrideZ; ++vOffsetZ) {
-          bpSize vLargeOffsetStrideZ = vLargeOffset + vOffsetZ * vLargeBlockSizeXY;
           for (bpSize vOffsetY = 0; vOffsetY < StrideY; ++vOffsetY) {
-            bpSize vLargeOffsetStrideYZ = vLargeOffsetStrideZ + vOffsetY * vLargeBlockSizeX;
-            for (bpSize vOffsetX = 0; vOffsetX < StrideX; ++vOffsetX) {
-              bpSize vLargeOffsetStrideXYZ = vLargeOffsetStrideYZ + vOffsetX;
-
-              TDataType vValue = vData[vLargeOffsetStrideXYZ];
-              vSumOfLarge += static_cast<bpFloat>(vValue);
-              if (ShouldAddHistogramValues) {
-                vHighResHistogram->AddValue(vValue);
-              }
-            }
+            vRows[vOffsetZ * StrideY + vOffsetY] = vData + (vBeginZ + vOffsetZ) * vLargeBlockSizeXY + (vIndexY + vOffsetY) * vLargeBlockSizeX;
           }
         }
-        vSumOfLarge /= StrideZ * StrideY * StrideX;
-        vResult[vSmallOffset] = static_cast<TDataType>(vSumOfLarge);
-      }
-    }
-  }
-
-  OnCopiedData(aIndexT, aIndexC, aHigherResBlockIndex, vSmallIndexR);
-
-  if (!ShouldAddHistogramValues) {
-    return;
-  }
-
-  bool vIsLastX = vLargeMaxX < aLargeIndexMax[0];
-  bool vIsLastY = vLargeMaxY < aLargeIndexMax[1];
-  bool vIsLastZ = vLargeMaxZ < aLargeIndexMax[2];
-
-  if (vIsLastX) {
-    bpSize vLargeOffset0 = vLargeRegionX;
-    for (bpSize vLargeIndexZ = 0; vLargeIndexZ < vLargeRegionZ; ++vLargeIndexZ) {
-      bpSize vLargeOffset1 = vLargeOffset0 + vLargeIndexZ * vLargeBlockSizeXY;
-      for (bpSize vLargeIndexY = 0; vLargeIndexY < vLargeRegionY; ++vLargeIndexY) {
-        vHighResHistogram->AddValue(vData[vLargeOffset1 + vLargeIndexY * vLargeBlockSizeX]);
+        TDataType* vResult = vResample.mResult + (vBeginZ / StrideZ) * vResample.mResultSizeXY + (vIndexY / StrideY) * vResample.mResultSizeX;
+        bpDownsampleRows<TDataType, StrideX>(vRows, StrideZ * StrideY, vSmallRegionX, vResult);
       }
     }
   }
 
-  if (vIsLastY) {
-    bpSize vLargeOffset0 = vLargeRegionY * vLargeBlockSizeX;
-    bpSize vExtendedLargeRegionX = aLargeIndexMax[0] - aLargeIndexMin[0];
-    for (bpSize vLargeIndexZ = 0; vLargeIndexZ < vLargeRegionZ; ++vLargeIndexZ) {
-      bpSize vLargeOffset1 = vLargeOffset0 + vLargeIndexZ * vLargeBlockSizeXY;
-      for (bpSize vLargeIndexX = 0; vLargeIndexX < vExtendedLargeRegionX; ++vLargeIndexX) {
-        vHighResHistogram->AddValue(vData[vLargeOffset1 + vLargeIndexX]);
-      }
-    }
+  // blocks sharing a builder are merged in the order their jobs finish. The counts and the value range do not depend
+  // on it, but the bins of the adaptive builders (32 bit and float) may be laid out differently from run to run.
+  if (vBlockHistogram) {
+    std::unique_lock<std::mutex> vLock = vImage.LockHistogramBuilderForBlock(aBlockIndex[0], aBlockIndex[1], aBlockIndex[2]);
+    vImage.GetHistogramBuilderForBlock(aBlockIndex[0], aBlockIndex[1], aBlockIndex[2]).Merge(*vBlockHistogram);
   }
 
-  if (vIsLastZ) {
-    bpSize vLargeOffset0 = vLargeRegionZ * vLargeBlockSizeXY;
-    bpSize vExtendedLargeRegionX = aLargeIndexMax[0] - aLargeIndexMin[0];
-    bpSize vExtendedLargeRegionY = aLargeIndexMax[1] - aLargeIndexMin[1];
-    for (bpSize vLargeIndexY = 0; vLargeIndexY < vExtendedLargeRegionY; ++vLargeIndexY) {
-      bpSize vLargeOffset1 = vLargeOffset0 + vLargeIndexY * vLargeBlockSizeX;
-      for (bpSize vLargeIndexX = 0; vLargeIndexX < vExtendedLargeRegionX; ++vLargeIndexX) {
-        vHighResHistogram->AddValue(vData[vLargeOffset1 + vLargeIndexX]);
-      }
-    }
+  if (vIsResampled) {
+    OnCopiedData(aIndexT, aIndexC, aBlockIndex, aIndexR + 1, false);
   }
 }
 
 
 template<typename TDataType>
-void bpMultiresolutionImsImage<TDataType>::AddHistogramValues(bpImsImage3D<TDataType>& aImage, const bpVec3& aHigherResBlockIndex, const bpConstMemoryBlock<TDataType>& aBlockData)
+typename bpMultiresolutionImsImage<TDataType>::cResampleRegion bpMultiresolutionImsImage<TDataType>::GetResampleRegion(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpVec3& aStride)
 {
-  bpVec3 vMemoryBlockSize = aImage.GetMemoryBlockSize();
-  const TDataType* vData = aBlockData.GetData();
+  bpSize vSmallIndexR = aIndexR + 1;
+  bpImsImage3D<TDataType>& vHigherResImage = mImages[aIndexR].GetImage3D(aIndexT, aIndexC);
+  bpImsImage3D<TDataType>& vLowerResImage = mImages[vSmallIndexR].GetImage3D(aIndexT, aIndexC);
+  bpVec3 vMemoryBlockSize = vHigherResImage.GetMemoryBlockSize();
+  bpVec3 vLowerResBlockSize = vLowerResImage.GetMemoryBlockSize();
 
   //minIndex is first voxel in block, maxIndex is last (+1) in block or last voxel (+1) of image
   bpVec3 aLargeIndexMin;
   bpVec3 aLargeIndexMax;
   for (bpSize vDim = 0; vDim < 3; vDim++) {
     aLargeIndexMin[vDim] = aHigherResBlockIndex[vDim] * vMemoryBlockSize[vDim];
-    aLargeIndexMax[vDim] = std::min((aHigherResBlockIndex[vDim] + 1) * vMemoryBlockSize[vDim], aImage.GetImageSize()[vDim]);
+    aLargeIndexMax[vDim] = std::min((aHigherResBlockIndex[vDim] + 1) * vMemoryBlockSize[vDim], vLowerResImage.GetImageSize()[vDim] * aStride[vDim]);
   }
 
   if (aLargeIndexMin[0] >= aLargeIndexMax[0] || aLargeIndexMin[1] >= aLargeIndexMax[1] || aLargeIndexMin[2] >= aLargeIndexMax[2]) {
-    return;
+    return{};
   }
 
-  auto& vHistogram = aImage.GetHistogramBuilderForBlock(aHigherResBlockIndex[0], aHigherResBlockIndex[1], aHigherResBlockIndex[2]);
+  // special case: if higher resolution block only has one row and there is no corresponding lower resolution block anymore
+  bpVec3 vLowerResNBlocks = vLowerResImage.GetNBlocks();
 
-  bpSize vLargeBlockSizeX = vMemoryBlockSize[0];
-  bpSize vLargeBlockSizeXY = vLargeBlockSizeX * vMemoryBlockSize[1];
+  bpVec3 vBlockIndexSmallMin;
+  bpVec3 vNBlocks;
+  for (bpSize vDim = 0; vDim < 3; vDim++) {
+    vBlockIndexSmallMin[vDim] = (aLargeIndexMin[vDim] / aStride[vDim]) / vLowerResBlockSize[vDim];
+    bpSize vBlockIndexSmallMax = std::min(((aLargeIndexMax[vDim] - 1) / aStride[vDim]) / vLowerResBlockSize[vDim] + 1, vLowerResNBlocks[vDim]);
+    vNBlocks[vDim] = vBlockIndexSmallMax - vBlockIndexSmallMin[vDim];
+  }
 
-  bpSize vExtendedLargeRegionX = aLargeIndexMax[0] - aLargeIndexMin[0];
-  bpSize vExtendedLargeRegionY = aLargeIndexMax[1] - aLargeIndexMin[1];
-  bpSize vExtendedLargeRegionZ = aLargeIndexMax[2] - aLargeIndexMin[2];
-  for (bpSize vLargeIndexZ = 0; vLargeIndexZ < vExtendedLargeRegionZ; ++vLargeIndexZ) {
-    for (bpSize vLargeIndexY = 0; vLargeIndexY < vExtendedLargeRegionY; ++vLargeIndexY) {
-      bpSize vLargeOffset = vLargeIndexZ * vLargeBlockSizeXY + vLargeIndexY * vLargeBlockSizeX;
-      for (bpSize vLargeIndexX = 0; vLargeIndexX < vExtendedLargeRegionX; ++vLargeIndexX) {
-        vHistogram.AddValue(vData[vLargeOffset + vLargeIndexX]);
-      }
-    }
+  if (vNBlocks[0] == 0 || vNBlocks[1] == 0 || vNBlocks[2] == 0) {
+    return{};
+  }
+  if (vNBlocks[0] > 1 || vNBlocks[1] > 1 || vNBlocks[2] > 1) {
+    throw "image layout";
+  }
+
+  // as we don't need absolute index, we can compute HigherResRegionSizes
+  cResampleRegion vRegion;
+  bpVec3 vLowerResImageSize = vLowerResImage.GetImageSize();
+  for (bpSize vDim = 0; vDim < 3; vDim++) {
+    bpSize vLargeMax = std::min(aLargeIndexMax[vDim], std::min(aLargeIndexMin[vDim] + vNBlocks[vDim] * vLowerResBlockSize[vDim] * aStride[vDim], vLowerResImageSize[vDim] * aStride[vDim]));
+    vRegion.mSize[vDim] = vLargeMax - aLargeIndexMin[vDim];
+  }
+
+  // special case: if higher resolution block has only one row, but there is a corresponding lower resolution block
+  if (vRegion.mSize[0] == 0 || vRegion.mSize[1] == 0 || vRegion.mSize[2] == 0) {
+    return{};
+  }
+
+  bpVec3 vSmallOffset;
+  for (bpSize vDim = 0; vDim < 3; vDim++) {
+    vSmallOffset[vDim] = aLargeIndexMin[vDim] / aStride[vDim] - vBlockIndexSmallMin[vDim] * vLowerResBlockSize[vDim];
   }
+
+  bpImsImageBlock<TDataType>& vSmallMemoryBlock = vLowerResImage.GetBlock(vBlockIndexSmallMin[0], vBlockIndexSmallMin[1], vBlockIndexSmallMin[2]);
+  vRegion.mResultSizeX = vLowerResBlockSize[0];
+  vRegion.mResultSizeXY = vLowerResBlockSize[0] * vLowerResBlockSize[1];
+  vRegion.mResult = vSmallMemoryBlock.GetData() + vSmallOffset[0] + vRegion.mResultSizeX * vSmallOffset[1] + vRegion.mResultSizeXY * vSmallOffset[2];
+  return vRegion;
 }
 
 
 template<typename TDataType>
-std::vector<bpVec3> bpMultiresolutionImsImage<TDataType>::ComputeMemoryBlockSizes(const std::vector<bpVec3>& aResolutionSizes, bpSize aSizeT)
+std::vector<bpVec3> bpMultiresolutionImsImage<TDataType>::ComputeMemoryBlockSizes(const std::vector<bpVec3>& aResolutionSizes, bpSize aSizeT, bool aForceFileBlockSizeZ1)
 {
   bpSize vImageBlockSize = 1024 * 1024;
   bpSize vImageElementSize = sizeof(TDataType);
-  return GetOptimalBlockSizes(vImageBlockSize / vImageElementSize, aResolutionSizes, aSizeT);
+  std::vector<bpVec3> vBlockSizes = GetOptimalBlockSizes(vImageBlockSize / vImageElementSize, aResolutionSizes, aSizeT);
+  if (aForceFileBlockSizeZ1) {
+    for (bpVec3& vBlockSize : vBlockSizes) {
+      vBlockSize[2] = 1;
+    }
+  }
+  return vBlockSizes;
+}
+
+
+template<typename TDataType>
+bpVec3 bpMultiresolutionImsImage<TDataType>::GetFullResolutionMemoryBlockSize(const bpVec3& aImageSize, bpSize aSizeT, bool aForceFileBlockSizeZ1)
+{
+  bool vReduceZ = !aForceFileBlockSizeZ1;
+  std::vector<bpVec3> vResolutionSizes = GetOptimalImagePyramid(aImageSize, vReduceZ);
+  return ComputeMemoryBlockSizes(vResolutionSizes, aSizeT, aForceFileBlockSizeZ1)[0];
 }
 
 
@@ -21,9 +21,13 @@
 #include "../interface/bpConverterTypes.h"
 #include "bpMemoryManager.h"
 #include "bpThumbnailBuilder.h"
+#include "bpTileLayout.h"
 
 #include <functional>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
 
 
 class bpThreadPool;
@@ -40,7 +44,8 @@ public:
     const bpVec2& aCopyBlockSizeXY, const bpVec2& aSampleXY,
     const bpSharedPtr<bpWriterFactory>& aWriterFactory,
     const bpString& aOutputFile, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType,
-    bpSize aThumbnailSizeXY, bool aForceFileBlockSizeZ1, bpSize aNumberOfThreads);
+    bpSize aThumbnailSizeXY, bool aForceFileBlockSizeZ1, bpSize aNumberOfThreads,
+    bpSharedPtr<bpMemoryBudget> aBudget = nullptr, const bpString& aScratchDirectory = "", bpSize aHistogramSampleRate = 1);
 
   bpMultiresolutionImsImage(const bpMultiresolutionImsImage&) = delete;
   bpMultiresolutionImsImage& operator=(const bpMultiresolutionImsImage&) = delete;
@@ -49,7 +54,67 @@ public:
 
   ~bpMultiresolutionImsImage();
 
-  void CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBlockIndexXY, const TDataType* aDataBlockXY, bpSize aIndexR = 0);
+  /**
+  * Copies the region [aBeginXY, aEndXY) of slice aIndexZ of the full resolution image. The data is dense in the region.
+  * Only copies, call SetDataCopied once the whole copy block slice has been copied.
+  */
+  void CopyData(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY);
+
+  /**
+  * Schedules the memory blocks completed by the copy block slice. Waits for the compute thread if it is busy and aWaitIfBusy is set.
+  */
+  void SetDataCopied(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aCopyBlockIndexXY, bool aWaitIfBusy);
+
+  /**
+  * Copies the region [aBeginXY, aEndXY) of slice aIndexZ of the full resolution image and schedules the memory blocks it completes.
+  * The region does not need to be aligned to the copy blocks. Regions may overlap, voxels already copied by an earlier region are kept.
+  * Regions must not overlap copy blocks passed to SetDataCopied.
+  */
+  void CopyRegion(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataXY, bool aWaitIfBusy);
+
+  /**
+  * Places the data of CopyTile. A memory block is complete once all tiles covering it have been copied, memory blocks no tile
+  * covers are written as zeros when their time point is first copied to or finished. Call before copying any data.
+  */
+  void SetTiles(bpUniquePtr<bpTileLayout> aTiles);
+
+  /**
+  * Copies the rows [aBeginXY, aEndXY) of slice aIndexZ of tile aTileIndex, resolving overlaps with the other tiles.
+  */
+  void CopyTile(bpSize aTileIndex, bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataXY, bool aWaitIfBusy);
+
+  /**
+  * Uses aData as a full resolution memory block without copying it. Copy blocks have to be memory blocks.
+  */
+  void AdoptMemoryBlock(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpMemoryBlock<TDataType> aData);
+
+  /**
+  * Region of the full resolution image covered by a copy block. Returns false if the copy block is outside the image.
+  */
+  bool GetCopyBlockRegion(const bpVec2& aCopyBlockIndexXY, bpSize aIndexZ, bpVec2& aBeginXY, bpVec2& aEndXY) const;
+
+  bpVec3 GetMemoryBlockSize() const;
+
+  /**
+  * True if completing a memory block would wait until the compute thread catches up, or the memory budget is exceeded.
+  */
+  bool IsBusy() const;
+
+  /**
+  * Waits while the memory budget is exceeded and the queued blocks are going to return memory.
+  */
+  void WaitForMemory();
+
+  // full memory blocks waiting for the compute thread
+  bpSize GetNumberOfQueuedBlocks() const;
+
+  // bytes of memory blocks that are being compressed or written
+  bpSize GetQueuedWriteBytes() const;
+
+  // memory of the image blocks, in use and cached
+  typename bpMemoryManager<TDataType>::cStatistics GetMemoryStatistics() const;
+
+  static bpVec3 GetFullResolutionMemoryBlockSize(const bpVec3& aImageSize, bpSize aSizeT, bool aForceFileBlockSizeZ1);
 
   void FinishWriteDataBlocks();
 
@@ -61,39 +126,146 @@ public:
     const bpConverterTypes::tTimeInfoVector& aTimeInfoPerTimePoint,
     const bpConverterTypes::tColorInfoVector& aColorInfoPerChannel);
 
+  /**
+  * Merges the full resolution histograms of all time points. Call after FinishWriteDataBlocks.
+  */
   bpHistogram GetChannelHistogram(bpSize aIndexC) const;
 
+  // one more than the highest time point copied, at least the number of time points of the constructor
+  bpSize GetSizeT() const;
+
 private:
   bpSize GetMemoryBlockIndex(bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aIndexZ, bpSize aIndexC, bpSize aIndexT, bpSize aIndexR) const;
 
-  void InitCopyBlocksLeft(bpSize aIndexR);
+  // copies needed to complete each memory block of one channel
+  std::vector<bpSize> GetCopyBlocksOfChannel(bpSize aIndexR) const;
+  // counts aCount copies to a memory block, true if this completed it. aMemoryBlockIndex as returned by GetMemoryBlockIndex
+  bool SubtractCopyBlocksLeft(bpSize aMemoryBlockIndex, bpSize aIndexR, bpSize aCount);
+  // true if all voxels of a full resolution memory block have been copied
+  bool IsMemoryBlockComplete(bpSize aMemoryBlockIndex);
 
-  void OnCopiedData(bpSize aIndexT, bpSize aIndexC, const bpVec3& aBlockIndexY, bpSize aIndexR);
-  void OnCopiedDataImpl(bpSize aIndexT, bpSize aIndexC, const bpVec3& aBlockIndexXYZ, bpSize aIndexR);
+  // called by each histogram and resample job, the last job of a time point schedules FinishTimePoint
+  void OnTimePointJobDone(bpSize aIndexT);
+  // writes the histograms not written yet of a time point and frees its images
+  void FinishTimePoint(bpSize aIndexT);
+  // called by each histogram job, the last job of a resolution and channel schedules FinishHistogram
+  void OnHistogramJobDone(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC);
+  // writes the histogram of one resolution, time point and channel and frees its builders
+  void FinishHistogram(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC);
+  // decrements mResampleCount, FinishWriteDataBlocks is woken once it is zero
+  void OnResampleDone();
+
+  void OnCopiedRegion(bpSize aIndexT, bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, bool aWaitIfBusy);
+  void OnCopiedData(bpSize aIndexT, bpSize aIndexC, const bpVec3& aCopyBlockIndexXYZ, bpSize aIndexR, bool aWaitIfBusy);
+  void ScheduleMemoryBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpSize aIndexR, bool aWaitIfBusy);
+  void OnMemoryBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bpSize aIndexR);
 
   static std::vector<bpVec3> GetOptimalImagePyramid(const bpVec3& aImageSize, bool aReduceZ);
-  static std::vector<bpVec3> ComputeMemoryBlockSizes(const std::vector<bpVec3>& aResolutionSizes, bpSize aSizeT);
+  static std::vector<bpVec3> ComputeMemoryBlockSizes(const std::vector<bpVec3>& aResolutionSizes, bpSize aSizeT, bool aForceFileBlockSizeZ1);
 
   bpVec3 GetStrideToNextResolution(bpSize aIndexR) const;
   void InitLowResBlock(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC);
-  void ResampleBlock(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData);
+  // adds a full memory block to the histogram and the thumbnail and averages it into the lower resolution (if any), in one pass
+  void ProcessBlock(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData);
 
   template<bpSize Dim = 0, bpSize... Stride>
-  std::enable_if_t<(Dim < 3)> ResampleBlockD(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride);
+  std::enable_if_t<(Dim < 3)> ProcessBlockD(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride);
 
   template<bpSize Dim, bpSize... Stride>
-  std::enable_if_t<(Dim == 3)> ResampleBlockD(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride);
+  std::enable_if_t<(Dim == 3)> ProcessBlockD(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData, const bpVec3& aStride);
+
+  template<bpSize StrideX, bpSize StrideY, bpSize StrideZ, bool ShouldResample>
+  void ProcessBlockT(const bpVec3& aBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData);
 
-  template<bpSize StrideX, bpSize StrideY, bpSize StrideZ, bool ShouldAddHistogramValues>
-  void ResampleBlockT(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpConstMemoryBlock<TDataType>& aBlockData);
+  // the part of a higher resolution block averaged into a lower resolution block
+  struct cResampleRegion
+  {
+    // in higher resolution voxels
+    bpVec3 mSize{ { 0, 0, 0 } };
+    // the first lower resolution voxel, nullptr if nothing is averaged
+    TDataType* mResult = nullptr;
+    bpSize mResultSizeX = 0;
+    bpSize mResultSizeXY = 0;
+  };
+  cResampleRegion GetResampleRegion(const bpVec3& aHigherResBlockIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpVec3& aStride);
 
-  void AddHistogramValues(bpImsImage3D<TDataType>& aImage, const bpVec3& aHigherResBlockIndex, const bpConstMemoryBlock<TDataType>& aBlockData);
+  // true while blocks are computed, compressed or written, they return their memory when done
+  bool IsWorkQueued() const;
 
-  bpSharedPtr<bpThreadPool> GetHistogramThread(bpSize aIndexR, bpSize aIndexT, bpSize aIndexC, const bpVec3& aBlockIndex) const;
+  // full resolution memory block filled by CopyRegion or CopyTile
+  struct cPartialBlock
+  {
+    std::mutex mMutex;
+    std::vector<bpUInt64> mBits; // voxels copied by CopyRegion, one bit each
+    bool mIsCleared = false; // CopyTile leaves the voxels no tile covers at 0
+    std::vector<bpDouble> mBlendSums; // weighted sums and weights of the blended voxels
+    std::vector<bpFloat> mBlendWeights;
+  };
+
+  // nullptr if the memory block is already complete
+  bpSharedPtr<cPartialBlock> GetPartialBlock(bpSize aMemoryBlockIndex);
+  void OnPartialBlockFull(bpSize aIndexT, bpSize aIndexC, const bpVec3& aMemoryBlockIndexXYZ, bool aWaitIfBusy);
 
   // one image for each resolution level
   std::vector<bpImsImage5D<TDataType>> mImages;
-  std::vector<std::vector<bpSize>> mCopyBlocksLeft;
+
+  // created when a time point is first copied to, released when it is finished
+  struct cTimePoint
+  {
+    // the counters of a memory block are guarded by the shard of its index, blocks completed concurrently rarely share a lock
+    struct cShard
+    {
+      std::mutex mMutex;
+      // copies left of the memory blocks that are started but not complete, mCopyBlocksLeft[R][XYZ + blocks * C]
+      // counts voxels at full resolution, copy blocks of the higher resolution at the lower resolutions
+      std::vector<std::unordered_map<bpSize, bpSize>> mCopyBlocksLeft;
+    };
+    std::vector<cShard> mShards;
+    // full resolution memory blocks that are complete, one bit each, set under the lock of the block's shard
+    std::vector<std::atomic<bpUInt64>> mIsComplete;
+
+    cShard& GetShard(bpSize aIndex)
+    {
+      return mShards[aIndex % mShards.size()];
+    }
+
+    bool IsComplete(bpSize aIndex) const
+    {
+      return (mIsComplete[aIndex / 64] >> (aIndex % 64)) & 1;
+    }
+
+    void SetComplete(bpSize aIndex)
+    {
+      mIsComplete[aIndex / 64] |= bpUInt64(1) << (aIndex % 64);
+    }
+
+    // histogram and resample jobs of all memory blocks not done yet
+    std::atomic<bpSize> mJobsLeft;
+    // histogram jobs not done yet, mHistogramJobsLeft[R + levels * C]
+    std::vector<std::atomic<bpSize>> mHistogramJobsLeft;
+
+    // full resolution memory blocks no tile covers, XYZ + blocks * C, zero filled by the first FillGaps
+    std::vector<bpSize> mGapBlocks;
+    std::atomic<bool> mAreGapsFilled{ true };
+  };
+  bpUniquePtr<bpTimePointVector<cTimePoint>> mTimePoints;
+
+  // counts the voxels of the tiles covering each memory block of a new time point and records the gaps
+  void InitTiledTimePoint(cTimePoint& aTimePoint, bpSize aIndexT) const;
+  // writes the gap blocks of a tiled time point once
+  void FillGaps(bpSize aIndexT, bool aWaitIfBusy);
+  // GetCopyBlocksOfChannel of each resolution, the count of a memory block before its first copy
+  std::vector<std::vector<bpSize>> mCopyBlocksOfChannel;
+
+  // full resolution histograms of the finished time points merged, one for each channel
+  std::vector<bpHistogram> mChannelHistograms;
+  bpUniquePtr<std::mutex> mChannelHistogramsMutex;
+
+  // full resolution memory blocks partially copied by CopyRegion or CopyTile
+  std::unordered_map<bpSize, bpSharedPtr<cPartialBlock>> mPartialBlocks;
+  bpUniquePtr<std::mutex> mPartialBlocksMutex;
+
+  bpUniquePtr<bpTileLayout> mTiles;
 
   const bpVec2 mCopyBlockSizeXY;
   const bpVec2 mSampleXY;
@@ -101,12 +273,20 @@ private:
   bpSharedPtr<bpWriter> mWriter;
   bpSharedPtr<bpThumbnailBuilder<TDataType>> mThumbnailBuilder;
 
-  bpSharedPtr<bpThreadPool> mComputeThread;
-  std::vector<bpSharedPtr<bpThreadPool>> mHistogramThreads;
+  // pads, releases and schedules full memory blocks, finishes histograms and time points
+  bpSharedPtr<bpThreadPool> mComputeThreads;
 
+  // blocks being processed before compression, the lower resolution jobs they scheduled and time points being finished, zero once all levels are done
   std::atomic_size_t mResampleCount;
+  bpUniquePtr<std::mutex> mResampleMutex;
+  bpUniquePtr<std::condition_variable> mResampleDoneCondition;
 
   bpSize mMaxRunningJobsPerThread;
+  // full resolution histograms count every Nth row and scale the counts by N
+  const bpSize mHistogramSampleRate;
+
+  bpSharedPtr<bpMemoryBudget> mBudget;
+  bpSharedPtr<bpMemoryManager<TDataType>> mMemoryManager;
 };
 
 #endif // __BP_MULTIRESOLUTION_IMS_IMAGE__
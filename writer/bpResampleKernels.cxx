@@ -0,0 +1,387 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpResampleKernels.h"
+
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BP_RESAMPLE_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define BP_RESAMPLE_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+
+namespace
+{
+
+// holds the sum of 8 values
+template<typename TDataType>
+struct cSum;
+
+template<>
+struct cSum<bpUInt8> { using tType = bpUInt32; };
+
+template<>
+struct cSum<bpUInt16> { using tType = bpUInt32; };
+
+template<>
+struct cSum<bpUInt32> { using tType = bpUInt64; };
+
+
+int GetShift(bpSize aNumberOfValues)
+{
+  int vShift = 0;
+  while ((bpSize(1) << vShift) < aNumberOfValues) {
+    ++vShift;
+  }
+  return vShift;
+}
+
+
+template<bpSize StrideX, typename TDataType>
+void AverageScalar(const TDataType* const* aRows, bpSize aNumberOfRows, bpSize aBegin, bpSize aEnd, TDataType* aDest, std::false_type)
+{
+  int vShift = GetShift(aNumberOfRows * StrideX);
+  for (bpSize vIndex = aBegin; vIndex < aEnd; ++vIndex) {
+    typename cSum<TDataType>::tType vSum = 0;
+    for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+      for (bpSize vOffsetX = 0; vOffsetX < StrideX; ++vOffsetX) {
+        vSum += aRows[vRow][vIndex * StrideX + vOffsetX];
+      }
+    }
+    aDest[vIndex] = static_cast<TDataType>(vSum >> vShift);
+  }
+}
+
+template<bpSize StrideX, typename TDataType>
+void AverageScalar(const TDataType* const* aRows, bpSize aNumberOfRows, bpSize aBegin, bpSize aEnd, TDataType* aDest, std::true_type)
+{
+  bpFloat vNumberOfValues = static_cast<bpFloat>(aNumberOfRows * StrideX);
+  for (bpSize vIndex = aBegin; vIndex < aEnd; ++vIndex) {
+    bpFloat vSum = 0;
+    for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+      for (bpSize vOffsetX = 0; vOffsetX < StrideX; ++vOffsetX) {
+        vSum += aRows[vRow][vIndex * StrideX + vOffsetX];
+      }
+    }
+    aDest[vIndex] = vSum / vNumberOfValues;
+  }
+}
+
+
+/**
+* Averages whole vectors and returns the number of values written, the caller averages the rest.
+* Never reads beyond the last value averaged.
+*/
+template<typename TDataType, bpSize StrideX>
+struct cKernel
+{
+  static bpSize Run(const TDataType* const* /*aRows*/, bpSize /*aNumberOfRows*/, bpSize /*aCount*/, TDataType* /*aDest*/)
+  {
+    return 0;
+  }
+};
+
+
+#ifdef BP_RESAMPLE_KERNELS_SSE2
+
+struct cSse2Vector
+{
+  using tVector = __m128i;
+  static const bpSize mBytes = 16;
+
+  static tVector Zero() { return _mm_setzero_si128(); }
+  static tVector Load(const void* aSource) { return _mm_loadu_si128(static_cast<const __m128i*>(aSource)); }
+  static void Store(void* aDest, tVector aValues) { _mm_storeu_si128(static_cast<__m128i*>(aDest), aValues); }
+  static tVector Add16(tVector aA, tVector aB) { return _mm_add_epi16(aA, aB); }
+  static tVector Add32(tVector aA, tVector aB) { return _mm_add_epi32(aA, aB); }
+  static tVector Shift16(tVector aValues, __m128i aShift) { return _mm_srl_epi16(aValues, aShift); }
+  static tVector Shift32(tVector aValues, __m128i aShift) { return _mm_srl_epi32(aValues, aShift); }
+
+  // 8 bit values to 16 bit, the lower and the upper half
+  static tVector WidenLow8(tVector aValues) { return _mm_unpacklo_epi8(aValues, _mm_setzero_si128()); }
+  static tVector WidenHigh8(tVector aValues) { return _mm_unpackhi_epi8(aValues, _mm_setzero_si128()); }
+  static tVector WidenLow16(tVector aValues) { return _mm_unpacklo_epi16(aValues, _mm_setzero_si128()); }
+  static tVector WidenHigh16(tVector aValues) { return _mm_unpackhi_epi16(aValues, _mm_setzero_si128()); }
+
+  // sums of neighboring 8 bit (16 bit) values, in 16 bit (32 bit)
+  static tVector AddPairs8(tVector aValues) { return _mm_add_epi16(_mm_and_si128(aValues, _mm_set1_epi16(0x00ff)), _mm_srli_epi16(aValues, 8)); }
+  static tVector AddPairs16(tVector aValues) { return _mm_add_epi32(_mm_and_si128(aValues, _mm_set1_epi32(0xffff)), _mm_srli_epi32(aValues, 16)); }
+
+  // narrows values that fit, aLow before aHigh
+  static tVector Narrow16(tVector aLow, tVector aHigh) { return _mm_packus_epi16(aLow, aHigh); }
+  static tVector Narrow32(tVector aLow, tVector aHigh)
+  {
+    // there is no unsigned saturation in SSE2, the values are moved into the signed range and back
+    const __m128i vBias = _mm_set1_epi32(0x8000);
+    __m128i vPacked = _mm_packs_epi32(_mm_sub_epi32(aLow, vBias), _mm_sub_epi32(aHigh, vBias));
+    return _mm_xor_si128(vPacked, _mm_set1_epi16(static_cast<short>(0x8000)));
+  }
+
+  // Narrow of the pair sums of consecutive vectors keeps their order
+  static tVector OrderPairs(tVector aValues) { return aValues; }
+};
+
+#endif
+
+
+#ifdef BP_RESAMPLE_KERNELS_AVX2
+
+struct cAvx2Vector
+{
+  using tVector = __m256i;
+  static const bpSize mBytes = 32;
+
+  static tVector Zero() { return _mm256_setzero_si256(); }
+  static tVector Load(const void* aSource) { return _mm256_loadu_si256(static_cast<const __m256i*>(aSource)); }
+  static void Store(void* aDest, tVector aValues) { _mm256_storeu_si256(static_cast<__m256i*>(aDest), aValues); }
+  static tVector Add16(tVector aA, tVector aB) { return _mm256_add_epi16(aA, aB); }
+  static tVector Add32(tVector aA, tVector aB) { return _mm256_add_epi32(aA, aB); }
+  static tVector Shift16(tVector aValues, __m128i aShift) { return _mm256_srl_epi16(aValues, aShift); }
+  static tVector Shift32(tVector aValues, __m128i aShift) { return _mm256_srl_epi32(aValues, aShift); }
+
+  // within each 128 bit lane, Narrow undoes it
+  static tVector WidenLow8(tVector aValues) { return _mm256_unpacklo_epi8(aValues, _mm256_setzero_si256()); }
+  static tVector WidenHigh8(tVector aValues) { return _mm256_unpackhi_epi8(aValues, _mm256_setzero_si256()); }
+  static tVector WidenLow16(tVector aValues) { return _mm256_unpacklo_epi16(aValues, _mm256_setzero_si256()); }
+  static tVector WidenHigh16(tVector aValues) { return _mm256_unpackhi_epi16(aValues, _mm256_setzero_si256()); }
+
+  static tVector AddPairs8(tVector aValues) { return _mm256_add_epi16(_mm256_and_si256(aValues, _mm256_set1_epi16(0x00ff)), _mm256_srli_epi16(aValues, 8)); }
+  static tVector AddPairs16(tVector aValues) { return _mm256_add_epi32(_mm256_and_si256(aValues, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(aValues, 16)); }
+
+  static tVector Narrow16(tVector aLow, tVector aHigh) { return _mm256_packus_epi16(aLow, aHigh); }
+  static tVector Narrow32(tVector aLow, tVector aHigh) { return _mm256_packus_epi32(aLow, aHigh); }
+
+  // Narrow works per 128 bit lane, the quarters of the pair sums of consecutive vectors come out as 0, 2, 1, 3
+  static tVector OrderPairs(tVector aValues) { return _mm256_permute4x64_epi64(aValues, _MM_SHUFFLE(3, 1, 2, 0)); }
+};
+
+#endif
+
+
+#if defined(BP_RESAMPLE_KERNELS_AVX2)
+using cVector = cAvx2Vector;
+#elif defined(BP_RESAMPLE_KERNELS_SSE2)
+using cVector = cSse2Vector;
+#endif
+
+
+#if defined(BP_RESAMPLE_KERNELS_SSE2)
+
+template<>
+struct cKernel<bpUInt8, 1>
+{
+  static bpSize Run(const bpUInt8* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt8* aDest)
+  {
+    const bpSize vWidth = cVector::mBytes;
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows));
+    bpSize vIndex = 0;
+    for (; vIndex + vWidth <= aCount; vIndex += vWidth) {
+      cVector::tVector vSumLow = cVector::Zero();
+      cVector::tVector vSumHigh = cVector::Zero();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        cVector::tVector vValues = cVector::Load(aRows[vRow] + vIndex);
+        vSumLow = cVector::Add16(vSumLow, cVector::WidenLow8(vValues));
+        vSumHigh = cVector::Add16(vSumHigh, cVector::WidenHigh8(vValues));
+      }
+      cVector::Store(aDest + vIndex, cVector::Narrow16(cVector::Shift16(vSumLow, vShift), cVector::Shift16(vSumHigh, vShift)));
+    }
+    return vIndex;
+  }
+};
+
+template<>
+struct cKernel<bpUInt8, 2>
+{
+  static bpSize Run(const bpUInt8* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt8* aDest)
+  {
+    const bpSize vWidth = cVector::mBytes;
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows * 2));
+    bpSize vIndex = 0;
+    for (; vIndex + vWidth <= aCount; vIndex += vWidth) {
+      cVector::tVector vSumLow = cVector::Zero();
+      cVector::tVector vSumHigh = cVector::Zero();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        const bpUInt8* vSource = aRows[vRow] + 2 * vIndex;
+        vSumLow = cVector::Add16(vSumLow, cVector::AddPairs8(cVector::Load(vSource)));
+        vSumHigh = cVector::Add16(vSumHigh, cVector::AddPairs8(cVector::Load(vSource + vWidth)));
+      }
+      cVector::Store(aDest + vIndex, cVector::OrderPairs(cVector::Narrow16(cVector::Shift16(vSumLow, vShift), cVector::Shift16(vSumHigh, vShift))));
+    }
+    return vIndex;
+  }
+};
+
+template<>
+struct cKernel<bpUInt16, 1>
+{
+  static bpSize Run(const bpUInt16* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt16* aDest)
+  {
+    const bpSize vWidth = cVector::mBytes / 2;
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows));
+    bpSize vIndex = 0;
+    for (; vIndex + vWidth <= aCount; vIndex += vWidth) {
+      cVector::tVector vSumLow = cVector::Zero();
+      cVector::tVector vSumHigh = cVector::Zero();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        cVector::tVector vValues = cVector::Load(aRows[vRow] + vIndex);
+        vSumLow = cVector::Add32(vSumLow, cVector::WidenLow16(vValues));
+        vSumHigh = cVector::Add32(vSumHigh, cVector::WidenHigh16(vValues));
+      }
+      cVector::Store(aDest + vIndex, cVector::Narrow32(cVector::Shift32(vSumLow, vShift), cVector::Shift32(vSumHigh, vShift)));
+    }
+    return vIndex;
+  }
+};
+
+template<>
+struct cKernel<bpUInt16, 2>
+{
+  static bpSize Run(const bpUInt16* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt16* aDest)
+  {
+    const bpSize vWidth = cVector::mBytes / 2;
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows * 2));
+    bpSize vIndex = 0;
+    for (; vIndex + vWidth <= aCount; vIndex += vWidth) {
+      cVector::tVector vSumLow = cVector::Zero();
+      cVector::tVector vSumHigh = cVector::Zero();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        const bpUInt16* vSource = aRows[vRow] + 2 * vIndex;
+        vSumLow = cVector::Add32(vSumLow, cVector::AddPairs16(cVector::Load(vSource)));
+        vSumHigh = cVector::Add32(vSumHigh, cVector::AddPairs16(cVector::Load(vSource + vWidth)));
+      }
+      cVector::Store(aDest + vIndex, cVector::OrderPairs(cVector::Narrow32(cVector::Shift32(vSumLow, vShift), cVector::Shift32(vSumHigh, vShift))));
+    }
+    return vIndex;
+  }
+};
+
+// 32 bit values are summed in 64 bit lanes, SSE2 only
+inline __m128i Narrow64(__m128i aLow, __m128i aHigh)
+{
+  return _mm_unpacklo_epi64(_mm_shuffle_epi32(aLow, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_epi32(aHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+template<>
+struct cKernel<bpUInt32, 1>
+{
+  static bpSize Run(const bpUInt32* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt32* aDest)
+  {
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows));
+    bpSize vIndex = 0;
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128i vSumLow = _mm_setzero_si128();
+      __m128i vSumHigh = _mm_setzero_si128();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        __m128i vValues = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aRows[vRow] + vIndex));
+        vSumLow = _mm_add_epi64(vSumLow, _mm_unpacklo_epi32(vValues, _mm_setzero_si128()));
+        vSumHigh = _mm_add_epi64(vSumHigh, _mm_unpackhi_epi32(vValues, _mm_setzero_si128()));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest + vIndex), Narrow64(_mm_srl_epi64(vSumLow, vShift), _mm_srl_epi64(vSumHigh, vShift)));
+    }
+    return vIndex;
+  }
+};
+
+template<>
+struct cKernel<bpUInt32, 2>
+{
+  static bpSize Run(const bpUInt32* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpUInt32* aDest)
+  {
+    __m128i vShift = _mm_cvtsi32_si128(GetShift(aNumberOfRows * 2));
+    const __m128i vMask = _mm_set_epi32(0, -1, 0, -1);
+    bpSize vIndex = 0;
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128i vSumLow = _mm_setzero_si128();
+      __m128i vSumHigh = _mm_setzero_si128();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        const __m128i* vSource = reinterpret_cast<const __m128i*>(aRows[vRow] + 2 * vIndex);
+        __m128i vLow = _mm_loadu_si128(vSource);
+        __m128i vHigh = _mm_loadu_si128(vSource + 1);
+        vSumLow = _mm_add_epi64(vSumLow, _mm_add_epi64(_mm_and_si128(vLow, vMask), _mm_srli_epi64(vLow, 32)));
+        vSumHigh = _mm_add_epi64(vSumHigh, _mm_add_epi64(_mm_and_si128(vHigh, vMask), _mm_srli_epi64(vHigh, 32)));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest + vIndex), Narrow64(_mm_srl_epi64(vSumLow, vShift), _mm_srl_epi64(vSumHigh, vShift)));
+    }
+    return vIndex;
+  }
+};
+
+// adds in the same order as the scalar loop, the results are identical
+template<>
+struct cKernel<bpFloat, 1>
+{
+  static bpSize Run(const bpFloat* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpFloat* aDest)
+  {
+    __m128 vNumberOfValues = _mm_set1_ps(static_cast<bpFloat>(aNumberOfRows));
+    bpSize vIndex = 0;
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128 vSum = _mm_setzero_ps();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        vSum = _mm_add_ps(vSum, _mm_loadu_ps(aRows[vRow] + vIndex));
+      }
+      _mm_storeu_ps(aDest + vIndex, _mm_div_ps(vSum, vNumberOfValues));
+    }
+    return vIndex;
+  }
+};
+
+template<>
+struct cKernel<bpFloat, 2>
+{
+  static bpSize Run(const bpFloat* const* aRows, bpSize aNumberOfRows, bpSize aCount, bpFloat* aDest)
+  {
+    __m128 vNumberOfValues = _mm_set1_ps(static_cast<bpFloat>(aNumberOfRows * 2));
+    bpSize vIndex = 0;
+    for (; vIndex + 4 <= aCount; vIndex += 4) {
+      __m128 vSum = _mm_setzero_ps();
+      for (bpSize vRow = 0; vRow < aNumberOfRows; ++vRow) {
+        __m128 vLow = _mm_loadu_ps(aRows[vRow] + 2 * vIndex);
+        __m128 vHigh = _mm_loadu_ps(aRows[vRow] + 2 * vIndex + 4);
+        vSum = _mm_add_ps(vSum, _mm_shuffle_ps(vLow, vHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+        vSum = _mm_add_ps(vSum, _mm_shuffle_ps(vLow, vHigh, _MM_SHUFFLE(3, 1, 3, 1)));
+      }
+      _mm_storeu_ps(aDest + vIndex, _mm_div_ps(vSum, vNumberOfValues));
+    }
+    return vIndex;
+  }
+};
+
+#endif
+
+}
+
+
+template<typename TDataType, bpSize StrideX>
+void bpDownsampleRows(const TDataType* const* aRows, bpSize aNumberOfRows, bpSize aCount, TDataType* aDest)
+{
+  bpSize vIndex = cKernel<TDataType, StrideX>::Run(aRows, aNumberOfRows, aCount, aDest);
+  AverageScalar<StrideX>(aRows, aNumberOfRows, vIndex, aCount, aDest, std::is_floating_point<TDataType>());
+}
+
+
+template void bpDownsampleRows<bpUInt8, 1>(const bpUInt8* const*, bpSize, bpSize, bpUInt8*);
+template void bpDownsampleRows<bpUInt8, 2>(const bpUInt8* const*, bpSize, bpSize, bpUInt8*);
+template void bpDownsampleRows<bpUInt16, 1>(const bpUInt16* const*, bpSize, bpSize, bpUInt16*);
+template void bpDownsampleRows<bpUInt16, 2>(const bpUInt16* const*, bpSize, bpSize, bpUInt16*);
+template void bpDownsampleRows<bpUInt32, 1>(const bpUInt32* const*, bpSize, bpSize, bpUInt32*);
+template void bpDownsampleRows<bpUInt32, 2>(const bpUInt32* const*, bpSize, bpSize, bpUInt32*);
+template void bpDownsampleRows<bpFloat, 1>(const bpFloat* const*, bpSize, bpSize, bpFloat*);
+template void bpDownsampleRows<bpFloat, 2>(const bpFloat* const*, bpSize, bpSize, bpFloat*);
@@ -0,0 +1,32 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_RESAMPLE_KERNELS__
+#define __BP_RESAMPLE_KERNELS__
+
+
+#include "../interface/bpConverterTypes.h"
+
+
+/**
+* Writes aCount averages to aDest, value i is the mean of the StrideX values at i * StrideX of each of the aNumberOfRows rows.
+* aNumberOfRows * StrideX must be 1, 2, 4 or 8. Integers are summed exactly and rounded down, floats are summed in
+* the order of the rows. 8 and 16 bit values use SSE2 or AVX2 when the compiler targets them, 32 bit values and floats SSE2.
+*/
+template<typename TDataType, bpSize StrideX>
+void bpDownsampleRows(const TDataType* const* aRows, bpSize aNumberOfRows, bpSize aCount, TDataType* aDest);
+
+
+#endif
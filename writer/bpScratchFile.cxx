@@ -0,0 +1,214 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpScratchFile.h"
+
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+template<typename TDataType>
+class bpScratchFile<TDataType>::cImpl
+{
+public:
+  cImpl(const bpString& aDirectory, bpSize aBlockSize)
+    : mDirectory(aDirectory),
+      mBlockSize(aBlockSize)
+  {
+    // slots and chunks start at multiples of the mapping granularity (the page size, 64 KB on Windows)
+    const bpSize vGranularity = 64 * 1024;
+    const bpSize vChunkBytes = 64 * 1024 * 1024;
+    mSlotBytes = (aBlockSize * sizeof(TDataType) + vGranularity - 1) / vGranularity * vGranularity;
+    mSlotsPerChunk = mSlotBytes < vChunkBytes ? vChunkBytes / mSlotBytes : 1;
+  }
+
+  ~cImpl()
+  {
+    for (const cChunk& vChunk : mChunks) {
+#ifdef _WIN32
+      UnmapViewOfFile(vChunk.mData);
+      CloseHandle(vChunk.mMapping);
+#else
+      munmap(vChunk.mData, mSlotsPerChunk * mSlotBytes);
+#endif
+    }
+#ifdef _WIN32
+    if (mFile != INVALID_HANDLE_VALUE) {
+      CloseHandle(mFile);
+    }
+#else
+    if (mFile >= 0) {
+      close(mFile);
+    }
+#endif
+  }
+
+  TDataType* GetSlot(bpSize& aSlot)
+  {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    if (mFreeSlots.empty()) {
+      AddChunk();
+    }
+    aSlot = mFreeSlots.back();
+    mFreeSlots.pop_back();
+    char* vChunkData = mChunks[aSlot / mSlotsPerChunk].mData;
+    return reinterpret_cast<TDataType*>(vChunkData + (aSlot % mSlotsPerChunk) * mSlotBytes);
+  }
+
+  void ReturnSlot(bpSize aSlot)
+  {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    mFreeSlots.push_back(aSlot);
+  }
+
+  bpSize GetBlockSize() const
+  {
+    return mBlockSize;
+  }
+
+private:
+  struct cChunk
+  {
+    char* mData;
+#ifdef _WIN32
+    HANDLE mMapping;
+#endif
+  };
+
+  void Open()
+  {
+#ifdef _WIN32
+    char vName[MAX_PATH];
+    if (GetTempFileNameA(mDirectory.c_str(), "bpw", 0, vName) == 0) {
+      throw bpError("Could not create scratch file in " + mDirectory);
+    }
+    mFile = CreateFileA(vName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (mFile == INVALID_HANDLE_VALUE) {
+      throw bpError("Could not create scratch file " + bpString(vName));
+    }
+#else
+    bpString vTemplate = mDirectory + "/ImarisWriterScratchXXXXXX";
+    std::vector<char> vName(vTemplate.begin(), vTemplate.end());
+    vName.push_back('\0');
+    mFile = mkstemp(vName.data());
+    if (mFile < 0) {
+      throw bpError("Could not create scratch file in " + mDirectory);
+    }
+    // only the open descriptor keeps the file
+    unlink(vName.data());
+#endif
+  }
+
+  void AddChunk()
+  {
+    bpSize vChunkBytes = mSlotsPerChunk * mSlotBytes;
+    bpSize vOffset = mChunks.size() * vChunkBytes;
+    cChunk vChunk;
+#ifdef _WIN32
+    if (mFile == INVALID_HANDLE_VALUE) {
+      Open();
+    }
+    bpSize vFileSize = vOffset + vChunkBytes;
+    vChunk.mMapping = CreateFileMappingA(mFile, NULL, PAGE_READWRITE, static_cast<DWORD>(vFileSize >> 32), static_cast<DWORD>(vFileSize), NULL);
+    if (vChunk.mMapping == NULL) {
+      throw bpError("Could not extend scratch file");
+    }
+    vChunk.mData = static_cast<char*>(MapViewOfFile(vChunk.mMapping, FILE_MAP_ALL_ACCESS, static_cast<DWORD>(vOffset >> 32), static_cast<DWORD>(vOffset), vChunkBytes));
+    if (vChunk.mData == NULL) {
+      CloseHandle(vChunk.mMapping);
+      throw bpError("Could not map scratch file");
+    }
+#else
+    if (mFile < 0) {
+      Open();
+    }
+    // reserve the disk space, writing to a mapped page the disk has no space for would crash
+#ifdef __linux__
+    bool vIsExtended = posix_fallocate(mFile, static_cast<off_t>(vOffset), static_cast<off_t>(vChunkBytes)) == 0;
+#else
+    bpSize vFileSize = vOffset + vChunkBytes;
+    bool vIsExtended = ftruncate(mFile, static_cast<off_t>(vFileSize)) == 0;
+#endif
+    if (!vIsExtended) {
+      throw bpError("Could not extend scratch file");
+    }
+    void* vData = mmap(nullptr, vChunkBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, static_cast<off_t>(vOffset));
+    if (vData == MAP_FAILED) {
+      throw bpError("Could not map scratch file");
+    }
+    vChunk.mData = static_cast<char*>(vData);
+#endif
+    mChunks.push_back(vChunk);
+
+    // the lowest slots are used first
+    bpSize vEnd = mChunks.size() * mSlotsPerChunk;
+    for (bpSize vSlot = vEnd; vSlot > vEnd - mSlotsPerChunk; --vSlot) {
+      mFreeSlots.push_back(vSlot - 1);
+    }
+  }
+
+  const bpString mDirectory;
+  const bpSize mBlockSize;
+  bpSize mSlotBytes;
+  bpSize mSlotsPerChunk;
+
+  std::mutex mMutex;
+  std::vector<cChunk> mChunks;
+  std::vector<bpSize> mFreeSlots;
+#ifdef _WIN32
+  HANDLE mFile = INVALID_HANDLE_VALUE;
+#else
+  int mFile = -1;
+#endif
+};
+
+
+template<typename TDataType>
+bpScratchFile<TDataType>::bpScratchFile(const bpString& aDirectory, bpSize aBlockSize)
+  : mImpl(std::make_shared<cImpl>(aDirectory, aBlockSize))
+{
+}
+
+
+template<typename TDataType>
+bpMemoryBlock<TDataType> bpScratchFile<TDataType>::GetMemory()
+{
+  bpSize vSlot = 0;
+  TDataType* vData = mImpl->GetSlot(vSlot);
+  // the slot keeps the file mapped, even if the scratch file is destroyed first
+  bpSharedPtr<cImpl> vImpl = mImpl;
+  return bpMemoryBlock<TDataType>(vData, mImpl->GetBlockSize(), [vImpl, vSlot]() { vImpl->ReturnSlot(vSlot); });
+}
+
+
+template<typename TDataType>
+bpSize bpScratchFile<TDataType>::GetBlockSize() const
+{
+  return mImpl->GetBlockSize();
+}
+
+
+template class bpScratchFile<bpUInt8>;
+template class bpScratchFile<bpUInt16>;
+template class bpScratchFile<bpUInt32>;
+template class bpScratchFile<bpFloat>;
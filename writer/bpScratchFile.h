@@ -0,0 +1,45 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_SCRATCH_FILE__
+#define __BP_SCRATCH_FILE__
+
+
+#include "bpMemoryBlock.h"
+
+
+/**
+* Temporary file in aDirectory, mapped into memory, for memory blocks that have been moved out of RAM.
+* The operating system pages the blocks in and out, the file is created on first use and deleted when closed.
+*/
+template<typename TDataType>
+class bpScratchFile
+{
+public:
+  bpScratchFile(const bpString& aDirectory, bpSize aBlockSize);
+
+  /**
+  * A block of aBlockSize values in the file. Its slot is reused once the block is destroyed. Thread safe.
+  */
+  bpMemoryBlock<TDataType> GetMemory();
+
+  bpSize GetBlockSize() const;
+
+private:
+  class cImpl;
+  bpSharedPtr<cImpl> mImpl;
+};
+
+#endif // __BP_SCRATCH_FILE__
@@ -55,7 +55,7 @@ public:
       if (aCallback) {
         mFinishedCallbacks.emplace_back(std::move(aCallback), tError());
       }
-      mTaskFinishedCondition.notify_one();
+      mTaskFinishedCondition.notify_all();
       return;
     }
 
@@ -93,6 +93,12 @@ public:
     return mTasks.size();
   }
 
+  bpSize GetNumberOfWaitingFunctions()
+  {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return mTasks.size();
+  }
+
   void CallFinishedCallbacks()
   {
     std::deque<tFinishedCallback> vFinishedCallbacks;
@@ -144,7 +150,7 @@ private:
       if (vTask.second) {
         mFinishedCallbacks.emplace_back(std::move(vTask.second), std::move(vError));
       }
-      mTaskFinishedCondition.notify_one();
+      mTaskFinishedCondition.notify_all();
     }
   }
 
@@ -202,6 +208,12 @@ bpSize bpThreadPool::WaitSome(bpSize aMaxNumberOfWaitingFunctions)
 }
 
 
+bpSize bpThreadPool::GetNumberOfWaitingFunctions() const
+{
+  return mImpl->GetNumberOfWaitingFunctions();
+}
+
+
 void bpThreadPool::CallFinishedCallbacks()
 {
   mImpl->CallFinishedCallbacks();
@@ -38,6 +38,8 @@ public:
 
   bpSize WaitSome(bpSize aMaxNumberOfWaitingFunctions);
 
+  bpSize GetNumberOfWaitingFunctions() const;
+
   void CallFinishedCallbacks();
 
 private:
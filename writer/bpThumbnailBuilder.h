@@ -20,6 +20,9 @@
 #include "bpThumbnail.h"
 #include "bpMemoryBlock.h"
 
+#include <algorithm>
+#include <mutex>
+
 
 template<typename TDataType>
 class bpColorCacheWithTable
@@ -74,45 +77,78 @@ class bpThumbnailBuilder
 public:
   bpThumbnailBuilder(bpSize aThumbnailSizeXY, const std::vector<bpVec3>& aImageResolutionSizes, const std::vector<bpVec3>& aResolutionBlockSizes, bpSize aSizeC)
     : mThumbnailSizeXY(aThumbnailSizeXY),
-      mIndexR(bpComputeThumbnailIndexR(aThumbnailSizeXY, aImageResolutionSizes))
+      mIndexR(bpComputeThumbnailIndexR(aThumbnailSizeXY, aImageResolutionSizes)),
+      mChannels(aSizeC)
   {
     mImageSize = aImageResolutionSizes[mIndexR];
     mBlockSize = aResolutionBlockSizes[mIndexR];
-    mNBlocks[0] = DivEx(mImageSize[0], mBlockSize[0]);
-    mNBlocks[1] = DivEx(mImageSize[1], mBlockSize[1]);
-    mNBlocks[2] = DivEx(mImageSize[2], mBlockSize[2]);
-
-    bpSize vNumberOfBlocks = mNBlocks[0] * mNBlocks[1] * mNBlocks[2];
-    mBlocksPerChannel.resize(aSizeC, std::vector<bpConstMemoryBlock<TDataType>>(vNumberOfBlocks));
   }
 
-  void StartCopyDataBlock(const bpConstMemoryBlock<TDataType>& aData,
+  /**
+  * Adds the rows aBeginYZ to aEndYZ (relative to the block) to the planes of their channel right away, the block is not kept.
+  * Thread safe.
+  */
+  void AddDataRows(const bpConstMemoryBlock<TDataType>& aData,
     bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ,
-    bpSize aIndexT, bpSize aIndexC, bpSize aIndexR)
+    bpSize aIndexT, bpSize aIndexC, bpSize aIndexR, const bpVec2& aBeginYZ, const bpVec2& aEndYZ)
   {
-    if (aIndexT > 0 || aIndexR != mIndexR) {
+    if (aIndexT > 0 || aIndexR != mIndexR || aData.GetSize() == 0 || !aData.GetData()) {
+      return;
+    }
+
+    bpVec2 vBeginXY{ aBlockIndexX * mBlockSize[0], aBlockIndexY * mBlockSize[1] + aBeginYZ[0] };
+    bpVec2 vEndXY{ std::min((aBlockIndexX + 1) * mBlockSize[0], mImageSize[0]), std::min(aBlockIndexY * mBlockSize[1] + aEndYZ[0], mImageSize[1]) };
+    bpSize vBlockBeginY = aBlockIndexY * mBlockSize[1];
+    bpSize vBlockBeginZ = aBlockIndexZ * mBlockSize[2];
+    bpSize vBeginZ = vBlockBeginZ + aBeginYZ[1];
+    bpSize vEndZ = std::min(vBlockBeginZ + aEndYZ[1], mImageSize[2]);
+    bpSize vMiddleZ = mImageSize[2] / 2;
+    if (vBeginXY[1] >= vEndXY[1] || vBeginZ >= vEndZ) {
       return;
     }
 
-    mBlocksPerChannel[aIndexC][aBlockIndexX + mNBlocks[0] * (aBlockIndexY + mNBlocks[1] * aBlockIndexZ)] = aData;
+    cChannel& vChannel = mChannels[aIndexC];
+    std::lock_guard<std::mutex> vLock(vChannel.mMutex);
+    bpSize vPlaneSize = mImageSize[0] * mImageSize[1];
+    if (vChannel.mMiddle.empty()) {
+      vChannel.mMiddle.resize(vPlaneSize);
+      // a single slice is its own projection
+      if (mImageSize[2] > 1) {
+        vChannel.mMIP.resize(vPlaneSize);
+      }
+    }
+
+    for (bpSize vIndexZ = vBeginZ; vIndexZ < vEndZ; vIndexZ++) {
+      const TDataType* vDataXY = aData.GetData() + mBlockSize[0] * mBlockSize[1] * (vIndexZ - vBlockBeginZ);
+      for (bpSize vIndexY = vBeginXY[1]; vIndexY < vEndXY[1]; ++vIndexY) {
+        const TDataType* vSource = vDataXY + (vIndexY - vBlockBeginY) * mBlockSize[0];
+        bpSize vSizeX = vEndXY[0] - vBeginXY[0];
+        bpSize vDest = vBeginXY[0] + vIndexY * mImageSize[0];
+        if (vIndexZ == vMiddleZ) {
+          std::copy(vSource, vSource + vSizeX, vChannel.mMiddle.data() + vDest);
+        }
+        if (!vChannel.mMIP.empty()) {
+          TDataType* vMIP = vChannel.mMIP.data() + vDest;
+          for (bpSize vIndexX = 0; vIndexX < vSizeX; ++vIndexX) {
+            if (vSource[vIndexX] > vMIP[vIndexX]) {
+              vMIP[vIndexX] = vSource[vIndexX];
+            }
+          }
+        }
+      }
+    }
   }
 
   bpThumbnail CreateThumbnail(const std::vector<bpConverterTypes::cColorInfo>& aChannelColors, const bpConverterTypes::cImageExtent& aImageExtent) const
   {
-    std::vector<bpConverterTypes::cColorInfo> vChannelColors(aChannelColors);
-    if (vChannelColors.size() > mBlocksPerChannel.size()) {
-      vChannelColors.resize(mBlocksPerChannel.size());
-    }
-
     cResampler vResampler(mThumbnailSizeXY, mImageSize, aChannelColors, aImageExtent);
 
-    for (bpSize vBlockIndexZ = 0; vBlockIndexZ < mNBlocks[2]; vBlockIndexZ++) {
-      for (bpSize vBlockIndexY = 0; vBlockIndexY < mNBlocks[1]; vBlockIndexY++) {
-        for (bpSize vBlockIndexX = 0; vBlockIndexX < mNBlocks[0]; vBlockIndexX++) {
-          for (bpSize vIndexC = 0; vIndexC < vChannelColors.size(); vIndexC++) {
-            ResampleCopyDataBlock(vResampler, vIndexC, vBlockIndexX, vBlockIndexY, vBlockIndexZ);
-          }
-        }
+    bpSize vSizeC = std::min(aChannelColors.size(), mChannels.size());
+    for (bpSize vIndexC = 0; vIndexC < vSizeC; vIndexC++) {
+      const cChannel& vChannel = mChannels[vIndexC];
+      std::lock_guard<std::mutex> vLock(vChannel.mMutex);
+      if (!vChannel.mMiddle.empty()) {
+        vResampler.SamplePlanes(vIndexC, vChannel.mMIP.empty() ? nullptr : vChannel.mMIP.data(), vChannel.mMiddle.data());
       }
     }
 
@@ -124,30 +160,6 @@ public:
   }
 
 private:
-  class cResampler;
-
-  static inline bpSize DivEx(bpSize aNum, bpSize aDiv)
-  {
-    return (aNum + aDiv - 1) / aDiv;
-  }
-
-  void ResampleCopyDataBlock(cResampler& aResampler, bpSize aIndexC, bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ) const
-  {
-    const auto& vData = mBlocksPerChannel[aIndexC][aBlockIndexX + mNBlocks[0] * (aBlockIndexY + mNBlocks[1] * aBlockIndexZ)];
-    if (vData.GetSize() == 0 || !vData.GetData()) {
-      return; // or rather throw
-    }
-
-    bpVec2 vBeginXY{ aBlockIndexX * mBlockSize[0], aBlockIndexY * mBlockSize[1] };
-    bpVec2 vEndXY{ std::min((aBlockIndexX + 1) * mBlockSize[0], mImageSize[0]), std::min((aBlockIndexY + 1) * mBlockSize[1], mImageSize[1]) };
-    bpSize vBeginZ = aBlockIndexZ * mBlockSize[2];
-
-    for (bpSize vIndexZ = 0; vIndexZ < mBlockSize[2]; vIndexZ++) {
-      const TDataType* vDataBlockXY = vData.GetData() + mBlockSize[0] * mBlockSize[1] * vIndexZ;
-      aResampler.CopyData(aIndexC, vBeginZ + vIndexZ, vBeginXY, vEndXY, vDataBlockXY, mBlockSize[0]);
-    }
-  }
-
   class cResampler
   {
   public:
@@ -173,35 +185,18 @@ private:
       return bpThumbnail(mSizeX, mSizeY, Colorize(mMiddle, mChannelColors));
     }
 
-    void CopyData(bpSize aIndexC, bpSize aIndexZ, const bpVec2& aBeginXY, const bpVec2& aEndXY, const TDataType* aDataBlockXY, bpSize aBlockDataSizeX)
+    // aMIP nullptr if the image is a single slice, nearest neighbor
+    void SamplePlanes(bpSize aIndexC, const TDataType* aMIP, const TDataType* aMiddle)
     {
-      bpVec2 vBeginXY{
-        aBeginXY[0] * mSizeX / mImageSize[0],
-        aBeginXY[1] * mSizeY / mImageSize[1]
-      };
-      bpVec2 vEndXY{
-        std::min((aEndXY[0] * mSizeX + mImageSize[0] - 1) / mImageSize[0], mSizeX),
-        std::min((aEndXY[1] * mSizeY + mImageSize[1] - 1) / mImageSize[1], mSizeY)
-      };
-      for (bpSize vIndexY = vBeginXY[1]; vIndexY < vEndXY[1]; ++vIndexY) {
+      for (bpSize vIndexY = 0; vIndexY < mSizeY; ++vIndexY) {
         bpSize vY = vIndexY * mImageSize[1] / mSizeY;
-        if (vY < aBeginXY[1] || vY >= aEndXY[1]) {
-          continue;
-        }
-        for (bpSize vIndexX = vBeginXY[0]; vIndexX < vEndXY[0]; ++vIndexX) {
+        for (bpSize vIndexX = 0; vIndexX < mSizeX; ++vIndexX) {
           bpSize vX = vIndexX * mImageSize[0] / mSizeX;
-          if (vX < aBeginXY[0] || vX >= aEndXY[0]) {
-            continue;
-          }
-          bpSize vSource = (vX - aBeginXY[0]) + (vY - aBeginXY[1]) * aBlockDataSizeX;
+          bpSize vSource = vX + vY * mImageSize[0];
           bpSize vDest = vIndexX + vIndexY * mSizeX;
-          TDataType vData = aDataBlockXY[vSource];
-          if (vData > mMIP[aIndexC][vDest]) {
-            mMIP[aIndexC][vDest] = vData;
-          }
-          if (aIndexZ == mImageSize[2] / 2) {
-            mMiddle[aIndexC][vDest] = vData;
-          }
+          TDataType vMiddle = aMiddle[vSource];
+          mMIP[aIndexC][vDest] = aMIP ? aMIP[vSource] : (vMiddle > 0 ? vMiddle : TDataType(0));
+          mMiddle[aIndexC][vDest] = vMiddle;
         }
       }
     }
@@ -234,12 +229,19 @@ private:
     return vRGBA;
   }
 
-  std::vector<std::vector<bpConstMemoryBlock<TDataType>>> mBlocksPerChannel;
+  // maximum and middle slice of the thumbnail resolution at full XY size, allocated with the first block
+  struct cChannel
+  {
+    mutable std::mutex mMutex;
+    std::vector<TDataType> mMIP;
+    std::vector<TDataType> mMiddle;
+  };
+
   bpSize mThumbnailSizeXY;
   bpSize mIndexR;
   bpVec3 mImageSize;
   bpVec3 mBlockSize;
-  bpVec3 mNBlocks;
+  std::vector<cChannel> mChannels;
 };
 
 #endif
@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#include "bpTileLayout.h"
+
+#include <algorithm>
+
+
+using namespace bpConverterTypes;
+
+
+bpTileLayout::bpTileLayout(std::vector<cBox> aTiles, tOverlapPolicy aPolicy)
+  : mTiles(std::move(aTiles)),
+    mPolicy(aPolicy),
+    mOverlaps(mTiles.size())
+{
+  // tiles of a mosaic only overlap their neighbors, sorting by X keeps the search short
+  std::vector<bpSize> vOrder(mTiles.size());
+  for (bpSize vIndex = 0; vIndex < vOrder.size(); ++vIndex) {
+    vOrder[vIndex] = vIndex;
+  }
+  std::sort(vOrder.begin(), vOrder.end(), [this](bpSize aIndex1, bpSize aIndex2) {
+    return mTiles[aIndex1].mBegin[0] < mTiles[aIndex2].mBegin[0];
+  });
+
+  for (bpSize vOrderIndex1 = 0; vOrderIndex1 < vOrder.size(); ++vOrderIndex1) {
+    bpSize vIndex1 = vOrder[vOrderIndex1];
+    for (bpSize vOrderIndex2 = vOrderIndex1 + 1; vOrderIndex2 < vOrder.size(); ++vOrderIndex2) {
+      bpSize vIndex2 = vOrder[vOrderIndex2];
+      if (mTiles[vIndex2].mBegin[0] >= mTiles[vIndex1].mEnd[0]) {
+        break;
+      }
+      if (!Intersects(mTiles[vIndex1], mTiles[vIndex2])) {
+        continue;
+      }
+      bpSize vLower = std::min(vIndex1, vIndex2);
+      bpSize vHigher = std::max(vIndex1, vIndex2);
+      if (mPolicy != eOverlapFirstWins) {
+        mOverlaps[vLower].push_back(vHigher);
+      }
+      if (mPolicy != eOverlapLastWins) {
+        mOverlaps[vHigher].push_back(vLower);
+      }
+    }
+  }
+}
+
+
+bpSize bpTileLayout::GetNumberOfTiles() const
+{
+  return mTiles.size();
+}
+
+
+const bpTileLayout::cBox& bpTileLayout::GetTile(bpSize aTileIndex) const
+{
+  return mTiles[aTileIndex];
+}
+
+
+tOverlapPolicy bpTileLayout::GetPolicy() const
+{
+  return mPolicy;
+}
+
+
+bool bpTileLayout::Intersects(const cBox& aBox1, const cBox& aBox2)
+{
+  for (bpSize vDim = 0; vDim < 5; ++vDim) {
+    if (aBox1.mBegin[vDim] >= aBox2.mEnd[vDim] || aBox2.mBegin[vDim] >= aBox1.mEnd[vDim]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void bpTileLayout::SplitRow(bpSize aTileIndex, bpSize aIndexY, bpSize aIndexZ, bpSize aIndexC, bpSize aIndexT, bpSize aBeginX, bpSize aEndX,
+  std::vector<bpVec2>& aOwnRuns, std::vector<bpVec2>& aBlendRuns) const
+{
+  aOwnRuns.clear();
+  aBlendRuns.clear();
+
+  // parts of the row covered by the other tiles, merged
+  std::vector<bpVec2> vCovered;
+  bpSize vIndex[5] = { 0, aIndexY, aIndexZ, aIndexC, aIndexT };
+  for (bpSize vOther : mOverlaps[aTileIndex]) {
+    const cBox& vBox = mTiles[vOther];
+    bool vCoversRow = true;
+    for (bpSize vDim = 1; vDim < 5; ++vDim) {
+      vCoversRow = vCoversRow && vIndex[vDim] >= vBox.mBegin[vDim] && vIndex[vDim] < vBox.mEnd[vDim];
+    }
+    bpSize vBegin = std::max(vBox.mBegin[0], aBeginX);
+    bpSize vEnd = std::min(vBox.mEnd[0], aEndX);
+    if (vCoversRow && vBegin < vEnd) {
+      vCovered.push_back({ vBegin, vEnd });
+    }
+  }
+  std::sort(vCovered.begin(), vCovered.end());
+
+  std::vector<bpVec2>& vCoveredRuns = aBlendRuns;
+  for (const bpVec2& vRun : vCovered) {
+    if (!vCoveredRuns.empty() && vRun[0] <= vCoveredRuns.back()[1]) {
+      vCoveredRuns.back()[1] = std::max(vCoveredRuns.back()[1], vRun[1]);
+    }
+    else {
+      vCoveredRuns.push_back(vRun);
+    }
+  }
+
+  bpSize vBegin = aBeginX;
+  for (const bpVec2& vRun : vCoveredRuns) {
+    if (vBegin < vRun[0]) {
+      aOwnRuns.push_back({ vBegin, vRun[0] });
+    }
+    vBegin = vRun[1];
+  }
+  if (vBegin < aEndX) {
+    aOwnRuns.push_back({ vBegin, aEndX });
+  }
+
+  if (mPolicy != eOverlapLinearBlend) {
+    aBlendRuns.clear();
+  }
+}
+
+
+bpFloat bpTileLayout::GetWeight(bpSize aTileIndex, bpSize aIndexX, bpSize aIndexY) const
+{
+  const cBox& vBox = mTiles[aTileIndex];
+  bpSize vDistance = std::min(
+    std::min(aIndexX - vBox.mBegin[0], vBox.mEnd[0] - 1 - aIndexX),
+    std::min(aIndexY - vBox.mBegin[1], vBox.mEnd[1] - 1 - aIndexY));
+  return static_cast<bpFloat>(vDistance + 1);
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_TILE_LAYOUT__
+#define __BP_TILE_LAYOUT__
+
+
+#include "../interface/bpConverterTypes.h"
+
+
+/**
+* Boxes of the tiles of a mosaic in voxels of the full resolution image and which tile a voxel covered by several tiles gets its value from.
+*/
+class bpTileLayout
+{
+public:
+  struct cBox
+  {
+    bpSize mBegin[5]; // X, Y, Z, C, T
+    bpSize mEnd[5];
+  };
+
+  bpTileLayout(std::vector<cBox> aTiles, bpConverterTypes::tOverlapPolicy aPolicy);
+
+  bpSize GetNumberOfTiles() const;
+  const cBox& GetTile(bpSize aTileIndex) const;
+  bpConverterTypes::tOverlapPolicy GetPolicy() const;
+
+  /**
+  * Splits [aBeginX, aEndX) of a row of tile aTileIndex into the runs only this tile covers and the runs it blends with other tiles.
+  * Runs taken by a tile that wins the overlap are in neither.
+  */
+  void SplitRow(bpSize aTileIndex, bpSize aIndexY, bpSize aIndexZ, bpSize aIndexC, bpSize aIndexT, bpSize aBeginX, bpSize aEndX,
+    std::vector<bpVec2>& aOwnRuns, std::vector<bpVec2>& aBlendRuns) const;
+
+  // blend weight of a voxel of the tile, 1 at its border in X and Y and growing linearly towards its center
+  bpFloat GetWeight(bpSize aTileIndex, bpSize aIndexX, bpSize aIndexY) const;
+
+private:
+  static bool Intersects(const cBox& aBox1, const cBox& aBox2);
+
+  std::vector<cBox> mTiles;
+  bpConverterTypes::tOverlapPolicy mPolicy;
+
+  // for each tile the overlapping tiles that win against it, or all overlapping tiles if they are blended
+  std::vector<std::vector<bpSize>> mOverlaps;
+};
+
+
+#endif // __BP_TILE_LAYOUT__
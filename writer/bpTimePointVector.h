@@ -0,0 +1,214 @@
+/***************************************************************************
+ *   Copyright (c) 2020-present Bitplane AG Zuerich                        *
+ *                                                                         *
+ *   Licensed under the Apache License, Version 2.0 (the "License");       *
+ *   you may not use this file except in compliance with the License.      *
+ *   You may obtain a copy of the License at                               *
+ *                                                                         *
+ *       http://www.apache.org/licenses/LICENSE-2.0                        *
+ *                                                                         *
+ *   Unless required by applicable law or agreed to in writing, software   *
+ *   distributed under the License is distributed on an "AS IS" BASIS,     *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or imp   *
+ *   See the License for the specific language governing permissions and   *
+ *   limitations under the License.                                        *
+ ***************************************************************************/
+#ifndef __BP_TIME_POINT_VECTOR_H__
+#define __BP_TIME_POINT_VECTOR_H__
+
+
+#include "../interface/bpConverterTypes.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+
+/**
+* Per time point state that is created on first access, for images whose number of time points is not known in advance.
+* Storage grows in segments of doubling size, a created value never moves. Thread safe.
+*/
+template <class T>
+class bpTimePointVector
+{
+public:
+  using tCreate = std::function<bpUniquePtr<T>(bpSize aIndexT)>;
+
+  explicit bpTimePointVector(tCreate aCreate);
+  ~bpTimePointVector();
+
+  bpTimePointVector(const bpTimePointVector&) = delete;
+  bpTimePointVector& operator=(const bpTimePointVector&) = delete;
+
+  /**
+  * Creates the value of time point aIndexT on first access. Throws if it has been released.
+  */
+  T& Get(bpSize aIndexT);
+
+  /**
+  * nullptr if time point aIndexT has not been created yet or has been released.
+  */
+  T* Find(bpSize aIndexT) const;
+
+  // one more than the highest time point created
+  bpSize GetSize() const;
+
+  /**
+  * Destroys the value of time point aIndexT. Nobody may still use it, later calls to Get throw.
+  */
+  void Release(bpSize aIndexT);
+
+  // true once Release has been called for time point aIndexT
+  bool IsReleased(bpSize aIndexT) const;
+
+private:
+  struct cSlot
+  {
+    std::atomic<T*> mValue{ nullptr };
+    std::atomic<bool> mIsReleased{ false };
+  };
+
+  static const bpSize mNumberOfSegments = 64;
+
+  // segment k holds the time points [2^k - 1, 2^(k+1) - 1), aPosition is the time point index + 1
+  static bpSize GetSegmentIndex(bpSize aPosition);
+  cSlot* FindSlot(bpSize aIndexT) const;
+  cSlot& GetSlot(bpSize aIndexT);
+
+  tCreate mCreate;
+  std::atomic<cSlot*> mSegments[mNumberOfSegments];
+  std::atomic<bpSize> mSize;
+  std::mutex mMutex;
+};
+
+
+template <class T>
+bpTimePointVector<T>::bpTimePointVector(tCreate aCreate)
+  : mCreate(std::move(aCreate)),
+  mSize(0)
+{
+  for (auto& vSegment : mSegments) {
+    vSegment = nullptr;
+  }
+}
+
+
+template <class T>
+bpTimePointVector<T>::~bpTimePointVector()
+{
+  for (bpSize vSegmentIndex = 0; vSegmentIndex < mNumberOfSegments; ++vSegmentIndex) {
+    cSlot* vSegment = mSegments[vSegmentIndex];
+    if (!vSegment) {
+      continue;
+    }
+    bpSize vSegmentSize = bpSize(1) << vSegmentIndex;
+    for (bpSize vIndex = 0; vIndex < vSegmentSize; ++vIndex) {
+      delete vSegment[vIndex].mValue.load();
+    }
+    delete[] vSegment;
+  }
+}
+
+
+template <class T>
+bpSize bpTimePointVector<T>::GetSegmentIndex(bpSize aPosition)
+{
+  bpSize vSegmentIndex = 0;
+  while ((aPosition >> vSegmentIndex) > 1) {
+    ++vSegmentIndex;
+  }
+  return vSegmentIndex;
+}
+
+
+template <class T>
+typename bpTimePointVector<T>::cSlot* bpTimePointVector<T>::FindSlot(bpSize aIndexT) const
+{
+  bpSize vPosition = aIndexT + 1;
+  bpSize vSegmentIndex = GetSegmentIndex(vPosition);
+  cSlot* vSegment = mSegments[vSegmentIndex];
+  return vSegment ? vSegment + (vPosition - (bpSize(1) << vSegmentIndex)) : nullptr;
+}
+
+
+template <class T>
+typename bpTimePointVector<T>::cSlot& bpTimePointVector<T>::GetSlot(bpSize aIndexT)
+{
+  cSlot* vSlot = FindSlot(aIndexT);
+  if (vSlot) {
+    return *vSlot;
+  }
+
+  std::lock_guard<std::mutex> vLock(mMutex);
+  bpSize vPosition = aIndexT + 1;
+  bpSize vSegmentIndex = GetSegmentIndex(vPosition);
+  if (!mSegments[vSegmentIndex]) {
+    mSegments[vSegmentIndex] = new cSlot[bpSize(1) << vSegmentIndex];
+  }
+  return mSegments[vSegmentIndex][vPosition - (bpSize(1) << vSegmentIndex)];
+}
+
+
+template <class T>
+T& bpTimePointVector<T>::Get(bpSize aIndexT)
+{
+  cSlot& vSlot = GetSlot(aIndexT);
+  T* vValue = vSlot.mValue;
+  if (vValue) {
+    return *vValue;
+  }
+
+  std::lock_guard<std::mutex> vLock(mMutex);
+  if (vSlot.mIsReleased) {
+    throw bpError("Time point has already been completed");
+  }
+  vValue = vSlot.mValue;
+  if (!vValue) {
+    vValue = mCreate(aIndexT).release();
+    vSlot.mValue = vValue;
+    if (aIndexT >= mSize) {
+      mSize = aIndexT + 1;
+    }
+  }
+  return *vValue;
+}
+
+
+template <class T>
+T* bpTimePointVector<T>::Find(bpSize aIndexT) const
+{
+  cSlot* vSlot = FindSlot(aIndexT);
+  return vSlot ? vSlot->mValue.load() : nullptr;
+}
+
+
+template <class T>
+bpSize bpTimePointVector<T>::GetSize() const
+{
+  return mSize;
+}
+
+
+template <class T>
+void bpTimePointVector<T>::Release(bpSize aIndexT)
+{
+  T* vValue;
+  {
+    cSlot& vSlot = GetSlot(aIndexT);
+    std::lock_guard<std::mutex> vLock(mMutex);
+    vSlot.mIsReleased = true;
+    vValue = vSlot.mValue.exchange(nullptr);
+  }
+  delete vValue;
+}
+
+
+template <class T>
+bool bpTimePointVector<T>::IsReleased(bpSize aIndexT) const
+{
+  cSlot* vSlot = FindSlot(aIndexT);
+  return vSlot && vSlot->mIsReleased;
+}
+
+
+#endif // __BP_TIME_POINT_VECTOR_H__
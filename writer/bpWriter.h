@@ -42,6 +42,11 @@ public:
 
   virtual void WriteThumbnail(const bpThumbnail& aThumbnail) = 0;
 
+  // the number of time points of an image whose time points have been appended, call before WriteMetadata
+  virtual void SetNumberOfTimePoints(bpSize /*aSizeT*/)
+  {
+  }
+
   virtual void WriteDataBlock(
     const void* aData, bpSize aDataSize,
     bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ,
@@ -62,6 +67,12 @@ public:
   virtual void FinishWriteDataBlocks()
   {
   }
+
+  // bytes of data blocks started but not yet written
+  virtual bpSize GetQueuedBytes() const
+  {
+    return 0;
+  }
 };
 
 #endif // __BP_WRITER__
@@ -24,8 +24,9 @@ bpWriterCompressor::bpWriterCompressor(
   const bpImsLayout& aImageLayout,
   bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType,
   bpSize aNumberOfCompressionThreads,
-  bpConverterTypes::tProgressCallback aProgressCallback)
-: mThreads(std::make_unique<bpWriterThreads>(aNumberOfCompressionThreads * 3 + 32, aNumberOfCompressionThreads, std::make_shared<bpCompressionAlgorithmFactory>(), aCompressionAlgorithmType, aImageLayout.GetDataType())),
+  bpConverterTypes::tProgressCallback aProgressCallback,
+  bpSharedPtr<bpMemoryBudget> aBudget)
+: mThreads(std::make_unique<bpWriterThreads>(aNumberOfCompressionThreads * 3 + 32, aNumberOfCompressionThreads, std::make_shared<bpCompressionAlgorithmFactory>(), aCompressionAlgorithmType, aImageLayout.GetDataType(), std::move(aBudget))),
   mCallbackThread(std::make_unique<bpThreadPool>(1)),
   mProgressCallback(std::move(aProgressCallback)),
   mNumberOfBlocks(0),
@@ -69,6 +70,12 @@ void bpWriterCompressor::WriteMetadata(
 }
 
 
+void bpWriterCompressor::SetNumberOfTimePoints(bpSize aSizeT)
+{
+  mWriter->SetNumberOfTimePoints(aSizeT);
+}
+
+
 void bpWriterCompressor::WriteHistogram(const bpHistogram& aHistogram, bpSize aIndexT, bpSize aIndexC, bpSize aIndexR)
 {
   auto vWriteHistogram = [this, aHistogram, aIndexT, aIndexC, aIndexR] {
@@ -133,6 +140,12 @@ void bpWriterCompressor::FinishWriteDataBlocks()
 }
 
 
+bpSize bpWriterCompressor::GetQueuedBytes() const
+{
+  return mThreads->GetReservedMemory();
+}
+
+
 void bpWriterCompressor::IncrementProgress(bpUInt64 aAdditionalBytesWritten)
 {
   mNumberOfIncrements++;
@@ -19,6 +19,7 @@
 
 #include "bpImsLayout.h"
 #include "bpWriterFactory.h"
+#include "bpMemoryBudget.h"
 
 #include <functional>
 
@@ -36,7 +37,8 @@ public:
     const bpImsLayout& aImageLayout,
     bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType,
     bpSize aNumberOfCompressionThreads,
-    bpConverterTypes::tProgressCallback aProgressCallback);
+    bpConverterTypes::tProgressCallback aProgressCallback,
+    bpSharedPtr<bpMemoryBudget> aBudget = nullptr);
 
   virtual ~bpWriterCompressor();
 
@@ -52,6 +54,8 @@ public:
 
   virtual void WriteThumbnail(const bpThumbnail& aThumbnail);
 
+  virtual void SetNumberOfTimePoints(bpSize aSizeT);
+
   virtual void WriteDataBlock(
     const void* aData, bpSize aDataSize,
     bpSize aBlockIndexX, bpSize aBlockIndexY, bpSize aBlockIndexZ,
@@ -64,6 +68,8 @@ public:
 
   virtual void FinishWriteDataBlocks();
 
+  virtual bpSize GetQueuedBytes() const;
+
 private:
   void IncrementProgress(bpUInt64 aAdditionalBytesWritten);
 
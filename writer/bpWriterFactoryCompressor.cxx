@@ -17,14 +17,15 @@
 #include "bpWriterCompressor.h"
 
 
-bpWriterFactoryCompressor::bpWriterFactoryCompressor(bpSharedPtr<bpWriterFactory> aWriterFactory, bpSize aNumberOfCompressionThreads, bpConverterTypes::tProgressCallback aProgressCallback)
+bpWriterFactoryCompressor::bpWriterFactoryCompressor(bpSharedPtr<bpWriterFactory> aWriterFactory, bpSize aNumberOfCompressionThreads, bpConverterTypes::tProgressCallback aProgressCallback, bpSharedPtr<bpMemoryBudget> aBudget)
   : mWriterFactory(std::move(aWriterFactory)),
     mNumberOfCompressionThreads(aNumberOfCompressionThreads),
-    mProgressCallback(std::move(aProgressCallback))
+    mProgressCallback(std::move(aProgressCallback)),
+    mBudget(std::move(aBudget))
 {
 }
 
 bpSharedPtr<bpWriter> bpWriterFactoryCompressor::CreateWriter(const bpString& aFilename, const bpImsLayout& aImageLayout, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType)
 {
-  return std::make_shared<bpWriterCompressor>(mWriterFactory, aFilename, aImageLayout, aCompressionAlgorithmType, mNumberOfCompressionThreads, mProgressCallback);
+  return std::make_shared<bpWriterCompressor>(mWriterFactory, aFilename, aImageLayout, aCompressionAlgorithmType, mNumberOfCompressionThreads, mProgressCallback, mBudget);
 }
@@ -17,11 +17,12 @@
 #define __BP_WRITER_FACTORY_COMPRESSOR__
 
 #include "bpWriterFactory.h"
+#include "bpMemoryBudget.h"
 
 class bpWriterFactoryCompressor : public bpWriterFactory
 {
 public:
-  bpWriterFactoryCompressor(bpSharedPtr<bpWriterFactory> aWriterFactory, bpSize aNumberOfCompressionThreads, bpConverterTypes::tProgressCallback aProgressCallback);
+  bpWriterFactoryCompressor(bpSharedPtr<bpWriterFactory> aWriterFactory, bpSize aNumberOfCompressionThreads, bpConverterTypes::tProgressCallback aProgressCallback, bpSharedPtr<bpMemoryBudget> aBudget = nullptr);
 
   bpSharedPtr<bpWriter> CreateWriter(const bpString& aFilename, const bpImsLayout& aImageLayout, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType);
 
@@ -29,6 +30,7 @@ private:
   bpSharedPtr<bpWriterFactory> mWriterFactory;
   bpSize mNumberOfCompressionThreads;
   bpConverterTypes::tProgressCallback mProgressCallback;
+  bpSharedPtr<bpMemoryBudget> mBudget;
 };
 
 #endif // __BP_WRITER_FACTORY_HDF5__
@@ -277,6 +277,12 @@ void bpWriterHDF5::WriteHistogramImpl(const bpHistogram& aHistogram, const bpStr
 }
 
 
+void bpWriterHDF5::SetNumberOfTimePoints(bpSize aSizeT)
+{
+  mImageLayout.SetNumberOfTimePoints(aSizeT);
+}
+
+
 void bpWriterHDF5::WriteThumbnail(const bpThumbnail& aThumbnail)
 {
   if (GetFileId() == H5I_INVALID_HID) {
@@ -1003,13 +1009,13 @@ bpString bpWriterHDF5::H5GroupsManager::GetResolutionLevelFileName(bpString aMai
 }
 
 
-bpString bpWriterHDF5::H5GroupsManager::GetTimePointFileName(bpString aMainFileName, bpSize aDataSetIndex, bpSize aIndexR, bpSize aIndexT)
+bpString bpWriterHDF5::H5GroupsManager::GetTimePointFileName(bpString aMainFileName, bpSize aDataSetIndex, bpSize aIndexR, bpSize /*aIndexT*/)
 {
   return GetResolutionLevelFileName(aMainFileName, aDataSetIndex, aIndexR);
 }
 
 
-bpString bpWriterHDF5::H5GroupsManager::GetChannelFileName(bpString aMainFileName, bpSize aDataSetIndex, bpSize aIndexR, bpSize aIndexT, bpSize aIndexC)
+bpString bpWriterHDF5::H5GroupsManager::GetChannelFileName(bpString aMainFileName, bpSize aDataSetIndex, bpSize aIndexR, bpSize /*aIndexT*/, bpSize aIndexC)
 {
   return GetTimePointFileName(aMainFileName, aDataSetIndex, aIndexR, aIndexC);
 }
@@ -52,6 +52,8 @@ public:
 
   virtual void WriteThumbnail(const bpThumbnail& aThumbnail);
 
+  virtual void SetNumberOfTimePoints(bpSize aSizeT);
+
 private:
   using tColor = bpConverterTypes::cColor;
   using tColorInfo = bpConverterTypes::cColorInfo;
@@ -17,14 +17,18 @@
 #include "bpMemoryManager.h"
 #include "bpThreadPool.h"
 
+#include <atomic>
+
 
 class bpWriterThreads::cImpl
 {
 public:
-  cImpl(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithm::tPtr aCompressionAlgorithm)
+  cImpl(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithm::tPtr aCompressionAlgorithm, bpSharedPtr<bpMemoryBudget> aBudget)
     : mCompressionThreads(aNumberOfThreads),
       mWriterThread(1),
       mFreeMemory(aMaxBufferSizeMB * 1024 * 1024),
+      mQueuedMemory(0),
+      mManager(std::move(aBudget)),
       mCompressionAlgorithm(std::move(aCompressionAlgorithm))
   {
   }
@@ -33,8 +37,8 @@ public:
   {
     if (!mCompressionAlgorithm) {
       bpThreadPool::tCallback vReturnMemory = WaitReserveMemory(aData.GetSize());
-      bpThreadPool::tFunction vWrite = [aData, vOriginalWrite = std::move(aWrite)]{
-        vOriginalWrite(aData.GetData(), aData.GetSize());
+      bpThreadPool::tFunction vWrite = [this, aData, vOriginalWrite = std::move(aWrite)]{
+        CallWrite([&] { vOriginalWrite(aData.GetData(), aData.GetSize()); }, aData.GetSize());
       };
       bpThreadPool::tFunction vFunction = [this, vDoWrite = std::move(vWrite), vDoReturnMemory = std::move(vReturnMemory), vPreFunction = std::move(aPreFunction)]() mutable {
         if (vPreFunction) {
@@ -42,7 +46,7 @@ public:
         }
         mWriterThread.Run(vDoWrite, vDoReturnMemory);
       };
-      mCompressionThreads.Run(std::move(vFunction));
+      RunCompression(std::move(vFunction), aData.GetSize());
       return;
     }
 
@@ -60,8 +64,8 @@ public:
       *vCompressedDataSize = vResultSize;
     };
 
-    bpThreadPool::tFunction vWrite = [vBuffer, vOriginalWrite = std::move(aWrite), vCompressedDataSize]{
-      vOriginalWrite(vBuffer.GetData(), *vCompressedDataSize);
+    bpThreadPool::tFunction vWrite = [this, vBuffer, vOriginalWrite = std::move(aWrite), vCompressedDataSize, vAllocSize]{
+      CallWrite([&] { vOriginalWrite(vBuffer.GetData(), *vCompressedDataSize); }, vAllocSize);
     };
 
     bpThreadPool::tFunction vFunction = [this, vDoCompress = std::move(vCompress), vDoWrite = std::move(vWrite), vDoReturnMemory = std::move(vReturnMemory), vPreFunction = std::move(aPreFunction)] () mutable {
@@ -71,7 +75,7 @@ public:
       vDoCompress();
       mWriterThread.Run(vDoWrite, vDoReturnMemory);
     };
-    mCompressionThreads.Run(std::move(vFunction));
+    RunCompression(std::move(vFunction), vAllocSize);
   }
 
   void FinishWrite()
@@ -81,32 +85,71 @@ public:
     mWriterThread.CallFinishedCallbacks();
   }
 
+  bpSize GetReservedMemory() const
+  {
+    return static_cast<bpSize>(mQueuedMemory);
+  }
+
 private:
   bpThreadPool::tCallback WaitReserveMemory(bpSize aSize)
   {
     mWriterThread.CallFinishedCallbacks();
-    while (static_cast<bpInt64>(aSize) > mFreeMemory) {
-      mWriterThread.WaitOne();
-      mWriterThread.CallFinishedCallbacks();
+    // several producers reserve concurrently, the check and the subtraction must be one step
+    bpInt64 vSize = static_cast<bpInt64>(aSize);
+    bpInt64 vFreeMemory = mFreeMemory;
+    while (vSize > vFreeMemory || !mFreeMemory.compare_exchange_weak(vFreeMemory, vFreeMemory - vSize)) {
+      if (vSize > vFreeMemory) {
+        mWriterThread.WaitOne();
+        mWriterThread.CallFinishedCallbacks();
+        vFreeMemory = mFreeMemory;
+      }
     }
 
-    mFreeMemory -= aSize;
+    mQueuedMemory += aSize;
     bpThreadPool::tCallback vReturnMemory = [this, aSize] {
       mFreeMemory += aSize;
     };
     return vReturnMemory;
   }
 
+  // mFreeMemory is only given back by the finished callbacks, mQueuedMemory as soon as the block has been written
+  void RunCompression(bpThreadPool::tFunction aFunction, bpSize aSize)
+  {
+    mCompressionThreads.Run([this, vFunction = std::move(aFunction), aSize] {
+      try {
+        vFunction();
+      }
+      catch (...) {
+        mQueuedMemory -= aSize;
+        throw;
+      }
+    });
+  }
+
+  template<typename TFunction>
+  void CallWrite(const TFunction& aWrite, bpSize aSize)
+  {
+    try {
+      aWrite();
+    }
+    catch (...) {
+      mQueuedMemory -= aSize;
+      throw;
+    }
+    mQueuedMemory -= aSize;
+  }
+
   bpThreadPool mCompressionThreads;
   bpThreadPool mWriterThread;
-  bpInt64 mFreeMemory;
+  std::atomic<bpInt64> mFreeMemory;
+  std::atomic<bpInt64> mQueuedMemory;
   bpMemoryManager<bpUInt8> mManager;
   bpCompressionAlgorithm::tPtr mCompressionAlgorithm;
 };
 
 
-bpWriterThreads::bpWriterThreads(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithmFactory::tPtr aCompressionAlgorithmFactory, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType, bpConverterTypes::tDataType aDataType)
-  : mImpl(std::make_shared<cImpl>(aMaxBufferSizeMB, aNumberOfThreads, std::move(aCompressionAlgorithmFactory->Create(aCompressionAlgorithmType, aDataType))))
+bpWriterThreads::bpWriterThreads(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithmFactory::tPtr aCompressionAlgorithmFactory, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType, bpConverterTypes::tDataType aDataType, bpSharedPtr<bpMemoryBudget> aBudget)
+  : mImpl(std::make_shared<cImpl>(aMaxBufferSizeMB, aNumberOfThreads, std::move(aCompressionAlgorithmFactory->Create(aCompressionAlgorithmType, aDataType)), std::move(aBudget)))
 {
 }
 
@@ -121,3 +164,9 @@ void bpWriterThreads::FinishWrite()
 {
   mImpl->FinishWrite();
 }
+
+
+bpSize bpWriterThreads::GetReservedMemory() const
+{
+  return mImpl->GetReservedMemory();
+}
@@ -18,6 +18,7 @@
 
 
 #include "bpMemoryBlock.h"
+#include "bpMemoryBudget.h"
 #include "bpCompressionAlgorithmFactory.h"
 
 /*
@@ -31,13 +32,17 @@ public:
   // a function to run in the compression threads. in practice, this is going to be the resampling to the next level of resolution
   using tPreFunction = std::function<void()>;
 
-  bpWriterThreads(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithmFactory::tPtr aCompressionAlgorithmFactory, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType, bpConverterTypes::tDataType aDataType);
+  // compression buffers are accounted in aBudget
+  bpWriterThreads(bpSize aMaxBufferSizeMB, bpSize aNumberOfThreads, bpCompressionAlgorithmFactory::tPtr aCompressionAlgorithmFactory, bpConverterTypes::tCompressionAlgorithmType aCompressionAlgorithmType, bpConverterTypes::tDataType aDataType, bpSharedPtr<bpMemoryBudget> aBudget = nullptr);
 
   using tWrite = std::function<void(const void* aData, bpSize aDataSize)>;
 
   void StartWrite(bpMemoryHandle aData, bpSize aCompressionLevel, tWrite aWrite, tPreFunction aPreFunction);
   void FinishWrite();
 
+  // memory reserved by blocks that are being compressed or written
+  bpSize GetReservedMemory() const;
+
 private:
   class cImpl;
   bpSharedPtr<cImpl> mImpl;